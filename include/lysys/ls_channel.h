@@ -0,0 +1,129 @@
+#ifndef _LS_CHANNEL_H_
+#define _LS_CHANNEL_H_
+
+#include "ls_defs.h"
+
+#define LS_CHANNEL_SEND 0
+#define LS_CHANNEL_RECV 1
+
+//! \brief Operation to perform in ls_channel_select().
+struct ls_channel_op
+{
+	ls_handle channel;
+	int type; // LS_CHANNEL_SEND or LS_CHANNEL_RECV
+	void *data; // element to send or buffer to receive into
+
+	// set to LS_BAD_PIPE (send) or LS_END_OF_FILE (receive) if the
+	// operation completed because the channel is closed, 0 otherwise
+	int error;
+};
+
+//! \brief Create a channel.
+//!
+//! A channel is a bounded, first-in first-out queue of fixed size
+//! elements which may be used by any number of senders and receivers.
+//! Elements are copied into a buffer allocated when the channel is
+//! created, so passing elements does not allocate memory.
+//!
+//! A task which must wait to send or receive is suspended, allowing
+//! its worker to run other tasks (see ls_sched_create()). A thread
+//! which is not a task blocks instead. Waiting senders and receivers
+//! are served in the order they started waiting.
+//!
+//! \param elem_size The size of each element in bytes, must not be 0.
+//! \param capacity The number of elements the channel can buffer. If
+//! 0, a send completes only once a receiver takes the element.
+//!
+//! \return A handle to the channel, or NULL if an error occurred.
+ls_handle ls_channel_create(size_t elem_size, size_t capacity);
+
+//! \brief Send an element, waiting for room if the channel is full.
+//!
+//! \param ch The channel.
+//! \param data The element to send, elem_size bytes are copied.
+//!
+//! \return 0 on success, -1 on failure. Fails with LS_BAD_PIPE if the
+//! channel is closed.
+int ls_channel_send(ls_handle ch, const void *data);
+
+//! \brief Send an element, waiting up to a timeout.
+//!
+//! \param ch The channel.
+//! \param data The element to send.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 on success, 1 if the timeout expired, -1 on failure.
+int ls_channel_timedsend(ls_handle ch, const void *data, unsigned long ms);
+
+//! \brief Send an element if it can be done without waiting.
+//!
+//! \param ch The channel.
+//! \param data The element to send.
+//!
+//! \return 0 on success, 1 if the channel is full, -1 on failure.
+int ls_channel_trysend(ls_handle ch, const void *data);
+
+//! \brief Receive an element, waiting if the channel is empty.
+//!
+//! Elements sent before the channel was closed are still received.
+//!
+//! \param ch The channel.
+//! \param data Receives the element, must hold elem_size bytes.
+//!
+//! \return 0 on success, -1 on failure. Fails with LS_END_OF_FILE if
+//! the channel is closed and empty.
+int ls_channel_recv(ls_handle ch, void *data);
+
+//! \brief Receive an element, waiting up to a timeout.
+//!
+//! \param ch The channel.
+//! \param data Receives the element.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 on success, 1 if the timeout expired, -1 on failure.
+int ls_channel_timedrecv(ls_handle ch, void *data, unsigned long ms);
+
+//! \brief Receive an element if it can be done without waiting.
+//!
+//! \param ch The channel.
+//! \param data Receives the element.
+//!
+//! \return 0 on success, 1 if the channel is empty, -1 on failure.
+int ls_channel_tryrecv(ls_handle ch, void *data);
+
+//! \brief Close a channel.
+//!
+//! Wakes all waiting senders and receivers. Further sends fail, and
+//! receives fail once the buffered elements have been received. The
+//! handle must still be released with ls_close().
+//!
+//! \param ch The channel.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_channel_close(ls_handle ch);
+
+//! \brief Get the number of buffered elements in a channel.
+//!
+//! \param ch The channel.
+//!
+//! \return The number of elements, or -1 on failure.
+size_t ls_channel_count(ls_handle ch);
+
+//! \brief Perform one of several channel operations.
+//!
+//! Waits until at least one of the operations can complete, then
+//! completes exactly one of them. If several can complete at once,
+//! one is chosen at random. An operation on a closed channel
+//! completes immediately, setting its error member.
+//!
+//! \param ops The operations.
+//! \param nops The number of operations.
+//! \param ms Maximum time to wait in milliseconds, 0 to only check
+//! whether an operation can complete.
+//! \param index Receives the index of the completed operation.
+//!
+//! \return 0 if an operation completed, 1 if the timeout expired, -1
+//! on failure.
+int ls_channel_select(struct ls_channel_op *ops, size_t nops, unsigned long ms, size_t *index);
+
+#endif // _LS_CHANNEL_H_
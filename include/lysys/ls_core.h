@@ -34,6 +34,40 @@ int ls_wait(ls_handle h);
 //! information.
 int ls_timedwait(ls_handle h, unsigned long ms);
 
+//! \brief Wait for any of several handles to become signaled.
+//! 
+//! Completes a wait on exactly one of the handles, as if by
+//! ls_timedwait(). If several are signaled, the one earliest in the
+//! array is chosen. On Linux, handles backed by a descriptor (events,
+//! processes, watches and asynchronous I/O) are waited on together
+//! with epoll, so a single thread can wait on a large number of them.
+//! Other handles are checked periodically.
+//! 
+//! \param [in] handles The handles to wait for.
+//! \param [in] count The number of handles.
+//! \param [in] ms The timeout in milliseconds.
+//! \param [out] index Receives the index of the signaled handle, may
+//! be NULL.
+//! 
+//! \return 0 if a handle is signaled, -1 if an error occurred, or 1
+//! if the timeout expired.
+int ls_wait_any(const ls_handle *handles, size_t count, unsigned long ms, size_t *index);
+
+//! \brief Wait for all of several handles to become signaled.
+//! 
+//! The handles are waited on in order, sharing one timeout. Except on
+//! Windows, waits which completed before the timeout expired are not
+//! undone, so semaphores and auto-reset events among the handles may
+//! have been consumed even if 1 is returned.
+//! 
+//! \param [in] handles The handles to wait for.
+//! \param [in] count The number of handles.
+//! \param [in] ms The timeout in milliseconds.
+//! 
+//! \return 0 if every handle is signaled, -1 if an error occurred, or
+//! 1 if the timeout expired.
+int ls_wait_all(const ls_handle *handles, size_t count, unsigned long ms);
+
 //! \brief Close a handle.
 //! 
 //! Releases the resources associated with the handle. The handle
@@ -86,6 +86,7 @@
 #define LS_UNLIKELY(x) (x)
 #define LS_UNREACHABLE __assume(0)
 #define LS_NORETURN __declspec(noreturn)
+#define LS_NOINLINE __declspec(noinline)
 #else
 #define LS_THREADLOCAL __thread
 #define LS_RESTRICT restrict
@@ -93,6 +94,7 @@
 #define LS_UNLIKELY(x) __builtin_expect(!!(x), 0)
 #define LS_UNREACHABLE __builtin_unreachable()
 #define LS_NORETURN __attribute__((noreturn))
+#define LS_NOINLINE __attribute__((noinline))
 #endif // LS_WINDOWS
 
 typedef void *ls_handle;
@@ -0,0 +1,62 @@
+#ifndef _LS_EPOCH_H_
+#define _LS_EPOCH_H_
+
+#include "ls_defs.h"
+
+//! \brief Function which releases memory retired with ls_epoch_retire().
+typedef void(*ls_epoch_free_t)(void *ptr);
+
+//! \brief Enter an epoch critical section.
+//!
+//! Epoch based reclamation lets readers of a lock-free structure access
+//! its nodes without locks or reference counts. Readers bracket each
+//! access with ls_epoch_enter() and ls_epoch_leave(). Writers unlink a
+//! node so no new reader can reach it, then pass it to
+//! ls_epoch_retire(). The node is released once every thread which was
+//! inside a critical section at that time has left it.
+//!
+//! Entering and leaving only touch memory of the calling thread and
+//! never block. Critical sections may be nested. A critical section
+//! should be short, a thread which stays inside one delays the release
+//! of all memory retired in the meantime. It must be left on the same
+//! thread it was entered on, so it must not span a call which may
+//! suspend the current task.
+//!
+//! \return 0 on success, -1 if the first call on a thread could not
+//! allocate its state.
+int ls_epoch_enter(void);
+
+//! \brief Leave an epoch critical section.
+//!
+//! Must match a call to ls_epoch_enter() on the same thread.
+void ls_epoch_leave(void);
+
+//! \brief Release memory once no reader can still access it.
+//!
+//! Retired memory is queued on the calling thread and released by a
+//! later call to ls_epoch_retire() or ls_epoch_synchronize(), after
+//! the global epoch advanced twice. The epoch is advanced as retired
+//! memory accumulates, no call is needed to drive it. Memory of a
+//! thread which exits is released by the threads which advance the
+//! epoch later.
+//!
+//! May be called inside or outside a critical section.
+//!
+//! \param ptr The memory, must already be unreachable for new readers.
+//! \param free_fn Function which releases the memory, if NULL,
+//! ls_free() is used.
+//!
+//! \return 0 on success, -1 on failure, in which case the caller
+//! keeps ownership of ptr.
+int ls_epoch_retire(void *ptr, ls_epoch_free_t free_fn);
+
+//! \brief Wait until all memory retired by the calling thread is
+//! released.
+//!
+//! Blocks until every thread which is currently inside a critical
+//! section has left it. Must not be called inside a critical section.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_epoch_synchronize(void);
+
+#endif // _LS_EPOCH_H_
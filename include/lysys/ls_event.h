@@ -3,8 +3,41 @@
 
 #include "ls_defs.h"
 
+#define LS_EVENT_AUTO_RESET 0x1 // a completed wait resets the event
+
+//! \brief Create a manual-reset event.
+//!
+//! Equivalent to ls_event_create_ex(0).
+//!
+//! \return A handle to the event, or NULL if an error occurred.
 ls_handle ls_event_create(void);
 
+//! \brief Create an event.
+//!
+//! An event is signaled with ls_event_set() and waited on with
+//! ls_wait() or ls_timedwait(). A manual-reset event stays signaled,
+//! releasing every waiter, until ls_event_reset() is called. An
+//! auto-reset event releases a single waiter and is then reset
+//! automatically. Setting or waiting on an event which is not
+//! contended does not enter the kernel.
+//!
+//! \param flags LS_EVENT_AUTO_RESET for an auto-reset event, 0 for a
+//! manual-reset event.
+//!
+//! \return A handle to the event, or NULL if an error occurred.
+ls_handle ls_event_create_ex(int flags);
+
+//! \brief Check whether an event is signaled, without resetting it.
+//!
+//! On Windows, an auto-reset event cannot be queried without consuming
+//! its signal, so the signal is taken and set again. Between the two, a
+//! concurrent wait may time out and a concurrent ls_event_reset may be
+//! undone. Do not rely on this function for auto-reset events shared
+//! between threads on Windows.
+//!
+//! \param evt The event.
+//!
+//! \return 1 if the event is signaled, 0 if not, -1 on failure.
 int ls_event_signaled(ls_handle evt);
 
 int ls_event_set(ls_handle evt);
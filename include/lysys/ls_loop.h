@@ -0,0 +1,159 @@
+#ifndef _LS_LOOP_H_
+#define _LS_LOOP_H_
+
+#include "ls_defs.h"
+
+#define LS_LOOP_READ 0x1 // handle is readable, or its peer hung up
+#define LS_LOOP_WRITE 0x2 // handle is writable
+#define LS_LOOP_ERROR 0x4 // an error occurred on the handle
+#define LS_LOOP_SIGNALED 0x8 // a wait on the waitable handle completed
+#define LS_LOOP_TIMER 0x10 // the timer expired
+#define LS_LOOP_SIGNAL 0x20 // the signal was delivered
+
+#define LS_LOOP_ONESHOT 0x100 // remove the source after its first callback
+
+//! \brief Event loop callback.
+//!
+//! \param loop The loop running the callback.
+//! \param id The id of the source, as returned when it was added.
+//! \param events The events which occurred, a combination of the
+//! LS_LOOP_* event flags.
+//! \param up User data passed when the source was added.
+typedef void(*ls_loop_func_t)(ls_handle loop, int id, int events, void *up);
+
+//! \brief Create an event loop.
+//!
+//! An event loop lets a single thread react to many sources of events
+//! at once, calling a callback for each source which becomes ready.
+//! Sources are handles (files, pipes, sockets, servers, processes,
+//! threads, watches, asynchronous I/O and events), timers and
+//! signals.
+//!
+//! Callbacks run on the thread calling ls_loop_run() or
+//! ls_loop_run_once(), and may add, modify and remove sources,
+//! including their own. Except for ls_loop_stop(), the functions
+//! operating on a loop must not be called concurrently.
+//!
+//! If called from a task of a scheduler created with LS_SCHED_ASYNC_IO,
+//! running the loop suspends only the calling task.
+//!
+//! Event loops are currently only supported on Linux.
+//!
+//! \return A handle to the loop, or NULL if an error occurred.
+ls_handle ls_loop_create(void);
+
+//! \brief Add a handle to an event loop.
+//!
+//! For I/O handles (files, pipes, sockets and servers), events is a
+//! combination of LS_LOOP_READ and LS_LOOP_WRITE and the callback is
+//! called whenever the handle is ready for any of them. A server is
+//! readable when a connection can be accepted. Regular files are not
+//! supported.
+//!
+//! For waitable handles, events is ignored and the callback is called
+//! with LS_LOOP_SIGNALED each time a wait on the handle with a timeout
+//! of 0 completes, so any side effect of waiting applies (e.g. an
+//! auto-reset event is reset). A handle which stays signaled, such as
+//! an exited process or a manual-reset event, is reported on every
+//! iteration until it is reset or removed.
+//!
+//! The handle must not be closed while it is part of the loop, and
+//! may only be added to a loop once.
+//!
+//! \param loop The loop.
+//! \param h The handle.
+//! \param events Events to wait for, optionally combined with
+//! LS_LOOP_ONESHOT.
+//! \param func Callback to call when the handle is ready.
+//! \param up User data to pass to the callback.
+//!
+//! \return The id of the new source, or -1 on failure. Fails with
+//! LS_NOT_SUPPORTED if the handle cannot be monitored, or with
+//! LS_ALREADY_EXISTS if it is already part of the loop.
+int ls_loop_add(ls_handle loop, ls_handle h, int events, ls_loop_func_t func, void *up);
+
+//! \brief Change the events a handle source waits for.
+//!
+//! \param loop The loop.
+//! \param id The id of a source added with ls_loop_add().
+//! \param events The new events, as in ls_loop_add().
+//!
+//! \return 0 on success, -1 on failure.
+int ls_loop_modify(ls_handle loop, int id, int events);
+
+//! \brief Add a timer to an event loop.
+//!
+//! The callback is called with LS_LOOP_TIMER once ms milliseconds have
+//! passed, then every period milliseconds if period is not 0. A timer
+//! without a period is removed after its callback.
+//!
+//! \param loop The loop.
+//! \param ms Milliseconds until the first expiry.
+//! \param period Milliseconds between subsequent expiries, or 0.
+//! \param func Callback to call when the timer expires.
+//! \param up User data to pass to the callback.
+//!
+//! \return The id of the new source, or -1 on failure.
+int ls_loop_add_timer(ls_handle loop, unsigned long ms, unsigned long period, ls_loop_func_t func, void *up);
+
+//! \brief Add a signal to an event loop.
+//!
+//! The callback is called with LS_LOOP_SIGNAL when signum is
+//! delivered. The signal is blocked in the calling thread, so that it
+//! is delivered to the loop instead of a signal handler. For the loop
+//! to receive a signal sent to the process, it must be blocked in
+//! every thread, which is best done before creating any thread.
+//! Blocked signals are not unblocked when the source is removed.
+//!
+//! \param loop The loop.
+//! \param signum The signal number.
+//! \param func Callback to call when the signal is delivered.
+//! \param up User data to pass to the callback.
+//!
+//! \return The id of the new source, or -1 on failure.
+int ls_loop_add_signal(ls_handle loop, int signum, ls_loop_func_t func, void *up);
+
+//! \brief Remove a source from an event loop.
+//!
+//! Once removed, the callback of the source is not called again,
+//! even if the source was ready in the current iteration.
+//!
+//! \param loop The loop.
+//! \param id The id of the source.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_loop_remove(ls_handle loop, int id);
+
+//! \brief Run an event loop until it is stopped.
+//!
+//! \param loop The loop.
+//!
+//! \return 0 if the loop was stopped with ls_loop_stop(), -1 on
+//! failure.
+int ls_loop_run(ls_handle loop);
+
+//! \brief Run a single iteration of an event loop.
+//!
+//! Waits until at least one source is ready or the timeout expires,
+//! then calls the callbacks of all ready sources.
+//!
+//! \param loop The loop.
+//! \param ms Maximum time to wait in milliseconds, 0 to only call the
+//! callbacks of sources which are already ready.
+//!
+//! \return The number of callbacks called, or -1 on failure.
+int ls_loop_run_once(ls_handle loop, unsigned long ms);
+
+//! \brief Stop an event loop.
+//!
+//! Makes ls_loop_run() return after the current iteration. If the
+//! loop is not running, the next call to ls_loop_run() returns
+//! immediately. May be called from any thread, including from a
+//! callback.
+//!
+//! \param loop The loop.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_loop_stop(ls_handle loop);
+
+#endif // _LS_LOOP_H_
@@ -5,11 +5,14 @@
 
 #define LS_NET_STREAM 1
 #define LS_NET_DGRAM 2
+#define LS_NET_SEQPACKET 3 // reliable messages over a connection, LS_AF_UNIX only
 
+#define LS_NET_PROTO_DEFAULT 0 // the default protocol of the type, use with LS_AF_UNIX
 #define LS_NET_PROTO_TCP 1
 #define LS_NET_PROTO_UDP 2
 
 #define LS_AF_UNSPEC 0
+#define LS_AF_UNIX 1 // local sockets, the host is a path
 #define LS_AF_INET 2
 #define LS_AF_INET6 23
 
@@ -19,12 +22,197 @@
 
 #define LS_NET_MAXCONN 0x7fffffff
 
+#define LS_NET_OPT_NODELAY 1 // disable Nagle's algorithm, boolean
+#define LS_NET_OPT_QUICKACK 2 // acknowledge immediately, boolean, reset by the system
+#define LS_NET_OPT_CORK 3 // only send full segments until cleared, boolean
+#define LS_NET_OPT_SNDBUF 4 // send buffer size in bytes
+#define LS_NET_OPT_RCVBUF 5 // receive buffer size in bytes
+#define LS_NET_OPT_REUSEADDR 6 // allow binding a port in TIME_WAIT, boolean
+#define LS_NET_OPT_REUSEPORT 7 // allow several sockets to bind the same port, boolean
+#define LS_NET_OPT_KEEPALIVE 8 // send keepalive probes, boolean
+#define LS_NET_OPT_KEEPIDLE 9 // idle seconds before the first keepalive probe
+#define LS_NET_OPT_KEEPINTVL 10 // seconds between keepalive probes
+#define LS_NET_OPT_KEEPCNT 11 // unanswered probes before the connection is dropped
+#define LS_NET_OPT_FASTOPEN 12 // TCP Fast Open, queue length of a listening socket
+#define LS_NET_OPT_DEFER_ACCEPT 13 // seconds to wait for data before accepting
+#define LS_NET_OPT_BUSY_POLL 14 // microseconds to busy poll the device when receiving
+
+//! \brief A socket option, see ls_net_setopt()
+struct ls_net_option
+{
+	int opt; // one of the LS_NET_OPT_* constants
+	int value;
+};
+
+//! \brief Options for ls_net_listen_ex()
+struct ls_net_listen_options
+{
+	int backlog; // maximum pending connections, LS_NET_MAXCONN for the system maximum
+	int nonblocking; // nonzero to create a non-blocking socket, see ls_net_set_nonblocking()
+	const struct ls_net_option *opts; // options set before binding
+	size_t count; // number of entries in opts
+};
+
+//! \brief Options for ls_connpool_create()
+struct ls_connpool_options
+{
+	size_t max_idle; // idle connections kept per host and port
+	unsigned long idle_timeout; // milliseconds an idle connection is kept, LS_INFINITE to keep it
+	unsigned long connect_timeout; // milliseconds to connect, see ls_net_connect_ex()
+	int addr_family; // one of the LS_AF_* constants
+};
+
+#define LS_NET_SHARD_CPU 0x1 // steer connections to the shard of the receiving CPU
+
+#define LS_NET_MSG_TRUNC 0x1 // the datagram did not fit into the buffer
+
+#define LS_NET_ADDR_SIZE 128
+
+#define LS_NET_MAX_HANDLES 16 // handles passed with one message
+
+//! \brief Socket address, the source or destination of a datagram
+struct ls_net_addr
+{
+	uint64_t data[LS_NET_ADDR_SIZE / sizeof(uint64_t)]; // native address
+	unsigned int len; // length of the address, 0 if not set
+};
+
+//! \brief A datagram for ls_net_recv_batch() and ls_net_send_batch()
+struct ls_net_msg
+{
+	void *buffer; // the data
+	size_t size; // size of buffer when receiving, bytes to send when sending
+	size_t length; // bytes received or sent
+	struct ls_net_addr addr; // source when receiving, destination when sending
+	unsigned short segment_size; // size of coalesced datagrams, see below
+	int flags; // LS_NET_MSG_* flags, set when receiving
+};
+
+#define LS_NET_POLL_IN 0x1 // data can be received, or a connection accepted
+#define LS_NET_POLL_OUT 0x2 // data can be sent
+#define LS_NET_POLL_ERR 0x4 // an error is pending, only reported
+#define LS_NET_POLL_HUP 0x8 // the peer closed the connection, only reported
+
+//! \brief Connect to a host
+//! 
+//! With LS_AF_UNIX, host is the path of the socket file and port is
+//! not used. On Linux, a path starting with '@' names a socket in the
+//! abstract namespace, which has no file. Local sockets avoid the
+//! overhead of the network stack and can pass handles to another
+//! process, see ls_net_send_handles(). On Windows, only LS_NET_STREAM
+//! is supported.
+//! 
+//! \param host The host name or numeric address, or the path
+//! \param port The port
+//! \param type LS_NET_STREAM, LS_NET_DGRAM or LS_NET_SEQPACKET
+//! \param protocol The protocol, LS_NET_PROTO_DEFAULT for LS_AF_UNIX
+//! \param addr_family One of the LS_AF_* constants
+//! 
+//! \return A handle to the socket, or NULL on error
 ls_handle ls_net_connect(const char *host, unsigned short port, int type, int protocol, int addr_family);
 
+//! \brief Connect to a host, racing its addresses
+//! 
+//! Connects to every address the host resolves to without blocking,
+//! alternating between IPv6 and IPv4 and starting with IPv6. A new
+//! attempt is started every 250 milliseconds, or as soon as the
+//! previous one fails, while earlier attempts continue (RFC 8305,
+//! "Happy Eyeballs"). The first socket to connect is returned and the
+//! other attempts are abandoned, so an unreachable address only costs
+//! a short delay instead of the system connect timeout.
+//! 
+//! The host name is resolved on a background thread, so the time
+//! spent resolving counts against the timeout, and a task waiting for
+//! the resolver does not block its worker.
+//! 
+//! \param host The host name or numeric address
+//! \param port The port
+//! \param type LS_NET_STREAM, LS_NET_DGRAM or LS_NET_SEQPACKET
+//! \param protocol The protocol
+//! \param addr_family One of the LS_AF_* constants
+//! \param ms The maximum time to wait in milliseconds, LS_INFINITE to
+//! wait until every attempt failed
+//! 
+//! With LS_AF_UNIX, the connect is retried until the timeout while
+//! the backlog of the listener is full.
+//! 
+//! \return A handle to the socket, or NULL on error. Fails with
+//! LS_TIMEDOUT if no attempt succeeded in time, otherwise with the
+//! error of the last attempt.
+ls_handle ls_net_connect_ex(const char *host, unsigned short port, int type, int protocol, int addr_family, unsigned long ms);
+
+//! \brief Create a socket bound to a local address
+//! 
+//! For stream sockets, the socket listens for connections and the
+//! returned handle is passed to ls_net_accept(). For datagram sockets,
+//! a socket which can send and receive datagrams is returned instead,
+//! for use with ls_net_recv_batch() and ls_net_send_batch().
+//! LS_NET_SEQPACKET sockets accept connections like stream sockets.
+//! 
+//! With LS_AF_UNIX, host is the path of the socket file to create,
+//! see ls_net_connect(). Binding fails if the file exists, it is not
+//! removed when the socket is closed.
+//! 
+//! \return A handle to the socket, or NULL on error
 ls_handle ls_net_listen(const char *host, unsigned short port, int type, int protocol, int addr_family, int backlog);
 
+//! \brief Create a socket bound to a local address, with options
+//! 
+//! Same as ls_net_listen(), but sets socket options before the socket
+//! is bound, as some options, such as LS_NET_OPT_REUSEPORT, require.
+//! Options set on a listening socket are inherited by accepted
+//! sockets where the system supports it.
+//! 
+//! \return A handle to the socket, or NULL on error. Fails if any
+//! option cannot be set.
+ls_handle ls_net_listen_ex(const char *host, unsigned short port, int type, int protocol, int addr_family, const struct ls_net_listen_options *options);
+
+//! \brief Create one listening socket per worker on the same port
+//! 
+//! Creates nshards sockets with ls_net_listen_ex(), all bound to the
+//! same address with LS_NET_OPT_REUSEPORT. Each worker thread accepts
+//! on its own shard, so workers do not contend for a single accept
+//! queue and are not all woken for each connection. On Linux the
+//! system distributes incoming connections between the shards.
+//! 
+//! With LS_NET_SHARD_CPU, each connection is instead steered to the
+//! shard whose index is the CPU that received it, modulo nshards.
+//! This keeps a connection on one CPU if the worker of shard i runs on
+//! CPU i. Only supported on Linux.
+//! 
+//! \param host The local address
+//! \param port The port, must not be 0
+//! \param type LS_NET_STREAM or LS_NET_DGRAM
+//! \param protocol The protocol
+//! \param addr_family The address family
+//! \param options Options applied to each shard
+//! \param shards Receives nshards handles
+//! \param nshards The number of shards
+//! \param flags 0 or LS_NET_SHARD_CPU
+//! 
+//! \return 0 on success, -1 on error, in which case no shard is
+//! created
+int ls_net_listen_sharded(const char *host, unsigned short port, int type, int protocol, int addr_family,
+	const struct ls_net_listen_options *options, ls_handle *shards, size_t nshards, int flags);
+
 ls_handle ls_net_accept(ls_handle sock);
 
+//! \brief Accept all pending connections
+//! 
+//! Waits for the first connection, unless the server is
+//! non-blocking, then accepts connections until none are pending or
+//! count were accepted. The new sockets are non-blocking, see
+//! ls_net_set_nonblocking().
+//! 
+//! \param sock The server
+//! \param clients Receives the new sockets
+//! \param count The maximum number of connections to accept
+//! 
+//! \return The number of connections accepted, or -1 on error.
+//! Fails with LS_NOT_READY if the server is non-blocking and no
+//! connection is pending.
+size_t ls_net_accept_batch(ls_handle sock, ls_handle *clients, size_t count);
+
 //! \brief Shutdown a connection
 //! 
 //! Causes the socket to stop receiving, sending, or both. The
@@ -54,8 +242,407 @@ const char *ls_net_gethost(ls_handle sock);
 //! so check ls_get_errno() to determine if an error occurred.
 unsigned short ls_net_getport(ls_handle sock);
 
+//! \brief Receive data from a socket
+//! 
+//! Waits until size bytes were received or the peer closed the
+//! connection. On a non-blocking socket, receives only what is
+//! available.
+//! 
+//! \param sock The socket handle
+//! \param buffer Receives the data
+//! \param size The number of bytes to receive
+//! 
+//! \return The number of bytes received, which is less than size only
+//! if the peer closed the connection, or -1 on error
 size_t ls_net_recv(ls_handle sock, void *buffer, size_t size);
 
+//! \brief Receive the data which is available on a socket
+//! 
+//! Waits until at least one byte is available, then returns what was
+//! received by a single call into the kernel, up to size bytes. Use
+//! this to read messages whose length is not known in advance. On a
+//! non-blocking socket, fails with LS_NOT_READY instead of waiting.
+//! 
+//! \param sock The socket handle
+//! \param buffer Receives the data
+//! \param size The size of buffer
+//! 
+//! \return The number of bytes received, 0 if the peer closed the
+//! connection, or -1 on error
+size_t ls_net_recv_some(ls_handle sock, void *buffer, size_t size);
+
+//! \brief Receive exactly the given number of bytes from a socket
+//! 
+//! Waits until size bytes were received, even on a non-blocking
+//! socket. On a blocking socket the kernel fills the whole buffer
+//! before returning (MSG_WAITALL).
+//! 
+//! \param sock The socket handle
+//! \param buffer Receives the data
+//! \param size The number of bytes to receive
+//! 
+//! \return size, less if the peer closed the connection first, or -1
+//! on error
+size_t ls_net_recv_exact(ls_handle sock, void *buffer, size_t size);
+
 size_t ls_net_send(ls_handle sock, const void *buffer, size_t size);
 
+//! \brief Send data along with handles to another process
+//! 
+//! Passes file, pipe, socket and server handles over an LS_AF_UNIX
+//! socket. The receiver gets new handles to the same open files and
+//! sockets, so an accepted connection can be handed to another
+//! process without copying its data. The handles remain open in the
+//! sender and may be closed once the call returns.
+//! 
+//! The handles are attached to the first byte of data. For stream
+//! sockets, the receiver must receive them with
+//! ls_net_recv_handles() before reading past that byte. Not
+//! supported on Windows.
+//! 
+//! \param sock The socket
+//! \param buffer The data, at least one byte
+//! \param size The number of bytes to send
+//! \param handles The handles to pass
+//! \param count The number of handles, at most LS_NET_MAX_HANDLES
+//! 
+//! \return The number of bytes sent, or -1 on error. If fewer than
+//! size bytes were sent, the handles were passed and the remaining
+//! data can be sent with ls_net_send().
+size_t ls_net_send_handles(ls_handle sock, const void *buffer, size_t size, const ls_handle *handles, size_t count);
+
+//! \brief Receive data along with handles from another process
+//! 
+//! Receives data like ls_net_recv_some() and the handles sent with
+//! ls_net_send_handles(). Sockets are received as socket or server
+//! handles, anything else as a file handle. Not supported on Windows.
+//! 
+//! \param sock The socket
+//! \param buffer Receives the data
+//! \param size The size of buffer
+//! \param handles Receives the handles, which must be closed with
+//! ls_close()
+//! \param count On input, the number of handles the array can hold.
+//! On output, the number of handles received.
+//! 
+//! \return The number of bytes received, 0 if the peer closed the
+//! connection, -1 on error. The data is returned even if not all
+//! handles could be received: handles which do not fit into the
+//! array, or for which no handle could be created, are closed, and
+//! count is set to the number of handles kept.
+size_t ls_net_recv_handles(ls_handle sock, void *buffer, size_t size, ls_handle *handles, size_t *count);
+
+//! \brief Put a socket into non-blocking mode
+//! 
+//! Sockets and servers are waitable. ls_wait() and ls_timedwait()
+//! return once a socket has data to receive, or a server has a
+//! connection to accept, without receiving or accepting anything.
+//! They may also be added to an event loop or passed to
+//! ls_wait_any().
+//! 
+//! In non-blocking mode, ls_net_recv() and ls_net_send() transfer
+//! only what can be transferred immediately, and fail with
+//! LS_NOT_READY if that is nothing. ls_net_accept() fails with
+//! LS_NOT_READY if no connection is pending, and sockets accepted
+//! from a non-blocking server are non-blocking as well.
+//! 
+//! \param sock A socket or server handle
+//! \param nonblocking Nonzero to enable non-blocking mode, 0 to
+//! disable it
+//! 
+//! \return 0 on success, -1 on error
+int ls_net_set_nonblocking(ls_handle sock, int nonblocking);
+
+//! \brief Wait for any of several sockets to become ready
+//! 
+//! On input, events holds a combination of LS_NET_POLL_IN and
+//! LS_NET_POLL_OUT for each socket. On return, it holds the events
+//! which are ready, and may also contain LS_NET_POLL_ERR and
+//! LS_NET_POLL_HUP. The whole set is checked with one system call.
+//! When called from a task of a scheduler with asynchronous I/O, only
+//! the task is suspended.
+//! 
+//! For a large set of long-lived sockets, an event loop avoids
+//! passing the whole set to the kernel on each wait.
+//! 
+//! \param socks Socket or server handles
+//! \param events Events of each socket
+//! \param count The number of sockets
+//! \param ms Maximum time to wait in milliseconds
+//! 
+//! \return The number of ready sockets, 0 if the timeout expired, -1
+//! on error
+int ls_net_poll(const ls_handle *socks, int *events, size_t count, unsigned long ms);
+
+//! \brief Resolve a host into a socket address
+//! 
+//! \param host The host name or numeric address
+//! \param port The port
+//! \param addr_family One of the LS_AF_* constants
+//! \param addr Receives the address
+//! 
+//! \return 0 on success, -1 on error
+int ls_net_addr_parse(const char *host, unsigned short port, int addr_family, struct ls_net_addr *addr);
+
+//! \brief Format a socket address
+//! 
+//! \param addr The address
+//! \param host Receives the numeric host, or the path of an
+//! LS_AF_UNIX address, may be NULL if size is 0
+//! \param size The size of host, 46 bytes fit any network address
+//! \param port Receives the port, may be NULL
+//! 
+//! \return 0 on success, -1 on error
+int ls_net_addr_format(const struct ls_net_addr *addr, char *host, size_t size, unsigned short *port);
+
+//! \brief Receive several datagrams at once
+//! 
+//! Waits until at least one datagram is available, then receives as
+//! many of the queued datagrams as fit into msgs. On Linux they are
+//! received with one recvmmsg call per 64 datagrams. For each
+//! datagram, length, addr and flags are set. On a non-blocking
+//! socket, fails with LS_NOT_READY instead of waiting.
+//! 
+//! If UDP_GRO was enabled with ls_net_set_udp_gro(), the kernel may
+//! coalesce datagrams of the same flow into one message. Their
+//! segment_size is then the size of each datagram, only the last may
+//! be shorter, otherwise segment_size is 0.
+//! 
+//! \param sock A datagram socket
+//! \param msgs The datagrams, buffer and size must be set
+//! \param count The number of datagrams in msgs
+//! 
+//! \return The number of datagrams received, or -1 on error
+size_t ls_net_recv_batch(ls_handle sock, struct ls_net_msg *msgs, size_t count);
+
+//! \brief Send several datagrams at once
+//! 
+//! On Linux, datagrams are sent with one sendmmsg call per 64
+//! datagrams. Each is sent to its addr, or to the connected peer if
+//! addr.len is 0. If segment_size is not 0, the buffer is sent as a
+//! series of datagrams of that size, with UDP_SEGMENT offload where
+//! the system supports it. On a non-blocking socket, sends what can be
+//! sent immediately.
+//! 
+//! \param sock A datagram socket
+//! \param msgs The datagrams, length is set for each one sent
+//! \param count The number of datagrams in msgs
+//! 
+//! \return The number of datagrams sent, or -1 on error
+size_t ls_net_send_batch(ls_handle sock, struct ls_net_msg *msgs, size_t count);
+
+//! \brief Let the kernel coalesce received datagrams (UDP_GRO)
+//! 
+//! \param sock A datagram socket
+//! \param enable Nonzero to enable, 0 to disable
+//! 
+//! \return 0 on success, -1 on error. Fails with LS_NOT_SUPPORTED if
+//! the system does not support it.
+int ls_net_set_udp_gro(ls_handle sock, int enable);
+
+//! \brief Send part of a file over a socket
+//! 
+//! Copies the data from the file to the socket inside the kernel,
+//! using sendfile on Linux and macOS. Elsewhere, or if the file does
+//! not support it, the data is read into a buffer and sent with
+//! ls_net_send(). The file position is not used, but on Windows it
+//! is changed.
+//! 
+//! Blocks until all data is sent or the end of the file is reached,
+//! unless the socket is non-blocking.
+//! 
+//! \param sock The socket
+//! \param file A file opened with LS_FILE_READ
+//! \param offset The offset in the file to start at
+//! \param size The number of bytes to send
+//! 
+//! \return The number of bytes sent, or -1 on error
+size_t ls_net_sendfile(ls_handle sock, ls_handle file, uint64_t offset, size_t size);
+
+//! \brief Enable zero-copy sends on a socket
+//! 
+//! Once enabled, ls_net_send_zerocopy() lets the kernel send directly
+//! from the buffer of the caller (MSG_ZEROCOPY) instead of copying it.
+//! This only pays off for large buffers, around 10 KiB and up.
+//! 
+//! \param sock The socket
+//! \param enable Nonzero to enable, 0 to disable
+//! 
+//! \return 0 on success, -1 on error. Fails with LS_NOT_SUPPORTED if
+//! the system does not support it.
+int ls_net_set_zerocopy(ls_handle sock, int enable);
+
+//! \brief Send data without copying it
+//! 
+//! Behaves like ls_net_send(), but if zero-copy is enabled, the
+//! buffer is still in use by the kernel when the function returns.
+//! It must not be modified or freed until ls_net_zerocopy_wait()
+//! confirms the sequence number written to seq. Otherwise, the data
+//! is copied and the buffer may be reused immediately.
+//! 
+//! \param sock The socket
+//! \param buffer The data to send
+//! \param size The number of bytes to send
+//! \param seq Receives the sequence number of the send, may be NULL
+//! 
+//! \return The number of bytes sent, or -1 on error
+size_t ls_net_send_zerocopy(ls_handle sock, const void *buffer, size_t size, uint64_t *seq);
+
+//! \brief Wait for zero-copy sends to complete
+//! 
+//! Reads the completions the kernel posts to the error queue of the
+//! socket. Returns once every send up to seq has completed, after
+//! which their buffers may be reused. TCP completes sends in order.
+//! 
+//! \param sock The socket
+//! \param seq A sequence number from ls_net_send_zerocopy()
+//! \param ms The maximum time to wait in milliseconds, 0 to only
+//! check, LS_INFINITE to wait forever
+//! 
+//! \return 0 if the sends completed, 1 on timeout, -1 on error
+int ls_net_zerocopy_wait(ls_handle sock, uint64_t seq, unsigned long ms);
+
+//! \brief Set a socket option
+//! 
+//! Boolean options are enabled by any nonzero value. Options which do
+//! not apply to the socket fail with an error from the system.
+//! 
+//! \param sock A socket, or a socket returned by ls_net_listen()
+//! \param opt One of the LS_NET_OPT_* constants
+//! \param value The value
+//! 
+//! \return 0 on success, -1 on error. Fails with LS_NOT_SUPPORTED if
+//! the option is not available on the system.
+int ls_net_setopt(ls_handle sock, int opt, int value);
+
+//! \brief Get a socket option
+//! 
+//! The value may differ from the one which was set, Linux for example
+//! reports twice the requested buffer sizes.
+//! 
+//! \param sock A socket, or a socket returned by ls_net_listen()
+//! \param opt One of the LS_NET_OPT_* constants
+//! \param value Receives the value
+//! 
+//! \return 0 on success, -1 on error
+int ls_net_getopt(ls_handle sock, int opt, int *value);
+
+//! \brief Resolve a host name
+//! 
+//! Numeric addresses are converted without a lookup. Host names are
+//! kept in a process-wide cache keyed by the name and address family,
+//! which ls_net_connect() and ls_net_listen() also use. A successful
+//! lookup is cached for 30 seconds, a host which does not exist for 5
+//! seconds, see ls_net_resolver_config(). Other failures are not
+//! cached.
+//! 
+//! \param host The host name or numeric address
+//! \param port The port to set in each address
+//! \param addr_family One of the LS_AF_* constants
+//! \param addrs Receives the addresses, in order of preference
+//! \param count The number of addresses addrs can hold, at most 16
+//! are returned
+//! 
+//! \return The number of addresses, or -1 on error. Fails with
+//! LS_NOT_FOUND if the host does not exist.
+int ls_net_resolve(const char *host, unsigned short port, int addr_family, struct ls_net_addr *addrs, size_t count);
+
+//! \brief Resolve a host name in the background
+//! 
+//! Behaves like ls_net_resolve(), but a lookup which is not cached is
+//! done by a background thread. The returned handle is signaled once
+//! the result is available, wait on it with ls_wait() or
+//! ls_timedwait(), then get the result with ls_net_resolve_result().
+//! Closing the handle abandons the lookup.
+//! 
+//! \param host The host name or numeric address
+//! \param port The port to set in each address
+//! \param addr_family One of the LS_AF_* constants
+//! 
+//! \return A handle to the request, or NULL on error
+ls_handle ls_net_resolve_async(const char *host, unsigned short port, int addr_family);
+
+//! \brief Get the result of ls_net_resolve_async()
+//! 
+//! \param req The request
+//! \param addrs Receives the addresses, in order of preference
+//! \param count The number of addresses addrs can hold
+//! 
+//! \return The number of addresses, or -1 on error. Fails with
+//! LS_NOT_READY if the request has not completed.
+int ls_net_resolve_result(ls_handle req, struct ls_net_addr *addrs, size_t count);
+
+//! \brief Set how long host names are cached
+//! 
+//! Also removes all cached results.
+//! 
+//! \param ttl Milliseconds a successful lookup is cached, 0 to not
+//! cache it
+//! \param negative_ttl Milliseconds a host which does not exist is
+//! cached, 0 to not cache it
+void ls_net_resolver_config(unsigned long ttl, unsigned long negative_ttl);
+
+//! \brief Remove all cached host names
+void ls_net_resolver_flush(void);
+
+//! \brief Create a pool of outgoing connections
+//! 
+//! A connection pool keeps stream sockets which are no longer needed
+//! open, so a later request to the same host and port reuses them
+//! instead of resolving the host and connecting again. Connections are
+//! handed out by ls_connpool_acquire() and returned with
+//! ls_connpool_release(). The pool may be used by several threads at
+//! once. Closing the pool closes its idle connections, connections
+//! which were acquired stay open.
+//! 
+//! \param options The options, if NULL, up to 8 connections per host
+//! are kept for 60 seconds
+//! 
+//! \return A handle to the pool, or NULL on error
+ls_handle ls_connpool_create(const struct ls_connpool_options *options);
+
+//! \brief Get a connection to a host
+//! 
+//! Returns the most recently released idle connection to the host and
+//! port. Before it is returned, the connection is checked without
+//! blocking, one which was closed by the peer, failed, or received
+//! data while idle is closed and the next one is tried. If no idle
+//! connection is left, a new one is created with ls_net_connect_ex().
+//! 
+//! \param pool The pool
+//! \param host The host name or numeric address
+//! \param port The port
+//! 
+//! \return A connected socket, or NULL on error
+ls_handle ls_connpool_acquire(ls_handle pool, const char *host, unsigned short port);
+
+//! \brief Return a connection to a pool
+//! 
+//! The connection is kept for reuse if reuse is nonzero, otherwise it
+//! is closed. Pass 0 if the connection is in an unknown state, for
+//! example after an error or when a response was not read completely.
+//! If the host already has the maximum number of idle connections,
+//! the oldest one is closed.
+//! 
+//! \param pool The pool
+//! \param sock A socket from ls_connpool_acquire(), the caller must
+//! no longer use it
+//! \param reuse Whether the connection may be reused
+//! 
+//! \return 0 on success, -1 on error, in which case the socket is
+//! closed
+int ls_connpool_release(ls_handle pool, ls_handle sock, int reuse);
+
+//! \brief Close idle connections which timed out
+//! 
+//! Expired connections are also closed when their host is acquired,
+//! call this periodically to release connections to hosts which are
+//! no longer used. Hosts left without idle connections are forgotten.
+//! 
+//! \param pool The pool
+//! 
+//! \return The number of connections closed. Returns 0 if pool is
+//! not a connection pool, in which case ls_errno is set.
+size_t ls_connpool_prune(ls_handle pool);
+
 #endif // _LS_NET_H_
@@ -0,0 +1,121 @@
+#ifndef _LS_QUEUE_H_
+#define _LS_QUEUE_H_
+
+#include "ls_defs.h"
+
+#define LS_QUEUE_WAITABLE 0x1 // the queue may be waited on until not empty
+
+//! \brief Create a lock-free multi-producer multi-consumer queue.
+//!
+//! A bounded, first-in first-out queue of fixed size elements which
+//! may be used by any number of producers and consumers without
+//! locking. Each slot carries a sequence number, so producers and
+//! consumers only contend on their own position counter and never
+//! wait for one another. Elements are copied into a buffer allocated
+//! when the queue is created.
+//!
+//! Pushing and popping never block. If flags contains
+//! LS_QUEUE_WAITABLE, ls_wait() and ls_timedwait() on the queue return
+//! once it is not empty, without removing an element. Since another
+//! consumer may take the element first, ls_queue_pop() may still fail
+//! afterwards. Without the flag, waiting fails with LS_NOT_WAITABLE and
+//! pushing never checks for waiters.
+//!
+//! \param elem_size The size of each element in bytes, must not be 0.
+//! \param capacity The number of elements the queue can hold, rounded
+//! up to a power of 2.
+//! \param flags 0 or LS_QUEUE_WAITABLE.
+//!
+//! \return A handle to the queue, or NULL if an error occurred.
+ls_handle ls_queue_create(size_t elem_size, size_t capacity, int flags);
+
+//! \brief Push an element onto a queue.
+//!
+//! \param q The queue.
+//! \param data The element, elem_size bytes are copied.
+//!
+//! \return 0 on success, 1 if the queue is full, -1 on failure.
+int ls_queue_push(ls_handle q, const void *data);
+
+//! \brief Pop the oldest element from a queue.
+//!
+//! \param q The queue.
+//! \param data Receives the element, must hold elem_size bytes.
+//!
+//! \return 0 on success, 1 if the queue is empty, -1 on failure.
+int ls_queue_pop(ls_handle q, void *data);
+
+//! \brief Get the number of elements in a queue.
+//!
+//! The result is only a snapshot if other threads use the queue.
+//!
+//! \param q The queue.
+//!
+//! \return The number of elements, or -1 on failure.
+size_t ls_queue_count(ls_handle q);
+
+//! \brief Create a single-producer single-consumer ring buffer.
+//!
+//! A bounded, first-in first-out queue of fixed size elements for
+//! exactly one producing and one consuming thread. The producer and
+//! consumer positions live on separate cache lines and each side
+//! caches the position of the other, so the two threads only share a
+//! cache line when the ring appears full or empty. Batches of elements
+//! are moved with a single update of the position.
+//!
+//! LS_QUEUE_WAITABLE has the same meaning as for ls_queue_create().
+//!
+//! \param elem_size The size of each element in bytes, must not be 0.
+//! \param capacity The number of elements the ring can hold, rounded
+//! up to a power of 2.
+//! \param flags 0 or LS_QUEUE_WAITABLE.
+//!
+//! \return A handle to the ring, or NULL if an error occurred.
+ls_handle ls_spsc_ring_create(size_t elem_size, size_t capacity, int flags);
+
+//! \brief Push an element onto a ring, must only be called by the
+//! producer.
+//!
+//! \param ring The ring.
+//! \param data The element, elem_size bytes are copied.
+//!
+//! \return 0 on success, 1 if the ring is full, -1 on failure.
+int ls_spsc_ring_push(ls_handle ring, const void *data);
+
+//! \brief Pop the oldest element from a ring, must only be called by
+//! the consumer.
+//!
+//! \param ring The ring.
+//! \param data Receives the element, must hold elem_size bytes.
+//!
+//! \return 0 on success, 1 if the ring is empty, -1 on failure.
+int ls_spsc_ring_pop(ls_handle ring, void *data);
+
+//! \brief Push as many elements as fit onto a ring, must only be
+//! called by the producer.
+//!
+//! \param ring The ring.
+//! \param data Array of count elements.
+//! \param count The number of elements to push.
+//!
+//! \return The number of elements pushed, or -1 on failure.
+size_t ls_spsc_ring_push_n(ls_handle ring, const void *data, size_t count);
+
+//! \brief Pop up to a number of elements from a ring, must only be
+//! called by the consumer.
+//!
+//! \param ring The ring.
+//! \param data Receives the elements, must hold count elements.
+//! \param count The maximum number of elements to pop.
+//!
+//! \return The number of elements popped, or -1 on failure.
+size_t ls_spsc_ring_pop_n(ls_handle ring, void *data, size_t count);
+
+//! \brief Get the number of elements in a ring.
+//!
+//! \param ring The ring.
+//!
+//! \return The number of elements, or -1 on failure.
+size_t ls_spsc_ring_count(ls_handle ring);
+
+#endif // _LS_QUEUE_H_
@@ -0,0 +1,123 @@
+#ifndef _LS_SCHED_H_
+#define _LS_SCHED_H_
+
+#include "ls_defs.h"
+#include "ls_thread.h"
+
+//! \brief Suspend tasks in blocking calls instead of their worker.
+#define LS_SCHED_ASYNC_IO 0x1
+
+//! \brief Create a fiber scheduler.
+//!
+//! Creates a pool of worker threads which run tasks. A task is a
+//! fiber which is not bound to the thread that created it. Whenever
+//! a task yields or is suspended, it may be resumed by any of the
+//! workers. Workers which run out of tasks steal them from busy
+//! workers, so a single scheduler can keep every core busy.
+//!
+//! Per-thread state maintained by lysys, such as ls_errno(), follows
+//! the task when it moves between workers. Thread-local storage of
+//! the application does not; the values seen by a task may change
+//! each time it yields. The plain fiber functions (ls_fiber_*) must
+//! not be used from within a task.
+//!
+//! If flags contains LS_SCHED_ASYNC_IO, the scheduler runs a reactor
+//! thread and blocking calls made by its tasks suspend only the
+//! calling task, letting the worker run other tasks in the meantime.
+//! This applies to ls_read(), ls_write(), ls_net_recv(), ls_net_send(),
+//! ls_net_accept(), ls_wait(), ls_timedwait(), ls_sleep() and
+//! ls_nanosleep(). Descriptors which do not support readiness
+//! notifications, such as regular files, still block the worker.
+//! LS_SCHED_ASYNC_IO is currently only supported on Linux.
+//!
+//! Waiting on the scheduler with ls_wait() blocks until all tasks
+//! spawned on it have completed. Closing the scheduler stops the
+//! workers. Any task which has not yet completed never runs again,
+//! it is completed with an exit code of -1 and waits on it return.
+//! The stack of a task blocked on a synchronization object is kept
+//! until the process exits, as the object still refers to it.
+//!
+//! \param nworkers The number of worker threads, or 0 to create one
+//! worker per core.
+//! \param flags Flags for the scheduler, 0 or LS_SCHED_ASYNC_IO.
+//!
+//! \return A handle to the scheduler, or NULL if an error occurred.
+ls_handle ls_sched_create(int nworkers, int flags);
+
+//! \brief Spawn a task on a scheduler.
+//!
+//! Creates a new task which runs func on one of the workers of the
+//! scheduler. The task completes when func returns. May be called
+//! from any thread, including from other tasks.
+//!
+//! The returned handle may be waited on with ls_wait() and must be
+//! released with ls_close(). Closing the handle does not affect the
+//! execution of the task.
+//!
+//! \param sched The scheduler.
+//! \param func The function to run in the task.
+//! \param up User data to pass to the task function.
+//!
+//! \return A handle to the task, or NULL if an error occurred.
+ls_handle ls_sched_spawn(ls_handle sched, ls_thread_func_t func, void *up);
+
+//! \brief Yield the calling task.
+//!
+//! Places the calling task at the back of the run queue of its
+//! worker, allowing other tasks to run. If the caller is not a task,
+//! the calling thread yields instead.
+void ls_sched_yield(void);
+
+//! \brief Get a pseudo-handle to the calling task.
+//!
+//! \return LS_SELF if the caller is a task, NULL otherwise.
+ls_handle ls_task_self(void);
+
+//! \brief Get the index of the worker running the calling task.
+//!
+//! The value may change each time the task yields or is suspended.
+//!
+//! \return The index of the worker, in the range [0, nworkers), or
+//! -1 if the caller is not a task.
+int ls_sched_worker(void);
+
+//! \brief Get the exit code of a task.
+//!
+//! \param task Handle to the task.
+//! \param exit_code Pointer to the exit code. Only set if the task
+//! has completed.
+//!
+//! \return 0 on success, 1 if the task is still running, -1 on
+//! failure.
+int ls_task_exit_code(ls_handle task, int *exit_code);
+
+//! \brief Allocate a new Fiber Local Storage (FLS) key.
+//!
+//! FLS keys are the task equivalent of TLS keys. Each task has its
+//! own value for each key, which follows the task as it moves between
+//! workers. Values are initially NULL. Closing the key does not free
+//! the values stored with it.
+//!
+//! \return A handle to the FLS key or NULL if an error occurred.
+ls_handle ls_fls_create(void);
+
+//! \brief Set the value associated with an FLS key for the calling
+//! task.
+//!
+//! \param fls The FLS key.
+//! \param value The value to associate with the key.
+//!
+//! \return 0 on success, -1 on failure. Fails with LS_INVALID_STATE
+//! if the caller is not a task.
+int ls_fls_set(ls_handle fls, void *value);
+
+//! \brief Get the value associated with an FLS key for the calling
+//! task.
+//!
+//! \param fls The FLS key.
+//!
+//! \return The value associated with the key, or NULL if no value
+//! was set or an error occurred.
+void *ls_fls_get(ls_handle fls);
+
+#endif // _LS_SCHED_H_
@@ -3,14 +3,29 @@
 
 #include "ls_defs.h"
 
+#define LS_LOCK_RECURSIVE 0x1 // lock may be acquired again by its owner
+
 //! \brief Create a lock.
 //! 
 //! \details The lock is not guaranteed to be reentrant and behavior
 //! is undefined if a thread attempts to lock a lock it already holds.
+//! Acquiring and releasing a lock which is not contended does not
+//! enter the kernel.
 //! 
 //! \return A handle to the lock.
 ls_handle ls_lock_create(void);
 
+//! \brief Create a lock with flags.
+//!
+//! \details If LS_LOCK_RECURSIVE is set, the thread which holds the
+//! lock may acquire it again, and must release it once for each time
+//! it was acquired. Recursive locks are slightly slower to acquire.
+//!
+//! \param [in] flags LS_LOCK_* flags.
+//!
+//! \return A handle to the lock.
+ls_handle ls_lock_create_ex(int flags);
+
 //! \brief Acquire a lock.
 //! 
 //! \details Acquires the lock. If the lock is already held by another
@@ -42,6 +57,42 @@ int ls_trylock(ls_handle lock);
 //! \param [in] lock The lock to release.
 void ls_unlock(ls_handle lock);
 
+//! \brief Contention statistics of a lock, see ls_lock_profile().
+struct ls_lock_stat
+{
+	const char *name; // "ls_lock", or where an internal lock was created
+	const void *lock; // the lock, a handle if name is "ls_lock"
+	unsigned long long acquires;
+	unsigned long long contended; // acquires which had to wait
+	long long wait_total; // nanoseconds spent waiting to acquire
+	long long wait_max;
+	long long hold_total; // nanoseconds the lock was held
+	long long hold_max;
+};
+
+//! \brief Report the most contended locks.
+//!
+//! \details Only available if the library was built with
+//! LYSYS_FEATURE_LOCK_PROFILE. Every lock then records how often it
+//! was acquired, how long threads waited for it and how long it was
+//! held. This covers locks from ls_lock_create(), the locks waited
+//! with by ls_cond_wait() and the locks lysys uses internally. Time
+//! spent waiting on a condition variable does not count as holding
+//! the lock. Locks which were destroyed are not reported.
+//!
+//! \param [out] stats Receives the statistics of up to count locks,
+//! ordered by decreasing total wait time.
+//! \param [in] count The maximum number of locks to report.
+//!
+//! \return The number of locks written to stats, or -1 on failure.
+//! Fails with LS_NOT_SUPPORTED if profiling was not built in.
+size_t ls_lock_profile(struct ls_lock_stat *stats, size_t count);
+
+//! \brief Reset the statistics of all locks to zero.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_lock_profile_reset(void);
+
 //! \brief Create a condition variable.
 //! 
 //! \details The condition variable is used to block a thread until a
@@ -93,8 +144,155 @@ void ls_cond_signal(ls_handle cond);
 //! \param [in] cond The condition variable to broadcast.
 void ls_cond_broadcast(ls_handle cond);
 
+//! \brief Create a counting semaphore.
+//! 
+//! \details Waiting on the semaphore with ls_wait() or ls_timedwait()
+//! decrements its count, blocking while the count is zero. Waiting
+//! on a semaphore which is not contended does not enter the kernel.
+//! 
+//! \param [in] count The initial count, must not be negative.
+//! 
+//! \return A handle to the semaphore, or NULL if an error occurred.
 ls_handle ls_semaphore_create(int count);
 
+//! \brief Signal a semaphore.
+//! 
+//! \details Increments the count of the semaphore, waking one waiter
+//! if any are blocked.
+//! 
+//! \param [in] sema The semaphore to signal.
+//! 
+//! \return 0 on success, -1 on failure.
 int ls_semaphore_signal(ls_handle sema);
 
+//! \brief Create a reader-writer lock.
+//!
+//! \details Any number of threads may hold the lock shared, or one
+//! thread may hold it exclusively. Once a thread is waiting to take
+//! the lock exclusively, new shared acquisitions wait until it has
+//! taken and released the lock, so a steady stream of readers cannot
+//! starve writers. Shared acquisitions count readers on one of
+//! several cache lines chosen by the current CPU, so readers on
+//! different CPUs do not contend. The lock is not reentrant.
+//!
+//! \return A handle to the lock, or NULL if an error occurred.
+ls_handle ls_rwlock_create(void);
+
+//! \brief Acquire a reader-writer lock shared.
+//!
+//! \param [in] rwlock The lock.
+void ls_rwlock_lock_shared(ls_handle rwlock);
+
+//! \brief Attempt to acquire a reader-writer lock shared.
+//!
+//! \param [in] rwlock The lock.
+//!
+//! \return 0 if the lock was acquired, 1 if it is held exclusively
+//! or a thread is waiting to hold it exclusively.
+int ls_rwlock_trylock_shared(ls_handle rwlock);
+
+//! \brief Acquire a reader-writer lock shared, waiting up to a timeout.
+//!
+//! \param [in] rwlock The lock.
+//! \param [in] ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if the lock was acquired, 1 if the timeout expired.
+int ls_rwlock_timedlock_shared(ls_handle rwlock, unsigned long ms);
+
+//! \brief Release a reader-writer lock held shared.
+//!
+//! \param [in] rwlock The lock.
+void ls_rwlock_unlock_shared(ls_handle rwlock);
+
+//! \brief Acquire a reader-writer lock exclusively.
+//!
+//! \details Waits until no other thread holds the lock.
+//!
+//! \param [in] rwlock The lock.
+void ls_rwlock_lock(ls_handle rwlock);
+
+//! \brief Attempt to acquire a reader-writer lock exclusively.
+//!
+//! \param [in] rwlock The lock.
+//!
+//! \return 0 if the lock was acquired, 1 if it is held.
+int ls_rwlock_trylock(ls_handle rwlock);
+
+//! \brief Acquire a reader-writer lock exclusively, waiting up to a
+//! timeout.
+//!
+//! \param [in] rwlock The lock.
+//! \param [in] ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if the lock was acquired, 1 if the timeout expired.
+int ls_rwlock_timedlock(ls_handle rwlock, unsigned long ms);
+
+//! \brief Release a reader-writer lock held exclusively.
+//!
+//! \param [in] rwlock The lock.
+void ls_rwlock_unlock(ls_handle rwlock);
+
+#define LS_BARRIER_SERIAL 1 // returned to one thread per barrier phase
+
+//! \brief Create a barrier.
+//!
+//! \details A barrier blocks the threads calling ls_barrier_wait()
+//! until count threads have called it, then releases all of them at
+//! once and starts the next phase. Arrivals are combined in a tree of
+//! counters spread over cache lines, so arriving threads do not all
+//! contend on a single word. Waiters spin briefly before sleeping, so
+//! short phases complete without entering the kernel.
+//!
+//! \param [in] count The number of threads participating in each
+//! phase, must be greater than 0.
+//!
+//! \return A handle to the barrier, or NULL if an error occurred.
+ls_handle ls_barrier_create(int count);
+
+//! \brief Wait until all threads have reached a barrier.
+//!
+//! \param [in] barrier The barrier.
+//!
+//! \return LS_BARRIER_SERIAL for the last thread to arrive, 0 for the
+//! others, -1 on failure.
+int ls_barrier_wait(ls_handle barrier);
+
+//! \brief Create a latch.
+//!
+//! \details A latch is a single-use countdown. It is waited on with
+//! ls_wait() or ls_timedwait(), which return once the count has
+//! reached 0. Unlike a barrier, the threads counting down need not
+//! wait.
+//!
+//! \param [in] count The initial count, must not be negative.
+//!
+//! \return A handle to the latch, or NULL if an error occurred.
+ls_handle ls_latch_create(int count);
+
+//! \brief Decrement the count of a latch.
+//!
+//! \details Releases all waiters when the count reaches 0.
+//!
+//! \param [in] latch The latch.
+//! \param [in] n The amount to decrement by.
+//!
+//! \return 0 on success, -1 on failure. Fails with LS_INVALID_STATE if
+//! n is greater than the remaining count.
+int ls_latch_count_down(ls_handle latch, int n);
+
+//! \brief Decrement the count of a latch by 1 and wait for it to reach
+//! 0.
+//!
+//! \param [in] latch The latch.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_latch_arrive_and_wait(ls_handle latch);
+
+//! \brief Get the remaining count of a latch.
+//!
+//! \param [in] latch The latch.
+//!
+//! \return The count, or -1 on failure.
+int ls_latch_count(ls_handle latch);
+
 #endif // _LS_SYNC_H_
@@ -0,0 +1,115 @@
+#ifndef _LS_TASK_SYNC_H_
+#define _LS_TASK_SYNC_H_
+
+#include "ls_defs.h"
+
+//! \brief Create a task lock.
+//!
+//! \details A task lock is a lock which suspends only the calling task
+//! when contended, allowing its worker to run other tasks (see
+//! ls_sched_create()). Task locks may also be used by threads which
+//! are not tasks, in which case the thread blocks as with ls_lock().
+//!
+//! When a task lock is released while tasks are waiting for it, it
+//! is handed directly to the first waiter, which runs next on the
+//! worker which released it. Waiters acquire the lock in the order
+//! they started waiting. The lock is not reentrant.
+//!
+//! \return A handle to the lock, or NULL if an error occurred.
+ls_handle ls_task_lock_create(void);
+
+//! \brief Acquire a task lock.
+//!
+//! \details If the lock is held, the calling task is suspended until
+//! the lock is handed to it. If the calling task already holds the
+//! lock, behavior is undefined.
+//!
+//! \param [in] lock The lock to acquire.
+void ls_task_lock(ls_handle lock);
+
+//! \brief Attempt to acquire a task lock.
+//!
+//! \param [in] lock The lock to attempt to acquire.
+//!
+//! \return 0 if the lock was acquired, 1 if the lock is already held.
+int ls_task_trylock(ls_handle lock);
+
+//! \brief Release a task lock.
+//!
+//! \details If other tasks or threads are waiting for the lock, the
+//! lock is handed to the one which has waited the longest.
+//!
+//! \param [in] lock The lock to release.
+void ls_task_unlock(ls_handle lock);
+
+//! \brief Create a task condition variable.
+//!
+//! \details Like ls_cond_create(), but used together with a task
+//! lock. Waiting suspends only the calling task.
+//!
+//! \return A handle to the condition variable, or NULL if an error
+//! occurred.
+ls_handle ls_task_cond_create(void);
+
+//! \brief Wait on a task condition variable.
+//!
+//! \details Atomically releases lock and suspends the caller until
+//! the condition variable is signaled. Upon return, the lock is held
+//! again.
+//!
+//! \param [in] cond The condition variable to wait on.
+//! \param [in] lock The task lock held by the caller.
+void ls_task_cond_wait(ls_handle cond, ls_handle lock);
+
+//! \brief Wait on a task condition variable with a timeout.
+//!
+//! \param [in] cond The condition variable to wait on.
+//! \param [in] lock The task lock held by the caller.
+//! \param [in] ms The timeout in milliseconds.
+//!
+//! \return 0 if the condition variable was signaled, 1 if the timeout
+//! expired.
+int ls_task_cond_timedwait(ls_handle cond, ls_handle lock, unsigned long ms);
+
+//! \brief Wake one waiter of a task condition variable.
+//!
+//! \param [in] cond The condition variable to signal.
+void ls_task_cond_signal(ls_handle cond);
+
+//! \brief Wake all waiters of a task condition variable.
+//!
+//! \param [in] cond The condition variable to broadcast.
+void ls_task_cond_broadcast(ls_handle cond);
+
+//! \brief Create a task event.
+//!
+//! \details Like ls_event_create(), but waiting on the event with
+//! ls_wait() or ls_timedwait() suspends only the calling task. The
+//! event is initially not signaled and stays signaled until it is
+//! reset.
+//!
+//! \return A handle to the event, or NULL if an error occurred.
+ls_handle ls_task_event_create(void);
+
+//! \brief Check whether a task event is signaled.
+//!
+//! \param evt The event.
+//!
+//! \return 1 if the event is signaled, 0 if not, -1 on failure.
+int ls_task_event_signaled(ls_handle evt);
+
+//! \brief Signal a task event, waking all of its waiters.
+//!
+//! \param evt The event.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_task_event_set(ls_handle evt);
+
+//! \brief Reset a task event to the non-signaled state.
+//!
+//! \param evt The event.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_task_event_reset(ls_handle evt);
+
+#endif // _LS_TASK_SYNC_H_
@@ -0,0 +1,41 @@
+#ifndef _LS_TIMER_H_
+#define _LS_TIMER_H_
+
+#include "ls_defs.h"
+
+//! \brief Create a timer.
+//!
+//! A timer is a waitable handle which becomes signaled when it
+//! expires. A wait which completes resets the timer, so each expiry
+//! releases a single waiter. Expiries which occur while the timer is
+//! already signaled are merged. The timer is created disarmed, use
+//! ls_timer_set() to arm it.
+//!
+//! Timers may be waited on with ls_wait(), ls_wait_any() and
+//! ls_wait_all(), and added to an event loop.
+//!
+//! \return A handle to the timer, or NULL if an error occurred.
+ls_handle ls_timer_create(void);
+
+//! \brief Arm a timer.
+//!
+//! Replaces any previous setting of the timer and resets it. The
+//! timer measures time with a monotonic clock.
+//!
+//! \param timer The timer.
+//! \param ms Milliseconds until the timer first expires. If 0, the
+//! timer expires immediately.
+//! \param period Milliseconds between subsequent expiries, or 0 for a
+//! timer which expires only once.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_timer_set(ls_handle timer, unsigned long ms, unsigned long period);
+
+//! \brief Disarm and reset a timer.
+//!
+//! \param timer The timer.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_timer_cancel(ls_handle timer);
+
+#endif // _LS_TIMER_H_
@@ -1,27 +1,34 @@
 #ifndef _LYSYS_H_
 #define _LYSYS_H_
 
+#include "ls_channel.h"
 #include "ls_clipboard.h"
 #include "ls_core.h"
 #include "ls_defs.h"
+#include "ls_epoch.h"
 #include "ls_error.h"
 #include "ls_event.h"
 #include "ls_file.h"
 #include "ls_font.h"
 #include "ls_ioutils.h"
+#include "ls_loop.h"
 #include "ls_media.h"
 #include "ls_memory.h"
 #include "ls_mmap.h"
 #include "ls_net.h"
 #include "ls_proc.h"
+#include "ls_queue.h"
 #include "ls_random.h"
+#include "ls_sched.h"
 #include "ls_shell.h"
 #include "ls_stat.h"
 #include "ls_string.h"
 #include "ls_sync.h"
 #include "ls_sysinfo.h"
+#include "ls_task_sync.h"
 #include "ls_thread.h"
 #include "ls_time.h"
+#include "ls_timer.h"
 #include "ls_user.h"
 #include "ls_watch.h"
 
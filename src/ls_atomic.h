@@ -0,0 +1,84 @@
+#ifndef _LS_ATOMIC_H_
+#define _LS_ATOMIC_H_
+
+#include "ls_native.h"
+
+#include <stdint.h>
+
+//! \brief Size of a cache line, used to pad shared data
+#define LS_CACHE_LINE 64
+
+#if LS_WINDOWS
+
+#include <intrin.h>
+
+#define ls_atomic_load32(p) ((int32_t)InterlockedCompareExchange((volatile LONG *)(p), 0, 0))
+#define ls_atomic_store32(p, v) ((void)InterlockedExchange((volatile LONG *)(p), (LONG)(v)))
+#define ls_atomic_add32(p, v) ((int32_t)InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(v)))
+#define ls_atomic_xchg32(p, v) ((int32_t)InterlockedExchange((volatile LONG *)(p), (LONG)(v)))
+#define ls_atomic_cas32(p, e, d) ((int32_t)InterlockedCompareExchange((volatile LONG *)(p), (LONG)(d), (LONG)(e)) == (int32_t)(e))
+
+#define ls_atomic_load64(p) ((int64_t)InterlockedCompareExchange64((volatile LONG64 *)(p), 0, 0))
+#define ls_atomic_store64(p, v) ((void)InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v)))
+#define ls_atomic_add64(p, v) ((int64_t)InterlockedExchangeAdd64((volatile LONG64 *)(p), (LONG64)(v)))
+#define ls_atomic_xchg64(p, v) ((int64_t)InterlockedExchange64((volatile LONG64 *)(p), (LONG64)(v)))
+#define ls_atomic_cas64(p, e, d) ((int64_t)InterlockedCompareExchange64((volatile LONG64 *)(p), (LONG64)(d), (LONG64)(e)) == (int64_t)(e))
+
+#define ls_atomic_loadptr(p) InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL)
+#define ls_atomic_storeptr(p, v) ((void)InterlockedExchangePointer((PVOID volatile *)(p), (PVOID)(v)))
+#define ls_atomic_xchgptr(p, v) InterlockedExchangePointer((PVOID volatile *)(p), (PVOID)(v))
+#define ls_atomic_casptr(p, e, d) (InterlockedCompareExchangePointer((PVOID volatile *)(p), (PVOID)(d), (PVOID)(e)) == (PVOID)(e))
+
+#define ls_atomic_fence() MemoryBarrier()
+#define ls_cpu_relax() YieldProcessor()
+
+#else
+
+// loads acquire, stores release and read-modify-write operations
+// are sequentially consistent
+
+#define ls_atomic_load32(p) __atomic_load_n((volatile int32_t *)(p), __ATOMIC_ACQUIRE)
+#define ls_atomic_store32(p, v) __atomic_store_n((volatile int32_t *)(p), (int32_t)(v), __ATOMIC_RELEASE)
+#define ls_atomic_add32(p, v) __atomic_fetch_add((volatile int32_t *)(p), (int32_t)(v), __ATOMIC_SEQ_CST)
+#define ls_atomic_xchg32(p, v) __atomic_exchange_n((volatile int32_t *)(p), (int32_t)(v), __ATOMIC_SEQ_CST)
+#define ls_atomic_cas32(p, e, d) __ls_atomic_cas32((volatile int32_t *)(p), (int32_t)(e), (int32_t)(d))
+
+#define ls_atomic_load64(p) __atomic_load_n((volatile int64_t *)(p), __ATOMIC_ACQUIRE)
+#define ls_atomic_store64(p, v) __atomic_store_n((volatile int64_t *)(p), (int64_t)(v), __ATOMIC_RELEASE)
+#define ls_atomic_add64(p, v) __atomic_fetch_add((volatile int64_t *)(p), (int64_t)(v), __ATOMIC_SEQ_CST)
+#define ls_atomic_xchg64(p, v) __atomic_exchange_n((volatile int64_t *)(p), (int64_t)(v), __ATOMIC_SEQ_CST)
+#define ls_atomic_cas64(p, e, d) __ls_atomic_cas64((volatile int64_t *)(p), (int64_t)(e), (int64_t)(d))
+
+#define ls_atomic_loadptr(p) __atomic_load_n((void *volatile *)(p), __ATOMIC_ACQUIRE)
+#define ls_atomic_storeptr(p, v) __atomic_store_n((void *volatile *)(p), (void *)(v), __ATOMIC_RELEASE)
+#define ls_atomic_xchgptr(p, v) __atomic_exchange_n((void *volatile *)(p), (void *)(v), __ATOMIC_SEQ_CST)
+#define ls_atomic_casptr(p, e, d) __ls_atomic_casptr((void *volatile *)(p), (void *)(e), (void *)(d))
+
+#define ls_atomic_fence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ls_cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define ls_cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define ls_cpu_relax() ((void)0)
+#endif // __x86_64__
+
+static inline int __ls_atomic_cas32(volatile int32_t *p, int32_t e, int32_t d)
+{
+	return __atomic_compare_exchange_n(p, &e, d, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE);
+}
+
+static inline int __ls_atomic_cas64(volatile int64_t *p, int64_t e, int64_t d)
+{
+	return __atomic_compare_exchange_n(p, &e, d, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE);
+}
+
+static inline int __ls_atomic_casptr(void *volatile *p, void *e, void *d)
+{
+	return __atomic_compare_exchange_n(p, &e, d, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE);
+}
+
+#endif // LS_WINDOWS
+
+#endif // _LS_ATOMIC_H_
@@ -0,0 +1,613 @@
+#include <lysys/ls_channel.h>
+
+#include <lysys/ls_core.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ls_native.h"
+#include "ls_handle.h"
+#include "ls_atomic.h"
+#include "ls_sync_util.h"
+#include "ls_waiter.h"
+
+#define SELECT_STACK_OPS 8 // operations handled without allocating
+
+struct ls_select;
+
+//! \brief A sender or receiver waiting on a channel.
+struct ls_chan_node
+{
+	struct ls_chan_node *next, *prev;
+
+	struct ls_select *sel;
+	void *data;
+	size_t index; // of the operation in the select
+	int queued;
+};
+
+struct ls_chan_queue
+{
+	struct ls_chan_node *head, *tail;
+};
+
+//! \brief State of a blocked ls_channel_select() call.
+//!
+//! The first channel to claim the select, by setting done, completes
+//! the operation of its node and wakes the caller.
+struct ls_select
+{
+	volatile int32_t done;
+	size_t fired;
+	int error;
+
+	ls_lock_t lock; // protects w
+	struct ls_waiter w;
+};
+
+struct ls_channel
+{
+	ls_lock_t lock; // protects the fields below
+
+	uint8_t *buf;
+	size_t elem_size;
+	size_t capacity;
+	size_t head; // index of the oldest element
+	size_t count;
+
+	int closed;
+
+	struct ls_chan_queue sendq;
+	struct ls_chan_queue recvq;
+};
+
+static LS_THREADLOCAL uint32_t _select_seed = 0;
+
+static void ls_chan_push(struct ls_chan_queue *q, struct ls_chan_node *n)
+{
+	n->next = NULL;
+	n->prev = q->tail;
+
+	if (q->tail)
+		q->tail->next = n;
+	else
+		q->head = n;
+	q->tail = n;
+
+	n->queued = 1;
+}
+
+static void ls_chan_remove(struct ls_chan_queue *q, struct ls_chan_node *n)
+{
+	if (n->prev)
+		n->prev->next = n->next;
+	else
+		q->head = n->next;
+
+	if (n->next)
+		n->next->prev = n->prev;
+	else
+		q->tail = n->prev;
+
+	n->next = NULL;
+	n->prev = NULL;
+	n->queued = 0;
+}
+
+//! \brief Dequeue the first waiter whose select can be claimed.
+//!
+//! Waiters whose select was already completed by another channel are
+//! dropped from the queue.
+static struct ls_chan_node *ls_chan_claim(struct ls_chan_queue *q)
+{
+	struct ls_chan_node *n;
+
+	while ((n = q->head))
+	{
+		ls_chan_remove(q, n);
+		if (ls_atomic_cas32(&n->sel->done, 0, 1))
+			return n;
+	}
+
+	return NULL;
+}
+
+//! \brief Complete the operation of a claimed waiter.
+static void ls_chan_fire(struct ls_chan_node *n, int error)
+{
+	struct ls_select *sel = n->sel;
+
+	sel->fired = n->index;
+	sel->error = error;
+
+	lock_lock(&sel->lock);
+	ls_waiter_wake(&sel->w);
+	lock_unlock(&sel->lock);
+}
+
+static void ls_chan_put(struct ls_channel *ch, const void *data)
+{
+	size_t tail;
+
+	tail = (ch->head + ch->count) % ch->capacity;
+	memcpy(ch->buf + tail * ch->elem_size, data, ch->elem_size);
+	ch->count++;
+}
+
+static void ls_chan_take(struct ls_channel *ch, void *data)
+{
+	memcpy(data, ch->buf + ch->head * ch->elem_size, ch->elem_size);
+	ch->head = (ch->head + 1) % ch->capacity;
+	ch->count--;
+}
+
+//! \brief Attempt a send, channel lock must be held.
+//!
+//! \return 1 if the send completed, 0 if it must wait.
+static int ls_chan_try_send(struct ls_channel *ch, const void *data, int *error)
+{
+	struct ls_chan_node *n;
+
+	if (ch->closed)
+	{
+		*error = LS_BAD_PIPE;
+		return 1;
+	}
+
+	*error = 0;
+
+	// hand the element directly to a waiting receiver
+	n = ls_chan_claim(&ch->recvq);
+	if (n)
+	{
+		memcpy(n->data, data, ch->elem_size);
+		ls_chan_fire(n, 0);
+		return 1;
+	}
+
+	if (ch->count < ch->capacity)
+	{
+		ls_chan_put(ch, data);
+		return 1;
+	}
+
+	return 0;
+}
+
+//! \brief Attempt a receive, channel lock must be held.
+//!
+//! \return 1 if the receive completed, 0 if it must wait.
+static int ls_chan_try_recv(struct ls_channel *ch, void *data, int *error)
+{
+	struct ls_chan_node *n;
+
+	*error = 0;
+
+	if (ch->count != 0)
+	{
+		ls_chan_take(ch, data);
+
+		// refill the slot from a waiting sender
+		n = ls_chan_claim(&ch->sendq);
+		if (n)
+		{
+			ls_chan_put(ch, n->data);
+			ls_chan_fire(n, 0);
+		}
+
+		return 1;
+	}
+
+	// unbuffered, take the element directly from a waiting sender
+	n = ls_chan_claim(&ch->sendq);
+	if (n)
+	{
+		memcpy(data, n->data, ch->elem_size);
+		ls_chan_fire(n, 0);
+		return 1;
+	}
+
+	if (ch->closed)
+	{
+		*error = LS_END_OF_FILE;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void ls_chan_close_queue(struct ls_chan_queue *q, int error)
+{
+	struct ls_chan_node *n;
+
+	while ((n = ls_chan_claim(q)))
+		ls_chan_fire(n, error);
+}
+
+static void ls_channel_dtor(struct ls_channel *ch)
+{
+	ls_free(ch->buf);
+	lock_destroy(&ch->lock);
+}
+
+static const struct ls_class ChannelClass = {
+	.type = LS_CHANNEL,
+	.cb = sizeof(struct ls_channel),
+	.dtor = (ls_dtor_t)&ls_channel_dtor,
+	.wait = NULL
+};
+
+//! \brief Sort channels by address and remove duplicates.
+//!
+//! Channels are always locked in this order to avoid deadlocks
+//! between concurrent selects.
+static size_t ls_chan_lock_order(struct ls_channel **chans, size_t n)
+{
+	struct ls_channel *tmp;
+	size_t i, j, count;
+
+	for (i = 1; i < n; i++)
+	{
+		tmp = chans[i];
+		for (j = i; j > 0 && chans[j - 1] > tmp; j--)
+			chans[j] = chans[j - 1];
+		chans[j] = tmp;
+	}
+
+	count = 0;
+	for (i = 0; i < n; i++)
+	{
+		if (count == 0 || chans[count - 1] != chans[i])
+			chans[count++] = chans[i];
+	}
+
+	return count;
+}
+
+static void ls_chan_lock_all(struct ls_channel **chans, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		lock_lock(&chans[i]->lock);
+}
+
+static void ls_chan_unlock_all(struct ls_channel **chans, size_t n)
+{
+	size_t i;
+
+	for (i = n; i > 0; i--)
+		lock_unlock(&chans[i - 1]->lock);
+}
+
+//! \brief Complete one of the operations, or block until one can be.
+//!
+//! \return 0 if an operation completed, 1 on timeout, -1 on failure.
+static int ls_chan_select(struct ls_channel_op *ops, size_t nops, unsigned long ms, size_t *index)
+{
+	struct ls_channel *stack_chans[SELECT_STACK_OPS];
+	struct ls_chan_node stack_nodes[SELECT_STACK_OPS];
+	struct ls_channel **chans;
+	struct ls_chan_node *nodes;
+	struct ls_channel *ch;
+	struct ls_select sel;
+	size_t i, op, start, nchans;
+	int rc, error, completed;
+
+	if (nops <= SELECT_STACK_OPS)
+	{
+		chans = stack_chans;
+		nodes = stack_nodes;
+	}
+	else
+	{
+		chans = ls_malloc(nops * (sizeof(struct ls_channel *) + sizeof(struct ls_chan_node)));
+		if (!chans)
+			return -1;
+		nodes = (struct ls_chan_node *)(chans + nops);
+	}
+
+	for (i = 0; i < nops; i++)
+		chans[i] = ops[i].channel;
+	nchans = ls_chan_lock_order(chans, nops);
+
+	// random starting point, so no operation is always preferred
+	if (nops > 1)
+	{
+		if (_select_seed == 0)
+			_select_seed = (uint32_t)(uintptr_t)&sel | 1;
+		_select_seed ^= _select_seed << 13;
+		_select_seed ^= _select_seed >> 17;
+		_select_seed ^= _select_seed << 5;
+		start = _select_seed % nops;
+	}
+	else
+		start = 0;
+
+	ls_chan_lock_all(chans, nchans);
+
+	for (i = 0; i < nops; i++)
+	{
+		op = (start + i) % nops;
+		ch = ops[op].channel;
+
+		if (ops[op].type == LS_CHANNEL_SEND)
+			completed = ls_chan_try_send(ch, ops[op].data, &error);
+		else
+			completed = ls_chan_try_recv(ch, ops[op].data, &error);
+
+		if (completed)
+		{
+			ls_chan_unlock_all(chans, nchans);
+
+			ops[op].error = error;
+			*index = op;
+
+			if (chans != stack_chans)
+				ls_free(chans);
+			return 0;
+		}
+	}
+
+	if (ms == 0)
+	{
+		ls_chan_unlock_all(chans, nchans);
+
+		if (chans != stack_chans)
+			ls_free(chans);
+		return 1;
+	}
+
+	sel.done = 0;
+	sel.fired = 0;
+	sel.error = 0;
+
+	if (lock_init(&sel.lock) == -1)
+	{
+		ls_chan_unlock_all(chans, nchans);
+
+		if (chans != stack_chans)
+			ls_free(chans);
+		return -1;
+	}
+
+	if (ls_waiter_init(&sel.w) == -1)
+	{
+		ls_chan_unlock_all(chans, nchans);
+		lock_destroy(&sel.lock);
+
+		if (chans != stack_chans)
+			ls_free(chans);
+		return -1;
+	}
+
+	// no channel can claim the select while all of them are locked
+	for (i = 0; i < nops; i++)
+	{
+		nodes[i].sel = &sel;
+		nodes[i].data = ops[i].data;
+		nodes[i].index = i;
+
+		ch = ops[i].channel;
+		if (ops[i].type == LS_CHANNEL_SEND)
+			ls_chan_push(&ch->sendq, &nodes[i]);
+		else
+			ls_chan_push(&ch->recvq, &nodes[i]);
+	}
+
+	ls_chan_unlock_all(chans, nchans);
+
+	lock_lock(&sel.lock);
+
+	rc = ls_waiter_wait(&sel.w, &sel.lock, ms);
+	if (rc == 1)
+	{
+		if (!ls_atomic_cas32(&sel.done, 0, 1))
+		{
+			// claimed as the timeout expired, the operation is
+			// being completed and the wake is imminent
+			(void)ls_waiter_wait(&sel.w, &sel.lock, LS_INFINITE);
+			rc = 0;
+		}
+	}
+
+	lock_unlock(&sel.lock);
+
+	// withdraw from the channels which did not complete
+	ls_chan_lock_all(chans, nchans);
+
+	for (i = 0; i < nops; i++)
+	{
+		if (!nodes[i].queued)
+			continue;
+
+		ch = ops[i].channel;
+		if (ops[i].type == LS_CHANNEL_SEND)
+			ls_chan_remove(&ch->sendq, &nodes[i]);
+		else
+			ls_chan_remove(&ch->recvq, &nodes[i]);
+	}
+
+	ls_chan_unlock_all(chans, nchans);
+
+	ls_waiter_destroy(&sel.w);
+	lock_destroy(&sel.lock);
+
+	if (chans != stack_chans)
+		ls_free(chans);
+
+	if (rc == 0)
+	{
+		ops[sel.fired].error = sel.error;
+		*index = sel.fired;
+	}
+
+	return rc;
+}
+
+static int ls_chan_single(ls_handle chh, int type, void *data, unsigned long ms)
+{
+	struct ls_channel_op op;
+	size_t index;
+	int rc;
+
+	if (ls_type_check(chh, LS_CHANNEL))
+		return -1;
+
+	if (!data)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	op.channel = chh;
+	op.type = type;
+	op.data = data;
+	op.error = 0;
+
+	rc = ls_chan_select(&op, 1, ms, &index);
+	if (rc != 0)
+		return rc;
+
+	if (op.error)
+		return ls_set_errno(op.error);
+
+	return 0;
+}
+
+ls_handle ls_channel_create(size_t elem_size, size_t capacity)
+{
+	struct ls_channel *ch;
+
+	if (elem_size == 0)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	ch = ls_handle_create(&ChannelClass, 0);
+	if (!ch)
+		return NULL;
+
+	if (lock_init(&ch->lock) == -1)
+	{
+		ls_handle_dealloc(ch);
+		return NULL;
+	}
+
+	ch->elem_size = elem_size;
+	ch->capacity = capacity;
+
+	if (capacity != 0)
+	{
+		if (capacity > SIZE_MAX / elem_size)
+		{
+			lock_destroy(&ch->lock);
+			ls_handle_dealloc(ch);
+			ls_set_errno(LS_OUT_OF_RANGE);
+			return NULL;
+		}
+
+		ch->buf = ls_malloc(capacity * elem_size);
+		if (!ch->buf)
+		{
+			lock_destroy(&ch->lock);
+			ls_handle_dealloc(ch);
+			return NULL;
+		}
+	}
+
+	return ch;
+}
+
+int ls_channel_send(ls_handle ch, const void *data)
+{
+	return ls_chan_single(ch, LS_CHANNEL_SEND, (void *)data, LS_INFINITE);
+}
+
+int ls_channel_timedsend(ls_handle ch, const void *data, unsigned long ms)
+{
+	return ls_chan_single(ch, LS_CHANNEL_SEND, (void *)data, ms);
+}
+
+int ls_channel_trysend(ls_handle ch, const void *data)
+{
+	return ls_chan_single(ch, LS_CHANNEL_SEND, (void *)data, 0);
+}
+
+int ls_channel_recv(ls_handle ch, void *data)
+{
+	return ls_chan_single(ch, LS_CHANNEL_RECV, data, LS_INFINITE);
+}
+
+int ls_channel_timedrecv(ls_handle ch, void *data, unsigned long ms)
+{
+	return ls_chan_single(ch, LS_CHANNEL_RECV, data, ms);
+}
+
+int ls_channel_tryrecv(ls_handle ch, void *data)
+{
+	return ls_chan_single(ch, LS_CHANNEL_RECV, data, 0);
+}
+
+int ls_channel_close(ls_handle chh)
+{
+	struct ls_channel *ch = chh;
+
+	if (ls_type_check(chh, LS_CHANNEL))
+		return -1;
+
+	lock_lock(&ch->lock);
+
+	if (ch->closed)
+	{
+		lock_unlock(&ch->lock);
+		return ls_set_errno(LS_INVALID_STATE);
+	}
+
+	ch->closed = 1;
+
+	// receivers only wait if the buffer is empty
+	ls_chan_close_queue(&ch->recvq, LS_END_OF_FILE);
+	ls_chan_close_queue(&ch->sendq, LS_BAD_PIPE);
+
+	lock_unlock(&ch->lock);
+
+	return 0;
+}
+
+size_t ls_channel_count(ls_handle chh)
+{
+	struct ls_channel *ch = chh;
+	size_t count;
+
+	if (ls_type_check(chh, LS_CHANNEL))
+		return -1;
+
+	lock_lock(&ch->lock);
+	count = ch->count;
+	lock_unlock(&ch->lock);
+
+	return count;
+}
+
+int ls_channel_select(struct ls_channel_op *ops, size_t nops, unsigned long ms, size_t *index)
+{
+	size_t i;
+
+	if (!ops || nops == 0 || !index)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	for (i = 0; i < nops; i++)
+	{
+		if (ls_type_check(ops[i].channel, LS_CHANNEL))
+			return -1;
+
+		if (!ops[i].data)
+			return ls_set_errno(LS_INVALID_ARGUMENT);
+
+		if (ops[i].type != LS_CHANNEL_SEND && ops[i].type != LS_CHANNEL_RECV)
+			return ls_set_errno(LS_INVALID_ARGUMENT);
+
+		ops[i].error = 0;
+	}
+
+	return ls_chan_select(ops, nops, ms, index);
+}
@@ -0,0 +1,365 @@
+#include <lysys/ls_net.h>
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ls_handle.h"
+#include "ls_native.h"
+#include "ls_net_priv.h"
+#include "ls_sync_util.h"
+#include "ls_util.h"
+
+#define DEFAULT_MAX_IDLE 8
+#define DEFAULT_IDLE_TIMEOUT 60000 // milliseconds
+#define EXPIRE_BATCH 16 // expired connections closed per pass outside the lock
+
+//! \brief A connection waiting to be reused
+struct ls_idle_conn
+{
+	ls_handle sock;
+	long long since; // ls_nanotime of the release
+};
+
+//! \brief Idle connections to one host and port
+struct ls_endpoint
+{
+	struct ls_idle_conn *conns; // oldest first
+	size_t count;
+};
+
+struct ls_connpool
+{
+	ls_lock_t lock;
+	map_t *endpoints; // "host:port" -> struct ls_endpoint *
+	struct ls_connpool_options options;
+};
+
+static void ls_endpoint_free(any_t value)
+{
+	struct ls_endpoint *ep = value.ptr;
+	size_t i;
+
+	for (i = 0; i < ep->count; i++)
+		ls_close(ep->conns[i].sock);
+
+	ls_free(ep->conns);
+	ls_free(ep);
+}
+
+static void ls_connpool_dtor(struct ls_connpool *pool)
+{
+	ls_map_destroy(pool->endpoints);
+	lock_destroy(&pool->lock);
+}
+
+static const struct ls_class ConnPoolClass = {
+	.type = LS_CONNPOOL,
+	.cb = sizeof(struct ls_connpool),
+	.dtor = (ls_dtor_t)&ls_connpool_dtor,
+	.wait = NULL
+};
+
+static int ls_key_cmp(any_t key1, any_t key2)
+{
+	return strcmp(key1.cptr, key2.cptr);
+}
+
+static any_t ls_key_dup(any_t key)
+{
+	return ANY_PTR(ls_strdup(key.cptr));
+}
+
+static void ls_key_free(any_t key)
+{
+	ls_free(key.ptr);
+}
+
+//! \brief Whether an idle connection was kept for too long.
+static int ls_idle_expired(struct ls_connpool *pool, struct ls_idle_conn *conn, long long now)
+{
+	unsigned long timeout = pool->options.idle_timeout;
+
+	if (timeout == LS_INFINITE)
+		return 0;
+	return now - conn->since >= (long long)timeout * 1000000;
+}
+
+//! \brief Move expired connections of an endpoint to a list.
+//!
+//! The pool must be locked.
+//!
+//! \return The number of connections moved.
+static size_t ls_endpoint_expire(struct ls_connpool *pool, struct ls_endpoint *ep, long long now, ls_handle *out, size_t max)
+{
+	size_t n = 0;
+
+	// the oldest are at the front
+	while (n < ep->count && n < max && ls_idle_expired(pool, &ep->conns[n], now))
+	{
+		out[n] = ep->conns[n].sock;
+		n++;
+	}
+
+	if (n)
+	{
+		memmove(ep->conns, ep->conns + n, (ep->count - n) * sizeof(struct ls_idle_conn));
+		ep->count -= n;
+	}
+
+	return n;
+}
+
+static void ls_close_all(ls_handle *socks, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++)
+		ls_close(socks[i]);
+}
+
+ls_handle ls_connpool_create(const struct ls_connpool_options *options)
+{
+	struct ls_connpool *pool;
+
+	pool = ls_handle_create(&ConnPoolClass, 0);
+	if (!pool)
+		return NULL;
+
+	if (options)
+		pool->options = *options;
+	else
+	{
+		pool->options.max_idle = DEFAULT_MAX_IDLE;
+		pool->options.idle_timeout = DEFAULT_IDLE_TIMEOUT;
+		pool->options.connect_timeout = LS_INFINITE;
+		pool->options.addr_family = LS_AF_UNSPEC;
+	}
+
+	pool->endpoints = ls_map_create(&ls_key_cmp, &ls_key_free, &ls_key_dup, &ls_endpoint_free, NULL);
+	if (!pool->endpoints)
+	{
+		ls_handle_dealloc(pool);
+		return NULL;
+	}
+
+	if (lock_init(&pool->lock) == -1)
+	{
+		ls_map_destroy(pool->endpoints);
+		ls_handle_dealloc(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+ls_handle ls_connpool_acquire(ls_handle pool, const char *host, unsigned short port)
+{
+	struct ls_connpool *p = pool;
+	struct ls_endpoint *ep;
+	entry_t *entry;
+	ls_handle expired[EXPIRE_BATCH];
+	ls_handle sock;
+	size_t nexpired;
+	long long now;
+	char key[300];
+	int rc, stale;
+
+	if (ls_type_check(pool, LS_CONNPOOL))
+		return NULL;
+
+	if (!host)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	if (snprintf(key, sizeof(key), "%s:%hu", host, port) >= (int)sizeof(key))
+	{
+		ls_set_errno(LS_BUFFER_TOO_SMALL);
+		return NULL;
+	}
+
+	for (;;)
+	{
+		sock = NULL;
+		stale = 0;
+
+		lock_lock(&p->lock);
+
+		entry = ls_map_find(p->endpoints, ANY_CPTR(key));
+		ep = entry ? entry->value.ptr : NULL;
+
+		nexpired = 0;
+		if (ep)
+		{
+			now = ls_nanotime();
+			nexpired = ls_endpoint_expire(p, ep, now, expired, EXPIRE_BATCH);
+
+			// the most recently used connection is the least likely
+			// to have been closed by the peer
+			if (ep->count)
+			{
+				ep->count--;
+				sock = ep->conns[ep->count].sock;
+				stale = ls_idle_expired(p, &ep->conns[ep->count], now);
+			}
+		}
+
+		lock_unlock(&p->lock);
+
+		ls_close_all(expired, nexpired);
+
+		if (!sock)
+		{
+			// a full batch may have left more expired connections
+			if (nexpired == EXPIRE_BATCH)
+				continue;
+			break;
+		}
+
+		if (!stale)
+		{
+			rc = ls_socket_check_idle(sock);
+			if (rc == 1)
+				return sock;
+		}
+
+		ls_close(sock);
+	}
+
+	return ls_net_connect_ex(host, port, LS_NET_STREAM, LS_NET_PROTO_TCP,
+		p->options.addr_family, p->options.connect_timeout);
+}
+
+int ls_connpool_release(ls_handle pool, ls_handle sock, int reuse)
+{
+	struct ls_connpool *p = pool;
+	struct ls_endpoint *ep;
+	struct ls_idle_conn *conns;
+	entry_t *entry;
+	ls_handle evicted = NULL;
+	const char *host;
+	unsigned short port;
+	char key[300];
+
+	if (ls_type_check(pool, LS_CONNPOOL))
+		return -1;
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	host = ls_net_gethost(sock);
+	port = ls_net_getport(sock);
+
+	if (!reuse || !host || p->options.max_idle == 0)
+	{
+		ls_close(sock);
+		return 0;
+	}
+
+	if (snprintf(key, sizeof(key), "%s:%hu", host, port) >= (int)sizeof(key))
+	{
+		ls_close(sock);
+		return 0;
+	}
+
+	lock_lock(&p->lock);
+
+	entry = ls_map_find(p->endpoints, ANY_CPTR(key));
+	if (entry)
+		ep = entry->value.ptr;
+	else
+	{
+		ep = ls_calloc(1, sizeof(struct ls_endpoint));
+		if (!ep)
+			goto failure;
+
+		conns = ls_malloc(p->options.max_idle * sizeof(struct ls_idle_conn));
+		if (!conns)
+		{
+			ls_free(ep);
+			goto failure;
+		}
+
+		ep->conns = conns;
+
+		if (!ls_map_insert(p->endpoints, ANY_CPTR(key), ANY_PTR(ep)))
+		{
+			ls_free(conns);
+			ls_free(ep);
+			goto failure;
+		}
+	}
+
+	if (ep->count == p->options.max_idle)
+	{
+		// make room by dropping the oldest
+		evicted = ep->conns[0].sock;
+		memmove(ep->conns, ep->conns + 1, (ep->count - 1) * sizeof(struct ls_idle_conn));
+		ep->count--;
+	}
+
+	ep->conns[ep->count].sock = sock;
+	ep->conns[ep->count].since = ls_nanotime();
+	ep->count++;
+
+	lock_unlock(&p->lock);
+
+	if (evicted)
+		ls_close(evicted);
+
+	return 0;
+failure:
+	lock_unlock(&p->lock);
+	ls_close(sock);
+	return -1;
+}
+
+size_t ls_connpool_prune(ls_handle pool)
+{
+	struct ls_connpool *p = pool;
+	struct ls_endpoint *ep;
+	entry_t *entry, *next;
+	ls_handle expired[EXPIRE_BATCH];
+	size_t n, total = 0;
+	long long now;
+
+	if (ls_type_check(pool, LS_CONNPOOL))
+		return 0;
+
+	now = ls_nanotime();
+
+	for (;;)
+	{
+		n = 0;
+
+		lock_lock(&p->lock);
+
+		for (entry = p->endpoints->entries; entry && n == 0; entry = next)
+		{
+			next = entry->next;
+
+			ep = entry->value.ptr;
+			n = ls_endpoint_expire(p, ep, now, expired, EXPIRE_BATCH);
+
+			// forget hosts without idle connections, so a pool which
+			// contacts many hosts does not grow without bound
+			if (ep->count == 0)
+				(void)ls_map_remove(p->endpoints, entry->key);
+		}
+
+		lock_unlock(&p->lock);
+
+		if (n == 0)
+			break;
+
+		// closed outside the lock, a close may block
+		ls_close_all(expired, n);
+		total += n;
+	}
+
+	return total;
+}
@@ -0,0 +1,346 @@
+#include <lysys/ls_epoch.h>
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_thread.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ls_native.h"
+#include "ls_atomic.h"
+
+#if LS_POSIX
+#include <pthread.h>
+#endif // LS_POSIX
+
+#define NUM_LIMBO 3 // retired memory is safe two epochs later
+#define ADVANCE_THRESHOLD 64 // retires between attempts to advance
+
+//! \brief Memory waiting to be released
+struct ls_retired
+{
+	void *ptr;
+	ls_epoch_free_t free_fn;
+};
+
+//! \brief Memory retired by a thread during one epoch
+struct ls_limbo
+{
+	struct ls_retired *items;
+	size_t count;
+	size_t capacity;
+	int64_t epoch;
+};
+
+//! \brief Per-thread reclamation state
+//!
+//! Records are never freed. When a thread exits its record is marked
+//! unused, along with the memory it still holds, and may be claimed by
+//! another thread.
+struct ls_epoch_record
+{
+	// global epoch observed on entry << 1 | 1 while inside a critical
+	// section, 0 otherwise, read by threads advancing the epoch
+	volatile int64_t state;
+	volatile int32_t in_use;
+	char pad0[LS_CACHE_LINE - sizeof(int64_t) - sizeof(int32_t)];
+
+	// only accessed by the owner
+	unsigned long depth;
+	size_t retired; // retires since the last attempt to advance
+	struct ls_limbo limbo[NUM_LIMBO];
+	struct ls_epoch_record *next;
+};
+
+static volatile int64_t _global_epoch = 1;
+static struct ls_epoch_record *volatile _records = NULL;
+
+static LS_THREADLOCAL struct ls_epoch_record *_record = NULL;
+
+#if LS_WINDOWS
+static INIT_ONCE _exit_once = INIT_ONCE_STATIC_INIT;
+static DWORD _exit_index = FLS_OUT_OF_INDEXES;
+#else
+static pthread_once_t _exit_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _exit_key;
+static int _exit_key_valid = 0;
+#endif // LS_WINDOWS
+
+//! \brief Release all memory of a limbo list.
+static void ls_limbo_drain(struct ls_limbo *limbo)
+{
+	struct ls_retired *items;
+	size_t i, count;
+
+	if (limbo->count == 0)
+		return;
+
+	// the functions may retire more memory
+	items = limbo->items;
+	count = limbo->count;
+
+	limbo->items = NULL;
+	limbo->count = 0;
+	limbo->capacity = 0;
+
+	for (i = 0; i < count; i++)
+		items[i].free_fn(items[i].ptr);
+
+	if (limbo->items)
+		ls_free(items);
+	else
+	{
+		limbo->items = items;
+		limbo->capacity = count;
+	}
+}
+
+//! \brief Release the memory of a record which is safe to release.
+static void ls_record_reclaim(struct ls_epoch_record *rec, int64_t epoch)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_LIMBO; i++)
+	{
+		if (rec->limbo[i].epoch + 2 <= epoch)
+			ls_limbo_drain(&rec->limbo[i]);
+	}
+}
+
+static int ls_record_has_retired(struct ls_epoch_record *rec)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_LIMBO; i++)
+	{
+		if (rec->limbo[i].count)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void ls_record_release(struct ls_epoch_record *rec)
+{
+	rec->depth = 0;
+	rec->retired = 0;
+	ls_atomic_store64(&rec->state, 0);
+	ls_atomic_store32(&rec->in_use, 0);
+}
+
+#if LS_WINDOWS
+
+static void NTAPI ls_epoch_thread_exit(PVOID lpFlsData)
+{
+	struct ls_epoch_record *rec = lpFlsData;
+
+	if (_record == rec)
+		_record = NULL;
+	ls_record_release(rec);
+}
+
+static BOOL CALLBACK ls_epoch_init_exit(PINIT_ONCE InitOnce, PVOID Parameter, PVOID *Context)
+{
+	_exit_index = FlsAlloc(&ls_epoch_thread_exit);
+	return TRUE;
+}
+
+#else
+
+static void ls_epoch_thread_exit(void *value)
+{
+	ls_record_release(value);
+}
+
+static void ls_epoch_init_exit(void)
+{
+	_exit_key_valid = pthread_key_create(&_exit_key, &ls_epoch_thread_exit) == 0;
+}
+
+#endif // LS_WINDOWS
+
+//! \brief Get the record of the calling thread, claiming one if needed.
+static struct ls_epoch_record *ls_epoch_self(void)
+{
+	struct ls_epoch_record *rec, *head;
+
+	if (LS_LIKELY(_record != NULL))
+		return _record;
+
+	// reuse the record of an exited thread
+	for (rec = ls_atomic_loadptr(&_records); rec; rec = rec->next)
+	{
+		if (ls_atomic_load32(&rec->in_use) == 0 && ls_atomic_cas32(&rec->in_use, 0, 1))
+			break;
+	}
+
+	if (!rec)
+	{
+		rec = ls_calloc(1, sizeof(struct ls_epoch_record));
+		if (!rec)
+			return NULL;
+
+		rec->in_use = 1;
+
+		do
+		{
+			head = ls_atomic_loadptr(&_records);
+			rec->next = head;
+		} while (!ls_atomic_casptr(&_records, head, rec));
+	}
+
+	// release the record when the thread exits
+#if LS_WINDOWS
+	InitOnceExecuteOnce(&_exit_once, &ls_epoch_init_exit, NULL, NULL);
+	if (_exit_index != FLS_OUT_OF_INDEXES)
+		(void)FlsSetValue(_exit_index, rec);
+#else
+	(void)pthread_once(&_exit_once, &ls_epoch_init_exit);
+	if (_exit_key_valid)
+		(void)pthread_setspecific(_exit_key, rec);
+#endif // LS_WINDOWS
+
+	_record = rec;
+	return rec;
+}
+
+//! \brief Advance the global epoch if every thread inside a critical
+//! section observed the current one.
+//!
+//! \return 1 if the epoch was advanced, 0 otherwise.
+static int ls_epoch_try_advance(void)
+{
+	struct ls_epoch_record *rec;
+	int64_t epoch, state;
+
+	epoch = ls_atomic_load64(&_global_epoch);
+
+	for (rec = ls_atomic_loadptr(&_records); rec; rec = rec->next)
+	{
+		state = ls_atomic_load64(&rec->state);
+		if ((state & 1) && (state >> 1) != epoch)
+			return 0;
+	}
+
+	if (!ls_atomic_cas64(&_global_epoch, epoch, epoch + 1))
+		return 0;
+
+	// release memory left behind by exited threads
+	for (rec = ls_atomic_loadptr(&_records); rec; rec = rec->next)
+	{
+		if (ls_atomic_load32(&rec->in_use) != 0 || !ls_record_has_retired(rec))
+			continue;
+
+		if (ls_atomic_cas32(&rec->in_use, 0, 1))
+		{
+			ls_record_reclaim(rec, epoch + 1);
+			ls_atomic_store32(&rec->in_use, 0);
+		}
+	}
+
+	return 1;
+}
+
+int ls_epoch_enter(void)
+{
+	struct ls_epoch_record *rec;
+
+	rec = ls_epoch_self();
+	if (!rec)
+		return -1;
+
+	if (rec->depth++ == 0)
+	{
+		// the store must be visible before any shared memory is read
+		(void)ls_atomic_xchg64(&rec->state, (ls_atomic_load64(&_global_epoch) << 1) | 1);
+	}
+
+	return 0;
+}
+
+void ls_epoch_leave(void)
+{
+	struct ls_epoch_record *rec = _record;
+
+	if (!rec || rec->depth == 0)
+		return;
+
+	if (--rec->depth == 0)
+		ls_atomic_store64(&rec->state, 0);
+}
+
+int ls_epoch_retire(void *ptr, ls_epoch_free_t free_fn)
+{
+	struct ls_epoch_record *rec;
+	struct ls_limbo *limbo;
+	struct ls_retired *items;
+	size_t capacity;
+	int64_t epoch;
+
+	if (!ptr)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	rec = ls_epoch_self();
+	if (!rec)
+		return -1;
+
+	epoch = ls_atomic_load64(&_global_epoch);
+	limbo = &rec->limbo[epoch % NUM_LIMBO];
+
+	if (limbo->epoch != epoch)
+	{
+		// holds memory of three or more epochs ago
+		ls_limbo_drain(limbo);
+		limbo->epoch = epoch;
+	}
+
+	if (limbo->count == limbo->capacity)
+	{
+		capacity = limbo->capacity ? limbo->capacity * 2 : 16;
+		items = ls_realloc(limbo->items, capacity * sizeof(struct ls_retired));
+		if (!items)
+			return -1;
+
+		limbo->items = items;
+		limbo->capacity = capacity;
+	}
+
+	limbo->items[limbo->count].ptr = ptr;
+	limbo->items[limbo->count].free_fn = free_fn ? free_fn : &ls_free;
+	limbo->count++;
+
+	if (++rec->retired >= ADVANCE_THRESHOLD)
+	{
+		rec->retired = 0;
+		if (ls_epoch_try_advance())
+			ls_record_reclaim(rec, ls_atomic_load64(&_global_epoch));
+	}
+
+	return 0;
+}
+
+int ls_epoch_synchronize(void)
+{
+	struct ls_epoch_record *rec;
+	int64_t target;
+
+	rec = ls_epoch_self();
+	if (!rec)
+		return -1;
+
+	// would wait for itself
+	if (rec->depth != 0)
+		return ls_set_errno(LS_DEADLOCK);
+
+	target = ls_atomic_load64(&_global_epoch) + 2;
+	while (ls_atomic_load64(&_global_epoch) < target)
+	{
+		if (!ls_epoch_try_advance())
+			ls_yield();
+	}
+
+	rec->retired = 0;
+	ls_record_reclaim(rec, ls_atomic_load64(&_global_epoch));
+
+	return 0;
+}
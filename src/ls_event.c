@@ -1,20 +1,145 @@
 #include <lysys/ls_event.h>
 
 #include <time.h>
+#include <stdint.h>
 
 #include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
 
 #include "ls_native.h"
 #include "ls_handle.h"
 #include "ls_sync_util.h"
 #include "ls_event_priv.h"
+#include "ls_atomic.h"
+#include "ls_futex.h"
+
+#if LS_LINUX
+#include <sys/eventfd.h>
+#endif // LS_LINUX
+
+#if !LS_WINDOWS
+static void ls_event_notify(struct ls_event *ev)
+{
+#if LS_LINUX
+    uint64_t one = 1;
+#else
+    char one = 1;
+#endif // LS_LINUX
+
+    if (ls_atomic_load32(&ev->pollfd) == -1)
+        return;
+
+    // a full pipe or counter is already readable
+    (void)write(ev->writefd, &one, sizeof(one));
+}
+
+static void ls_event_drain(struct ls_event *ev)
+{
+    int fd;
+#if LS_LINUX
+    uint64_t value;
+#else
+    char buf[64];
+#endif // LS_LINUX
+
+    fd = ls_atomic_load32(&ev->pollfd);
+    if (fd == -1)
+        return;
+
+#if LS_LINUX
+    (void)read(fd, &value, sizeof(value));
+#else
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+#endif // LS_LINUX
+
+    // a set which notified before the drain must remain visible
+    if (ls_atomic_load32(&ev->signaled))
+        ls_event_notify(ev);
+}
+
+static int ls_event_consume(struct ls_event *ev)
+{
+    if (!(ev->flags & LS_EVENT_AUTO_RESET))
+        return ls_atomic_load32(&ev->signaled);
+
+    if (!ls_atomic_cas32(&ev->signaled, 1, 0))
+        return 0;
+
+    ls_event_drain(ev);
+    return 1;
+}
+
+static intptr_t ls_event_pollfd(struct ls_event *ev)
+{
+    int fd;
+#if !LS_LINUX
+    int fds[2];
+#endif // !LS_LINUX
+
+    fd = ls_atomic_load32(&ev->pollfd);
+    if (fd != -1)
+        return fd;
+
+    lock_lock(&ev->lock);
+
+    fd = ev->pollfd;
+    if (fd != -1)
+    {
+        lock_unlock(&ev->lock);
+        return fd;
+    }
+
+#if LS_LINUX
+    fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd == -1)
+    {
+        lock_unlock(&ev->lock);
+        return ls_set_errno_errno(errno);
+    }
+
+    ev->writefd = fd;
+#else
+    if (pipe(fds) == -1)
+    {
+        lock_unlock(&ev->lock);
+        return ls_set_errno_errno(errno);
+    }
+
+    (void)fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    (void)fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    (void)fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    (void)fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+    ev->writefd = fds[1];
+    fd = fds[0];
+#endif // LS_LINUX
+
+    (void)ls_atomic_xchg32(&ev->pollfd, fd);
+
+    // a set which ran before the descriptor was published skipped it
+    if (ls_atomic_load32(&ev->signaled))
+        ls_event_notify(ev);
+
+    lock_unlock(&ev->lock);
+
+    return fd;
+}
+
+#endif // !LS_WINDOWS
 
 static void ls_event_dtor(struct ls_event *ev)
 {
 #if LS_WINDOWS
     CloseHandle(ev->hEvent);
 #else
-    cond_destroy(&ev->cond);
+    if (ev->pollfd != -1)
+    {
+        if (ev->writefd != ev->pollfd)
+            close(ev->writefd);
+        close(ev->pollfd);
+    }
+
     lock_destroy(&ev->lock);
 #endif // LS_WINDOWS
 }
@@ -34,37 +159,85 @@ static int ls_event_wait(struct ls_event *ev, unsigned long ms)
 
     return ls_set_errno_win32(GetLastError());
 #else
-    int rc;
-    struct timespec ts;
+    long long deadline, remain;
 
-    lock_lock(&ev->lock);
+    // uncontended path, never enters the kernel
+    if (ls_event_consume(ev))
+        return 0;
+
+    if (ms == 0)
+    {
+        // clear a stale hint so the descriptor stops polling readable
+        ls_event_drain(ev);
+        return ls_event_consume(ev) ? 0 : 1;
+    }
 
-    while (!ev->signaled)
-        cond_wait(&ev->cond, &ev->lock, ms);
+    deadline = ls_nanotime() + (long long)ms * 1000000;
 
-    lock_unlock(&ev->lock);
+    // advertise before rechecking, pairs with the fence in ls_event_set
+    ls_atomic_add32(&ev->nwaiters, 1);
+    ls_atomic_fence();
+
+    while (!ls_event_consume(ev))
+    {
+        if (ms == LS_INFINITE)
+        {
+            (void)ls_futex_wait(&ev->signaled, 0, LS_INFINITE);
+            continue;
+        }
+
+        remain = deadline - ls_nanotime();
+        if (remain <= 0)
+        {
+            ls_atomic_add32(&ev->nwaiters, -1);
+            return 1;
+        }
+
+        (void)ls_futex_wait(&ev->signaled, 0, (unsigned long)((remain + 999999) / 1000000));
+    }
 
-    return rc;
+    ls_atomic_add32(&ev->nwaiters, -1);
+    return 0;
 #endif // LS_WINDOWS
 }
 
+#if LS_WINDOWS
+static intptr_t ls_event_pollfd(struct ls_event *ev)
+{
+    return (intptr_t)ev->hEvent;
+}
+#endif // LS_WINDOWS
+
 static const struct ls_class EventClass = {
     .type = LS_EVENT,
     .cb = sizeof(struct ls_event),
     .dtor = (ls_dtor_t)&ls_event_dtor,
-    .wait = (ls_wait_t)&ls_event_wait
+    .wait = (ls_wait_t)&ls_event_wait,
+    .pollfd = (ls_pollfd_t)&ls_event_pollfd
 };
 
 ls_handle ls_event_create(void)
+{
+    return ls_event_create_ex(0);
+}
+
+ls_handle ls_event_create_ex(int flags)
 {
 #if LS_WINDOWS
     struct ls_event *ev;
 
+    if (flags & ~LS_EVENT_AUTO_RESET)
+    {
+        ls_set_errno(LS_INVALID_ARGUMENT);
+        return NULL;
+    }
+
     ev = ls_handle_create(&EventClass, 0);
     if (!ev)
         return NULL;
 
-    ev->hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    ev->flags = flags;
+    ev->hEvent = CreateEventW(NULL, !(flags & LS_EVENT_AUTO_RESET), FALSE, NULL);
     if (!ev->hEvent)
     {
         ls_set_errno_win32(GetLastError());
@@ -75,26 +248,26 @@ ls_handle ls_event_create(void)
     return ev;
 #else
     struct ls_event *ev;
-    int rc;
+
+    if (flags & ~LS_EVENT_AUTO_RESET)
+    {
+        ls_set_errno(LS_INVALID_ARGUMENT);
+        return NULL;
+    }
 
     ev = ls_handle_create(&EventClass, 0);
     if (!ev)
         return NULL;
 
-    rc = lock_init(&ev->lock);
-    if (rc != 0)
+    if (lock_init(&ev->lock) != 0)
     {
         ls_handle_dealloc(ev);
         return NULL;
     }
 
-    rc = cond_init(&ev->cond);
-    if (rc != 0)
-    {
-        lock_destroy(&ev->lock);
-        ls_handle_dealloc(ev);
-        return NULL;
-    }
+    ev->flags = flags;
+    ev->pollfd = -1;
+    ev->writefd = -1;
 
     return ev;
 #endif // LS_WINDOWS
@@ -107,19 +280,21 @@ int ls_event_signaled(ls_handle evt)
 
     if (ls_type_check(evt, LS_EVENT))
 		return -1;
-    return WaitForSingleObject(ev->hEvent, 0) == WAIT_OBJECT_0;
+
+    if (WaitForSingleObject(ev->hEvent, 0) != WAIT_OBJECT_0)
+        return 0;
+
+    // checking an auto-reset event consumes the signal, restore it; this
+    // is not atomic, a concurrent wait or reset can observe the gap
+    if (ev->flags & LS_EVENT_AUTO_RESET)
+        (void)SetEvent(ev->hEvent);
+    return 1;
 #else
     struct ls_event *ev = evt;
-    int rc;
 
     if (ls_type_check(evt, LS_EVENT))
         return -1;
-
-    lock_lock(&ev->lock);
-    rc = ev->signaled;
-    lock_unlock(&ev->lock);
-
-    return rc;
+    return ls_atomic_load32(&ev->signaled);
 #endif // LS_WINDOWS
 }
 
@@ -138,15 +313,17 @@ int ls_event_set(ls_handle evt)
     return 0;
 #else
     struct ls_event *ev = evt;
-    int rc;
 
     if (ls_type_check(evt, LS_EVENT))
         return -1;
 
-    lock_lock(&ev->lock);
-    ev->signaled = 1;
-    cond_broadcast(&ev->cond);
-    lock_unlock(&ev->lock);
+    if (ls_atomic_xchg32(&ev->signaled, 1) == 0)
+        ls_event_notify(ev);
+
+    // pairs with the fence in ls_event_wait
+    ls_atomic_fence();
+    if (ls_atomic_load32(&ev->nwaiters) != 0)
+        ls_futex_wake(&ev->signaled, !(ev->flags & LS_EVENT_AUTO_RESET));
 
     return 0;
 #endif // LS_WINDOWS
@@ -167,14 +344,12 @@ int ls_event_reset(ls_handle evt)
     return 0;
 #else
     struct ls_event *ev = evt;
-    int rc;
 
     if (ls_type_check(evt, LS_EVENT))
         return -1;
 
-    lock_lock(&ev->lock);
-    ev->signaled = 0;
-    lock_unlock(&ev->lock);
+    if (ls_atomic_xchg32(&ev->signaled, 0) == 1)
+        ls_event_drain(ev);
 
     return 0;
 #endif // LS_WINDOWS
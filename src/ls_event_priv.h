@@ -8,10 +8,17 @@ struct ls_event
 {
 #if LS_WINDOWS
     HANDLE hEvent;
+    int flags;
 #else
-    ls_lock_t lock;
-    ls_cond_t cond;
-    int signaled;
+    volatile int32_t signaled;
+    volatile int32_t nwaiters; // threads which may be blocked on signaled
+    int flags;
+
+    // descriptor readable while the event is signaled, created for
+    // the first multi-object wait, -1 until then
+    volatile int32_t pollfd;
+    int writefd; // write end of pollfd, same descriptor on Linux
+    ls_lock_t lock; // serializes creation of pollfd
 #endif // LS_WINDOWS
 };
 
@@ -1,3 +1,7 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // preadv2, pwritev2
+#endif
+
 #include <lysys/ls_file.h>
 
 #include <lysys/ls_core.h>
@@ -20,6 +24,16 @@
 #include "ls_util.h"
 #include "ls_file_priv.h"
 #include "ls_event_priv.h"
+#include "ls_sched_priv.h"
+
+#if LS_LINUX
+#include <sys/eventfd.h>
+#endif // LS_LINUX
+
+#if LS_POSIX
+#include <poll.h>
+#include <sys/uio.h>
+#endif // LS_POSIX
 
 #if LS_WINDOWS
 #define PIPE_BUF_SIZE 4096
@@ -42,11 +56,21 @@ static void ls_file_dtor(ls_file_t *pf)
 #endif // LS_WINDOWS
 }
 
+static intptr_t ls_file_pollfd(ls_file_t *pf)
+{
+#if LS_WINDOWS
+	return -1;
+#else
+	return pf->fd;
+#endif // LS_WINDOWS
+}
+
 static const struct ls_class FileClass = {
 	.type = LS_FILE,
 	.cb = sizeof(ls_file_t),
 	.dtor = (ls_dtor_t)&ls_file_dtor,
-	.wait = NULL
+	.wait = NULL,
+	.pollfd = (ls_pollfd_t)&ls_file_pollfd
 };
 
 ls_handle ls_open(const char *path, int access, int share, int create)
@@ -111,6 +135,22 @@ ls_handle ls_open(const char *path, int access, int share, int create)
 #endif // LS_WINDOWS
 }
 
+#if !LS_WINDOWS
+
+ls_handle ls_file_from_fd(int fd, int access)
+{
+	ls_file_t *pf;
+
+	pf = ls_handle_create(&FileClass, access);
+	if (!pf)
+		return NULL;
+
+	pf->fd = fd;
+	return pf;
+}
+
+#endif // !LS_WINDOWS
+
 int64_t ls_seek(ls_handle file, int64_t offset, int origin)
 {
 #if LS_WINDOWS
@@ -153,6 +193,94 @@ int64_t ls_seek(ls_handle file, int64_t offset, int origin)
 #endif // LS_WINDOWS
 }
 
+#if !LS_WINDOWS
+
+//! \brief Check whether a task can wait for a descriptor to become
+//! ready, regular files always report ready and block instead.
+static int ls_fd_pollable(int fd)
+{
+	struct stat st;
+
+	if (fstat(fd, &st) == -1)
+		return 0;
+	return !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode);
+}
+
+//! \brief Read or write once without blocking.
+//!
+//! \return The number of bytes transferred, or -1 with errno set to
+//! EAGAIN if the descriptor is not ready.
+static ssize_t ls_fd_nowait(int fd, void *buffer, size_t size, int out)
+{
+	struct iovec iov;
+	struct pollfd pfd;
+	ssize_t rc;
+	int fl;
+
+	iov.iov_base = buffer;
+	iov.iov_len = size;
+
+#if LS_LINUX && defined(RWF_NOWAIT)
+	// does not change the descriptor, which may be shared
+	if (out)
+		rc = pwritev2(fd, &iov, 1, -1, RWF_NOWAIT);
+	else
+		rc = preadv2(fd, &iov, 1, -1, RWF_NOWAIT);
+
+	if (rc != -1 || (errno != EOPNOTSUPP && errno != ENOSYS))
+		return rc;
+#endif // LS_LINUX && RWF_NOWAIT
+
+	// a blocking descriptor is only used once it reports ready, which
+	// may still block if another reader or writer gets there first
+	fl = fcntl(fd, F_GETFL);
+	if (fl != -1 && !(fl & O_NONBLOCK))
+	{
+		pfd.fd = fd;
+		pfd.events = out ? POLLOUT : POLLIN;
+		pfd.revents = 0;
+
+		rc = poll(&pfd, 1, 0);
+		if (rc == -1)
+			return -1;
+
+		if (rc == 0)
+		{
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	return out ? write(fd, buffer, size) : read(fd, buffer, size);
+}
+
+//! \brief Read or write once, suspending only the calling task until
+//! the descriptor is ready.
+//!
+//! \return The number of bytes transferred, or -1 on failure.
+static size_t ls_task_transfer(int fd, void *buffer, size_t size, int out)
+{
+	ssize_t rc;
+
+	for (;;)
+	{
+		rc = ls_fd_nowait(fd, buffer, size, out);
+		if (rc != -1)
+			return (size_t)rc;
+
+		if (errno == EINTR)
+			continue;
+
+		if (errno != EAGAIN)
+			return ls_set_errno(ls_errno_to_error(errno));
+
+		if (ls_task_wait_fd(fd, out ? LS_POLL_OUT : LS_POLL_IN, LS_INFINITE) == -1)
+			return -1;
+	}
+}
+
+#endif // !LS_WINDOWS
+
 size_t ls_read(ls_handle fh, void *buffer, size_t size)
 {
 #if LS_WINDOWS
@@ -196,6 +324,7 @@ size_t ls_read(ls_handle fh, void *buffer, size_t size)
 	size_t bytes_read;
 	size_t remaining;
 	int flags;
+	int io_active;
 
 	if (LS_HANDLE_IS_TYPE(fh, LS_SOCKET))
 		return ls_net_recv(fh, buffer, size);
@@ -213,11 +342,22 @@ size_t ls_read(ls_handle fh, void *buffer, size_t size)
 	if (!(flags & LS_FILE_READ))
 		return ls_set_errno(LS_INVALID_ARGUMENT);
 
+	io_active = ls_task_io_active() && ls_fd_pollable(pf->fd);
+
 	remaining = size;
 	while (remaining != 0)
 	{
-		bytes_read = (size_t)read(pf->fd, buffer, remaining);
-		if (bytes_read == -1)
+		// must not block the worker of a task
+		if (io_active)
+		{
+			bytes_read = ls_task_transfer(pf->fd, buffer, remaining, 0);
+			if (bytes_read == (size_t)-1)
+				return -1;
+		}
+		else
+			bytes_read = (size_t)read(pf->fd, buffer, remaining);
+
+		if (bytes_read == (size_t)-1)
 		{
 			if (errno == EAGAIN)
 				continue;
@@ -276,6 +416,7 @@ size_t ls_write(ls_handle fh, const void *buffer, size_t size)
 	size_t bytes_written;
 	size_t remaining;
 	int flags;
+	int io_active;
 
 	if (LS_HANDLE_IS_TYPE(fh, LS_SOCKET))
 		return ls_net_send(fh, buffer, size);
@@ -293,11 +434,22 @@ size_t ls_write(ls_handle fh, const void *buffer, size_t size)
 	if (!(flags & LS_FILE_WRITE))
 		return ls_set_errno(LS_INVALID_ARGUMENT);
 
+	io_active = ls_task_io_active() && ls_fd_pollable(pf->fd);
+
 	remaining = size;
 	while (remaining != 0)
 	{
-		bytes_written = (size_t)write(pf->fd, buffer, remaining);
-		if (bytes_written == -1)
+		// must not block the worker of a task
+		if (io_active)
+		{
+			bytes_written = ls_task_transfer(pf->fd, (void *)buffer, remaining, 1);
+			if (bytes_written == (size_t)-1)
+				return -1;
+		}
+		else
+			bytes_written = (size_t)write(pf->fd, buffer, remaining);
+
+		if (bytes_written == (size_t)-1)
 		{
 			if (errno == EAGAIN)
 				continue;
@@ -370,6 +522,9 @@ struct ls_aio
 	size_t bytes_transferred;
 	int status;
 	int error;
+#if LS_LINUX
+	int ready; // eventfd readable while no operation is pending
+#endif // LS_LINUX
 #endif // LS_WINDOWS
 };
 
@@ -377,6 +532,9 @@ static void ls_aio_dtor(struct ls_aio *aio)
 {
 #if LS_WINDOWS
 #else
+#if LS_LINUX
+	close(aio->ready);
+#endif // LS_LINUX
 	cond_destroy(&aio->cond);
 	lock_destroy(&aio->lock);
 #endif // LS_WINDOWS
@@ -419,6 +577,19 @@ static int ls_aio_wait(struct ls_aio *aio, unsigned long ms)
 
 #if LS_POSIX
 
+// aio->lock must be held, call after changing aio->status
+static void ls_aio_sync_ready(struct ls_aio *aio)
+{
+#if LS_LINUX
+	eventfd_t value;
+
+	if (aio->status == LS_AIO_PENDING)
+		(void)eventfd_read(aio->ready, &value);
+	else
+		(void)eventfd_write(aio->ready, 1);
+#endif // LS_LINUX
+}
+
 static void ls_aio_update_status(struct ls_aio *aio, int status)
 {
 	if (aio->status == status)
@@ -437,6 +608,7 @@ static void ls_aio_update_status(struct ls_aio *aio, int status)
 		}
 	}
 
+	ls_aio_sync_ready(aio);
 	cond_broadcast(&aio->cond);
 }
 
@@ -486,11 +658,23 @@ static void ls_aio_handler(union sigval sv)
 
 #endif // LS_POSIX
 
+static intptr_t ls_aio_pollfd(struct ls_aio *aio)
+{
+#if LS_WINDOWS
+	return (intptr_t)aio->ov.hEvent;
+#elif LS_LINUX
+	return aio->ready;
+#else
+	return -1;
+#endif // LS_WINDOWS
+}
+
 static const struct ls_class AioClass = {
 	.type = LS_AIO,
 	.cb = sizeof(struct ls_aio),
 	.dtor = (ls_dtor_t)&ls_aio_dtor,
-	.wait = (ls_wait_t)&ls_aio_wait
+	.wait = (ls_wait_t)&ls_aio_wait,
+	.pollfd = (ls_pollfd_t)&ls_aio_pollfd
 };
 
 ls_handle ls_aio_open(ls_handle fh)
@@ -570,6 +754,19 @@ ls_handle ls_aio_open(ls_handle fh)
 		return NULL;
 	}
 
+#if LS_LINUX
+	// no operation is pending yet
+	aio->ready = eventfd(1, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (aio->ready == -1)
+	{
+		ls_set_errno_errno(errno);
+		cond_destroy(&aio->cond);
+		lock_destroy(&aio->lock);
+		ls_handle_dealloc(aio);
+		return NULL;
+	}
+#endif // LS_LINUX
+
 	aio->aiocb.aio_fildes = pf->fd;
 
 	// notifaction handler
@@ -671,6 +868,7 @@ int ls_aio_read(ls_handle aioh, uint64_t offset, volatile void *buffer, size_t s
 		// devnull, no need to perform any I/O
 		aio->status = LS_AIO_COMPLETED;
 		aio->bytes_transferred = 0;
+		ls_aio_sync_ready(aio);
 		cond_broadcast(&aio->cond);
 		lock_unlock(&aio->lock);
 		return 0;
@@ -689,6 +887,7 @@ int ls_aio_read(ls_handle aioh, uint64_t offset, volatile void *buffer, size_t s
 	}
 
 	aio->status = LS_AIO_PENDING;
+	ls_aio_sync_ready(aio);
 
 	lock_unlock(&aio->lock);
 
@@ -773,6 +972,7 @@ int ls_aio_write(ls_handle aioh, uint64_t offset, const volatile void *buffer, s
 		// devnull, no need to perform any I/O
 		aio->status = LS_AIO_COMPLETED;
 		aio->bytes_transferred = size;
+		ls_aio_sync_ready(aio);
 		cond_broadcast(&aio->cond);
 		lock_unlock(&aio->lock);
 		return 0;
@@ -791,6 +991,7 @@ int ls_aio_write(ls_handle aioh, uint64_t offset, const volatile void *buffer, s
 	}
 
 	aio->status = LS_AIO_PENDING;
+	ls_aio_sync_ready(aio);
 
 	lock_unlock(&aio->lock);
 
@@ -1194,11 +1395,21 @@ static void ls_pipe_dtor(ls_pipe_t *pp)
 #endif // LS_WINDOWS
 }
 
+static intptr_t ls_pipe_pollfd(ls_pipe_t *pp)
+{
+#if LS_WINDOWS
+	return -1;
+#else
+	return pp->fd;
+#endif // LS_WINDOWS
+}
+
 static const struct ls_class PipeClass = {
 	.type = LS_PIPE,
 	.cb = sizeof(ls_pipe_t),
 	.dtor = (ls_dtor_t)&ls_pipe_dtor,
-	.wait = NULL
+	.wait = NULL,
+	.pollfd = (ls_pollfd_t)&ls_pipe_pollfd
 };
 
 int ls_pipe(ls_handle *read, ls_handle *write, int flags)
@@ -1298,11 +1509,11 @@ int ls_pipe(ls_handle *read, ls_handle *write, int flags)
 	if (!read || !write)
 		return ls_set_errno(LS_INVALID_ARGUMENT);
 
-	pread = ls_handle_create(&FileClass, 0);
+	pread = ls_handle_create(&FileClass, LS_FILE_READ);
 	if (!pread)
 		return -1;
 
-	pwrite = ls_handle_create(&FileClass, 0);
+	pwrite = ls_handle_create(&FileClass, LS_FILE_WRITE);
 	if (!pwrite)
 	{
 		rc = _ls_errno;
@@ -41,4 +41,17 @@ ls_file_t *ls_resolve_file(ls_handle fh, int *flags);
 
 ls_pipe_t *ls_resolve_pipe(ls_handle fh, int *flags);
 
+#if !LS_WINDOWS
+
+//! \brief Create a file handle which owns a file descriptor.
+//! 
+//! \param fd The file descriptor, closed with the handle.
+//! \param access The LS_FILE_* access flags of the descriptor.
+//! 
+//! \return The file handle, or NULL on failure, in which case the
+//! descriptor is not closed.
+ls_handle ls_file_from_fd(int fd, int access);
+
+#endif // !LS_WINDOWS
+
 #endif // _LS_FILE_PRIV_H_
@@ -0,0 +1,128 @@
+#include "ls_futex.h"
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+
+#include "ls_atomic.h"
+
+#if LS_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#elif LS_POSIX
+#include <pthread.h>
+
+#define NUM_BUCKETS 64
+
+struct ls_futex_bucket
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static struct ls_futex_bucket _buckets[NUM_BUCKETS];
+static pthread_once_t _buckets_once = PTHREAD_ONCE_INIT;
+
+static void ls_futex_init_buckets(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_BUCKETS; i++)
+	{
+		pthread_mutex_init(&_buckets[i].lock, NULL);
+		pthread_cond_init(&_buckets[i].cond, NULL);
+	}
+}
+
+static struct ls_futex_bucket *ls_futex_bucket(volatile int32_t *addr)
+{
+	uintptr_t h;
+
+	(void)pthread_once(&_buckets_once, &ls_futex_init_buckets);
+
+	h = (uintptr_t)addr >> 2;
+	h ^= h >> 7;
+	return &_buckets[h % NUM_BUCKETS];
+}
+#endif // LS_LINUX
+
+int ls_futex_wait(volatile int32_t *addr, int32_t expected, unsigned long ms)
+{
+#if LS_WINDOWS
+	if (WaitOnAddress(addr, &expected, sizeof(int32_t), ms))
+		return 0;
+	return GetLastError() == ERROR_TIMEOUT ? 1 : 0;
+#elif LS_LINUX
+	struct timespec ts, *pts;
+	long rc;
+
+	if (ms == LS_INFINITE)
+		pts = NULL;
+	else
+	{
+		ts.tv_sec = ms / 1000;
+		ts.tv_nsec = (ms % 1000) * 1000000;
+		pts = &ts;
+	}
+
+	rc = syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, pts, NULL, 0);
+	if (rc == -1 && errno == ETIMEDOUT)
+		return 1;
+	return 0; // woken, value changed, or interrupted
+#else
+	struct ls_futex_bucket *b;
+	struct timespec ts;
+	int rc = 0;
+
+	b = ls_futex_bucket(addr);
+
+	pthread_mutex_lock(&b->lock);
+
+	// wakers take the bucket lock, so the check cannot race a wake
+	if (ls_atomic_load32(addr) == expected)
+	{
+		if (ms == LS_INFINITE)
+			pthread_cond_wait(&b->cond, &b->lock);
+		else
+		{
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_sec += ms / 1000;
+			ts.tv_nsec += (ms % 1000) * 1000000;
+			if (ts.tv_nsec >= 1000000000)
+			{
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+
+			if (pthread_cond_timedwait(&b->cond, &b->lock, &ts) == ETIMEDOUT)
+				rc = 1;
+		}
+	}
+
+	pthread_mutex_unlock(&b->lock);
+
+	return rc;
+#endif // LS_WINDOWS
+}
+
+void ls_futex_wake(volatile int32_t *addr, int all)
+{
+#if LS_WINDOWS
+	if (all)
+		WakeByAddressAll((PVOID)addr);
+	else
+		WakeByAddressSingle((PVOID)addr);
+#elif LS_LINUX
+	(void)syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, NULL, NULL, 0);
+#else
+	struct ls_futex_bucket *b;
+
+	b = ls_futex_bucket(addr);
+
+	// addresses share buckets, so every waiter must recheck its value
+	pthread_mutex_lock(&b->lock);
+	pthread_cond_broadcast(&b->cond);
+	pthread_mutex_unlock(&b->lock);
+
+	(void)all;
+#endif // LS_WINDOWS
+}
@@ -0,0 +1,29 @@
+#ifndef _LS_FUTEX_H_
+#define _LS_FUTEX_H_
+
+#include "ls_native.h"
+
+//! \brief Wait while a 32-bit value is equal to an expected value.
+//!
+//! Blocks the calling thread until ls_futex_wake() is called on addr
+//! or the timeout expires. Returns immediately if *addr does not equal
+//! expected at the time of the call. Wakes may be spurious, so the
+//! caller must recheck the value upon return.
+//!
+//! Uses futex(2) on Linux and WaitOnAddress on Windows. Other
+//! platforms use a hashed table of condition variables.
+//!
+//! \param addr The address to wait on.
+//! \param expected The value *addr is expected to hold.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if woken or the value differed, 1 if the timeout expired.
+int ls_futex_wait(volatile int32_t *addr, int32_t expected, unsigned long ms);
+
+//! \brief Wake threads waiting on an address.
+//!
+//! \param addr The address.
+//! \param all Nonzero to wake all waiters, otherwise one is woken.
+void ls_futex_wake(volatile int32_t *addr, int all);
+
+#endif // _LS_FUTEX_H_
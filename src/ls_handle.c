@@ -4,8 +4,19 @@
 #include <memory.h>
 
 #include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
 
 #include "ls_native.h"
+#include "ls_sched_priv.h"
+
+#if LS_LINUX
+#include <sys/epoll.h>
+#elif LS_POSIX
+#include <poll.h>
+#endif // LS_LINUX
+
+#define TASK_POLL_MAX_DELAY 16 // ms
+#define WAIT_ANY_EVENTS 64 // descriptors reported per epoll_wait
 
 ls_handle ls_handle_create(const struct ls_class *clazz, int flags)
 {
@@ -56,6 +67,61 @@ int ls_wait(ls_handle h)
 	return ls_timedwait(h, LS_INFINITE);
 }
 
+//! \brief Wait on a handle from a task without blocking its worker.
+//!
+//! If the class provides a descriptor, the task is parked until it
+//! becomes ready. Otherwise the handle is polled, sleeping the task
+//! between polls.
+static int ls_task_timedwait(ls_handle h, const struct ls_class *clazz, unsigned long ms)
+{
+	long long deadline, remain;
+	unsigned long delay, wait_ms;
+	intptr_t fd = -1;
+	int rc;
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+	delay = 1;
+
+#if !LS_WINDOWS
+	if (clazz->pollfd)
+		fd = clazz->pollfd(h);
+#endif // !LS_WINDOWS
+
+	for (;;)
+	{
+		rc = clazz->wait(h, 0);
+		if (rc != 1)
+			return rc;
+
+		wait_ms = LS_INFINITE;
+		if (ms != LS_INFINITE)
+		{
+			remain = (deadline - ls_nanotime() + 999999) / 1000000;
+			if (remain <= 0)
+				return 1;
+			wait_ms = (unsigned long)remain;
+		}
+
+		// another waiter may consume the signal, so check again once
+		// the descriptor is ready
+		if (fd != -1)
+		{
+			rc = ls_task_wait_fd((int)fd, LS_POLL_IN, wait_ms);
+			if (rc != -1)
+				continue;
+			fd = -1;
+		}
+
+		if (delay > wait_ms)
+			delay = wait_ms;
+
+		(void)ls_task_sleep(delay);
+
+		if (delay < TASK_POLL_MAX_DELAY)
+			delay *= 2;
+	}
+}
+
 int ls_timedwait(ls_handle h, unsigned long ms)
 {
 	struct ls_handle_info *hi;
@@ -65,11 +131,346 @@ int ls_timedwait(ls_handle h, unsigned long ms)
 	
 	hi = LS_HANDLE_INFO(h);
 	if (hi->clazz->wait)
+	{
+		if (ms != 0 && !(hi->clazz->type & LS_TASK_AWARE) && ls_task_io_active())
+			return ls_task_timedwait(h, hi->clazz, ms);
 		return hi->clazz->wait(h, ms);
+	}
 
 	return ls_set_errno(LS_NOT_WAITABLE);
 }
 
+// unsigned long ms remaining until deadline, for waits which span
+// several calls
+static unsigned long ls_wait_remain(long long deadline, unsigned long ms)
+{
+	long long remain;
+
+	if (ms == LS_INFINITE)
+		return LS_INFINITE;
+
+	remain = deadline - ls_nanotime();
+	if (remain <= 0)
+		return 0;
+	return (unsigned long)((remain + 999999) / 1000000);
+}
+
+static int ls_wait_validate(const ls_handle *handles, size_t count)
+{
+	size_t i;
+
+	if (!handles || count == 0)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	for (i = 0; i < count; i++)
+	{
+		if (LS_IS_PSUEDO_HANDLE(handles[i]))
+			return ls_set_errno(LS_INVALID_HANDLE);
+
+		if (!LS_HANDLE_CLASS(handles[i])->wait)
+			return ls_set_errno(LS_NOT_WAITABLE);
+	}
+
+	return 0;
+}
+
+static int ls_wait_check(const ls_handle *handles, size_t i, size_t *index)
+{
+	int rc;
+
+	rc = LS_HANDLE_CLASS(handles[i])->wait(handles[i], 0);
+	if (rc == 0 && index)
+		*index = i;
+	return rc;
+}
+
+#if LS_WINDOWS
+
+//! \brief Wait on the handles with WaitForMultipleObjects.
+//!
+//! \return 0, 1 or -1 as ls_wait_any(), or 2 if a handle has no
+//! waitable HANDLE.
+static int ls_wait_native(const ls_handle *handles, size_t count, unsigned long ms, size_t *index, BOOL bWaitAll)
+{
+	HANDLE hHandles[MAXIMUM_WAIT_OBJECTS];
+	const struct ls_class *clazz;
+	DWORD dwResult;
+	size_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		clazz = LS_HANDLE_CLASS(handles[i]);
+		if (!clazz->pollfd)
+			return 2;
+
+		hHandles[i] = (HANDLE)clazz->pollfd(handles[i]);
+		if (!hHandles[i] || hHandles[i] == INVALID_HANDLE_VALUE)
+			return 2;
+	}
+
+	dwResult = WaitForMultipleObjects((DWORD)count, hHandles, bWaitAll, ms);
+	if (dwResult < WAIT_OBJECT_0 + count)
+	{
+		if (index)
+			*index = dwResult - WAIT_OBJECT_0;
+		return 0;
+	}
+
+	if (dwResult >= WAIT_ABANDONED_0 && dwResult < WAIT_ABANDONED_0 + count)
+	{
+		if (index)
+			*index = dwResult - WAIT_ABANDONED_0;
+		return 0;
+	}
+
+	if (dwResult == WAIT_TIMEOUT)
+		return 1;
+
+	return ls_set_errno_win32(GetLastError());
+}
+
+//! \brief Wait until one of the handles completes by polling each.
+static int ls_wait_any_poll(const ls_handle *handles, size_t count, unsigned long ms, size_t *index)
+{
+	long long deadline;
+	unsigned long remain, delay;
+	size_t i;
+	int rc;
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+	delay = 1;
+
+	for (;;)
+	{
+		remain = ls_wait_remain(deadline, ms);
+		if (remain == 0)
+			return 1;
+
+		if (delay > remain)
+			delay = remain;
+
+		ls_sleep(delay);
+
+		for (i = 0; i < count; i++)
+		{
+			rc = ls_wait_check(handles, i, index);
+			if (rc != 1)
+				return rc;
+		}
+
+		if (delay < TASK_POLL_MAX_DELAY)
+			delay *= 2;
+	}
+}
+
+#else
+
+//! \brief Wait until one of the handles completes, sleeping on their
+//! descriptors.
+//!
+//! Handles without a descriptor are checked between sleeps, which
+//! are shortened while there are any.
+static int ls_wait_any_fd(const ls_handle *handles, size_t count, unsigned long ms, size_t *index)
+{
+	const struct ls_class *clazz;
+	long long deadline;
+	unsigned long remain, delay;
+	size_t *unpolled, nunpolled;
+	size_t i, j;
+	int fd, nready, timeout;
+	int rc;
+#if LS_LINUX
+	struct epoll_event ev, evs[WAIT_ANY_EVENTS];
+	int epfd;
+#else
+	struct pollfd *pfds;
+	size_t *map;
+	nfds_t npfds;
+#endif // LS_LINUX
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	unpolled = ls_malloc(count * sizeof(size_t));
+	if (!unpolled)
+		return -1;
+	nunpolled = 0;
+
+#if LS_LINUX
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+	{
+		ls_free(unpolled);
+		return ls_set_errno_errno(errno);
+	}
+#else
+	pfds = ls_malloc(count * sizeof(struct pollfd));
+	map = ls_malloc(count * sizeof(size_t));
+	if (!pfds || !map)
+	{
+		ls_free(map);
+		ls_free(pfds);
+		ls_free(unpolled);
+		return -1;
+	}
+	npfds = 0;
+#endif // LS_LINUX
+
+	for (i = 0; i < count; i++)
+	{
+		clazz = LS_HANDLE_CLASS(handles[i]);
+		fd = clazz->pollfd ? (int)clazz->pollfd(handles[i]) : -1;
+		if (fd == -1)
+		{
+			unpolled[nunpolled++] = i;
+			continue;
+		}
+
+#if LS_LINUX
+		ev.events = EPOLLIN;
+		ev.data.u64 = i;
+
+		// a handle passed twice is already registered
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1 && errno != EEXIST)
+			unpolled[nunpolled++] = i;
+#else
+		pfds[npfds].fd = fd;
+		pfds[npfds].events = POLLIN;
+		pfds[npfds].revents = 0;
+		map[npfds] = i;
+		npfds++;
+#endif // LS_LINUX
+	}
+
+	delay = 1;
+
+	for (;;)
+	{
+		remain = ls_wait_remain(deadline, ms);
+		if (remain == 0)
+		{
+			rc = 1;
+			break;
+		}
+
+		if (nunpolled > 0 && remain > delay)
+		{
+			remain = delay;
+			if (delay < TASK_POLL_MAX_DELAY)
+				delay *= 2;
+		}
+
+		timeout = remain == LS_INFINITE ? -1 : (remain > INT_MAX ? INT_MAX : (int)remain);
+
+#if LS_LINUX
+		if (ls_task_io_active() && ls_task_wait_fd(epfd, LS_POLL_IN, remain) != -1)
+			nready = epoll_wait(epfd, evs, WAIT_ANY_EVENTS, 0);
+		else
+			nready = epoll_wait(epfd, evs, WAIT_ANY_EVENTS, timeout);
+#else
+		nready = poll(pfds, npfds, timeout);
+#endif // LS_LINUX
+
+		if (nready == -1 && errno != EINTR)
+		{
+			rc = ls_set_errno_errno(errno);
+			break;
+		}
+
+		rc = 1;
+
+#if LS_LINUX
+		for (j = 0; j < (size_t)nready && rc == 1; j++)
+			rc = ls_wait_check(handles, (size_t)evs[j].data.u64, index);
+#else
+		for (j = 0; j < npfds && nready > 0 && rc == 1; j++)
+		{
+			if (pfds[j].revents)
+				rc = ls_wait_check(handles, map[j], index);
+		}
+#endif // LS_LINUX
+
+		for (j = 0; j < nunpolled && rc == 1; j++)
+			rc = ls_wait_check(handles, unpolled[j], index);
+
+		if (rc != 1)
+			break;
+	}
+
+#if LS_LINUX
+	close(epfd);
+#else
+	ls_free(map);
+	ls_free(pfds);
+#endif // LS_LINUX
+	ls_free(unpolled);
+
+	return rc;
+}
+
+#endif // LS_WINDOWS
+
+int ls_wait_any(const ls_handle *handles, size_t count, unsigned long ms, size_t *index)
+{
+	size_t i;
+	int rc;
+
+	if (ls_wait_validate(handles, count) != 0)
+		return -1;
+
+	for (i = 0; i < count; i++)
+	{
+		rc = ls_wait_check(handles, i, index);
+		if (rc != 1)
+			return rc;
+	}
+
+	if (ms == 0)
+		return 1;
+
+#if LS_WINDOWS
+	if (count <= MAXIMUM_WAIT_OBJECTS && !ls_task_io_active())
+	{
+		rc = ls_wait_native(handles, count, ms, index, FALSE);
+		if (rc != 2)
+			return rc;
+	}
+
+	return ls_wait_any_poll(handles, count, ms, index);
+#else
+	return ls_wait_any_fd(handles, count, ms, index);
+#endif // LS_WINDOWS
+}
+
+int ls_wait_all(const ls_handle *handles, size_t count, unsigned long ms)
+{
+	long long deadline;
+	size_t i;
+	int rc;
+
+	if (ls_wait_validate(handles, count) != 0)
+		return -1;
+
+#if LS_WINDOWS
+	if (count <= MAXIMUM_WAIT_OBJECTS && !ls_task_io_active())
+	{
+		rc = ls_wait_native(handles, count, ms, NULL, TRUE);
+		if (rc != 2)
+			return rc;
+	}
+#endif // LS_WINDOWS
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	for (i = 0; i < count; i++)
+	{
+		rc = ls_timedwait(handles[i], ls_wait_remain(deadline, ms));
+		if (rc != 0)
+			return rc;
+	}
+
+	return 0;
+}
+
 void ls_close(ls_handle h)
 {
 	struct ls_handle_info *hi;
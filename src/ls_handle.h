@@ -7,6 +7,8 @@
 
 #define LS_WAITABLE 0x1000
 #define LS_IO_STREAM 0x2000
+#define LS_TASK_AWARE 0x4000 // waiting suspends only the calling task
+#define LS_IO_READY 0x8000 // waiting reports I/O readiness, consumes nothing
 
 #define LS_FILE (1 | LS_IO_STREAM)
 #define LS_FILEMAPPING 2
@@ -24,9 +26,25 @@
 #define LS_AIO (14 | LS_WAITABLE)
 #define LS_PIPE (15 | LS_IO_STREAM)
 #define LS_FIBER 16
-#define LS_SOCKET 17
-#define LS_SERVER 18
+#define LS_SOCKET (17 | LS_WAITABLE | LS_TASK_AWARE | LS_IO_READY)
+#define LS_SERVER (18 | LS_WAITABLE | LS_TASK_AWARE | LS_IO_READY)
 #define LS_MEDIAPLAYER 19
+#define LS_SCHED (20 | LS_WAITABLE)
+#define LS_TASK (21 | LS_WAITABLE | LS_TASK_AWARE)
+#define LS_FLS 22
+#define LS_TASK_LOCK 23
+#define LS_TASK_COND 24
+#define LS_TASK_EVENT (25 | LS_WAITABLE | LS_TASK_AWARE)
+#define LS_CHANNEL 26
+#define LS_RWLOCK 27
+#define LS_LOOP 28
+#define LS_TIMER (29 | LS_WAITABLE | LS_TASK_AWARE)
+#define LS_BARRIER 30
+#define LS_LATCH (31 | LS_WAITABLE)
+#define LS_QUEUE (32 | LS_WAITABLE)
+#define LS_SPSC_RING (33 | LS_WAITABLE)
+#define LS_RESOLVE (34 | LS_WAITABLE)
+#define LS_CONNPOOL 35
 
 // handle is statically allocated, will never have memory deallocated
 // or destructor called
@@ -58,6 +76,11 @@
 typedef void(*ls_dtor_t)(void *ptr);
 typedef int(*ls_wait_t)(void *ptr, unsigned long ms);
 
+// descriptor which becomes ready when a wait on the handle may
+// complete, or the underlying descriptor of an I/O handle, a file
+// descriptor on POSIX or a HANDLE on Windows, -1 if there is none
+typedef intptr_t(*ls_pollfd_t)(void *ptr);
+
 //! \brief Class structure
 struct ls_class
 {
@@ -65,6 +88,12 @@ struct ls_class
 	uint32_t cb;	//!< Size of class data
 	ls_dtor_t dtor;	//!< Destructor. If NULL, no destructor is called.
 	ls_wait_t wait;	//!< Wait. If type is waitable, this must not be NULL.
+
+	//! Descriptor for multi-object waits and event loops, may be
+	//! NULL. For waitable types, after it becomes ready a wait with a
+	//! timeout of 0 must either complete or leave the descriptor not
+	//! ready.
+	ls_pollfd_t pollfd;
 };
 
 //! \brief Handle information.
@@ -0,0 +1,723 @@
+#include <lysys/ls_loop.h>
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_file.h>
+#include <lysys/ls_memory.h>
+#include <lysys/ls_time.h>
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ls_handle.h"
+#include "ls_native.h"
+#include "ls_atomic.h"
+#include "ls_file_priv.h"
+#include "ls_sched_priv.h"
+#include "ls_timer_wheel.h"
+
+#if LS_LINUX
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <pthread.h>
+#endif // LS_LINUX
+
+#define MAX_EVENTS 64
+
+// source types
+#define SOURCE_IO 0
+#define SOURCE_WAIT 1
+#define SOURCE_TIMER 2
+#define SOURCE_SIGNAL 3
+
+// ids are the slot index combined with a generation, so stale ids and
+// stale epoll events of removed sources are recognized
+#define ID_INDEX_BITS 20
+#define ID_INDEX_MASK ((1 << ID_INDEX_BITS) - 1)
+#define ID_GEN_MASK 0x7ff
+
+#define WAKE_DATA UINT64_MAX // epoll data of the wake descriptor
+
+struct ls_loop_source
+{
+	int type;
+	int id;
+	int events; // LS_LOOP_* flags the source was added with
+	int fd; // -1 for timers
+	ls_handle h; // NULL for timers and signals
+
+	ls_loop_func_t func;
+	void *up;
+
+	// timers
+	struct ls_wheel_entry entry;
+	uint64_t period; // milliseconds, 0 if not periodic
+
+	// signals
+	int signum;
+};
+
+struct ls_loop_slot
+{
+	struct ls_loop_source *src; // NULL if free
+	int gen;
+	int next_free; // next free slot, -1 for the last one
+};
+
+struct ls_loop
+{
+#if LS_LINUX
+	int epfd;
+	int evfd; // wakes the loop from ls_loop_stop()
+	sigset_t signals; // signals with a source
+#endif // LS_LINUX
+
+	volatile int32_t stop;
+
+	struct ls_loop_slot *slots;
+	int nslots, cap;
+	int free_head;
+
+	// timers, one tick per millisecond
+	struct ls_timer_wheel wheel;
+	uint64_t tick; // tick the wheel is being advanced to
+};
+
+#if LS_LINUX
+
+static uint64_t ls_loop_tick(void)
+{
+	return (uint64_t)ls_nanotime() / 1000000;
+}
+
+static struct ls_loop_source *ls_loop_lookup(struct ls_loop *loop, int id)
+{
+	int index;
+	struct ls_loop_slot *slot;
+
+	if (id < 0)
+		return NULL;
+
+	index = id & ID_INDEX_MASK;
+	if (index >= loop->nslots)
+		return NULL;
+
+	slot = &loop->slots[index];
+	if (!slot->src || slot->src->id != id)
+		return NULL;
+	return slot->src;
+}
+
+//! \brief Allocate a source and assign it an id.
+static struct ls_loop_source *ls_loop_alloc(struct ls_loop *loop, int type, ls_loop_func_t func, void *up)
+{
+	struct ls_loop_source *src;
+	struct ls_loop_slot *slots, *slot;
+	int index, cap;
+
+	if (loop->free_head == -1)
+	{
+		if (loop->nslots == loop->cap)
+		{
+			if (loop->cap > ID_INDEX_MASK / 2)
+			{
+				ls_set_errno(LS_OUT_OF_MEMORY);
+				return NULL;
+			}
+
+			cap = loop->cap ? loop->cap * 2 : 16;
+			slots = ls_realloc(loop->slots, cap * sizeof(struct ls_loop_slot));
+			if (!slots)
+				return NULL;
+
+			loop->slots = slots;
+			loop->cap = cap;
+		}
+
+		index = loop->nslots++;
+		slot = &loop->slots[index];
+		slot->src = NULL;
+		slot->gen = 1;
+		slot->next_free = -1;
+	}
+	else
+	{
+		index = loop->free_head;
+		slot = &loop->slots[index];
+		loop->free_head = slot->next_free;
+	}
+
+	src = ls_calloc(1, sizeof(struct ls_loop_source));
+	if (!src)
+	{
+		slot->next_free = loop->free_head;
+		loop->free_head = index;
+		return NULL;
+	}
+
+	src->type = type;
+	src->id = (slot->gen << ID_INDEX_BITS) | index;
+	src->fd = -1;
+	src->func = func;
+	src->up = up;
+	ls_wheel_entry_init(&src->entry);
+
+	slot->src = src;
+
+	return src;
+}
+
+//! \brief Free a source which is not registered with the loop.
+static void ls_loop_free(struct ls_loop *loop, struct ls_loop_source *src)
+{
+	struct ls_loop_slot *slot;
+	int index;
+
+	index = src->id & ID_INDEX_MASK;
+	slot = &loop->slots[index];
+
+	slot->src = NULL;
+	slot->gen = (slot->gen + 1) & ID_GEN_MASK;
+	if (slot->gen == 0)
+		slot->gen = 1;
+
+	slot->next_free = loop->free_head;
+	loop->free_head = index;
+
+	ls_free(src);
+}
+
+//! \brief Detach a source from the loop and free it.
+static void ls_loop_release(struct ls_loop *loop, struct ls_loop_source *src)
+{
+	switch (src->type)
+	{
+	case SOURCE_IO:
+	case SOURCE_WAIT:
+		(void)epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+		break;
+	case SOURCE_TIMER:
+		ls_wheel_cancel(&loop->wheel, &src->entry);
+		break;
+	case SOURCE_SIGNAL:
+		(void)epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+		(void)close(src->fd);
+		(void)sigdelset(&loop->signals, src->signum);
+		break;
+	}
+
+	ls_loop_free(loop, src);
+}
+
+static uint32_t ls_loop_epoll_events(int events)
+{
+	uint32_t ev = 0;
+
+	if (events & LS_LOOP_READ)
+		ev |= EPOLLIN;
+	if (events & LS_LOOP_WRITE)
+		ev |= EPOLLOUT;
+	return ev;
+}
+
+//! \brief Get the descriptor to monitor for a handle.
+//!
+//! \return The descriptor, or -1 if the handle cannot be monitored.
+static int ls_loop_handle_fd(ls_handle h, int *type)
+{
+	const struct ls_class *clazz;
+	ls_file_t *pf;
+	int flags;
+	intptr_t fd;
+
+	if (LS_IS_PSUEDO_HANDLE(h))
+		return ls_set_errno(LS_INVALID_HANDLE);
+
+	if (h == LS_STDIN || h == LS_STDOUT || h == LS_STDERR || h == LS_DEVNULL)
+	{
+		pf = ls_resolve_file(h, &flags);
+		if (!pf)
+			return -1;
+
+		if (pf->fd == -1)
+			return ls_set_errno(LS_NOT_SUPPORTED);
+
+		*type = SOURCE_IO;
+		return pf->fd;
+	}
+
+	clazz = LS_HANDLE_CLASS(h);
+	if (!clazz->pollfd)
+		return ls_set_errno(LS_NOT_SUPPORTED);
+
+	fd = clazz->pollfd(h);
+	if (fd == -1)
+		return ls_set_errno(LS_NOT_SUPPORTED);
+
+	// sockets are waitable, but are watched like any descriptor
+	*type = clazz->wait && !(clazz->type & LS_IO_READY) ? SOURCE_WAIT : SOURCE_IO;
+	return (int)fd;
+}
+
+//! \brief Call the callback of a source and remove it if it is a
+//! one-shot source.
+static void ls_loop_call(struct ls_loop *loop, struct ls_loop_source *src, int events)
+{
+	int id = src->id;
+	int oneshot = src->events & LS_LOOP_ONESHOT;
+
+	src->func(loop, id, events, src->up);
+
+	// the callback may have removed the source
+	if (oneshot && (src = ls_loop_lookup(loop, id)))
+		ls_loop_release(loop, src);
+}
+
+//! \brief Handle an epoll event.
+//!
+//! \return 1 if a callback was called, 0 otherwise.
+static int ls_loop_dispatch(struct ls_loop *loop, struct ls_loop_source *src, uint32_t ev)
+{
+	struct signalfd_siginfo si;
+	int events = 0;
+	int rc;
+
+	switch (src->type)
+	{
+	case SOURCE_IO:
+		if (ev & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))
+			events |= LS_LOOP_READ;
+		if (ev & EPOLLOUT)
+			events |= LS_LOOP_WRITE;
+		if (ev & EPOLLERR)
+			events |= LS_LOOP_ERROR;
+
+		// report hang ups only to sources interested in reading
+		events &= src->events | LS_LOOP_ERROR;
+		break;
+	case SOURCE_WAIT:
+		rc = LS_HANDLE_CLASS(src->h)->wait(src->h, 0);
+		if (rc == 0)
+			events = LS_LOOP_SIGNALED;
+		else if (rc == -1)
+			events = LS_LOOP_ERROR;
+		break;
+	case SOURCE_SIGNAL:
+		// signals of the same number coalesce, as they would for a
+		// signal handler
+		while (read(src->fd, &si, sizeof(si)) == sizeof(si))
+			events = LS_LOOP_SIGNAL;
+		break;
+	}
+
+	if (!events)
+		return 0;
+
+	ls_loop_call(loop, src, events);
+	return 1;
+}
+
+static void ls_loop_expire(struct ls_wheel_entry *e, void *up)
+{
+	struct ls_loop *loop = up;
+	struct ls_loop_source *src;
+	uint64_t expires, period;
+	int id;
+
+	src = (struct ls_loop_source *)((char *)e - offsetof(struct ls_loop_source, entry));
+	id = src->id;
+	period = src->period;
+	expires = e->expires;
+
+	src->func(loop, id, LS_LOOP_TIMER, src->up);
+
+	// the callback may have removed the source
+	src = ls_loop_lookup(loop, id);
+	if (!src)
+		return;
+
+	if (!period)
+	{
+		ls_loop_release(loop, src);
+		return;
+	}
+
+	// skip expiries missed while the loop was not running
+	expires += period;
+	if (expires <= loop->tick)
+		expires = loop->tick + period;
+
+	ls_wheel_add(&loop->wheel, &src->entry, expires);
+}
+
+static void ls_loop_dtor(struct ls_loop *loop)
+{
+	int i;
+
+	for (i = 0; i < loop->nslots; i++)
+	{
+		if (!loop->slots[i].src)
+			continue;
+
+		if (loop->slots[i].src->type == SOURCE_SIGNAL)
+			(void)close(loop->slots[i].src->fd);
+		ls_free(loop->slots[i].src);
+	}
+
+	ls_free(loop->slots);
+
+	(void)close(loop->evfd);
+	(void)close(loop->epfd);
+}
+
+#else
+
+static void ls_loop_dtor(struct ls_loop *loop)
+{
+	(void)loop;
+}
+
+#endif // LS_LINUX
+
+static const struct ls_class LoopClass = {
+	.type = LS_LOOP,
+	.cb = sizeof(struct ls_loop),
+	.dtor = (ls_dtor_t)&ls_loop_dtor,
+	.wait = NULL
+};
+
+ls_handle ls_loop_create(void)
+{
+#if LS_LINUX
+	struct ls_loop *loop;
+	struct epoll_event ev;
+
+	loop = ls_handle_create(&LoopClass, 0);
+	if (!loop)
+		return NULL;
+
+	loop->free_head = -1;
+	(void)sigemptyset(&loop->signals);
+	ls_wheel_init(&loop->wheel, ls_loop_tick());
+
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd == -1)
+	{
+		ls_set_errno_errno(errno);
+		ls_handle_dealloc(loop);
+		return NULL;
+	}
+
+	loop->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (loop->evfd == -1)
+	{
+		ls_set_errno_errno(errno);
+		(void)close(loop->epfd);
+		ls_handle_dealloc(loop);
+		return NULL;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = WAKE_DATA;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->evfd, &ev) == -1)
+	{
+		ls_set_errno_errno(errno);
+		(void)close(loop->evfd);
+		(void)close(loop->epfd);
+		ls_handle_dealloc(loop);
+		return NULL;
+	}
+
+	return loop;
+#else
+	ls_set_errno(LS_NOT_IMPLEMENTED);
+	return NULL;
+#endif // LS_LINUX
+}
+
+int ls_loop_add(ls_handle loop, ls_handle h, int events, ls_loop_func_t func, void *up)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+	struct ls_loop_source *src;
+	struct epoll_event ev;
+	int fd, type;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	if (!h || !func)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	fd = ls_loop_handle_fd(h, &type);
+	if (fd == -1)
+		return -1;
+
+	src = ls_loop_alloc(l, type, func, up);
+	if (!src)
+		return -1;
+
+	src->events = events;
+	src->fd = fd;
+	src->h = h;
+
+	ev.events = type == SOURCE_WAIT ? EPOLLIN : ls_loop_epoll_events(events);
+	ev.data.u64 = (uint32_t)src->id;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+	{
+		// regular files cannot be polled
+		ls_set_errno(errno == EPERM ? LS_NOT_SUPPORTED : ls_errno_to_error(errno));
+
+		ls_loop_free(l, src);
+		return -1;
+	}
+
+	return src->id;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_modify(ls_handle loop, int id, int events)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+	struct ls_loop_source *src;
+	struct epoll_event ev;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	src = ls_loop_lookup(l, id);
+	if (!src)
+		return ls_set_errno(LS_NOT_FOUND);
+
+	if (src->type != SOURCE_IO && src->type != SOURCE_WAIT)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (src->type == SOURCE_IO)
+	{
+		ev.events = ls_loop_epoll_events(events);
+		ev.data.u64 = (uint32_t)src->id;
+		if (epoll_ctl(l->epfd, EPOLL_CTL_MOD, src->fd, &ev) == -1)
+			return ls_set_errno_errno(errno);
+	}
+
+	src->events = events;
+
+	return 0;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_add_timer(ls_handle loop, unsigned long ms, unsigned long period, ls_loop_func_t func, void *up)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+	struct ls_loop_source *src;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	if (!func)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	src = ls_loop_alloc(l, SOURCE_TIMER, func, up);
+	if (!src)
+		return -1;
+
+	src->period = period;
+
+	// round up, so the timer never expires early
+	ls_wheel_add(&l->wheel, &src->entry, ((uint64_t)ls_nanotime() + 999999) / 1000000 + ms);
+
+	return src->id;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_add_signal(ls_handle loop, int signum, ls_loop_func_t func, void *up)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+	struct ls_loop_source *src;
+	struct epoll_event ev;
+	sigset_t set;
+	int rc;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	if (!func)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	(void)sigemptyset(&set);
+	if (sigaddset(&set, signum) == -1)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	// each delivery is read by only one descriptor
+	if (sigismember(&l->signals, signum) == 1)
+		return ls_set_errno(LS_ALREADY_EXISTS);
+
+	rc = pthread_sigmask(SIG_BLOCK, &set, NULL);
+	if (rc != 0)
+		return ls_set_errno_errno(rc);
+
+	src = ls_loop_alloc(l, SOURCE_SIGNAL, func, up);
+	if (!src)
+		return -1;
+
+	src->signum = signum;
+
+	src->fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (src->fd == -1)
+	{
+		ls_set_errno_errno(errno);
+		ls_loop_free(l, src);
+		return -1;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = (uint32_t)src->id;
+	if (epoll_ctl(l->epfd, EPOLL_CTL_ADD, src->fd, &ev) == -1)
+	{
+		ls_set_errno_errno(errno);
+		(void)close(src->fd);
+		ls_loop_free(l, src);
+		return -1;
+	}
+
+	(void)sigaddset(&l->signals, signum);
+
+	return src->id;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_remove(ls_handle loop, int id)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+	struct ls_loop_source *src;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	src = ls_loop_lookup(l, id);
+	if (!src)
+		return ls_set_errno(LS_NOT_FOUND);
+
+	ls_loop_release(l, src);
+	return 0;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_run(ls_handle loop)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	while (!ls_atomic_xchg32(&l->stop, 0))
+	{
+		if (ls_loop_run_once(loop, LS_INFINITE) == -1)
+			return -1;
+	}
+
+	return 0;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_run_once(ls_handle loop, unsigned long ms)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+	struct epoll_event events[MAX_EVENTS];
+	struct ls_loop_source *src;
+	long long timeout, remain;
+	uint64_t next;
+	uint64_t value;
+	int i, n, count = 0;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	timeout = ms == LS_INFINITE ? -1 : (long long)ms;
+
+	next = ls_wheel_next(&l->wheel);
+	if (next != LS_WHEEL_NEVER)
+	{
+		remain = (long long)(next * 1000000) - ls_nanotime();
+		remain = remain <= 0 ? 0 : (remain + 999999) / 1000000;
+		if (timeout == -1 || remain < timeout)
+			timeout = remain;
+	}
+
+	if (timeout > INT_MAX)
+		timeout = INT_MAX;
+
+	// let the worker run other tasks while the loop is idle
+	if (timeout != 0 && ls_task_io_active())
+	{
+		if (ls_task_wait_fd(l->epfd, LS_POLL_IN, timeout == -1 ? LS_INFINITE : (unsigned long)timeout) != -1)
+			timeout = 0;
+	}
+
+	n = epoll_wait(l->epfd, events, MAX_EVENTS, (int)timeout);
+	if (n == -1)
+	{
+		if (errno != EINTR)
+			return ls_set_errno_errno(errno);
+		n = 0;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (events[i].data.u64 == WAKE_DATA)
+		{
+			(void)eventfd_read(l->evfd, &value);
+			continue;
+		}
+
+		// NULL if removed by an earlier callback of this iteration
+		src = ls_loop_lookup(l, (int)events[i].data.u64);
+		if (src)
+			count += ls_loop_dispatch(l, src, events[i].events);
+	}
+
+	l->tick = ls_loop_tick();
+	count += (int)ls_wheel_advance(&l->wheel, l->tick, &ls_loop_expire, l);
+
+	return count;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_loop_stop(ls_handle loop)
+{
+#if LS_LINUX
+	struct ls_loop *l = loop;
+
+	if (ls_type_check(loop, LS_LOOP))
+		return -1;
+
+	ls_atomic_store32(&l->stop, 1);
+	(void)eventfd_write(l->evfd, 1);
+
+	return 0;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
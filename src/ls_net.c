@@ -1,25 +1,81 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // accept4
+#endif
+
 #include <lysys/ls_net.h>
 
 #include <lysys/ls_core.h>
 #include <lysys/ls_file.h>
+#include <lysys/ls_time.h>
 
 #include "ls_handle.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
 #if LS_WINDOWS
 #include <WinSock2.h>
 #include <WS2tcpip.h>
+#include <afunix.h>
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <fcntl.h>
+#include <poll.h>
 #endif // LS_WINDOWS
 
+#if LS_LINUX
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif // SO_ATTACH_REUSEPORT_CBPF
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif // SO_ZEROCOPY
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif // MSG_ZEROCOPY
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif // SO_EE_ORIGIN_ZEROCOPY
+
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif // SO_EE_CODE_ZEROCOPY_COPIED
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif // UDP_SEGMENT
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif // UDP_GRO
+#endif // LS_LINUX
+
+#if LS_DARWIN
+#include <sys/uio.h>
+#endif // LS_DARWIN
+
 #include "ls_native.h"
+#include "ls_sched_priv.h"
+#include "ls_file_priv.h"
+#include "ls_resolve_priv.h"
+#include "ls_net_priv.h"
 
 typedef struct ls_socket
 {
@@ -33,11 +89,18 @@ typedef struct ls_socket
 	char *host;
 	unsigned short port;
 	int can_recv, can_send;
+	int nonblock;
+
+	int zerocopy; // send with MSG_ZEROCOPY
+	uint64_t zc_sent; // zero-copy sends issued
+	uint64_t zc_done; // zero-copy sends completed
 } ls_socket_t;
 
 typedef struct ls_server
 {
 	unsigned short port;
+	int nonblock; // also applies to accepted sockets
+	int native_nonblock; // the native socket was made non-blocking, see ls_server_native_nonblock()
 
 #if LS_WINDOWS
 	SOCKET socket;
@@ -58,11 +121,355 @@ static void ls_socket_dtor(ls_socket_t *sock)
 #endif // LS_WINDOWS
 }
 
+#define POLL_STACK_COUNT 64 // sockets polled without allocating
+
+#if LS_WINDOWS
+
+static int ls_wsa_to_error(int err)
+{
+	switch (err)
+	{
+	default: return LS_IO_ERROR;
+	case WSAEWOULDBLOCK: return LS_NOT_READY;
+	case WSAEINTR: return LS_INTERRUPTED;
+	case WSAEINVAL: return LS_INVALID_ARGUMENT;
+	case WSAENOBUFS: return LS_OUT_OF_MEMORY;
+	case WSAEACCES: return LS_ACCESS_DENIED;
+	case WSAETIMEDOUT: return LS_TIMEDOUT;
+	case WSAEADDRINUSE: return LS_ALREADY_EXISTS;
+	case WSAENOTSOCK: return LS_INVALID_HANDLE;
+	}
+}
+
+#define ls_set_errno_wsa(err) ls_set_errno(ls_wsa_to_error(err))
+
+#endif // LS_WINDOWS
+
+#if LS_WINDOWS
+#define ls_sock_error() WSAGetLastError()
+#define ls_sock_would_block(err) ((err) == WSAEWOULDBLOCK)
+#define ls_sock_interrupted(err) ((err) == WSAEINTR)
+#define ls_set_errno_sock(err) ls_set_errno_wsa(err)
+#else
+#define ls_sock_error() errno
+#define ls_sock_would_block(err) ((err) == EAGAIN || (err) == EWOULDBLOCK)
+#define ls_sock_interrupted(err) ((err) == EINTR)
+#define ls_set_errno_sock(err) ls_set_errno_errno(err)
+#endif // LS_WINDOWS
+
+#if LS_WINDOWS
+typedef SOCKET ls_sockfd_t;
+typedef WSAPOLLFD ls_pollfd;
+#define ls_sys_poll WSAPoll
+#else
+typedef int ls_sockfd_t;
+typedef struct pollfd ls_pollfd;
+#define ls_sys_poll poll
+#endif // LS_WINDOWS
+
+//! \brief Wait for sockets to become ready.
+//!
+//! \param fds The sockets, revents is set on return.
+//! \param count The number of sockets.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return The number of ready sockets, 0 if the timeout expired, -1
+//! on failure.
+static int ls_socket_poll(ls_pollfd *fds, size_t count, unsigned long ms)
+{
+	long long deadline, remain;
+	unsigned long wait;
+	int rc;
+#if LS_LINUX
+	struct epoll_event ev;
+	size_t i, j;
+	int epfd;
+#endif // LS_LINUX
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+#if LS_LINUX
+	if (ms != 0 && ls_task_io_active())
+	{
+		rc = ls_sys_poll(fds, count, 0);
+		if (rc != 0)
+			return rc == -1 ? ls_set_errno_errno(errno) : rc;
+
+		if (count == 1)
+		{
+			// suspend only the calling task
+			rc = ls_task_wait_fd(fds[0].fd,
+				((fds[0].events & POLLIN) ? LS_POLL_IN : 0) |
+				((fds[0].events & POLLOUT) ? LS_POLL_OUT : 0), ms);
+			if (rc != -1)
+				return ls_sys_poll(fds, count, 0);
+		}
+		else
+		{
+			// combine the sockets into one descriptor the task can
+			// wait on
+			epfd = epoll_create1(EPOLL_CLOEXEC);
+			if (epfd == -1)
+				return ls_set_errno_errno(errno);
+
+			for (i = 0; i < count; i++)
+			{
+				ev.events = fds[i].events;
+				ev.data.u64 = i;
+				if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i].fd, &ev) == 0)
+					continue;
+
+				if (errno == EEXIST)
+				{
+					// a socket passed twice, wait for the events of
+					// every entry
+					for (j = 0; j < i; j++)
+					{
+						if (fds[j].fd == fds[i].fd)
+							ev.events |= fds[j].events;
+					}
+
+					if (epoll_ctl(epfd, EPOLL_CTL_MOD, fds[i].fd, &ev) == 0)
+						continue;
+				}
+
+				(void)close(epfd);
+				return ls_set_errno_errno(errno);
+			}
+
+			rc = ls_task_wait_fd(epfd, LS_POLL_IN, ms);
+			(void)close(epfd);
+
+			if (rc != -1)
+				return ls_sys_poll(fds, count, 0);
+		}
+	}
+#endif // LS_LINUX
+
+	for (;;)
+	{
+		if (ms == LS_INFINITE)
+			wait = LS_INFINITE;
+		else
+		{
+			remain = deadline - ls_nanotime();
+			if (remain < 0)
+				remain = 0;
+			wait = (unsigned long)((remain + 999999) / 1000000);
+		}
+
+#if LS_WINDOWS
+		rc = WSAPoll(fds, (ULONG)count, wait == LS_INFINITE ? -1 : wait > INT_MAX ? INT_MAX : (INT)wait);
+		if (rc == SOCKET_ERROR)
+			return ls_set_errno_wsa(WSAGetLastError());
+		return rc;
+#else
+		rc = poll(fds, (nfds_t)count, wait == LS_INFINITE ? -1 : wait > INT_MAX ? INT_MAX : (int)wait);
+		if (rc != -1)
+			return rc;
+
+		if (errno != EINTR)
+			return ls_set_errno_errno(errno);
+#endif // LS_WINDOWS
+	}
+}
+
+//! \brief Wait for a socket to become readable.
+static int ls_sockfd_wait(ls_sockfd_t fd, unsigned long ms)
+{
+	ls_pollfd pfd;
+	int rc;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	rc = ls_socket_poll(&pfd, 1, ms);
+	if (rc == -1)
+		return -1;
+	return rc == 0 ? 1 : 0;
+}
+
+//! \brief Put a socket into blocking or non-blocking mode.
+static int ls_sockfd_set_nonblock(ls_sockfd_t fd, int nonblock)
+{
+#if LS_WINDOWS
+	u_long mode = nonblock ? 1 : 0;
+
+	if (ioctlsocket(fd, FIONBIO, &mode) == SOCKET_ERROR)
+		return ls_set_errno_wsa(WSAGetLastError());
+	return 0;
+#else
+	int flags;
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1)
+		return ls_set_errno_errno(errno);
+
+	flags = nonblock ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+	if (fcntl(fd, F_SETFL, flags) == -1)
+		return ls_set_errno_errno(errno);
+	return 0;
+#endif // LS_WINDOWS
+}
+
+//! \brief Get the native level and name of an LS_NET_OPT_* option.
+static int ls_sockopt_native(int opt, int *level, int *name)
+{
+	switch (opt)
+	{
+	default:
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+	case LS_NET_OPT_NODELAY:
+		*level = IPPROTO_TCP;
+		*name = TCP_NODELAY;
+		return 0;
+	case LS_NET_OPT_QUICKACK:
+#ifdef TCP_QUICKACK
+		*level = IPPROTO_TCP;
+		*name = TCP_QUICKACK;
+		return 0;
+#else
+		break;
+#endif // TCP_QUICKACK
+	case LS_NET_OPT_CORK:
+#if defined(TCP_CORK)
+		*level = IPPROTO_TCP;
+		*name = TCP_CORK;
+		return 0;
+#elif defined(TCP_NOPUSH)
+		*level = IPPROTO_TCP;
+		*name = TCP_NOPUSH;
+		return 0;
+#else
+		break;
+#endif // TCP_CORK
+	case LS_NET_OPT_SNDBUF:
+		*level = SOL_SOCKET;
+		*name = SO_SNDBUF;
+		return 0;
+	case LS_NET_OPT_RCVBUF:
+		*level = SOL_SOCKET;
+		*name = SO_RCVBUF;
+		return 0;
+	case LS_NET_OPT_REUSEADDR:
+#if LS_WINDOWS
+		// SO_REUSEADDR would allow stealing the port on Windows, which
+		// rebinds ports in TIME_WAIT by default
+		break;
+#else
+		*level = SOL_SOCKET;
+		*name = SO_REUSEADDR;
+		return 0;
+#endif // LS_WINDOWS
+	case LS_NET_OPT_REUSEPORT:
+#ifdef SO_REUSEPORT
+		*level = SOL_SOCKET;
+		*name = SO_REUSEPORT;
+		return 0;
+#else
+		break;
+#endif // SO_REUSEPORT
+	case LS_NET_OPT_KEEPALIVE:
+		*level = SOL_SOCKET;
+		*name = SO_KEEPALIVE;
+		return 0;
+	case LS_NET_OPT_KEEPIDLE:
+#if defined(TCP_KEEPIDLE)
+		*level = IPPROTO_TCP;
+		*name = TCP_KEEPIDLE;
+		return 0;
+#elif defined(TCP_KEEPALIVE)
+		*level = IPPROTO_TCP;
+		*name = TCP_KEEPALIVE;
+		return 0;
+#else
+		break;
+#endif // TCP_KEEPIDLE
+	case LS_NET_OPT_KEEPINTVL:
+#ifdef TCP_KEEPINTVL
+		*level = IPPROTO_TCP;
+		*name = TCP_KEEPINTVL;
+		return 0;
+#else
+		break;
+#endif // TCP_KEEPINTVL
+	case LS_NET_OPT_KEEPCNT:
+#ifdef TCP_KEEPCNT
+		*level = IPPROTO_TCP;
+		*name = TCP_KEEPCNT;
+		return 0;
+#else
+		break;
+#endif // TCP_KEEPCNT
+	case LS_NET_OPT_FASTOPEN:
+#ifdef TCP_FASTOPEN
+		*level = IPPROTO_TCP;
+		*name = TCP_FASTOPEN;
+		return 0;
+#else
+		break;
+#endif // TCP_FASTOPEN
+	case LS_NET_OPT_DEFER_ACCEPT:
+#ifdef TCP_DEFER_ACCEPT
+		*level = IPPROTO_TCP;
+		*name = TCP_DEFER_ACCEPT;
+		return 0;
+#else
+		break;
+#endif // TCP_DEFER_ACCEPT
+	case LS_NET_OPT_BUSY_POLL:
+#ifdef SO_BUSY_POLL
+		*level = SOL_SOCKET;
+		*name = SO_BUSY_POLL;
+		return 0;
+#else
+		break;
+#endif // SO_BUSY_POLL
+	}
+
+	return ls_set_errno(LS_NOT_SUPPORTED);
+}
+
+//! \brief Set an LS_NET_OPT_* option on a socket.
+static int ls_sockfd_setopt(ls_sockfd_t fd, int opt, int value)
+{
+	int level, name;
+
+	if (ls_sockopt_native(opt, &level, &name) == -1)
+		return -1;
+
+#if LS_WINDOWS
+	if (setsockopt(fd, level, name, (const char *)&value, sizeof(value)) == SOCKET_ERROR)
+		return ls_set_errno_wsa(WSAGetLastError());
+#else
+	if (setsockopt(fd, level, name, &value, sizeof(value)) == -1)
+		return ls_set_errno(errno == ENOPROTOOPT ? LS_NOT_SUPPORTED : ls_errno_to_error(errno));
+#endif // LS_WINDOWS
+
+	return 0;
+}
+
+static int ls_socket_wait(ls_socket_t *sock, unsigned long ms)
+{
+	return ls_sockfd_wait(sock->socket, ms);
+}
+
+static intptr_t ls_socket_pollfd(ls_socket_t *sock)
+{
+#if LS_WINDOWS
+	return -1;
+#else
+	return sock->socket;
+#endif // LS_WINDOWS
+}
+
 static const struct ls_class SocketClass = {
 	.type = LS_SOCKET,
 	.cb = sizeof(ls_socket_t),
 	.dtor = (ls_dtor_t)&ls_socket_dtor,
-	.wait = NULL
+	.wait = (ls_wait_t)&ls_socket_wait,
+	.pollfd = (ls_pollfd_t)&ls_socket_pollfd
 };
 
 static void ls_server_dtor(ls_server_t *server)
@@ -74,11 +481,26 @@ static void ls_server_dtor(ls_server_t *server)
 #endif // LS_WINDOWS
 }
 
+static int ls_server_wait(ls_server_t *server, unsigned long ms)
+{
+	return ls_sockfd_wait(server->socket, ms);
+}
+
+static intptr_t ls_server_pollfd(ls_server_t *server)
+{
+#if LS_WINDOWS
+	return -1;
+#else
+	return server->socket;
+#endif // LS_WINDOWS
+}
+
 static const struct ls_class ServerClass = {
 	.type = LS_SERVER,
 	.cb = sizeof(ls_server_t),
 	.dtor = (ls_dtor_t)&ls_server_dtor,
-	.wait = NULL
+	.wait = (ls_wait_t)&ls_server_wait,
+	.pollfd = (ls_pollfd_t)&ls_server_pollfd
 };
 
 #if LS_WINDOWS
@@ -114,10 +536,110 @@ typedef struct sockaddr_storage *PSOCKADDR_STORAGE;
 typedef struct addrinfo *PADDRINFOA;
 #endif // LS_WINDOWS
 
+//! \brief Convert an LS_AF_* constant to the native address family.
+static int ls_af_native(int af)
+{
+	switch (af)
+	{
+	case LS_AF_UNSPEC:
+		return AF_UNSPEC;
+	case LS_AF_UNIX:
+		return AF_UNIX;
+	case LS_AF_INET:
+		return AF_INET;
+	case LS_AF_INET6:
+		return AF_INET6;
+	default:
+		return -1;
+	}
+}
+
+//! \brief Get the length of a local socket address.
+static int ls_unix_addr_len(const struct sockaddr_un *addr)
+{
+	// names in the abstract namespace are not terminated
+	if (addr->sun_path[0] == 0)
+		return (int)(offsetof(struct sockaddr_un, sun_path) + 1 + strlen(addr->sun_path + 1));
+	return (int)(offsetof(struct sockaddr_un, sun_path) + strlen(addr->sun_path) + 1);
+}
+
+//! \brief Get the length of a socket address for bind and connect.
+static int ls_sockaddr_len(const struct sockaddr_storage *addr)
+{
+	switch (addr->ss_family)
+	{
+	case AF_UNIX:
+		return ls_unix_addr_len((const struct sockaddr_un *)addr);
+	case AF_INET:
+		return sizeof(struct sockaddr_in);
+	case AF_INET6:
+		return sizeof(struct sockaddr_in6);
+	default:
+		return sizeof(struct sockaddr_storage);
+	}
+}
+
+//! \brief Build the address of a local socket from its path.
+static int ls_parse_unix_addr(const char *path, PSOCKADDR_STORAGE addr)
+{
+	struct sockaddr_un *un = (struct sockaddr_un *)addr;
+	size_t len;
+
+	if (!path || !*path)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	len = strlen(path);
+	if (len >= sizeof(un->sun_path))
+		return ls_set_errno(LS_BUFFER_TOO_SMALL);
+
+	memset(addr, 0, sizeof(*addr));
+	un->sun_family = AF_UNIX;
+	memcpy(un->sun_path, path, len);
+
+#if LS_LINUX
+	if (path[0] == '@')
+		un->sun_path[0] = 0; // abstract namespace
+#endif // LS_LINUX
+
+	return 0;
+}
+
+//! \brief Get the path of a local socket address.
+static int ls_format_unix_addr(const struct sockaddr_un *addr, size_t len, char *path, size_t size)
+{
+	size_t n = 0;
+
+	if (len > offsetof(struct sockaddr_un, sun_path))
+		n = len - offsetof(struct sockaddr_un, sun_path);
+	if (n > sizeof(addr->sun_path))
+		n = sizeof(addr->sun_path);
+
+	// the length of a path may include its terminator
+	if (n && addr->sun_path[0] != 0)
+		n = strnlen(addr->sun_path, n);
+
+	if (!path)
+		return 0;
+
+	if (n >= size)
+		return ls_set_errno(LS_BUFFER_TOO_SMALL);
+
+	memcpy(path, addr->sun_path, n);
+	if (n && path[0] == 0)
+		path[0] = '@';
+	path[n] = 0;
+
+	return 0;
+}
+
 static int ls_parse_sockaddr(const char *host, unsigned short port, int af, PSOCKADDR_STORAGE addr)
 {
-	PADDRINFOA info, ptr;
-	char service[16];
+	af = ls_af_native(af);
+	if (af == -1)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (af == AF_UNIX)
+		return ls_parse_unix_addr(host, addr);
 
 	if (!host)
 	{
@@ -134,51 +656,10 @@ static int ls_parse_sockaddr(const char *host, unsigned short port, int af, PSOC
 		}
 	}
 
-	snprintf(service, sizeof(service), "%hu", port);
-
-    if (getaddrinfo(host, service, NULL, &info) != 0)
-		return ls_set_errno(LS_INVALID_ARGUMENT);
-
-	for (ptr = info; ptr; ptr = ptr->ai_next)
-	{
-		switch (ptr->ai_family)
-		{
-		default:
-		case AF_UNSPEC:
-			break;
-		case AF_INET:
-#ifdef AF_IPX
-		case AF_IPX:
-#endif // AF_IPX
-                
-#ifdef AF_APPLETALK
-		case AF_APPLETALK:
-#endif // AF_APPLETALK
-                
-#ifdef AF_NETBIOS
-		case AF_NETBIOS:
-#endif // AF_NETBIOS
-                
-#ifdef AF_NETLINK
-        case AF_NETLINK:
-#endif // AF_NETLINK
-                
-		case AF_INET6:
-#if LS_WINDOWS
-		case AF_IRDA:
-		case AF_BTH:
-#endif // LS_WINDOWS
-			if (af != LS_AF_UNSPEC && ptr->ai_family != af)
-				continue; // skip this address
-
-			memcpy(addr, ptr->ai_addr, ptr->ai_addrlen);
-			freeaddrinfo(info);
-			return 0;
-		}
-	}
-
-	freeaddrinfo(info);
-	return ls_set_errno(LS_NOT_FOUND);
+	// cached, host names are not looked up on every call
+	if (ls_resolve(host, port, af, addr, 1) == -1)
+		return -1;
+	return 0;
 }
 
 ls_handle ls_net_connect(const char *host, unsigned short port, int type, int protocol, int addr_family)
@@ -199,6 +680,9 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
 	case LS_NET_DGRAM:
 		type = SOCK_DGRAM;
 		break;
+	case LS_NET_SEQPACKET:
+		type = SOCK_SEQPACKET;
+		break;
 	}
 
 	switch (protocol)
@@ -206,6 +690,9 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
 	default:
 		ls_set_errno(LS_INVALID_ARGUMENT);
 		return NULL;
+	case LS_NET_PROTO_DEFAULT:
+		protocol = 0;
+		break;
 	case LS_NET_PROTO_TCP:
 		protocol = IPPROTO_TCP;
 		break;
@@ -236,7 +723,7 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
 		return NULL;
 	}
 
-	if (connect(sock->socket, (PSOCKADDR)&addr, sizeof(addr)) == SOCKET_ERROR)
+	if (connect(sock->socket, (PSOCKADDR)&addr, ls_sockaddr_len(&addr)) == SOCKET_ERROR)
 	{
 		ls_set_errno(LS_IO_ERROR);
 		closesocket(sock->socket);
@@ -274,6 +761,9 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
     case LS_NET_DGRAM:
         type = SOCK_DGRAM;
         break;
+    case LS_NET_SEQPACKET:
+        type = SOCK_SEQPACKET;
+        break;
     }
 
     switch (protocol)
@@ -281,6 +771,8 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
     default:
         ls_set_errno(LS_INVALID_ARGUMENT);
         return NULL;
+    case LS_NET_PROTO_DEFAULT:
+        break;
     case LS_NET_PROTO_TCP:
         break;
     case LS_NET_PROTO_UDP:
@@ -306,7 +798,7 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
         return NULL;
     }
     
-    if (connect(sock->socket, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    if (connect(sock->socket, (struct sockaddr *)&addr, ls_sockaddr_len(&addr)) != 0)
     {
         ls_set_errno_errno(errno);
         close(sock->socket);
@@ -332,12 +824,31 @@ ls_handle ls_net_connect(const char *host, unsigned short port, int type, int pr
 }
 
 ls_handle ls_net_listen(const char *host, unsigned short port, int type, int protocol, int addr_family, int backlog)
+{
+	struct ls_net_listen_options options;
+
+	memset(&options, 0, sizeof(options));
+	options.backlog = backlog;
+
+	return ls_net_listen_ex(host, port, type, protocol, addr_family, &options);
+}
+
+ls_handle ls_net_listen_ex(const char *host, unsigned short port, int type, int protocol, int addr_family, const struct ls_net_listen_options *options)
 {
 #if LS_WINDOWS
-	ls_server_t *sock;
+	ls_server_t *server;
+	ls_socket_t *sock;
 	SOCKADDR_STORAGE addr;
+	SOCKET s;
+	size_t i;
 	int rc;
 
+	if (!options)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
 	switch (type)
 	{
 	default:
@@ -349,6 +860,9 @@ ls_handle ls_net_listen(const char *host, unsigned short port, int type, int pro
 	case LS_NET_DGRAM:
 		type = SOCK_DGRAM;
 		break;
+	case LS_NET_SEQPACKET:
+		type = SOCK_SEQPACKET;
+		break;
 	}
 
 	switch (protocol)
@@ -356,6 +870,9 @@ ls_handle ls_net_listen(const char *host, unsigned short port, int type, int pro
 	default:
 		ls_set_errno(LS_INVALID_ARGUMENT);
 		return NULL;
+	case LS_NET_PROTO_DEFAULT:
+		protocol = 0;
+		break;
 	case LS_NET_PROTO_TCP:
 		protocol = IPPROTO_TCP;
 		break;
@@ -367,50 +884,93 @@ ls_handle ls_net_listen(const char *host, unsigned short port, int type, int pro
 	if (ls_check_wsa() != 0)
 		return NULL;
 
-	sock = ls_handle_create(&ServerClass, 0);
-	if (!sock)
-		return NULL;
-
 	rc = ls_parse_sockaddr(host, port, addr_family, &addr);
 	if (rc == -1)
-	{
-		ls_handle_dealloc(sock);
 		return NULL;
-	}
 	
-	sock->socket = socket(addr.ss_family, type, protocol);
-	if (sock->socket == INVALID_SOCKET)
+	s = socket(addr.ss_family, type, protocol);
+	if (s == INVALID_SOCKET)
 	{
-		ls_handle_dealloc(sock);
-		ls_set_errno(LS_IO_ERROR);
+		ls_set_errno_wsa(WSAGetLastError());
 		return NULL;
 	}
 
-	if (bind(sock->socket, (PSOCKADDR)&addr, sizeof(addr)) == SOCKET_ERROR)
+	// some options only take effect before binding
+	for (i = 0; i < options->count; i++)
 	{
-		closesocket(sock->socket);
-		ls_handle_dealloc(sock);
-		ls_set_errno(LS_IO_ERROR);
+		if (ls_sockfd_setopt(s, options->opts[i].opt, options->opts[i].value) == -1)
+		{
+			closesocket(s);
+			return NULL;
+		}
+	}
+
+	if (options->nonblocking && ls_sockfd_set_nonblock(s, 1) == -1)
+	{
+		closesocket(s);
 		return NULL;
 	}
 
-	if (listen(sock->socket, backlog) == SOCKET_ERROR)
+	if (bind(s, (PSOCKADDR)&addr, ls_sockaddr_len(&addr)) == SOCKET_ERROR)
 	{
-		closesocket(sock->socket);
-		ls_handle_dealloc(sock);
-		ls_set_errno(LS_IO_ERROR);
+		ls_set_errno_wsa(WSAGetLastError());
+		closesocket(s);
 		return NULL;
 	}
 
-	sock->port = port;
+	if (type == SOCK_DGRAM)
+	{
+		// datagram sockets do not accept connections, received from
+		// directly
+		sock = ls_handle_create(&SocketClass, 0);
+		if (!sock)
+		{
+			closesocket(s);
+			return NULL;
+		}
 
-	return sock;
-#else
-    ls_server_t *server;
-    struct sockaddr_storage addr;
-    int rc;
-    
-    switch (type)
+		sock->socket = s;
+		sock->port = port;
+		sock->can_recv = 1;
+		sock->can_send = 1;
+		sock->nonblock = options->nonblocking ? 1 : 0;
+
+		return sock;
+	}
+
+	if (listen(s, options->backlog) == SOCKET_ERROR)
+	{
+		ls_set_errno_wsa(WSAGetLastError());
+		closesocket(s);
+		return NULL;
+	}
+
+	server = ls_handle_create(&ServerClass, 0);
+	if (!server)
+	{
+		closesocket(s);
+		return NULL;
+	}
+
+	server->socket = s;
+	server->port = port;
+	server->nonblock = options->nonblocking ? 1 : 0;
+
+	return server;
+#else
+    ls_server_t *server;
+    ls_socket_t *sock;
+    struct sockaddr_storage addr;
+    size_t i;
+    int rc, s;
+
+    if (!options)
+    {
+        ls_set_errno(LS_INVALID_ARGUMENT);
+        return NULL;
+    }
+    
+    switch (type)
     {
     default:
         ls_set_errno(LS_INVALID_ARGUMENT);
@@ -421,6 +981,9 @@ ls_handle ls_net_listen(const char *host, unsigned short port, int type, int pro
     case LS_NET_DGRAM:
         type = SOCK_DGRAM;
         break;
+    case LS_NET_SEQPACKET:
+        type = SOCK_SEQPACKET;
+        break;
     }
 
     switch (protocol)
@@ -428,119 +991,122 @@ ls_handle ls_net_listen(const char *host, unsigned short port, int type, int pro
     default:
         ls_set_errno(LS_INVALID_ARGUMENT);
         return NULL;
+    case LS_NET_PROTO_DEFAULT:
+        break;
     case LS_NET_PROTO_TCP:
         break;
     case LS_NET_PROTO_UDP:
         break;
     }
     
-    server = ls_handle_create(&ServerClass, 0);
-    if (!server)
-        return NULL;
-    
     rc = ls_parse_sockaddr(host, port, addr_family, &addr);
     if (rc == -1)
-    {
-        ls_handle_dealloc(server);
         return NULL;
-    }
     
-    server->socket = socket(addr.ss_family, type, 0);
-    if (server->socket == -1)
+    s = socket(addr.ss_family, type, 0);
+    if (s == -1)
     {
         ls_set_errno_errno(errno);
-        ls_handle_dealloc(server);
         return NULL;
     }
     
-    rc = bind(server->socket, (struct sockaddr *)&addr, sizeof(struct sockaddr));
+    // some options only take effect before binding
+    for (i = 0; i < options->count; i++)
+    {
+        if (ls_sockfd_setopt(s, options->opts[i].opt, options->opts[i].value) == -1)
+        {
+            close(s);
+            return NULL;
+        }
+    }
+
+    if (options->nonblocking && ls_sockfd_set_nonblock(s, 1) == -1)
+    {
+        close(s);
+        return NULL;
+    }
+
+    rc = bind(s, (struct sockaddr *)&addr, ls_sockaddr_len(&addr));
     if (rc != 0)
     {
         ls_set_errno_errno(errno);
-        close(server->socket);
-        ls_handle_dealloc(server);
+        close(s);
         return NULL;
     }
+
+    if (type == SOCK_DGRAM)
+    {
+        // datagram sockets do not accept connections, received from
+        // directly
+        sock = ls_handle_create(&SocketClass, 0);
+        if (!sock)
+        {
+            close(s);
+            return NULL;
+        }
+
+        sock->socket = s;
+        sock->port = port;
+        sock->can_recv = 1;
+        sock->can_send = 1;
+        sock->nonblock = options->nonblocking ? 1 : 0;
+
+        return sock;
+    }
     
-    rc = listen(server->socket, backlog);
+    rc = listen(s, options->backlog);
     if (rc != 0)
     {
         ls_set_errno_errno(errno);
-        close(server->socket);
-        ls_handle_dealloc(server);
+        close(s);
+        return NULL;
+    }
+    
+    server = ls_handle_create(&ServerClass, 0);
+    if (!server)
+    {
+        close(s);
         return NULL;
     }
     
+    server->socket = s;
     server->port = port;
+    server->nonblock = options->nonblocking ? 1 : 0;
     
     return server;
 #endif // LS_WINDOWS
 }
 
-ls_handle ls_net_accept(ls_handle sock)
+//! \brief Make the native socket of a blocking server non-blocking,
+//! so an accept cannot block once another thread or task took the
+//! pending connection. Accepting callers wait themselves.
+static int ls_server_native_nonblock(ls_server_t *server)
 {
-#if LS_WINDOWS
-	ls_server_t *server = sock;
-	ls_socket_t *client;
-
-	union
-	{
-		SOCKADDR_STORAGE addr;
-		SOCKADDR_IN addr4;
-		SOCKADDR_IN6 addr6;
-	} u;
-
-	PSOCKADDR pAddr = (PSOCKADDR)&u.addr;
-	int addr_len = sizeof(u.addr);
-
-	if (!sock)
-	{
-		ls_set_errno(LS_INVALID_HANDLE);
-		return NULL;
-	}
-
-	client = ls_handle_create(&SocketClass, 0);
-	if (!client)
-		return NULL;
+	if (server->native_nonblock)
+		return 0;
 
-	client->socket = accept(server->socket, pAddr, &addr_len);
-	if (client->socket == INVALID_SOCKET)
-	{
-		ls_handle_dealloc(client);
-		ls_set_errno(LS_IO_ERROR);
-		return NULL;
-	}
+	if (ls_sockfd_set_nonblock(server->socket, 1) == -1)
+		return -1;
 
-	switch (pAddr->sa_family)
-	{
-	default:
-		break;
-	case AF_INET:
-		client->port = ntohs(u.addr4.sin_port);
-		client->host = ls_malloc(INET_ADDRSTRLEN);
-		if (client->host)
-		{
-			snprintf(client->host, INET_ADDRSTRLEN, "%hu.%hu.%hu.%hu",
-				u.addr4.sin_addr.S_un.S_un_b.s_b1,
-				u.addr4.sin_addr.S_un.S_un_b.s_b2,
-				u.addr4.sin_addr.S_un.S_un_b.s_b3,
-				u.addr4.sin_addr.S_un.S_un_b.s_b4);
-		}
-		break;
-	case AF_INET6:
-		client->port = ntohs(u.addr6.sin6_port);
-		client->host = NULL;
-		break;
-	}
+	server->native_nonblock = 1;
+	return 0;
+}
 
-	client->can_recv = 1;
-	client->can_send = 1;
+#if !LS_WINDOWS
 
-	return client;
-#else
-    ls_server_t *server = sock;
+//! \brief Accept a connection from a server.
+//!
+//! \param server The server.
+//! \param nonblock Whether the new socket is non-blocking.
+//! \param err Receives the system error on failure, 0 if the failure
+//! was not reported by the system. May be NULL.
+//!
+//! \return The new socket, or NULL on failure.
+static ls_socket_t *ls_server_accept(ls_server_t *server, int nonblock, int *err)
+{
     ls_socket_t *client;
     uint8_t *addr_bytes;
+    int e;
     
     union
     {
@@ -551,21 +1117,41 @@ ls_handle ls_net_accept(ls_handle sock)
     
     struct sockaddr *addr = (struct sockaddr *)&u.addr;
     socklen_t addr_len = sizeof(u.addr);
-    
-    if (ls_type_check(sock, LS_SERVER) != 0)
-        return NULL;
+
+    if (err)
+        *err = 0;
     
     client = ls_handle_create(&SocketClass, 0);
     if (!client)
         return NULL;
     
+#if LS_LINUX
+    client->socket = accept4(server->socket, addr, &addr_len, nonblock ? SOCK_NONBLOCK : 0);
+#else
     client->socket = accept(server->socket, addr, &addr_len);
+#endif // LS_LINUX
     if (client->socket == -1)
     {
-        ls_set_errno_errno(errno);
+        // saved first, freeing the handle may change errno
+        e = errno;
+        ls_handle_dealloc(client);
+        if (err)
+            *err = e;
+        ls_set_errno_errno(e);
+        return NULL;
+    }
+
+#if !LS_LINUX
+    // may have inherited the mode of the server
+    if (ls_sockfd_set_nonblock(client->socket, nonblock) == -1)
+    {
+        close(client->socket);
         ls_handle_dealloc(client);
         return NULL;
     }
+#endif // !LS_LINUX
+
+    client->nonblock = nonblock;
     
     switch (addr->sa_family)
     {
@@ -591,7 +1177,116 @@ ls_handle ls_net_accept(ls_handle sock)
     client->can_send = 1;
     
     return client;
+}
+
+#else
+
+//! \brief Accept a connection from a server.
+//!
+//! \param server The server.
+//! \param nonblock Whether the new socket is non-blocking.
+//! \param err Receives the system error on failure, 0 if the failure
+//! was not reported by the system. May be NULL.
+//!
+//! \return The new socket, or NULL on failure.
+static ls_socket_t *ls_server_accept(ls_server_t *server, int nonblock, int *err)
+{
+	ls_socket_t *client;
+	int e;
+
+	union
+	{
+		SOCKADDR_STORAGE addr;
+		SOCKADDR_IN addr4;
+		SOCKADDR_IN6 addr6;
+	} u;
+
+	PSOCKADDR pAddr = (PSOCKADDR)&u.addr;
+	int addr_len = sizeof(u.addr);
+
+	if (err)
+		*err = 0;
+
+	client = ls_handle_create(&SocketClass, 0);
+	if (!client)
+		return NULL;
+
+	client->socket = accept(server->socket, pAddr, &addr_len);
+	if (client->socket == INVALID_SOCKET)
+	{
+		e = WSAGetLastError();
+		ls_handle_dealloc(client);
+		if (err)
+			*err = e;
+		ls_set_errno_wsa(e);
+		return NULL;
+	}
+
+	// inherits the mode of the native socket
+	if ((server->nonblock || server->native_nonblock) != nonblock &&
+		ls_sockfd_set_nonblock(client->socket, nonblock) == -1)
+	{
+		closesocket(client->socket);
+		ls_handle_dealloc(client);
+		return NULL;
+	}
+
+	client->nonblock = nonblock;
+
+	switch (pAddr->sa_family)
+	{
+	default:
+		break;
+	case AF_INET:
+		client->port = ntohs(u.addr4.sin_port);
+		client->host = ls_malloc(INET_ADDRSTRLEN);
+		if (client->host)
+		{
+			snprintf(client->host, INET_ADDRSTRLEN, "%hu.%hu.%hu.%hu",
+				u.addr4.sin_addr.S_un.S_un_b.s_b1,
+				u.addr4.sin_addr.S_un.S_un_b.s_b2,
+				u.addr4.sin_addr.S_un.S_un_b.s_b3,
+				u.addr4.sin_addr.S_un.S_un_b.s_b4);
+		}
+		break;
+	case AF_INET6:
+		client->port = ntohs(u.addr6.sin6_port);
+		client->host = NULL;
+		break;
+	}
+
+	client->can_recv = 1;
+	client->can_send = 1;
+
+	return client;
+}
+
 #endif // LS_WINDOWS
+
+ls_handle ls_net_accept(ls_handle sock)
+{
+	ls_server_t *server = sock;
+	ls_socket_t *client;
+	int err;
+
+	if (ls_type_check(sock, LS_SERVER) != 0)
+		return NULL;
+
+	// tasks must not block their worker in accept, wait below instead
+	if (!server->nonblock && ls_task_io_active() && ls_server_native_nonblock(server) == -1)
+		return NULL;
+
+	for (;;)
+	{
+		client = ls_server_accept(server, server->nonblock, &err);
+		if (client || server->nonblock || !ls_sock_would_block(err))
+			return client;
+
+		// the native socket is non-blocking and no connection is
+		// pending, or another thread took it, suspends only a task
+		if (ls_sockfd_wait(server->socket, LS_INFINITE) == -1)
+			return NULL;
+	}
 }
 
 int ls_net_shutdown(ls_handle sock, int how)
@@ -711,138 +1406,2203 @@ unsigned short ls_net_getport(ls_handle sock)
 	return socket->port;
 }
 
-size_t ls_net_recv(ls_handle sock, void *buffer, size_t size)
+#if LS_LINUX
+#define SEND_FLAGS MSG_NOSIGNAL // report EPIPE instead of raising SIGPIPE
+#else
+#define SEND_FLAGS 0
+#endif // LS_LINUX
+
+#define RECV_SOME 0 // return once any data was received
+#define RECV_ALL 1 // return once the buffer is full or the peer closed
+
+//! \brief Receive data from a socket.
+//!
+//! \param socket The socket.
+//! \param buffer Receives the data.
+//! \param size The size of buffer.
+//! \param mode RECV_SOME or RECV_ALL.
+//! \param block Whether to wait for data. If 0 and no data is
+//! available, fails with LS_NOT_READY.
+//!
+//! \return The number of bytes received, 0 if the peer closed the
+//! connection, -1 on failure.
+static size_t ls_socket_recv(ls_socket_t *socket, void *buffer, size_t size, int mode, int block)
 {
+	char *buf = buffer;
+	size_t total = 0;
+	int task, flags, err;
 #if LS_WINDOWS
-	ls_socket_t *socket = sock;
-	int to_read, rc;
-	size_t remain;
-	char *buf;
-
-	if (ls_type_check(sock, LS_SOCKET))
-		return -1;
+	int len, rc;
+#else
+	ssize_t rc;
+#endif // LS_WINDOWS
 
 	if (!socket->can_recv)
 		return ls_set_errno(LS_ACCESS_DENIED);
 
-	remain = size;
-	buf = buffer;
+	// tasks must not block their worker in recv
+	task = block && ls_task_io_active();
 
-	while (remain != 0)
+	while (total < size)
 	{
-		to_read = remain > INT_MAX ? INT_MAX : (int)remain;
+		flags = 0;
+		if (mode == RECV_ALL && block && !task && !socket->nonblock)
+			flags |= MSG_WAITALL;
 
-		rc = recv(socket->socket, buf, to_read, 0);
-		if (rc == SOCKET_ERROR)
-			return ls_set_errno(LS_IO_ERROR);
+#if LS_WINDOWS
+		len = size - total > INT_MAX ? INT_MAX : (int)(size - total);
+		rc = recv(socket->socket, buf + total, len, flags);
+#else
+		if (!block || task)
+			flags |= MSG_DONTWAIT;
+		rc = recv(socket->socket, buf + total, size - total, flags);
+#endif // LS_WINDOWS
+
+		if (rc > 0)
+		{
+			total += rc;
+			if (mode == RECV_SOME)
+				break;
+			continue;
+		}
 
 		if (rc == 0)
-			break;
+			break; // peer closed the connection
+
+		err = ls_sock_error();
+		if (ls_sock_interrupted(err))
+			continue;
+
+		if (ls_sock_would_block(err))
+		{
+			if (!block)
+			{
+				if (total != 0)
+					break;
+				return ls_set_errno(LS_NOT_READY);
+			}
+
+			// sleep until data arrives, suspends only a task
+			if (ls_sockfd_wait(socket->socket, LS_INFINITE) == -1)
+				return total != 0 ? total : (size_t)-1;
+			continue;
+		}
 
-		remain -= rc;
-		buf += rc;
+		// report the error on the next call
+		if (total != 0)
+			break;
+		return ls_set_errno_sock(err);
 	}
 
-	return size - remain;
-#else
-    ls_socket_t *socket = sock;
-    ssize_t bytes_read;
-    size_t remain;
-    char *buf;
-    
-    if (ls_type_check(sock, LS_SOCKET))
-        return -1;
-    
-    if (!socket->can_recv)
-        return ls_set_errno(LS_ACCESS_DENIED);
-    
-    remain = size;
-    buf = buffer;
-    
-    while (remain != 0)
-    {
-        bytes_read = read(socket->socket, buf, remain);
-        if (bytes_read == 0)
-            break;
-        else if (bytes_read == -1)
-        {
-            if (errno == EAGAIN)
-                continue;
-            return ls_set_errno(errno);
-        }
-        
-        remain -= bytes_read;
-        buf += bytes_read;
-    }
-    
-    return size - remain;
-#endif // LS_WINDOWS
+	return total;
 }
 
-size_t ls_net_send(ls_handle sock, const void *buffer, size_t size)
+size_t ls_net_recv(ls_handle sock, void *buffer, size_t size)
 {
-#if LS_WINDOWS
 	ls_socket_t *socket = sock;
-	int to_write, rc;
-	size_t remain;
-	const char *buf;
 
 	if (ls_type_check(sock, LS_SOCKET))
 		return -1;
 
-	if (!socket->can_send)
-		return ls_set_errno(LS_ACCESS_DENIED);
+	return ls_socket_recv(socket, buffer, size, RECV_ALL, !socket->nonblock);
+}
 
-	remain = size;
-	buf = buffer;
+size_t ls_net_recv_some(ls_handle sock, void *buffer, size_t size)
+{
+	ls_socket_t *socket = sock;
 
-	while (remain != 0)
-	{
-		to_write = remain > INT_MAX ? INT_MAX : (int)remain;
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
 
-		rc = send(socket->socket, buf, to_write, 0);
-		if (rc == SOCKET_ERROR)
-			return ls_set_errno(LS_IO_ERROR);
+	return ls_socket_recv(socket, buffer, size, RECV_SOME, !socket->nonblock);
+}
 
-		if (rc == 0)
-			break;
+size_t ls_net_recv_exact(ls_handle sock, void *buffer, size_t size)
+{
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
 
-		remain -= rc;
-		buf += rc;
-	}
+	return ls_socket_recv(sock, buffer, size, RECV_ALL, 1);
+}
 
-	return size - remain;
+size_t ls_net_send(ls_handle sock, const void *buffer, size_t size)
+{
+	ls_socket_t *socket = sock;
+	const char *buf = buffer;
+	size_t total = 0;
+	int block, task, flags, err;
+	ls_pollfd pfd;
+#if LS_WINDOWS
+	int len, rc;
+#else
+	ssize_t rc;
+#endif // LS_WINDOWS
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (!socket->can_send)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+	block = !socket->nonblock;
+	task = block && ls_task_io_active();
+
+	while (total < size)
+	{
+		flags = SEND_FLAGS;
+
+#if LS_WINDOWS
+		len = size - total > INT_MAX ? INT_MAX : (int)(size - total);
+		rc = send(socket->socket, buf + total, len, flags);
+#else
+		if (task)
+			flags |= MSG_DONTWAIT;
+		rc = send(socket->socket, buf + total, size - total, flags);
+#endif // LS_WINDOWS
+
+		if (rc > 0)
+		{
+			total += rc;
+			continue;
+		}
+
+		if (rc == 0)
+			break;
+
+		err = ls_sock_error();
+		if (ls_sock_interrupted(err))
+			continue;
+
+		if (ls_sock_would_block(err))
+		{
+			if (!block)
+			{
+				if (total != 0)
+					break;
+				return ls_set_errno(LS_NOT_READY);
+			}
+
+			// sleep until there is room, suspends only a task
+			pfd.fd = socket->socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (ls_socket_poll(&pfd, 1, LS_INFINITE) == -1)
+				return total != 0 ? total : (size_t)-1;
+			continue;
+		}
+
+		if (total != 0)
+			break;
+		return ls_set_errno_sock(err);
+	}
+
+	return total;
+}
+
+int ls_socket_check_idle(ls_handle sock)
+{
+	ls_socket_t *socket = sock;
+	ls_pollfd pfd;
+	char c;
+	int rc;
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (!socket->can_recv || !socket->can_send)
+		return 0;
+
+	pfd.fd = socket->socket;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	rc = ls_socket_poll(&pfd, 1, 0);
+	if (rc == -1)
+		return -1;
+
+	if (rc == 0)
+		return 1; // nothing happened while idle
+
+	if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+		return 0;
+
+	// readable, either the peer closed the connection or sent data
+	// nobody asked for
+#if LS_WINDOWS
+	rc = recv(socket->socket, &c, 1, MSG_PEEK);
+#else
+	rc = recv(socket->socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (rc == -1 && ls_sock_would_block(errno))
+		return 1;
+#endif // LS_WINDOWS
+
+	return 0;
+}
+
+int ls_net_set_nonblocking(ls_handle sock, int nonblocking)
+{
+	ls_socket_t *socket;
+	ls_server_t *server;
+
+	nonblocking = nonblocking ? 1 : 0;
+
+	if (ls_type_check(sock, LS_SOCKET) == 0)
+	{
+		socket = sock;
+		if (ls_sockfd_set_nonblock(socket->socket, nonblocking) == -1)
+			return -1;
+
+		socket->nonblock = nonblocking;
+		return 0;
+	}
+
+	if (ls_type_check(sock, LS_SERVER) == 0)
+	{
+		server = sock;
+		if (ls_sockfd_set_nonblock(server->socket, nonblocking || server->native_nonblock) == -1)
+			return -1;
+
+		server->nonblock = nonblocking;
+		return 0;
+	}
+
+	return -1;
+}
+
+//! \brief Get the native socket of a socket or server handle.
+static int ls_handle_sockfd(ls_handle sock, ls_sockfd_t *fd)
+{
+	if (ls_type_check(sock, LS_SOCKET) == 0)
+	{
+		*fd = ((ls_socket_t *)sock)->socket;
+		return 0;
+	}
+
+	if (ls_type_check(sock, LS_SERVER) == 0)
+	{
+		*fd = ((ls_server_t *)sock)->socket;
+		return 0;
+	}
+
+	return -1;
+}
+
+int ls_net_setopt(ls_handle sock, int opt, int value)
+{
+	ls_sockfd_t fd;
+
+	if (ls_handle_sockfd(sock, &fd) == -1)
+		return -1;
+
+	return ls_sockfd_setopt(fd, opt, value);
+}
+
+int ls_net_getopt(ls_handle sock, int opt, int *value)
+{
+	ls_sockfd_t fd;
+	int level, name;
+#if LS_WINDOWS
+	int len;
+#else
+	socklen_t len;
+#endif // LS_WINDOWS
+
+	if (!value)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (ls_handle_sockfd(sock, &fd) == -1)
+		return -1;
+
+	if (ls_sockopt_native(opt, &level, &name) == -1)
+		return -1;
+
+	*value = 0;
+	len = sizeof(*value);
+
+#if LS_WINDOWS
+	if (getsockopt(fd, level, name, (char *)value, &len) == SOCKET_ERROR)
+		return ls_set_errno_wsa(WSAGetLastError());
+#else
+	if (getsockopt(fd, level, name, value, &len) == -1)
+		return ls_set_errno(errno == ENOPROTOOPT ? LS_NOT_SUPPORTED : ls_errno_to_error(errno));
+#endif // LS_WINDOWS
+
+	return 0;
+}
+
+int ls_net_poll(const ls_handle *socks, int *events, size_t count, unsigned long ms)
+{
+	ls_pollfd stack_fds[POLL_STACK_COUNT];
+	ls_pollfd *fds;
+	size_t i;
+	int rc;
+
+	if (!socks || !events)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (count == 0)
+		return 0;
+
+	if (count > INT_MAX)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (count <= POLL_STACK_COUNT)
+		fds = stack_fds;
+	else
+	{
+		fds = ls_malloc(count * sizeof(ls_pollfd));
+		if (!fds)
+			return -1;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (ls_type_check(socks[i], LS_SOCKET) == 0)
+			fds[i].fd = ((ls_socket_t *)socks[i])->socket;
+		else if (ls_type_check(socks[i], LS_SERVER) == 0)
+			fds[i].fd = ((ls_server_t *)socks[i])->socket;
+		else
+		{
+			if (fds != stack_fds)
+				ls_free(fds);
+			return -1;
+		}
+
+		fds[i].events = 0;
+		if (events[i] & LS_NET_POLL_IN)
+			fds[i].events |= POLLIN;
+		if (events[i] & LS_NET_POLL_OUT)
+			fds[i].events |= POLLOUT;
+		fds[i].revents = 0;
+	}
+
+	rc = ls_socket_poll(fds, count, ms);
+	if (rc != -1)
+	{
+		for (i = 0; i < count; i++)
+		{
+			events[i] = 0;
+			if (fds[i].revents & POLLIN)
+				events[i] |= LS_NET_POLL_IN;
+			if (fds[i].revents & POLLOUT)
+				events[i] |= LS_NET_POLL_OUT;
+			if (fds[i].revents & (POLLERR | POLLNVAL))
+				events[i] |= LS_NET_POLL_ERR;
+			if (fds[i].revents & POLLHUP)
+				events[i] |= LS_NET_POLL_HUP;
+		}
+	}
+
+	if (fds != stack_fds)
+		ls_free(fds);
+
+	return rc;
+}
+
+int ls_net_addr_parse(const char *host, unsigned short port, int addr_family, struct ls_net_addr *addr)
+{
+	if (!host || !addr)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+#if LS_WINDOWS
+	if (ls_check_wsa() != 0)
+		return -1;
+#endif // LS_WINDOWS
+
+	if (ls_parse_sockaddr(host, port, addr_family, (PSOCKADDR_STORAGE)addr->data) == -1)
+		return -1;
+
+	addr->len = ls_sockaddr_len((struct sockaddr_storage *)addr->data);
+	return 0;
+}
+
+int ls_net_addr_format(const struct ls_net_addr *addr, char *host, size_t size, unsigned short *port)
+{
+	const struct sockaddr_storage *ss;
+	const void *src;
+
+	if (!addr || (!host && size))
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	ss = (const struct sockaddr_storage *)addr->data;
+	switch (ss->ss_family)
+	{
+	case AF_UNIX:
+		if (port)
+			*port = 0;
+		return ls_format_unix_addr((const struct sockaddr_un *)ss, addr->len, host, size);
+	case AF_INET:
+		src = &((const struct sockaddr_in *)ss)->sin_addr;
+		if (port)
+			*port = ntohs(((const struct sockaddr_in *)ss)->sin_port);
+		break;
+	case AF_INET6:
+		src = &((const struct sockaddr_in6 *)ss)->sin6_addr;
+		if (port)
+			*port = ntohs(((const struct sockaddr_in6 *)ss)->sin6_port);
+		break;
+	default:
+		return ls_set_errno(LS_NOT_SUPPORTED);
+	}
+
+	if (host && !inet_ntop(ss->ss_family, (void *)src, host, size))
+		return ls_set_errno(LS_BUFFER_TOO_SMALL);
+
+	return 0;
+}
+
+int ls_net_set_udp_gro(ls_handle sock, int enable)
+{
+#if LS_LINUX
+	ls_socket_t *socket = sock;
+	int val = enable ? 1 : 0;
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (setsockopt(socket->socket, IPPROTO_UDP, UDP_GRO, &val, sizeof(val)) == -1)
+		return ls_set_errno(errno == ENOPROTOOPT ? LS_NOT_SUPPORTED : ls_errno_to_error(errno));
+
+	return 0;
+#else
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	// received datagrams are never coalesced
+	return enable ? ls_set_errno(LS_NOT_SUPPORTED) : 0;
+#endif // LS_LINUX
+}
+
+#if LS_LINUX
+
+#define BATCH_MAX 64 // datagrams per recvmmsg or sendmmsg
+
+//! \brief Control data of a batched datagram.
+union ls_msg_control
+{
+	char buf[CMSG_SPACE(sizeof(int))];
+	struct cmsghdr align;
+};
+
+//! \brief Receive up to count datagrams with one call.
+//!
+//! \return The number of datagrams received, -1 on failure.
+static int ls_recv_chunk(ls_socket_t *socket, struct ls_net_msg *msgs, size_t count, int flags)
+{
+	struct mmsghdr hdrs[BATCH_MAX];
+	struct iovec iov[BATCH_MAX];
+	union ls_msg_control control[BATCH_MAX];
+	struct cmsghdr *cmsg;
+	size_t i;
+	int rc;
+
+	for (i = 0; i < count; i++)
+	{
+		iov[i].iov_base = msgs[i].buffer;
+		iov[i].iov_len = msgs[i].size;
+
+		memset(&hdrs[i].msg_hdr, 0, sizeof(hdrs[i].msg_hdr));
+		hdrs[i].msg_hdr.msg_name = msgs[i].addr.data;
+		hdrs[i].msg_hdr.msg_namelen = sizeof(msgs[i].addr.data);
+		hdrs[i].msg_hdr.msg_iov = &iov[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+		hdrs[i].msg_hdr.msg_control = control[i].buf;
+		hdrs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+	}
+
+	rc = recvmmsg(socket->socket, hdrs, (unsigned int)count, flags, NULL);
+	if (rc == -1)
+		return -1;
+
+	for (i = 0; i < (size_t)rc; i++)
+	{
+		msgs[i].length = hdrs[i].msg_len;
+		msgs[i].addr.len = hdrs[i].msg_hdr.msg_namelen;
+		msgs[i].segment_size = 0;
+		msgs[i].flags = 0;
+
+		if (hdrs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			msgs[i].flags |= LS_NET_MSG_TRUNC;
+
+		for (cmsg = CMSG_FIRSTHDR(&hdrs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&hdrs[i].msg_hdr, cmsg))
+		{
+			// datagrams coalesced by UDP_GRO
+			if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+				msgs[i].segment_size = (unsigned short)*(int *)CMSG_DATA(cmsg);
+		}
+	}
+
+	return rc;
+}
+
+//! \brief Send up to count datagrams with one call.
+//!
+//! \return The number of datagrams sent, -1 on failure.
+static int ls_send_chunk(ls_socket_t *socket, struct ls_net_msg *msgs, size_t count, int flags)
+{
+	struct mmsghdr hdrs[BATCH_MAX];
+	struct iovec iov[BATCH_MAX];
+	union ls_msg_control control[BATCH_MAX];
+	struct cmsghdr *cmsg;
+	uint16_t segment;
+	size_t i;
+	int rc;
+
+	for (i = 0; i < count; i++)
+	{
+		iov[i].iov_base = msgs[i].buffer;
+		iov[i].iov_len = msgs[i].size;
+
+		memset(&hdrs[i].msg_hdr, 0, sizeof(hdrs[i].msg_hdr));
+		if (msgs[i].addr.len)
+		{
+			hdrs[i].msg_hdr.msg_name = msgs[i].addr.data;
+			hdrs[i].msg_hdr.msg_namelen = msgs[i].addr.len;
+		}
+		hdrs[i].msg_hdr.msg_iov = &iov[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+
+		if (msgs[i].segment_size)
+		{
+			// let the kernel split the buffer (UDP_SEGMENT)
+			memset(&control[i], 0, sizeof(control[i]));
+			hdrs[i].msg_hdr.msg_control = control[i].buf;
+			hdrs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+
+			cmsg = CMSG_FIRSTHDR(&hdrs[i].msg_hdr);
+			cmsg->cmsg_level = IPPROTO_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+			segment = msgs[i].segment_size;
+			memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+		}
+	}
+
+	rc = sendmmsg(socket->socket, hdrs, (unsigned int)count, flags);
+	if (rc == -1)
+		return -1;
+
+	for (i = 0; i < (size_t)rc; i++)
+		msgs[i].length = hdrs[i].msg_len;
+
+	return rc;
+}
+
+#else
+
+//! \brief Receive a single datagram.
+static int ls_recv_chunk(ls_socket_t *socket, struct ls_net_msg *msgs, size_t count, int flags)
+{
+#if LS_WINDOWS
+	int addr_len = sizeof(msgs->addr.data);
+	int len = msgs->size > INT_MAX ? INT_MAX : (int)msgs->size;
+	int rc;
+#else
+	socklen_t addr_len = sizeof(msgs->addr.data);
+	size_t len = msgs->size;
+	ssize_t rc;
+#endif // LS_WINDOWS
+
+	(void)count;
+	(void)flags;
+
+	rc = recvfrom(socket->socket, msgs->buffer, len, 0, (struct sockaddr *)msgs->addr.data, &addr_len);
+	if (rc < 0)
+	{
+#if LS_WINDOWS
+		// the datagram did not fit, the rest was discarded
+		if (WSAGetLastError() != WSAEMSGSIZE)
+			return -1;
+
+		msgs->length = msgs->size;
+		msgs->flags = LS_NET_MSG_TRUNC;
+#else
+		return -1;
+#endif // LS_WINDOWS
+	}
+	else
+	{
+		msgs->length = rc;
+		msgs->flags = 0;
+	}
+
+	msgs->addr.len = (unsigned int)addr_len;
+	msgs->segment_size = 0;
+
+	return 1;
+}
+
+//! \brief Send a single datagram, split into segments if requested.
+static int ls_send_chunk(ls_socket_t *socket, struct ls_net_msg *msgs, size_t count, int flags)
+{
+	const char *buf = msgs->buffer;
+	size_t off = 0, len;
+	int rc;
+
+	(void)count;
+	(void)flags;
+
+	do
+	{
+		len = msgs->size - off;
+		if (msgs->segment_size && len > msgs->segment_size)
+			len = msgs->segment_size;
+
+		rc = sendto(socket->socket, buf + off, (int)len, SEND_FLAGS,
+			msgs->addr.len ? (const struct sockaddr *)msgs->addr.data : NULL, msgs->addr.len);
+		if (rc < 0)
+		{
+			// segments already sent cannot be taken back
+			if (off != 0)
+				break;
+			return -1;
+		}
+
+		off += len;
+	} while (off < msgs->size);
+
+	msgs->length = off;
+	return 1;
+}
+
+#endif // LS_LINUX
+
+size_t ls_net_recv_batch(ls_handle sock, struct ls_net_msg *msgs, size_t count)
+{
+	ls_socket_t *socket = sock;
+	size_t total = 0, n;
+	int block, task, flags, rc, err;
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (!msgs && count)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (!socket->can_recv)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+	block = !socket->nonblock;
+	task = block && ls_task_io_active();
+
+	while (total < count)
+	{
+#if LS_LINUX
+		n = count - total;
+		if (n > BATCH_MAX)
+			n = BATCH_MAX;
+
+		// wait for the first datagram at most, then take what is queued
+		flags = total != 0 || !block || task ? MSG_DONTWAIT : MSG_WAITFORONE;
+#else
+		n = 1;
+		flags = 0;
+
+		// only take datagrams which are already queued
+		if (total != 0 && ls_socket_wait(socket, 0) != 0)
+			break;
+#endif // LS_LINUX
+
+		rc = ls_recv_chunk(socket, msgs + total, n, flags);
+		if (rc >= 0)
+		{
+			total += rc;
+			if ((size_t)rc < n)
+				break;
+			continue;
+		}
+
+		err = ls_sock_error();
+		if (ls_sock_interrupted(err))
+			continue;
+
+		if (ls_sock_would_block(err))
+		{
+			if (total != 0)
+				break;
+
+			if (!block)
+				return ls_set_errno(LS_NOT_READY);
+
+			if (ls_sockfd_wait(socket->socket, LS_INFINITE) == -1)
+				return -1;
+			continue;
+		}
+
+		if (total != 0)
+			break;
+		return ls_set_errno_sock(err);
+	}
+
+	return total;
+}
+
+size_t ls_net_send_batch(ls_handle sock, struct ls_net_msg *msgs, size_t count)
+{
+	ls_socket_t *socket = sock;
+	size_t total = 0, n;
+	int block, task, flags, rc, err;
+	ls_pollfd pfd;
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (!msgs && count)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (!socket->can_send)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+	block = !socket->nonblock;
+	task = block && ls_task_io_active();
+
+	while (total < count)
+	{
+#if LS_LINUX
+		n = count - total;
+		if (n > BATCH_MAX)
+			n = BATCH_MAX;
+		flags = SEND_FLAGS | (task ? MSG_DONTWAIT : 0);
+#else
+		n = 1;
+		flags = 0;
+#endif // LS_LINUX
+
+		rc = ls_send_chunk(socket, msgs + total, n, flags);
+		if (rc > 0)
+		{
+			total += rc;
+			continue;
+		}
+
+		err = ls_sock_error();
+		if (ls_sock_interrupted(err))
+			continue;
+
+		if (ls_sock_would_block(err))
+		{
+			if (!block)
+			{
+				if (total != 0)
+					break;
+				return ls_set_errno(LS_NOT_READY);
+			}
+
+			pfd.fd = socket->socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (ls_socket_poll(&pfd, 1, LS_INFINITE) == -1)
+				return total != 0 ? total : (size_t)-1;
+			continue;
+		}
+
+		if (total != 0)
+			break;
+		return ls_set_errno_sock(err);
+	}
+
+	return total;
+}
+
+#define SENDFILE_CHUNK 0x10000 // bytes copied at once without kernel support
+
+//! \brief Send part of a file by reading it into a buffer.
+static size_t ls_sendfile_copy(ls_socket_t *socket, ls_file_t *file, uint64_t offset, size_t size)
+{
+	char *buf;
+	size_t total = 0, chunk, sent;
+#if LS_WINDOWS
+	OVERLAPPED ov;
+	DWORD dwRead;
+#else
+	ssize_t rc;
+#endif // LS_WINDOWS
+
+	buf = ls_malloc(size < SENDFILE_CHUNK ? size : SENDFILE_CHUNK);
+	if (!buf)
+		return -1;
+
+	while (total < size)
+	{
+		chunk = size - total < SENDFILE_CHUNK ? size - total : SENDFILE_CHUNK;
+
+#if LS_WINDOWS
+		ZeroMemory(&ov, sizeof(ov));
+		ov.Offset = (DWORD)(offset + total);
+		ov.OffsetHigh = (DWORD)((offset + total) >> 32);
+
+		if (!ReadFile(file->hFile, buf, (DWORD)chunk, &dwRead, &ov))
+		{
+			if (GetLastError() == ERROR_HANDLE_EOF)
+				break;
+
+			ls_free(buf);
+			if (total != 0)
+				return total;
+			return ls_set_errno_win32(GetLastError());
+		}
+
+		chunk = dwRead;
+#else
+		do
+			rc = pread(file->fd, buf, chunk, (off_t)(offset + total));
+		while (rc == -1 && errno == EINTR);
+
+		if (rc == -1)
+		{
+			ls_free(buf);
+			if (total != 0)
+				return total;
+			return ls_set_errno_errno(errno);
+		}
+
+		chunk = (size_t)rc;
+#endif // LS_WINDOWS
+
+		if (chunk == 0)
+			break; // end of file
+
+		sent = ls_net_send(socket, buf, chunk);
+		if (sent == (size_t)-1)
+		{
+			ls_free(buf);
+			return total != 0 ? total : (size_t)-1;
+		}
+
+		total += sent;
+		if (sent < chunk)
+			break; // non-blocking socket is full
+	}
+
+	ls_free(buf);
+	return total;
+}
+
+size_t ls_net_sendfile(ls_handle sock, ls_handle file, uint64_t offset, size_t size)
+{
+	ls_socket_t *socket = sock;
+	ls_file_t *pf = file;
+#if LS_LINUX
+	size_t total = 0;
+	int task, err;
+	off_t off;
+	ssize_t rc;
+	ls_pollfd pfd;
+#elif LS_DARWIN
+	size_t total = 0;
+	off_t len;
+	int rc, err;
+	ls_pollfd pfd;
+#endif // LS_LINUX
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (ls_type_check(file, LS_FILE))
+		return -1;
+
+	if (!(LS_HANDLE_INFO(file)->flags & LS_FILE_READ))
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+	if (!socket->can_send)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+#if LS_WINDOWS
+	if (!pf->hFile)
+		return 0; // NUL device
+#else
+	if (pf->fd == -1)
+		return 0; // null device
+#endif // LS_WINDOWS
+
+#if LS_LINUX
+	// sendfile has no per-call flag to avoid blocking the worker
+	task = !socket->nonblock && ls_task_io_active();
+	if (task && ls_sockfd_set_nonblock(socket->socket, 1) == -1)
+		return -1;
+
+	off = (off_t)offset;
+
+	while (total < size)
+	{
+		rc = sendfile(socket->socket, pf->fd, &off, size - total);
+		if (rc > 0)
+		{
+			total += rc;
+			continue;
+		}
+
+		if (rc == 0)
+			break; // end of file
+
+		err = errno;
+		if (err == EINTR)
+			continue;
+
+		if (err == EINVAL || err == ENOSYS)
+		{
+			// the file does not support mapping, e.g. a pipe
+			if (total != 0)
+				break;
+
+			if (task)
+				(void)ls_sockfd_set_nonblock(socket->socket, 0);
+			return ls_sendfile_copy(socket, pf, offset, size);
+		}
+
+		if (err == EAGAIN)
+		{
+			if (socket->nonblock)
+			{
+				if (total != 0)
+					break;
+				return ls_set_errno(LS_NOT_READY);
+			}
+
+			pfd.fd = socket->socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (ls_socket_poll(&pfd, 1, LS_INFINITE) != -1)
+				continue;
+			err = -1;
+		}
+
+		if (task)
+			(void)ls_sockfd_set_nonblock(socket->socket, 0);
+
+		if (total != 0)
+			return total;
+		return err == -1 ? -1 : ls_set_errno_errno(err);
+	}
+
+	if (task)
+		(void)ls_sockfd_set_nonblock(socket->socket, 0);
+
+	return total;
+#elif LS_DARWIN
+	while (total < size)
+	{
+		len = (off_t)(size - total);
+		rc = sendfile(pf->fd, socket->socket, (off_t)(offset + total), &len, NULL, 0);
+
+		// len is the number of bytes sent, even on failure
+		total += (size_t)len;
+
+		if (rc == 0)
+		{
+			if (len == 0)
+				break; // end of file
+			continue;
+		}
+
+		err = errno;
+		if (err == EINTR)
+			continue;
+
+		if (err == EAGAIN)
+		{
+			if (socket->nonblock)
+			{
+				if (total != 0)
+					break;
+				return ls_set_errno(LS_NOT_READY);
+			}
+
+			pfd.fd = socket->socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (ls_socket_poll(&pfd, 1, LS_INFINITE) != -1)
+				continue;
+			return total != 0 ? total : -1;
+		}
+
+		if ((err == ENOTSUP || err == ENOTSOCK || err == EOPNOTSUPP) && total == 0)
+			return ls_sendfile_copy(socket, pf, offset, size);
+
+		if (total != 0)
+			break;
+		return ls_set_errno_errno(err);
+	}
+
+	return total;
+#else
+	return ls_sendfile_copy(socket, pf, offset, size);
+#endif // LS_LINUX
+}
+
+int ls_net_set_zerocopy(ls_handle sock, int enable)
+{
+	ls_socket_t *socket = sock;
+#if LS_LINUX
+	int val = enable ? 1 : 0;
+#endif // LS_LINUX
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+#if LS_LINUX
+	if (setsockopt(socket->socket, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)) == -1)
+		return ls_set_errno(errno == ENOPROTOOPT || errno == EOPNOTSUPP ? LS_NOT_SUPPORTED : ls_errno_to_error(errno));
+
+	socket->zerocopy = val;
+	return 0;
+#else
+	(void)socket;
+	return enable ? ls_set_errno(LS_NOT_SUPPORTED) : 0;
+#endif // LS_LINUX
+}
+
+#if LS_LINUX
+
+//! \brief Read zero-copy completions from the error queue.
+//!
+//! \return 0 if no completion reported copied data, 1 if one did,
+//! -1 on failure.
+static int ls_zerocopy_reap(ls_socket_t *socket)
+{
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct sock_extended_err *serr;
+	char control[128];
+	int copied = 0;
+
+	for (;;)
+	{
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(socket->socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				return copied;
+			return ls_set_errno_errno(errno);
+		}
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+				!(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			// sends ee_info through ee_data completed
+			socket->zc_done += (uint32_t)(serr->ee_data - serr->ee_info) + 1;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				copied = 1;
+		}
+	}
+}
+
+#endif // LS_LINUX
+
+size_t ls_net_send_zerocopy(ls_handle sock, const void *buffer, size_t size, uint64_t *seq)
+{
+	ls_socket_t *socket = sock;
+#if LS_LINUX
+	const char *buf = buffer;
+	size_t total = 0, sent;
+	int block, task, flags, err;
+	ssize_t rc;
+	ls_pollfd pfd;
+#endif // LS_LINUX
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (!socket->can_send)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+#if LS_LINUX
+	if (!socket->zerocopy)
+	{
+		if (seq)
+			*seq = socket->zc_sent;
+		return ls_net_send(sock, buffer, size);
+	}
+
+	block = !socket->nonblock;
+	task = block && ls_task_io_active();
+
+	while (total < size)
+	{
+		flags = SEND_FLAGS | MSG_ZEROCOPY;
+		if (task)
+			flags |= MSG_DONTWAIT;
+
+		rc = send(socket->socket, buf + total, size - total, flags);
+		if (rc >= 0)
+		{
+			// every successful call is completed separately
+			socket->zc_sent++;
+			total += rc;
+			if (rc == 0)
+				break;
+			continue;
+		}
+
+		err = errno;
+		if (err == EINTR)
+			continue;
+
+		if (err == ENOBUFS)
+		{
+			// too many pending completions, copy the rest
+			sent = ls_net_send(sock, buf + total, size - total);
+			if (sent != (size_t)-1)
+				total += sent;
+			else if (total == 0)
+				return -1;
+			break;
+		}
+
+		if (err == EAGAIN)
+		{
+			if (!block)
+			{
+				if (total != 0)
+					break;
+				return ls_set_errno(LS_NOT_READY);
+			}
+
+			pfd.fd = socket->socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (ls_socket_poll(&pfd, 1, LS_INFINITE) != -1)
+				continue;
+
+			if (total != 0)
+				break;
+			return -1;
+		}
+
+		if (total != 0)
+			break;
+		return ls_set_errno_errno(err);
+	}
+
+	if (seq)
+		*seq = socket->zc_sent;
+
+	return total;
+#else
+	if (seq)
+		*seq = 0;
+	return ls_net_send(sock, buffer, size);
+#endif // LS_LINUX
+}
+
+int ls_net_zerocopy_wait(ls_handle sock, uint64_t seq, unsigned long ms)
+{
+	ls_socket_t *socket = sock;
+#if LS_LINUX
+	long long deadline, remain;
+	unsigned long wait;
+	ls_pollfd pfd;
+#endif // LS_LINUX
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+#if LS_LINUX
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	for (;;)
+	{
+		if (socket->zc_done >= seq)
+			return 0;
+
+		if (ls_zerocopy_reap(socket) == -1)
+			return -1;
+
+		if (socket->zc_done >= seq)
+			return 0;
+
+		if (ms == LS_INFINITE)
+			wait = LS_INFINITE;
+		else
+		{
+			remain = deadline - ls_nanotime();
+			if (remain <= 0)
+				return 1;
+			wait = (unsigned long)((remain + 999999) / 1000000);
+		}
+
+		// completions are reported as a pending error
+		pfd.fd = socket->socket;
+		pfd.events = 0;
+		pfd.revents = 0;
+		if (ls_socket_poll(&pfd, 1, wait) == -1)
+			return -1;
+	}
+#else
+	// data was copied when it was sent
+	(void)socket;
+	(void)seq;
+	(void)ms;
+	return 0;
+#endif // LS_LINUX
+}
+
+size_t ls_net_accept_batch(ls_handle sock, ls_handle *clients, size_t count)
+{
+	ls_server_t *server = sock;
+	ls_socket_t *client;
+	size_t total = 0;
+	int rc, err;
+
+	if (ls_type_check(sock, LS_SERVER))
+		return -1;
+
+	if (!clients && count)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (count == 0)
+		return 0;
+
+	// another thread may take a connection between the wait and the
+	// accept, which must then not block
+	if (!server->nonblock && ls_server_native_nonblock(server) == -1)
+		return -1;
+
+	while (total < count)
+	{
+		if (!server->nonblock && total == 0)
+		{
+			// wait for the first connection only, suspends only a task
+			rc = ls_server_wait(server, LS_INFINITE);
+			if (rc == -1)
+				return -1;
+		}
+
+		client = ls_server_accept(server, 1, &err);
+		if (!client)
+		{
+			// the connection was reset before it was accepted
+			if (ls_sock_interrupted(err))
+				continue;
+#if !LS_WINDOWS
+			if (err == ECONNABORTED)
+				continue;
+#endif // !LS_WINDOWS
+
+			// the backlog is drained
+			if (ls_sock_would_block(err))
+			{
+				if (total != 0)
+					break;
+
+				if (server->nonblock)
+					return ls_set_errno(LS_NOT_READY);
+				continue; // taken by another thread, wait again
+			}
+
+			if (total != 0)
+				break;
+			return -1;
+		}
+
+		clients[total++] = client;
+	}
+
+	return total;
+}
+
+#if LS_LINUX
+
+//! \brief Steer connections to the shard of the receiving CPU.
+static int ls_attach_cpu_steering(ls_sockfd_t fd, size_t nshards)
+{
+	struct sock_filter code[] = {
+		// A = the CPU which received the packet
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+		// A = A % nshards
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)nshards },
+		// select the socket at index A
+		{ BPF_RET | BPF_A, 0, 0, 0 }
+	};
+	struct sock_fprog prog;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == -1)
+		return ls_set_errno(errno == ENOPROTOOPT ? LS_NOT_SUPPORTED : ls_errno_to_error(errno));
+
+	return 0;
+}
+
+#endif // LS_LINUX
+
+int ls_net_listen_sharded(const char *host, unsigned short port, int type, int protocol, int addr_family,
+	const struct ls_net_listen_options *options, ls_handle *shards, size_t nshards, int flags)
+{
+	struct ls_net_listen_options opts;
+	struct ls_net_option *list;
+	ls_sockfd_t fd;
+	size_t i;
+
+	if (!options || !shards || nshards == 0 || port == 0)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+#if !LS_LINUX
+	if (flags & LS_NET_SHARD_CPU)
+		return ls_set_errno(LS_NOT_SUPPORTED);
+#endif // !LS_LINUX
+
+	// every shard binds the same port
+	list = ls_malloc((options->count + 1) * sizeof(struct ls_net_option));
+	if (!list)
+		return -1;
+
+	if (options->count)
+		memcpy(list, options->opts, options->count * sizeof(struct ls_net_option));
+	list[options->count].opt = LS_NET_OPT_REUSEPORT;
+	list[options->count].value = 1;
+
+	opts = *options;
+	opts.opts = list;
+	opts.count = options->count + 1;
+
+	for (i = 0; i < nshards; i++)
+	{
+		shards[i] = ls_net_listen_ex(host, port, type, protocol, addr_family, &opts);
+		if (!shards[i])
+			goto failure;
+	}
+
+	ls_free(list);
+	list = NULL;
+
+#if LS_LINUX
+	// applies to the whole group, shards are indexed in creation order
+	if ((flags & LS_NET_SHARD_CPU) && nshards > 1)
+	{
+		if (ls_handle_sockfd(shards[0], &fd) == -1)
+			goto failure;
+
+		if (ls_attach_cpu_steering(fd, nshards) == -1)
+			goto failure;
+	}
+#else
+	(void)fd;
+#endif // LS_LINUX
+
+	return 0;
+failure:
+	while (i-- > 0)
+		ls_close(shards[i]);
+
+	ls_free(list);
+	return -1;
+}
+
+int ls_net_resolve(const char *host, unsigned short port, int addr_family, struct ls_net_addr *addrs, size_t count)
+{
+	struct sockaddr_storage found[RESOLVE_MAX_ADDRS];
+	int af, rc, i;
+
+	if (!host || !addrs || count == 0)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	af = ls_af_native(addr_family);
+	if (af == -1)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+#if LS_WINDOWS
+	if (ls_check_wsa() != 0)
+		return -1;
+#endif // LS_WINDOWS
+
+	rc = ls_resolve(host, port, af, found, count < RESOLVE_MAX_ADDRS ? (int)count : RESOLVE_MAX_ADDRS);
+	if (rc == -1)
+		return -1;
+
+	for (i = 0; i < rc; i++)
+	{
+		memcpy(addrs[i].data, &found[i], sizeof(found[i]));
+		addrs[i].len = ls_sockaddr_len(&found[i]);
+	}
+
+	return rc;
+}
+
+ls_handle ls_net_resolve_async(const char *host, unsigned short port, int addr_family)
+{
+	int af;
+
+	af = ls_af_native(addr_family);
+	if (af == -1)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+#if LS_WINDOWS
+	if (ls_check_wsa() != 0)
+		return NULL;
+#endif // LS_WINDOWS
+
+	return ls_resolve_async(host, port, af);
+}
+
+int ls_net_resolve_result(ls_handle req, struct ls_net_addr *addrs, size_t count)
+{
+	struct sockaddr_storage found[RESOLVE_MAX_ADDRS];
+	int rc, i;
+
+	if (!addrs || count == 0)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	rc = ls_resolve_result(req, found, count < RESOLVE_MAX_ADDRS ? (int)count : RESOLVE_MAX_ADDRS);
+	if (rc == -1)
+		return -1;
+
+	for (i = 0; i < rc; i++)
+	{
+		memcpy(addrs[i].data, &found[i], sizeof(found[i]));
+		addrs[i].len = ls_sockaddr_len(&found[i]);
+	}
+
+	return rc;
+}
+
+void ls_net_resolver_config(unsigned long ttl, unsigned long negative_ttl)
+{
+	ls_resolve_set_ttl(ttl, negative_ttl);
+}
+
+void ls_net_resolver_flush(void)
+{
+	ls_resolve_flush();
+}
+
+#define ATTEMPT_DELAY 250 // milliseconds before the next address is tried, RFC 8305
+#define UNIX_RETRY_MAX_DELAY 16 // milliseconds between local connects while the backlog is full
+
+//! \brief Order addresses for connecting.
+//!
+//! Alternates between IPv6 and IPv4 addresses, starting with IPv6, so
+//! a broken path of one family does not delay the other (RFC 8305).
+static void ls_sort_addrs(const struct sockaddr_storage *in, int count, struct sockaddr_storage *out)
+{
+	int i6 = 0, i4 = 0, n = 0;
+	int want6 = 1;
+
+	while (n < count)
+	{
+		if (want6)
+		{
+			while (i6 < count && in[i6].ss_family != AF_INET6)
+				i6++;
+
+			if (i6 < count)
+				out[n++] = in[i6++];
+		}
+		else
+		{
+			while (i4 < count && in[i4].ss_family == AF_INET6)
+				i4++;
+
+			if (i4 < count)
+				out[n++] = in[i4++];
+		}
+
+		// one family ran out, the rest is taken in order
+		if (i6 >= count && i4 >= count)
+			break;
+
+		want6 = !want6;
+	}
+}
+
+static void ls_sockfd_close(ls_sockfd_t fd)
+{
+#if LS_WINDOWS
+	(void)closesocket(fd);
+#else
+	(void)close(fd);
+#endif // LS_WINDOWS
+}
+
+//! \brief Start a non-blocking connect.
+//!
+//! \return 0 if the socket connected immediately, 1 if the connect
+//! is in progress, -1 on failure.
+static int ls_connect_start(const struct sockaddr_storage *addr, int type, ls_sockfd_t *fd)
+{
+	ls_sockfd_t s;
+	int err;
+
+	s = socket(addr->ss_family, type, 0);
+#if LS_WINDOWS
+	if (s == INVALID_SOCKET)
+		return ls_set_errno_wsa(WSAGetLastError());
+#else
+	if (s == -1)
+		return ls_set_errno_errno(errno);
+#endif // LS_WINDOWS
+
+	if (ls_sockfd_set_nonblock(s, 1) == -1)
+	{
+		ls_sockfd_close(s);
+		return -1;
+	}
+
+	if (connect(s, (const struct sockaddr *)addr, ls_sockaddr_len(addr)) == 0)
+	{
+		*fd = s;
+		return 0;
+	}
+
+	err = ls_sock_error();
+#if LS_WINDOWS
+	if (err == WSAEWOULDBLOCK)
+#else
+	if (err == EINPROGRESS || err == EINTR)
+#endif // LS_WINDOWS
+	{
+		*fd = s;
+		return 1;
+	}
+
+	ls_sockfd_close(s);
+	return ls_set_errno_sock(err);
+}
+
+//! \brief Get the result of a connect which finished.
+//!
+//! \return 0 if the socket connected, -1 if the connect failed.
+static int ls_connect_result(ls_sockfd_t fd)
+{
+	int err = 0;
+#if LS_WINDOWS
+	int len = sizeof(err);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *)&err, &len) == SOCKET_ERROR)
+		return ls_set_errno_wsa(WSAGetLastError());
+#else
+	socklen_t len = sizeof(err);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1)
+		return ls_set_errno_errno(errno);
+#endif // LS_WINDOWS
+
+	if (err != 0)
+		return ls_set_errno_sock(err);
+	return 0;
+}
+
+//! \brief Connect a local socket before a deadline.
+//!
+//! While the backlog of the listener is full, a non-blocking connect
+//! fails with EAGAIN on Linux instead of waiting, so it is retried
+//! with a backoff until the deadline.
+//!
+//! \return 0 on success, -1 on failure.
+static int ls_connect_unix(const struct sockaddr_storage *addr, int type, long long deadline, unsigned long ms, ls_sockfd_t *fd)
+{
+	ls_pollfd pfd;
+	long long remain;
+	unsigned long delay = 1, wait;
+	int rc, err;
+
+	for (;;)
+	{
+		rc = ls_connect_start(addr, type, fd);
+		if (rc == 0)
+			return 0;
+
+		if (ms == LS_INFINITE)
+			wait = LS_INFINITE;
+		else
+		{
+			remain = (deadline - ls_nanotime() + 999999) / 1000000;
+			wait = remain > 0 ? (unsigned long)remain : 0;
+		}
+
+		if (rc == 1)
+		{
+			// completes asynchronously on some systems
+			pfd.fd = *fd;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+
+			rc = ls_socket_poll(&pfd, 1, wait);
+			if (rc == 1 && ls_connect_result(*fd) == 0)
+				return 0;
+
+			err = rc == 0 ? LS_TIMEDOUT : _ls_errno;
+			ls_sockfd_close(*fd);
+			return ls_set_errno(err);
+		}
+
+		if (_ls_errno != LS_NOT_READY)
+			return -1;
+
+		// the backlog of the listener is full
+		if (wait == 0)
+			return ls_set_errno(LS_TIMEDOUT);
+
+		if (delay > wait)
+			delay = wait;
+
+		// suspends only a task
+		if (ls_task_sleep(delay) == -1)
+			ls_sleep(delay);
+
+		if (delay < UNIX_RETRY_MAX_DELAY)
+			delay *= 2;
+	}
+}
+
+ls_handle ls_net_connect_ex(const char *host, unsigned short port, int type, int protocol, int addr_family, unsigned long ms)
+{
+	struct sockaddr_storage found[RESOLVE_MAX_ADDRS];
+	struct sockaddr_storage addrs[RESOLVE_MAX_ADDRS];
+	ls_pollfd pfds[RESOLVE_MAX_ADDRS];
+	ls_socket_t *sock;
+	ls_sockfd_t fd;
+	ls_handle req;
+	long long now, deadline, next, until;
+	unsigned long wait;
+	int af, count, started = 0, active = 0, connected = 0;
+	int rc, i, err = LS_NOT_FOUND;
+
+	switch (type)
+	{
+	default:
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	case LS_NET_STREAM:
+		type = SOCK_STREAM;
+		break;
+	case LS_NET_DGRAM:
+		type = SOCK_DGRAM;
+		break;
+	case LS_NET_SEQPACKET:
+		type = SOCK_SEQPACKET;
+		break;
+	}
+
+	if (protocol != LS_NET_PROTO_DEFAULT && protocol != LS_NET_PROTO_TCP && protocol != LS_NET_PROTO_UDP)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	af = ls_af_native(addr_family);
+	if (!host || af == -1)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+#if LS_WINDOWS
+	if (ls_check_wsa() != 0)
+		return NULL;
+#endif // LS_WINDOWS
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	if (af == AF_UNIX)
+	{
+		if (ls_parse_sockaddr(host, port, addr_family, &addrs[0]) == -1)
+			return NULL;
+
+		if (ls_connect_unix(&addrs[0], type, deadline, ms, &fd) == -1)
+			return NULL;
+
+		goto connected;
+	}
+
+	// resolved in the background, a slow resolver counts against the
+	// deadline and does not block the worker of a task. Numeric and
+	// cached hosts complete immediately.
+	req = ls_resolve_async(host, port, af);
+	if (!req)
+		return NULL;
+
+	rc = ls_timedwait(req, ms);
+	if (rc != 0)
+	{
+		ls_close(req);
+		if (rc == 1)
+			ls_set_errno(LS_TIMEDOUT);
+		return NULL;
+	}
+
+	count = ls_resolve_result(req, found, RESOLVE_MAX_ADDRS);
+	ls_close(req);
+	if (count == -1)
+		return NULL;
+
+	ls_sort_addrs(found, count, addrs);
+
+	next = ls_nanotime();
+
+	for (;;)
+	{
+		now = ls_nanotime();
+
+		// start the next attempt once the previous one had time to
+		// complete, or right away if none is pending
+		if (started < count && (now >= next || active == 0))
+		{
+			rc = ls_connect_start(&addrs[started++], type, &fd);
+			if (rc == 0)
+			{
+				connected = 1;
+				break;
+			}
+
+			if (rc == 1)
+			{
+				pfds[active].fd = fd;
+				pfds[active].events = POLLOUT;
+				pfds[active].revents = 0;
+				active++;
+
+				next = now + (long long)ATTEMPT_DELAY * 1000000;
+			}
+			else
+				err = _ls_errno;
+			continue;
+		}
+
+		if (active == 0)
+			break; // every address failed
+
+		if (ms != LS_INFINITE && now >= deadline)
+		{
+			err = LS_TIMEDOUT;
+			break;
+		}
+
+		if (started < count)
+			until = next;
+		else if (ms != LS_INFINITE)
+			until = deadline;
+		else
+			until = 0;
+
+		if (until != 0 && ms != LS_INFINITE && deadline < until)
+			until = deadline;
+
+		wait = until == 0 ? LS_INFINITE : (unsigned long)((until - now + 999999) / 1000000);
+
+		// suspends only a task
+		rc = ls_socket_poll(pfds, active, wait);
+		if (rc == -1)
+		{
+			err = _ls_errno;
+			break;
+		}
+
+		for (i = 0; i < active;)
+		{
+			if (pfds[i].revents == 0)
+			{
+				i++;
+				continue;
+			}
+
+			if (ls_connect_result(pfds[i].fd) == 0)
+			{
+				fd = pfds[i].fd;
+				pfds[i] = pfds[--active];
+				connected = 1;
+				break;
+			}
+
+			err = _ls_errno;
+			ls_sockfd_close(pfds[i].fd);
+			pfds[i] = pfds[--active];
+
+			// a failed attempt does not hold back the next one
+			next = now;
+		}
+
+		if (connected)
+			break;
+	}
+
+	// abandon the attempts which lost the race
+	for (i = 0; i < active; i++)
+		ls_sockfd_close(pfds[i].fd);
+
+	if (!connected)
+	{
+		ls_set_errno(err);
+		return NULL;
+	}
+
+connected:
+	if (ls_sockfd_set_nonblock(fd, 0) == -1)
+	{
+		ls_sockfd_close(fd);
+		return NULL;
+	}
+
+	sock = ls_handle_create(&SocketClass, 0);
+	if (!sock)
+	{
+		ls_sockfd_close(fd);
+		return NULL;
+	}
+
+	sock->socket = fd;
+	sock->host = ls_strdup(host);
+	if (!sock->host)
+	{
+		ls_sockfd_close(fd);
+		ls_handle_dealloc(sock);
+		return NULL;
+	}
+
+	sock->port = port;
+	sock->can_recv = 1;
+	sock->can_send = 1;
+
+	return sock;
+}
+
+#if !LS_WINDOWS
+
+//! \brief Get the file descriptor of a handle to pass to another
+//! process.
+static int ls_handle_passable_fd(ls_handle h, int *fd)
+{
+	ls_file_t *pf;
+	int flags;
+
+	if (ls_handle_sockfd(h, fd) == 0)
+		return 0;
+
+	// also resolves pipes and the standard streams
+	pf = ls_resolve_file(h, &flags);
+	if (!pf)
+		return -1;
+
+	if (pf->fd == -1)
+		return ls_set_errno(LS_INVALID_HANDLE); // LS_DEVNULL
+
+	*fd = pf->fd;
+	return 0;
+}
+
+//! \brief Set the host and port of a socket from the address of its
+//! peer.
+static void ls_socket_set_peer(ls_socket_t *sock, const struct sockaddr_storage *addr)
+{
+	char host[INET6_ADDRSTRLEN];
+	const void *src;
+
+	switch (addr->ss_family)
+	{
+	default:
+		return;
+	case AF_INET:
+		src = &((const struct sockaddr_in *)addr)->sin_addr;
+		sock->port = ntohs(((const struct sockaddr_in *)addr)->sin_port);
+		break;
+	case AF_INET6:
+		src = &((const struct sockaddr_in6 *)addr)->sin6_addr;
+		sock->port = ntohs(((const struct sockaddr_in6 *)addr)->sin6_port);
+		break;
+	}
+
+	if (inet_ntop(addr->ss_family, src, host, sizeof(host)))
+		sock->host = ls_strdup(host);
+}
+
+//! \brief Create a handle which owns a received file descriptor.
+//!
+//! \return The handle, or NULL on failure, in which case the
+//! descriptor is not closed.
+static ls_handle ls_handle_from_fd(int fd)
+{
+	ls_socket_t *sock;
+	ls_server_t *server;
+	struct sockaddr_storage addr;
+	struct stat st;
+	socklen_t len;
+	int flags, access, listening = 0;
+
+	if (fstat(fd, &st) == -1 || (flags = fcntl(fd, F_GETFL)) == -1)
+	{
+		ls_set_errno_errno(errno);
+		return NULL;
+	}
+
+	if (!S_ISSOCK(st.st_mode))
+	{
+		switch (flags & O_ACCMODE)
+		{
+		case O_RDONLY:
+			access = LS_FILE_READ;
+			break;
+		case O_WRONLY:
+			access = LS_FILE_WRITE;
+			break;
+		default:
+			access = LS_FILE_READ | LS_FILE_WRITE;
+			break;
+		}
+
+		return ls_file_from_fd(fd, access);
+	}
+
+	len = sizeof(listening);
+	(void)getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len);
+
+	len = sizeof(addr);
+
+	if (listening)
+	{
+		server = ls_handle_create(&ServerClass, 0);
+		if (!server)
+			return NULL;
+
+		server->socket = fd;
+		server->nonblock = (flags & O_NONBLOCK) ? 1 : 0;
+
+		if (getsockname(fd, (struct sockaddr *)&addr, &len) == 0)
+		{
+			if (addr.ss_family == AF_INET)
+				server->port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+			else if (addr.ss_family == AF_INET6)
+				server->port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+		}
+
+		return server;
+	}
+
+	sock = ls_handle_create(&SocketClass, 0);
+	if (!sock)
+		return NULL;
+
+	sock->socket = fd;
+	sock->can_recv = 1;
+	sock->can_send = 1;
+	sock->nonblock = (flags & O_NONBLOCK) ? 1 : 0;
+
+	// lets a handed off connection be returned to a connection pool
+	if (getpeername(fd, (struct sockaddr *)&addr, &len) == 0)
+		ls_socket_set_peer(sock, &addr);
+
+	return sock;
+}
+
+#endif // !LS_WINDOWS
+
+size_t ls_net_send_handles(ls_handle sock, const void *buffer, size_t size, const ls_handle *handles, size_t count)
+{
+#if LS_WINDOWS
+	// sockets could be passed with WSADuplicateSocket, but files
+	// cannot be passed over AF_UNIX sockets
+	return ls_set_errno(LS_NOT_SUPPORTED);
 #else
-    ls_socket_t *socket = sock;
-    ssize_t written;
-    size_t remain;
-    const char *buf;
-    
+	ls_socket_t *socket = sock;
+	union
+	{
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * LS_NET_MAX_HANDLES)];
+	} control;
+	int fds[LS_NET_MAX_HANDLES];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	ls_pollfd pfd;
+	int block, task, flags, err;
+	ssize_t rc;
+	size_t i;
+
 	if (ls_type_check(sock, LS_SOCKET))
 		return -1;
-    
-    if (!socket->can_send)
-        return ls_set_errno(LS_ACCESS_DENIED);
-    
-    remain = size;
-    buf = buffer;
-    
-    while (remain != 0)
-    {
-        written = write(socket->socket, buf, remain);
-        if (written == 0)
-            break;
-        else if (written == -1)
-        {
-            if (errno == EAGAIN)
-                continue;
-            return ls_set_errno(errno);
-        }
-        
-        remain -= written;
-        buf += written;
-    }
-    
-    return size - remain;
+
+	if (!buffer || size == 0 || (!handles && count) || count > LS_NET_MAX_HANDLES)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (!socket->can_send)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+	for (i = 0; i < count; i++)
+	{
+		if (ls_handle_passable_fd(handles[i], &fds[i]) == -1)
+			return -1;
+	}
+
+	iov.iov_base = (void *)buffer;
+	iov.iov_len = size;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if (count)
+	{
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+	}
+
+	block = !socket->nonblock;
+	task = block && ls_task_io_active();
+
+	for (;;)
+	{
+		flags = SEND_FLAGS;
+		if (task)
+			flags |= MSG_DONTWAIT;
+
+		// the descriptors are passed with the first byte sent
+		rc = sendmsg(socket->socket, &msg, flags);
+		if (rc >= 0)
+			return rc;
+
+		err = errno;
+		if (ls_sock_interrupted(err))
+			continue;
+
+		if (ls_sock_would_block(err))
+		{
+			if (!block)
+				return ls_set_errno(LS_NOT_READY);
+
+			// sleep until there is room, suspends only a task
+			pfd.fd = socket->socket;
+			pfd.events = POLLOUT;
+			pfd.revents = 0;
+			if (ls_socket_poll(&pfd, 1, LS_INFINITE) == -1)
+				return -1;
+			continue;
+		}
+
+		return ls_set_errno_sock(err);
+	}
+#endif // LS_WINDOWS
+}
+
+size_t ls_net_recv_handles(ls_handle sock, void *buffer, size_t size, ls_handle *handles, size_t *count)
+{
+#if LS_WINDOWS
+	return ls_set_errno(LS_NOT_SUPPORTED);
+#else
+	ls_socket_t *socket = sock;
+	union
+	{
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * LS_NET_MAX_HANDLES)];
+	} control;
+	int fds[LS_NET_MAX_HANDLES];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int block, task, flags, err;
+	size_t i, n, nfds = 0;
+	ssize_t rc;
+
+	if (ls_type_check(sock, LS_SOCKET))
+		return -1;
+
+	if (!buffer || size == 0 || !count || (!handles && *count))
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (!socket->can_recv)
+		return ls_set_errno(LS_ACCESS_DENIED);
+
+	block = !socket->nonblock;
+	task = block && ls_task_io_active();
+
+	for (;;)
+	{
+		iov.iov_base = buffer;
+		iov.iov_len = size;
+
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+
+		flags = 0;
+#if LS_LINUX
+		flags |= MSG_CMSG_CLOEXEC;
+#endif // LS_LINUX
+		if (!block || task)
+			flags |= MSG_DONTWAIT;
+
+		rc = recvmsg(socket->socket, &msg, flags);
+		if (rc >= 0)
+			break;
+
+		err = errno;
+		if (ls_sock_interrupted(err))
+			continue;
+
+		if (ls_sock_would_block(err))
+		{
+			if (!block)
+				return ls_set_errno(LS_NOT_READY);
+
+			// sleep until data arrives, suspends only a task
+			if (ls_sockfd_wait(socket->socket, LS_INFINITE) == -1)
+				return -1;
+			continue;
+		}
+
+		return ls_set_errno_sock(err);
+	}
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		if (n > LS_NET_MAX_HANDLES - nfds)
+			n = LS_NET_MAX_HANDLES - nfds;
+
+		memcpy(fds + nfds, CMSG_DATA(cmsg), n * sizeof(int));
+		nfds += n;
+	}
+
+	// the data was consumed, so it is returned even if not all
+	// handles can be. Descriptors beyond the control buffer were
+	// already closed by the system.
+	for (i = 0, n = 0; i < nfds; i++)
+	{
+#if !LS_LINUX
+		(void)fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+#endif // !LS_LINUX
+
+		if (n < *count)
+		{
+			handles[n] = ls_handle_from_fd(fds[i]);
+			if (handles[n])
+			{
+				n++;
+				continue;
+			}
+		}
+
+		(void)close(fds[i]);
+	}
+
+	*count = n;
+	return rc;
 #endif // LS_WINDOWS
 }
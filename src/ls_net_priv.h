@@ -0,0 +1,15 @@
+#ifndef _LS_NET_PRIV_H_
+#define _LS_NET_PRIV_H_
+
+#include "ls_native.h"
+
+//! \brief Check whether an idle connection can be reused.
+//!
+//! \param sock The socket.
+//!
+//! \return 1 if the connection is open and no data is waiting to be
+//! received, 0 if it was closed, failed or received unexpected data,
+//! -1 on failure.
+int ls_socket_check_idle(ls_handle sock);
+
+#endif // _LS_NET_PRIV_H_
@@ -4,6 +4,7 @@
 #include <lysys/ls_string.h>
 #include <lysys/ls_shell.h>
 #include <lysys/ls_file.h>
+#include <lysys/ls_time.h>
 
 #include "ls_native.h"
 #include "ls_handle.h"
@@ -17,6 +18,11 @@
 #include <signal.h>
 #include <stdio.h>
 
+#if LS_LINUX
+#include <poll.h>
+#include <sys/syscall.h>
+#endif // LS_LINUX
+
 #if LS_DARWIN
 #include <libproc.h>
 #endif // LS_DARWIN
@@ -33,6 +39,10 @@ struct ls_proc
 #else
 	pid_t pid;
 	int status;
+	int reaped; // status holds the result of waitpid
+#if LS_LINUX
+	int pidfd; // readable once the process exits, -1 if pidfd_open failed
+#endif // LS_LINUX
 
 	char *path;
 	char *name;
@@ -78,6 +88,11 @@ static void ls_proc_dtor(struct ls_proc *proc)
 	if (proc->path)
 		ls_free(proc->path);
 
+#if LS_LINUX
+	if (proc->pidfd != -1)
+		close(proc->pidfd);
+#endif // LS_LINUX
+
 	pid = waitpid(proc->pid, NULL, WNOHANG);
 	if (pid == 0)
 	{
@@ -92,6 +107,34 @@ static void ls_proc_dtor(struct ls_proc *proc)
 #endif // LS_WINDOWS
 }
 
+#if LS_LINUX
+
+//! \brief Open the pidfd of a process once its pid is known.
+//!
+//! Done when the handle is created, as the descriptor may be requested
+//! by several threads at once.
+static void ls_proc_open_pidfd(struct ls_proc *proc)
+{
+#ifdef SYS_pidfd_open
+	proc->pidfd = (int)syscall(SYS_pidfd_open, proc->pid, 0);
+#else
+	proc->pidfd = -1;
+#endif // SYS_pidfd_open
+}
+
+#endif // LS_LINUX
+
+static intptr_t ls_proc_pollfd(struct ls_proc *proc)
+{
+#if LS_WINDOWS
+	return (intptr_t)proc->pi.hProcess;
+#elif LS_LINUX
+	return proc->pidfd;
+#else
+	return -1;
+#endif // LS_WINDOWS
+}
+
 static int ls_proc_wait(struct ls_proc *proc, unsigned long ms)
 {
 #if LS_WINDOWS
@@ -110,8 +153,12 @@ static int ls_proc_wait(struct ls_proc *proc, unsigned long ms)
 	int status;
 	useconds_t useconds;
 	struct sigaction sa;
+#if LS_LINUX
+	struct pollfd pfd;
+	long long deadline, remain;
+#endif // LS_LINUX
 
-	if (proc->status)
+	if (proc->reaped || proc->status)
 		return 0;
 
 	if (ms == LS_INFINITE)
@@ -120,6 +167,47 @@ static int ls_proc_wait(struct ls_proc *proc, unsigned long ms)
 		if (rc == -1)
 			return ls_set_errno(ls_errno_to_error(errno));
 	}
+	else if (ms == 0)
+	{
+		rc = waitpid(proc->pid, &status, WNOHANG);
+		if (rc == -1)
+			return ls_set_errno(ls_errno_to_error(errno));
+
+		if (rc == 0)
+			return 1; // still running
+	}
+#if LS_LINUX
+	else if (proc->pidfd != -1)
+	{
+		pfd.fd = proc->pidfd;
+		pfd.events = POLLIN;
+
+		deadline = ls_nanotime() + (long long)ms * 1000000;
+
+		do
+		{
+			remain = (deadline - ls_nanotime() + 999999) / 1000000;
+			if (remain < 0)
+				remain = 0;
+
+			pfd.revents = 0;
+			rc = poll(&pfd, 1, remain > INT_MAX ? INT_MAX : (int)remain);
+		} while (rc == -1 && errno == EINTR);
+
+		if (rc == -1)
+			return ls_set_errno(ls_errno_to_error(errno));
+
+		if (rc == 0)
+			return 1;
+
+		rc = waitpid(proc->pid, &status, WNOHANG);
+		if (rc == -1)
+			return ls_set_errno(ls_errno_to_error(errno));
+
+		if (rc == 0)
+			return 1;
+	}
+#endif // LS_LINUX
 	else
 	{
 		sa.sa_handler = &alarm_handler;
@@ -150,6 +238,7 @@ static int ls_proc_wait(struct ls_proc *proc, unsigned long ms)
 	}
 
 	proc->status = status;
+	proc->reaped = 1;
 
 	return 0;
 #endif // LS_WINDOWS
@@ -159,7 +248,8 @@ static const struct ls_class ProcClass = {
 	.type = LS_PROC,
 	.cb = sizeof(struct ls_proc),
 	.dtor = (ls_dtor_t)&ls_proc_dtor,
-	.wait = (ls_wait_t)&ls_proc_wait
+	.wait = (ls_wait_t)&ls_proc_wait,
+	.pollfd = (ls_pollfd_t)&ls_proc_pollfd
 };
 
 #if LS_WINDOWS
@@ -545,6 +635,10 @@ generic_error:
 		goto create_error;
 	}
 
+#if LS_LINUX
+	ls_proc_open_pidfd(ph);
+#endif // LS_LINUX
+
 	return ph;
 create_error:
 	for (i = 0; i < env_len; i++)
@@ -797,6 +891,9 @@ ls_handle ls_proc_open(unsigned long pid)
 		proc->name++;
 
 	proc->pid = (pid_t)pid;
+#if LS_LINUX
+	ls_proc_open_pidfd(proc);
+#endif // LS_LINUX
 
 	return proc;
 #endif // LS_WINDOWS
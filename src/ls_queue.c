@@ -0,0 +1,468 @@
+#include <lysys/ls_queue.h>
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_memory.h>
+#include <lysys/ls_time.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ls_native.h"
+#include "ls_handle.h"
+#include "ls_atomic.h"
+#include "ls_futex.h"
+
+#define MIN_CAPACITY 2
+
+//! \brief Wakes threads waiting for a queue to become non-empty.
+struct ls_notify
+{
+	volatile int32_t seq; // changed by each push while there are waiters
+	volatile int32_t nwaiters;
+};
+
+//! \brief Slot of a multi-producer multi-consumer queue.
+//!
+//! seq equals the position of the next push into the slot while it is
+//! free and that position + 1 once it holds an element.
+struct ls_cell
+{
+	volatile int64_t seq;
+	// element follows
+};
+
+struct ls_queue
+{
+	// read-only after creation
+	uint8_t *cells;
+	size_t mask;
+	size_t stride; // bytes per cell
+	size_t elem_size;
+	int flags;
+	struct ls_notify notify;
+	char pad0[LS_CACHE_LINE];
+
+	volatile int64_t enqueue_pos;
+	char pad1[LS_CACHE_LINE - sizeof(int64_t)];
+
+	volatile int64_t dequeue_pos;
+	char pad2[LS_CACHE_LINE - sizeof(int64_t)];
+};
+
+struct ls_spsc_ring
+{
+	// read-only after creation
+	uint8_t *buf;
+	size_t mask;
+	size_t elem_size;
+	int flags;
+	struct ls_notify notify;
+	char pad0[LS_CACHE_LINE];
+
+	// producer
+	volatile int64_t head;
+	int64_t cached_tail;
+	char pad1[LS_CACHE_LINE - 2 * sizeof(int64_t)];
+
+	// consumer
+	volatile int64_t tail;
+	int64_t cached_head;
+	char pad2[LS_CACHE_LINE - 2 * sizeof(int64_t)];
+};
+
+static size_t ls_round_capacity(size_t capacity)
+{
+	size_t cap = MIN_CAPACITY;
+
+	while (cap < capacity)
+		cap <<= 1;
+	return cap;
+}
+
+static void ls_notify_push(struct ls_notify *n)
+{
+	// orders the published element before the check for waiters
+	ls_atomic_fence();
+
+	if (ls_atomic_load32(&n->nwaiters) != 0)
+	{
+		ls_atomic_add32(&n->seq, 1);
+		ls_futex_wake(&n->seq, 1);
+	}
+}
+
+//! \brief Wait until a queue is not empty.
+//!
+//! \param n The notifier of the queue.
+//! \param count Returns the number of elements in the queue.
+//! \param q The queue.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if the queue is not empty, 1 if the timeout expired.
+static int ls_notify_wait(struct ls_notify *n, size_t(*count)(void *), void *q, unsigned long ms)
+{
+	long long deadline = 0, remain;
+	int32_t seq;
+	int rc = 0;
+
+	if (count(q) != 0)
+		return 0;
+
+	if (ms == 0)
+		return 1;
+
+	if (ms != LS_INFINITE)
+		deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	ls_atomic_add32(&n->nwaiters, 1);
+
+	for (;;)
+	{
+		seq = ls_atomic_load32(&n->seq);
+		if (count(q) != 0)
+			break;
+
+		if (ms == LS_INFINITE)
+			(void)ls_futex_wait(&n->seq, seq, LS_INFINITE);
+		else
+		{
+			remain = deadline - ls_nanotime();
+			if (remain <= 0)
+			{
+				rc = 1;
+				break;
+			}
+
+			(void)ls_futex_wait(&n->seq, seq, (unsigned long)((remain + 999999) / 1000000));
+		}
+	}
+
+	ls_atomic_add32(&n->nwaiters, -1);
+
+	return rc;
+}
+
+static size_t ls_queue_size(struct ls_queue *q)
+{
+	int64_t deq, enq;
+
+	deq = ls_atomic_load64(&q->dequeue_pos);
+	enq = ls_atomic_load64(&q->enqueue_pos);
+	return enq > deq ? (size_t)(enq - deq) : 0;
+}
+
+static void ls_queue_dtor(struct ls_queue *q)
+{
+	ls_free(q->cells);
+}
+
+static int ls_queue_wait(struct ls_queue *q, unsigned long ms)
+{
+	if (!(q->flags & LS_QUEUE_WAITABLE))
+		return ls_set_errno(LS_NOT_WAITABLE);
+	return ls_notify_wait(&q->notify, (size_t(*)(void *))&ls_queue_size, q, ms);
+}
+
+static const struct ls_class QueueClass = {
+	.type = LS_QUEUE,
+	.cb = sizeof(struct ls_queue),
+	.dtor = (ls_dtor_t)&ls_queue_dtor,
+	.wait = (ls_wait_t)&ls_queue_wait
+};
+
+static size_t ls_spsc_ring_size(struct ls_spsc_ring *r)
+{
+	int64_t tail, head;
+
+	tail = ls_atomic_load64(&r->tail);
+	head = ls_atomic_load64(&r->head);
+	return head > tail ? (size_t)(head - tail) : 0;
+}
+
+static void ls_spsc_ring_dtor(struct ls_spsc_ring *r)
+{
+	ls_free(r->buf);
+}
+
+static int ls_spsc_ring_wait(struct ls_spsc_ring *r, unsigned long ms)
+{
+	if (!(r->flags & LS_QUEUE_WAITABLE))
+		return ls_set_errno(LS_NOT_WAITABLE);
+	return ls_notify_wait(&r->notify, (size_t(*)(void *))&ls_spsc_ring_size, r, ms);
+}
+
+static const struct ls_class SPSCRingClass = {
+	.type = LS_SPSC_RING,
+	.cb = sizeof(struct ls_spsc_ring),
+	.dtor = (ls_dtor_t)&ls_spsc_ring_dtor,
+	.wait = (ls_wait_t)&ls_spsc_ring_wait
+};
+
+ls_handle ls_queue_create(size_t elem_size, size_t capacity, int flags)
+{
+	struct ls_queue *q;
+	struct ls_cell *cell;
+	size_t i;
+
+	if (elem_size == 0 || capacity > (SIZE_MAX >> 2) / elem_size)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	q = ls_handle_create(&QueueClass, 0);
+	if (!q)
+		return NULL;
+
+	capacity = ls_round_capacity(capacity);
+
+	q->mask = capacity - 1;
+	q->elem_size = elem_size;
+	q->flags = flags;
+
+	// keep the sequence numbers aligned
+	q->stride = (sizeof(struct ls_cell) + elem_size + sizeof(int64_t) - 1) & ~(sizeof(int64_t) - 1);
+
+	q->cells = ls_malloc(capacity * q->stride);
+	if (!q->cells)
+	{
+		ls_handle_dealloc(q);
+		return NULL;
+	}
+
+	for (i = 0; i < capacity; i++)
+	{
+		cell = (struct ls_cell *)(q->cells + i * q->stride);
+		cell->seq = (int64_t)i;
+	}
+
+	return q;
+}
+
+int ls_queue_push(ls_handle q, const void *data)
+{
+	struct ls_queue *queue = q;
+	struct ls_cell *cell;
+	int64_t pos, seq;
+
+	if (ls_type_check(q, LS_QUEUE))
+		return -1;
+
+	pos = ls_atomic_load64(&queue->enqueue_pos);
+	for (;;)
+	{
+		cell = (struct ls_cell *)(queue->cells + ((size_t)pos & queue->mask) * queue->stride);
+		seq = ls_atomic_load64(&cell->seq);
+
+		if (seq == pos)
+		{
+			// the slot is free, claim it
+			if (ls_atomic_cas64(&queue->enqueue_pos, pos, pos + 1))
+				break;
+			pos = ls_atomic_load64(&queue->enqueue_pos);
+		}
+		else if (seq < pos)
+			return 1; // a consumer has not yet emptied the slot, full
+		else
+			pos = ls_atomic_load64(&queue->enqueue_pos);
+	}
+
+	memcpy(cell + 1, data, queue->elem_size);
+	ls_atomic_store64(&cell->seq, pos + 1);
+
+	if (queue->flags & LS_QUEUE_WAITABLE)
+		ls_notify_push(&queue->notify);
+
+	return 0;
+}
+
+int ls_queue_pop(ls_handle q, void *data)
+{
+	struct ls_queue *queue = q;
+	struct ls_cell *cell;
+	int64_t pos, seq;
+
+	if (ls_type_check(q, LS_QUEUE))
+		return -1;
+
+	pos = ls_atomic_load64(&queue->dequeue_pos);
+	for (;;)
+	{
+		cell = (struct ls_cell *)(queue->cells + ((size_t)pos & queue->mask) * queue->stride);
+		seq = ls_atomic_load64(&cell->seq);
+
+		if (seq == pos + 1)
+		{
+			// the slot holds an element, claim it
+			if (ls_atomic_cas64(&queue->dequeue_pos, pos, pos + 1))
+				break;
+			pos = ls_atomic_load64(&queue->dequeue_pos);
+		}
+		else if (seq < pos + 1)
+			return 1; // a producer has not yet filled the slot, empty
+		else
+			pos = ls_atomic_load64(&queue->dequeue_pos);
+	}
+
+	memcpy(data, cell + 1, queue->elem_size);
+
+	// free the slot for the push one lap later
+	ls_atomic_store64(&cell->seq, pos + (int64_t)queue->mask + 1);
+
+	return 0;
+}
+
+size_t ls_queue_count(ls_handle q)
+{
+	if (ls_type_check(q, LS_QUEUE))
+		return -1;
+	return ls_queue_size(q);
+}
+
+ls_handle ls_spsc_ring_create(size_t elem_size, size_t capacity, int flags)
+{
+	struct ls_spsc_ring *r;
+
+	if (elem_size == 0 || capacity > (SIZE_MAX >> 2) / elem_size)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	r = ls_handle_create(&SPSCRingClass, 0);
+	if (!r)
+		return NULL;
+
+	capacity = ls_round_capacity(capacity);
+
+	r->mask = capacity - 1;
+	r->elem_size = elem_size;
+	r->flags = flags;
+
+	r->buf = ls_malloc(capacity * elem_size);
+	if (!r->buf)
+	{
+		ls_handle_dealloc(r);
+		return NULL;
+	}
+
+	return r;
+}
+
+//! \brief Copy elements into the ring, wrapping around its end.
+static void ls_spsc_ring_copy_in(struct ls_spsc_ring *r, int64_t pos, const void *data, size_t count)
+{
+	size_t index, first;
+
+	index = (size_t)pos & r->mask;
+	first = r->mask + 1 - index;
+	if (first > count)
+		first = count;
+
+	memcpy(r->buf + index * r->elem_size, data, first * r->elem_size);
+	memcpy(r->buf, (const uint8_t *)data + first * r->elem_size, (count - first) * r->elem_size);
+}
+
+//! \brief Copy elements out of the ring, wrapping around its end.
+static void ls_spsc_ring_copy_out(struct ls_spsc_ring *r, int64_t pos, void *data, size_t count)
+{
+	size_t index, first;
+
+	index = (size_t)pos & r->mask;
+	first = r->mask + 1 - index;
+	if (first > count)
+		first = count;
+
+	memcpy(data, r->buf + index * r->elem_size, first * r->elem_size);
+	memcpy((uint8_t *)data + first * r->elem_size, r->buf, (count - first) * r->elem_size);
+}
+
+size_t ls_spsc_ring_push_n(ls_handle ring, const void *data, size_t count)
+{
+	struct ls_spsc_ring *r = ring;
+	int64_t head;
+	size_t avail;
+
+	if (ls_type_check(ring, LS_SPSC_RING))
+		return -1;
+
+	// only the producer writes head
+	head = r->head;
+
+	avail = r->mask + 1 - (size_t)(head - r->cached_tail);
+	if (avail < count)
+	{
+		r->cached_tail = ls_atomic_load64(&r->tail);
+		avail = r->mask + 1 - (size_t)(head - r->cached_tail);
+		if (avail < count)
+			count = avail;
+	}
+
+	if (count == 0)
+		return 0;
+
+	ls_spsc_ring_copy_in(r, head, data, count);
+	ls_atomic_store64(&r->head, head + (int64_t)count);
+
+	if (r->flags & LS_QUEUE_WAITABLE)
+		ls_notify_push(&r->notify);
+
+	return count;
+}
+
+size_t ls_spsc_ring_pop_n(ls_handle ring, void *data, size_t count)
+{
+	struct ls_spsc_ring *r = ring;
+	int64_t tail;
+	size_t avail;
+
+	if (ls_type_check(ring, LS_SPSC_RING))
+		return -1;
+
+	// only the consumer writes tail
+	tail = r->tail;
+
+	avail = (size_t)(r->cached_head - tail);
+	if (avail < count)
+	{
+		r->cached_head = ls_atomic_load64(&r->head);
+		avail = (size_t)(r->cached_head - tail);
+		if (avail < count)
+			count = avail;
+	}
+
+	if (count == 0)
+		return 0;
+
+	ls_spsc_ring_copy_out(r, tail, data, count);
+	ls_atomic_store64(&r->tail, tail + (int64_t)count);
+
+	return count;
+}
+
+int ls_spsc_ring_push(ls_handle ring, const void *data)
+{
+	size_t rc;
+
+	rc = ls_spsc_ring_push_n(ring, data, 1);
+	if (rc == (size_t)-1)
+		return -1;
+	return rc == 0 ? 1 : 0;
+}
+
+int ls_spsc_ring_pop(ls_handle ring, void *data)
+{
+	size_t rc;
+
+	rc = ls_spsc_ring_pop_n(ring, data, 1);
+	if (rc == (size_t)-1)
+		return -1;
+	return rc == 0 ? 1 : 0;
+}
+
+size_t ls_spsc_ring_count(ls_handle ring)
+{
+	if (ls_type_check(ring, LS_SPSC_RING))
+		return -1;
+	return ls_spsc_ring_size(ring);
+}
@@ -0,0 +1,563 @@
+#include "ls_reactor.h"
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+#include <lysys/ls_thread.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ls_atomic.h"
+#include "ls_sync_util.h"
+#include "ls_sched_priv.h"
+
+#if LS_LINUX
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif // LS_LINUX
+
+#define MAX_EVENTS 64
+#define WAKE_DATA UINT64_MAX // epoll data of the wake up descriptor
+
+// waiter results
+#define WAIT_PENDING 0
+#define WAIT_READY 1
+#define WAIT_TIMEOUT 2
+
+struct ls_reactor_waiter
+{
+	struct ls_task *task;
+	int fd; // -1 if waiting for the timeout only
+	uint32_t events; // epoll events which complete the wait
+	struct ls_reactor_waiter *prev, *next; // waiters on the same fd
+	long long deadline; // ls_nanotime, only valid if heap_index != -1
+	size_t heap_index;
+	volatile int32_t result;
+};
+
+//! \brief Registration of a descriptor, shared by all of its waiters.
+struct ls_reactor_fd
+{
+	struct ls_reactor_waiter *waiters;
+	int registered; // whether fd is in the epoll set
+};
+
+struct ls_reactor
+{
+#if LS_LINUX
+	int epfd;
+	int evfd; // wakes the reactor thread
+#endif // LS_LINUX
+
+	ls_handle thread;
+	volatile int32_t stop;
+
+	ls_lock_t lock; // protects the heap and dispatch of waiters
+
+	// min-heap of waiters with a deadline
+	struct ls_reactor_waiter **heap;
+	size_t nheap;
+	size_t cap;
+
+	// registrations, indexed by descriptor
+	struct ls_reactor_fd *fds;
+	size_t nfds;
+};
+
+#if LS_LINUX
+
+static void ls_heap_swap(struct ls_reactor *r, size_t a, size_t b)
+{
+	struct ls_reactor_waiter *tmp;
+
+	tmp = r->heap[a];
+	r->heap[a] = r->heap[b];
+	r->heap[b] = tmp;
+
+	r->heap[a]->heap_index = a;
+	r->heap[b]->heap_index = b;
+}
+
+static void ls_heap_up(struct ls_reactor *r, size_t i)
+{
+	size_t parent;
+
+	while (i != 0)
+	{
+		parent = (i - 1) / 2;
+		if (r->heap[parent]->deadline <= r->heap[i]->deadline)
+			break;
+
+		ls_heap_swap(r, i, parent);
+		i = parent;
+	}
+}
+
+static void ls_heap_down(struct ls_reactor *r, size_t i)
+{
+	size_t left, right, min;
+
+	for (;;)
+	{
+		left = i * 2 + 1;
+		right = left + 1;
+		min = i;
+
+		if (left < r->nheap && r->heap[left]->deadline < r->heap[min]->deadline)
+			min = left;
+
+		if (right < r->nheap && r->heap[right]->deadline < r->heap[min]->deadline)
+			min = right;
+
+		if (min == i)
+			break;
+
+		ls_heap_swap(r, i, min);
+		i = min;
+	}
+}
+
+static int ls_heap_insert(struct ls_reactor *r, struct ls_reactor_waiter *w)
+{
+	struct ls_reactor_waiter **heap;
+	size_t cap;
+
+	if (r->nheap == r->cap)
+	{
+		cap = r->cap ? r->cap * 2 : 64;
+		heap = ls_realloc(r->heap, cap * sizeof(struct ls_reactor_waiter *));
+		if (!heap)
+			return -1;
+
+		r->heap = heap;
+		r->cap = cap;
+	}
+
+	w->heap_index = r->nheap;
+	r->heap[r->nheap++] = w;
+	ls_heap_up(r, w->heap_index);
+
+	return 0;
+}
+
+static void ls_heap_remove(struct ls_reactor *r, struct ls_reactor_waiter *w)
+{
+	size_t i = w->heap_index;
+
+	if (i == (size_t)-1)
+		return;
+
+	w->heap_index = (size_t)-1;
+
+	r->nheap--;
+	if (i == r->nheap)
+		return;
+
+	r->heap[i] = r->heap[r->nheap];
+	r->heap[i]->heap_index = i;
+
+	ls_heap_up(r, i);
+	ls_heap_down(r, r->heap[i]->heap_index);
+}
+
+static void ls_reactor_interrupt(struct ls_reactor *r)
+{
+	uint64_t one = 1;
+	(void)!write(r->evfd, &one, sizeof(one));
+}
+
+//! \brief Get the registration of a descriptor, must hold the reactor
+//! lock.
+//!
+//! \return The registration, or NULL if it could not be allocated.
+static struct ls_reactor_fd *ls_reactor_fd(struct ls_reactor *r, int fd)
+{
+	struct ls_reactor_fd *fds;
+	size_t n;
+
+	if ((size_t)fd >= r->nfds)
+	{
+		n = r->nfds ? r->nfds : 64;
+		while (n <= (size_t)fd)
+			n *= 2;
+
+		fds = ls_realloc(r->fds, n * sizeof(struct ls_reactor_fd));
+		if (!fds)
+			return NULL;
+
+		memset(fds + r->nfds, 0, (n - r->nfds) * sizeof(struct ls_reactor_fd));
+		r->fds = fds;
+		r->nfds = n;
+	}
+
+	return &r->fds[fd];
+}
+
+//! \brief Register the combined interest of the waiters of a
+//! descriptor, must hold the reactor lock.
+//!
+//! Registrations are one-shot, so this also re-arms the descriptor
+//! after an event was reported.
+//!
+//! \return 0 on success, -1 if the descriptor cannot be registered.
+static int ls_reactor_update(struct ls_reactor *r, int fd)
+{
+	struct ls_reactor_fd *rfd = &r->fds[fd];
+	struct ls_reactor_waiter *w;
+	struct epoll_event ev;
+	int rc;
+
+	if (!rfd->waiters)
+	{
+		if (rfd->registered)
+		{
+			(void)epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL);
+			rfd->registered = 0;
+		}
+		return 0;
+	}
+
+	ev.events = EPOLLONESHOT;
+	for (w = rfd->waiters; w; w = w->next)
+		ev.events |= w->events;
+	ev.data.u64 = (uint64_t)fd;
+
+	// the descriptor may have been closed, which removes it from the
+	// epoll set, and reopened since
+	rc = epoll_ctl(r->epfd, rfd->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+	if (rc == -1 && errno == ENOENT)
+		rc = epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev);
+	else if (rc == -1 && errno == EEXIST)
+		rc = epoll_ctl(r->epfd, EPOLL_CTL_MOD, fd, &ev);
+
+	if (rc == -1)
+		return -1;
+
+	rfd->registered = 1;
+	return 0;
+}
+
+static void ls_reactor_link(struct ls_reactor *r, struct ls_reactor_waiter *w)
+{
+	struct ls_reactor_fd *rfd = &r->fds[w->fd];
+
+	w->prev = NULL;
+	w->next = rfd->waiters;
+	if (w->next)
+		w->next->prev = w;
+	rfd->waiters = w;
+}
+
+static void ls_reactor_unlink(struct ls_reactor *r, struct ls_reactor_waiter *w)
+{
+	struct ls_reactor_fd *rfd = &r->fds[w->fd];
+
+	if (w->prev)
+		w->prev->next = w->next;
+	else
+		rfd->waiters = w->next;
+
+	if (w->next)
+		w->next->prev = w->prev;
+}
+
+//! \brief Complete a wait, must hold the reactor lock.
+//!
+//! The waiter must already be unlinked from its descriptor. After the
+//! task is woken, the waiter must not be accessed again as it lives on
+//! the stack of the task.
+static void ls_reactor_complete(struct ls_reactor *r, struct ls_reactor_waiter *w, int result)
+{
+	ls_heap_remove(r, w);
+
+	ls_atomic_store32(&w->result, result);
+	ls_task_wake(w->task);
+}
+
+//! \brief Complete the waiters of a descriptor which reported events,
+//! must hold the reactor lock.
+static void ls_reactor_dispatch(struct ls_reactor *r, int fd, uint32_t events)
+{
+	struct ls_reactor_waiter *w, *next;
+
+	for (w = r->fds[fd].waiters; w; w = next)
+	{
+		next = w->next;
+		if (!(events & (w->events | EPOLLERR | EPOLLHUP)))
+			continue;
+
+		ls_reactor_unlink(r, w);
+		ls_reactor_complete(r, w, WAIT_READY);
+	}
+
+	// re-arm for the remaining waiters
+	(void)ls_reactor_update(r, fd);
+}
+
+//! \brief Complete a wait whose deadline expired, must hold the
+//! reactor lock.
+static void ls_reactor_expire(struct ls_reactor *r, struct ls_reactor_waiter *w)
+{
+	int fd = w->fd;
+
+	if (fd != -1)
+		ls_reactor_unlink(r, w);
+
+	ls_reactor_complete(r, w, WAIT_TIMEOUT);
+
+	if (fd != -1)
+		(void)ls_reactor_update(r, fd);
+}
+
+static int ls_reactor_main(void *param)
+{
+	struct ls_reactor *r = param;
+	struct epoll_event events[MAX_EVENTS];
+	long long now, timeout;
+	uint64_t val;
+	int i, n;
+
+	while (!ls_atomic_load32(&r->stop))
+	{
+		lock_lock(&r->lock);
+
+		if (r->nheap == 0)
+			timeout = -1;
+		else
+		{
+			timeout = r->heap[0]->deadline - ls_nanotime();
+			timeout = timeout <= 0 ? 0 : (timeout + 999999) / 1000000;
+			if (timeout > INT_MAX)
+				timeout = INT_MAX;
+		}
+
+		lock_unlock(&r->lock);
+
+		n = epoll_wait(r->epfd, events, MAX_EVENTS, (int)timeout);
+		if (n == -1)
+		{
+			if (errno != EINTR)
+				return -1;
+			n = 0;
+		}
+
+		lock_lock(&r->lock);
+
+		// descriptors first, so that no event of this batch refers to
+		// a waiter completed by a timeout below
+		for (i = 0; i < n; i++)
+		{
+			if (events[i].data.u64 == WAKE_DATA)
+			{
+				(void)!read(r->evfd, &val, sizeof(val));
+				continue;
+			}
+
+			ls_reactor_dispatch(r, (int)events[i].data.u64, events[i].events);
+		}
+
+		now = ls_nanotime();
+		while (r->nheap != 0 && r->heap[0]->deadline <= now)
+			ls_reactor_expire(r, r->heap[0]);
+
+		lock_unlock(&r->lock);
+	}
+
+	return 0;
+}
+
+#endif // LS_LINUX
+
+struct ls_reactor *ls_reactor_create(void)
+{
+#if LS_LINUX
+	struct ls_reactor *r;
+	struct epoll_event ev;
+
+	r = ls_calloc(1, sizeof(struct ls_reactor));
+	if (!r)
+		return NULL;
+
+	if (lock_init(&r->lock) == -1)
+	{
+		ls_free(r);
+		return NULL;
+	}
+
+	r->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (r->epfd == -1)
+	{
+		ls_set_errno_errno(errno);
+		lock_destroy(&r->lock);
+		ls_free(r);
+		return NULL;
+	}
+
+	r->evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (r->evfd == -1)
+	{
+		ls_set_errno_errno(errno);
+		close(r->epfd);
+		lock_destroy(&r->lock);
+		ls_free(r);
+		return NULL;
+	}
+
+	ev.events = EPOLLIN;
+	ev.data.u64 = WAKE_DATA;
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->evfd, &ev) == -1)
+	{
+		ls_set_errno_errno(errno);
+		close(r->evfd);
+		close(r->epfd);
+		lock_destroy(&r->lock);
+		ls_free(r);
+		return NULL;
+	}
+
+	r->thread = ls_thread_create(&ls_reactor_main, r);
+	if (!r->thread)
+	{
+		close(r->evfd);
+		close(r->epfd);
+		lock_destroy(&r->lock);
+		ls_free(r);
+		return NULL;
+	}
+
+	return r;
+#else
+	ls_set_errno(LS_NOT_IMPLEMENTED);
+	return NULL;
+#endif // LS_LINUX
+}
+
+void ls_reactor_destroy(struct ls_reactor *r)
+{
+#if LS_LINUX
+	ls_atomic_store32(&r->stop, 1);
+	ls_reactor_interrupt(r);
+
+	(void)ls_wait(r->thread);
+	ls_close(r->thread);
+
+	close(r->evfd);
+	close(r->epfd);
+
+	ls_free(r->fds);
+	ls_free(r->heap);
+	lock_destroy(&r->lock);
+	ls_free(r);
+#endif // LS_LINUX
+}
+
+int ls_reactor_wait(struct ls_reactor *r, struct ls_task *task, int fd, int events, unsigned long ms)
+{
+#if LS_LINUX
+	struct ls_reactor_waiter w;
+	int err;
+
+	w.task = task;
+	w.fd = fd;
+	w.events = 0;
+	if (events & LS_POLL_IN)
+		w.events |= EPOLLIN | EPOLLRDHUP;
+	if (events & LS_POLL_OUT)
+		w.events |= EPOLLOUT;
+	w.heap_index = (size_t)-1;
+	w.result = WAIT_PENDING;
+
+	if (ms == 0 && fd == -1)
+		return 1;
+
+	lock_lock(&r->lock);
+
+	if (ms != LS_INFINITE)
+	{
+		w.deadline = ls_nanotime() + (long long)ms * 1000000;
+		if (ls_heap_insert(r, &w) == -1)
+		{
+			lock_unlock(&r->lock);
+			return -1;
+		}
+
+		// the reactor must recompute its timeout
+		if (w.heap_index == 0)
+			ls_reactor_interrupt(r);
+	}
+
+	if (fd != -1)
+	{
+		if (!ls_reactor_fd(r, fd))
+		{
+			ls_heap_remove(r, &w);
+			lock_unlock(&r->lock);
+			return -1;
+		}
+
+		ls_reactor_link(r, &w);
+
+		if (ls_reactor_update(r, fd) == -1)
+		{
+			err = errno;
+			ls_reactor_unlink(r, &w);
+			(void)ls_reactor_update(r, fd);
+			ls_heap_remove(r, &w);
+			lock_unlock(&r->lock);
+
+			// regular files are always ready
+			if (err == EPERM)
+				return ls_set_errno(LS_NOT_SUPPORTED);
+			return ls_set_errno_errno(err);
+		}
+	}
+
+	ls_task_park(&r->lock);
+
+	// the reactor owns the waiter until it publishes a result
+	while (ls_atomic_load32(&w.result) == WAIT_PENDING)
+		ls_task_park(NULL);
+
+	return w.result == WAIT_READY ? 0 : 1;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
+
+int ls_reactor_park(struct ls_reactor *r, struct ls_task *task, ls_lock_t *lock, unsigned long ms)
+{
+#if LS_LINUX
+	struct ls_reactor_waiter w;
+
+	w.task = task;
+	w.fd = -1;
+	w.heap_index = (size_t)-1;
+	w.result = WAIT_PENDING;
+
+	lock_lock(&r->lock);
+
+	w.deadline = ls_nanotime() + (long long)ms * 1000000;
+	if (ls_heap_insert(r, &w) == -1)
+	{
+		lock_unlock(&r->lock);
+		return -1;
+	}
+
+	if (w.heap_index == 0)
+		ls_reactor_interrupt(r);
+
+	lock_unlock(&r->lock);
+
+	ls_task_park(lock);
+
+	// woken by someone else, withdraw the timeout
+	lock_lock(&r->lock);
+	if (w.result == WAIT_PENDING)
+		ls_heap_remove(r, &w);
+	lock_unlock(&r->lock);
+
+	return 0;
+#else
+	return ls_set_errno(LS_NOT_IMPLEMENTED);
+#endif // LS_LINUX
+}
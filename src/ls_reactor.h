@@ -0,0 +1,63 @@
+#ifndef _LS_REACTOR_H_
+#define _LS_REACTOR_H_
+
+#include "ls_native.h"
+#include "ls_sync_util.h"
+
+struct ls_task;
+
+//! \brief Readiness reactor which suspends tasks on file descriptors
+//! and timeouts.
+//!
+//! A reactor owns a thread which waits for readiness of registered
+//! descriptors and for deadlines to expire, waking the task which
+//! registered each of them.
+struct ls_reactor;
+
+//! \brief Create a reactor and start its thread.
+//!
+//! \return The reactor, or NULL on failure.
+struct ls_reactor *ls_reactor_create(void);
+
+//! \brief Stop the reactor thread and release its resources.
+//!
+//! No task may be waiting on the reactor.
+//!
+//! \param r The reactor.
+void ls_reactor_destroy(struct ls_reactor *r);
+
+//! \brief Suspend a task until a descriptor is ready.
+//!
+//! Must be called from the task itself.
+//!
+//! \param r The reactor.
+//! \param task The calling task.
+//! \param fd The descriptor to wait on, or -1 to wait for the timeout
+//! only.
+//! \param events Combination of LS_POLL_IN and LS_POLL_OUT.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if the descriptor is ready, 1 if the timeout expired,
+//! -1 if the descriptor cannot be waited on. ls_errno is set to
+//! LS_NOT_SUPPORTED if the descriptor does not support readiness
+//! notifications, in which case the descriptor is always ready.
+int ls_reactor_wait(struct ls_reactor *r, struct ls_task *task, int fd, int events, unsigned long ms);
+
+//! \brief Suspend a task until it is woken or a timeout expires.
+//!
+//! Behaves like ls_task_park(), but the reactor wakes the task if it
+//! is still suspended after ms milliseconds. Must be called from the
+//! task itself.
+//!
+//! \param r The reactor.
+//! \param task The calling task.
+//! \param lock Lock to release once suspended, may be NULL.
+//! \param ms Maximum time to wait in milliseconds, must not be
+//! LS_INFINITE.
+//!
+//! \return 0 once the task has been woken, -1 if the timeout could
+//! not be registered, in which case the task was not suspended and
+//! lock is still held.
+int ls_reactor_park(struct ls_reactor *r, struct ls_task *task, ls_lock_t *lock, unsigned long ms);
+
+#endif // _LS_REACTOR_H_
@@ -0,0 +1,794 @@
+#include "ls_resolve_priv.h"
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_event.h>
+#include <lysys/ls_sync.h>
+#include <lysys/ls_thread.h>
+#include <lysys/ls_time.h>
+
+#include <string.h>
+
+#include "ls_handle.h"
+#include "ls_atomic.h"
+#include "ls_sync_util.h"
+
+#if !LS_WINDOWS
+#include <arpa/inet.h>
+#include <pthread.h>
+#endif // !LS_WINDOWS
+
+#define NUM_BUCKETS 256
+#define MAX_ENTRIES 4096 // cached hosts before the cache is pruned
+#define NUM_WORKERS 4 // threads resolving in the background
+
+#define DEFAULT_TTL 30000 // milliseconds a result is cached
+#define DEFAULT_NEGATIVE_TTL 5000 // milliseconds a failure is cached
+
+//! \brief Cached result of a lookup
+struct ls_resolve_entry
+{
+	struct ls_resolve_entry *next;
+	uint32_t hash;
+	int af;
+	long long expires; // ls_nanotime
+	int error; // LS_* error if the host does not exist, 0 otherwise
+	int count;
+	char *host;
+	struct sockaddr_storage addrs[]; // port is 0
+};
+
+//! \brief A lookup handed to a background thread
+struct ls_resolve_job
+{
+	volatile int32_t refs; // held by the handle and the queue
+	struct ls_resolve_job *next;
+	char *host;
+	unsigned short port;
+	int af;
+	ls_handle event; // set once the result is available
+	int result; // number of addresses, or -1
+	int error;
+	struct sockaddr_storage addrs[RESOLVE_MAX_ADDRS];
+};
+
+struct ls_resolve
+{
+	struct ls_resolve_job *job;
+};
+
+//! \brief A lookup in progress, shared by concurrent lookups of the
+//! same host
+struct ls_resolve_query
+{
+	struct ls_resolve_query *next;
+	uint32_t hash;
+	int af;
+	const char *host; // of the thread asking the system
+	int refs; // protected by the cache lock
+	ls_handle done; // set once the result is available
+	int result; // number of addresses, or -1
+	int error;
+	struct sockaddr_storage addrs[RESOLVE_MAX_ADDRS]; // port is 0
+};
+
+#if LS_WINDOWS
+static INIT_ONCE _init_once = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t _init_once = PTHREAD_ONCE_INIT;
+#endif // LS_WINDOWS
+static int _init_error = 0;
+
+static ls_lock_t _cache_lock; // also protects _queries
+static struct ls_resolve_entry *_buckets[NUM_BUCKETS];
+static size_t _nentries = 0;
+
+static volatile int32_t _ttl = DEFAULT_TTL;
+static volatile int32_t _negative_ttl = DEFAULT_NEGATIVE_TTL;
+
+static struct ls_resolve_query *_queries = NULL;
+
+static ls_lock_t _queue_lock;
+static struct ls_resolve_job *_queue_head = NULL;
+static struct ls_resolve_job *_queue_tail = NULL;
+static ls_handle volatile _queue_sema = NULL; // counts jobs in the queue
+static int _nworkers = 0;
+static int _nidle = 0;
+
+#if LS_LOCK_PROFILE
+#define ls_resolve_lock_init(lock, name) lock_init_named((lock), 0, (name))
+#else
+#define ls_resolve_lock_init(lock, name) lock_init(lock)
+#endif // LS_LOCK_PROFILE
+
+static void ls_resolve_init_locks(void)
+{
+	if (ls_resolve_lock_init(&_cache_lock, "resolver cache") == -1)
+	{
+		_init_error = _ls_errno;
+		return;
+	}
+
+	if (ls_resolve_lock_init(&_queue_lock, "resolver queue") == -1)
+	{
+		_init_error = _ls_errno;
+		lock_destroy(&_cache_lock);
+	}
+}
+
+#if LS_WINDOWS
+static BOOL CALLBACK ls_resolve_init_once(PINIT_ONCE InitOnce, PVOID Parameter, PVOID *Context)
+{
+	ls_resolve_init_locks();
+	return TRUE;
+}
+#endif // LS_WINDOWS
+
+//! \brief Create the locks on first use.
+static int ls_resolve_init(void)
+{
+#if LS_WINDOWS
+	InitOnceExecuteOnce(&_init_once, &ls_resolve_init_once, NULL, NULL);
+#else
+	(void)pthread_once(&_init_once, &ls_resolve_init_locks);
+#endif // LS_WINDOWS
+
+	if (_init_error)
+		return ls_set_errno(_init_error);
+	return 0;
+}
+
+//! \brief FNV-1a hash of a host name and address family.
+static uint32_t ls_resolve_hash(const char *host, int af)
+{
+	uint32_t h = 2166136261u;
+
+	while (*host)
+	{
+		h ^= (unsigned char)*host++;
+		h *= 16777619u;
+	}
+
+	h ^= (uint32_t)af;
+	h *= 16777619u;
+
+	return h;
+}
+
+static void ls_set_port(struct sockaddr_storage *addr, unsigned short port)
+{
+	if (addr->ss_family == AF_INET)
+		((struct sockaddr_in *)addr)->sin_port = htons(port);
+	else if (addr->ss_family == AF_INET6)
+		((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+}
+
+//! \brief Convert a numeric address without a lookup.
+//!
+//! \return 1 if host is a numeric address, 0 if not.
+static int ls_resolve_numeric(const char *host, unsigned short port, int af, struct sockaddr_storage *addr)
+{
+	struct sockaddr_in *addr4 = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)addr;
+
+	memset(addr, 0, sizeof(*addr));
+
+	if ((af == AF_UNSPEC || af == AF_INET) && inet_pton(AF_INET, host, &addr4->sin_addr) == 1)
+	{
+		addr4->sin_family = AF_INET;
+		addr4->sin_port = htons(port);
+		return 1;
+	}
+
+	// scoped addresses are left to getaddrinfo
+	if ((af == AF_UNSPEC || af == AF_INET6) && inet_pton(AF_INET6, host, &addr6->sin6_addr) == 1)
+	{
+		addr6->sin6_family = AF_INET6;
+		addr6->sin6_port = htons(port);
+		return 1;
+	}
+
+	return 0;
+}
+
+//! \brief Remove expired entries, or all entries if all is nonzero.
+//!
+//! The cache must be locked.
+static void ls_cache_prune(long long now, int all)
+{
+	struct ls_resolve_entry **pp, *ent;
+	size_t i;
+
+	for (i = 0; i < NUM_BUCKETS; i++)
+	{
+		pp = &_buckets[i];
+		while ((ent = *pp) != NULL)
+		{
+			if (all || ent->expires <= now)
+			{
+				*pp = ent->next;
+				ls_free(ent);
+				_nentries--;
+			}
+			else
+				pp = &ent->next;
+		}
+	}
+}
+
+//! \brief Look up a host in the cache, without setting the port.
+//!
+//! The cache must be locked.
+//!
+//! \return The number of addresses copied, 0 if the host is not
+//! cached, -1 if it is cached as not existing.
+static int ls_cache_find(const char *host, uint32_t hash, int af, struct sockaddr_storage *addrs, int count)
+{
+	struct ls_resolve_entry *ent;
+	long long now;
+	int rc = 0;
+
+	now = ls_nanotime();
+
+	for (ent = _buckets[hash % NUM_BUCKETS]; ent; ent = ent->next)
+	{
+		if (ent->hash != hash || ent->af != af || strcmp(ent->host, host) != 0)
+			continue;
+
+		if (ent->expires <= now)
+			break; // expired, replaced after the next lookup
+
+		if (ent->error)
+		{
+			rc = ls_set_errno(ent->error);
+			break;
+		}
+
+		rc = ent->count < count ? ent->count : count;
+		memcpy(addrs, ent->addrs, rc * sizeof(struct sockaddr_storage));
+		break;
+	}
+
+	return rc;
+}
+
+//! \brief Look up a host in the cache.
+//!
+//! \return The number of addresses copied, 0 if the host is not
+//! cached, -1 if it is cached as not existing.
+static int ls_cache_lookup(const char *host, unsigned short port, int af, struct sockaddr_storage *addrs, int count)
+{
+	int i, rc;
+
+	if (ls_resolve_init() == -1)
+		return 0; // only a cache
+
+	lock_lock(&_cache_lock);
+	rc = ls_cache_find(host, ls_resolve_hash(host, af), af, addrs, count);
+	lock_unlock(&_cache_lock);
+
+	for (i = 0; i < rc; i++)
+		ls_set_port(&addrs[i], port);
+
+	return rc;
+}
+
+//! \brief Add the result of a lookup to the cache.
+static void ls_cache_insert(const char *host, int af, const struct sockaddr_storage *addrs, int count, int error)
+{
+	struct ls_resolve_entry *ent, **pp;
+	size_t host_len;
+	uint32_t hash;
+	long long now;
+	unsigned long ttl;
+	int i;
+
+	ttl = (unsigned long)ls_atomic_load32(error ? &_negative_ttl : &_ttl);
+	if (ttl == 0)
+		return;
+
+	host_len = strlen(host) + 1;
+	ent = ls_malloc(sizeof(struct ls_resolve_entry) + count * sizeof(struct sockaddr_storage) + host_len);
+	if (!ent)
+		return; // only a cache
+
+	now = ls_nanotime();
+	hash = ls_resolve_hash(host, af);
+
+	ent->hash = hash;
+	ent->af = af;
+	ent->expires = now + (long long)ttl * 1000000;
+	ent->error = error;
+	ent->count = count;
+	ent->host = (char *)&ent->addrs[count];
+	memcpy(ent->host, host, host_len);
+	memcpy(ent->addrs, addrs, count * sizeof(struct sockaddr_storage));
+
+	for (i = 0; i < count; i++)
+		ls_set_port(&ent->addrs[i], 0);
+
+	lock_lock(&_cache_lock);
+
+	// replace a previous result of the same host
+	for (pp = &_buckets[hash % NUM_BUCKETS]; *pp; pp = &(*pp)->next)
+	{
+		if ((*pp)->hash == hash && (*pp)->af == af && strcmp((*pp)->host, host) == 0)
+		{
+			ent->next = (*pp)->next;
+			ls_free(*pp);
+			*pp = ent;
+
+			lock_unlock(&_cache_lock);
+			return;
+		}
+	}
+
+	if (_nentries >= MAX_ENTRIES)
+	{
+		ls_cache_prune(now, 0);
+		if (_nentries >= MAX_ENTRIES)
+			ls_cache_prune(now, 1);
+	}
+
+	ent->next = _buckets[hash % NUM_BUCKETS];
+	_buckets[hash % NUM_BUCKETS] = ent;
+	_nentries++;
+
+	lock_unlock(&_cache_lock);
+}
+
+//! \brief Convert an error of getaddrinfo.
+static int ls_gai_to_error(int err)
+{
+	switch (err)
+	{
+	case EAI_NONAME:
+#if defined(EAI_NODATA) && EAI_NODATA != EAI_NONAME
+	case EAI_NODATA:
+#endif // EAI_NODATA
+		return LS_NOT_FOUND;
+	case EAI_AGAIN:
+		return LS_BUSY;
+	case EAI_MEMORY:
+		return LS_OUT_OF_MEMORY;
+	case EAI_FAMILY:
+		return LS_NOT_SUPPORTED;
+	default:
+		return LS_INVALID_ARGUMENT;
+	}
+}
+
+//! \brief Ask the system resolver.
+//!
+//! The returned addresses have a port of 0.
+static int ls_resolve_system(const char *host, int af, struct sockaddr_storage *addrs, int count)
+{
+	struct addrinfo hints, *info, *ptr;
+	int rc, n = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = af;
+	hints.ai_socktype = SOCK_STREAM; // one result per address
+
+	rc = getaddrinfo(host, NULL, &hints, &info);
+	if (rc != 0)
+		return ls_set_errno(ls_gai_to_error(rc));
+
+	for (ptr = info; ptr && n < count; ptr = ptr->ai_next)
+	{
+		if (ptr->ai_family != AF_INET && ptr->ai_family != AF_INET6)
+			continue;
+
+		if ((size_t)ptr->ai_addrlen > sizeof(struct sockaddr_storage))
+			continue;
+
+		memset(&addrs[n], 0, sizeof(struct sockaddr_storage));
+		memcpy(&addrs[n], ptr->ai_addr, ptr->ai_addrlen);
+		n++;
+	}
+
+	freeaddrinfo(info);
+
+	if (n == 0)
+		return ls_set_errno(LS_NOT_FOUND);
+	return n;
+}
+
+static void ls_query_release(struct ls_resolve_query *q)
+{
+	int refs;
+
+	lock_lock(&_cache_lock);
+	refs = --q->refs;
+	lock_unlock(&_cache_lock);
+
+	if (refs != 0)
+		return;
+
+	ls_close(q->done);
+	ls_free(q);
+}
+
+//! \brief Ask the system resolver, or wait for a lookup of the same
+//! host already in progress.
+//!
+//! The cache is consulted again first, a lookup may have completed
+//! since the caller checked it.
+//!
+//! \return The number of addresses, with a port of 0, or -1 on
+//! failure.
+static int ls_resolve_shared(const char *host, int af, struct sockaddr_storage *addrs)
+{
+	struct ls_resolve_query *q, **pp;
+	uint32_t hash;
+	int rc, err;
+
+	hash = ls_resolve_hash(host, af);
+
+	lock_lock(&_cache_lock);
+
+	rc = ls_cache_find(host, hash, af, addrs, RESOLVE_MAX_ADDRS);
+	if (rc != 0)
+	{
+		lock_unlock(&_cache_lock);
+		return rc;
+	}
+
+	for (q = _queries; q; q = q->next)
+	{
+		if (q->hash == hash && q->af == af && strcmp(q->host, host) == 0)
+			break;
+	}
+
+	if (q)
+	{
+		q->refs++;
+		lock_unlock(&_cache_lock);
+
+		// suspends only a task
+		if (ls_wait(q->done) == -1)
+		{
+			ls_query_release(q);
+			return -1;
+		}
+
+		rc = q->result;
+		err = q->error;
+		if (rc > 0)
+			memcpy(addrs, q->addrs, rc * sizeof(struct sockaddr_storage));
+
+		ls_query_release(q);
+		return rc == -1 ? ls_set_errno(err) : rc;
+	}
+
+	q = ls_calloc(1, sizeof(struct ls_resolve_query));
+	if (q)
+	{
+		q->done = ls_event_create();
+		if (q->done)
+		{
+			q->hash = hash;
+			q->af = af;
+			q->host = host;
+			q->refs = 1;
+			q->next = _queries;
+			_queries = q;
+		}
+		else
+		{
+			ls_free(q);
+			q = NULL; // resolved without sharing
+		}
+	}
+
+	lock_unlock(&_cache_lock);
+
+	rc = ls_resolve_system(host, af, addrs, RESOLVE_MAX_ADDRS);
+	err = rc == -1 ? _ls_errno : 0;
+
+	if (rc == -1)
+	{
+		// only a host which does not exist is remembered, other
+		// failures may be temporary
+		if (err == LS_NOT_FOUND)
+			ls_cache_insert(host, af, NULL, 0, LS_NOT_FOUND);
+	}
+	else
+		ls_cache_insert(host, af, addrs, rc, 0);
+
+	if (q)
+	{
+		q->result = rc;
+		q->error = err;
+		if (rc > 0)
+			memcpy(q->addrs, addrs, rc * sizeof(struct sockaddr_storage));
+
+		lock_lock(&_cache_lock);
+		for (pp = &_queries; *pp != q; pp = &(*pp)->next)
+			;
+		*pp = q->next;
+		lock_unlock(&_cache_lock);
+
+		(void)ls_event_set(q->done);
+		ls_query_release(q);
+	}
+
+	return rc == -1 ? ls_set_errno(err) : rc;
+}
+
+int ls_resolve(const char *host, unsigned short port, int af, struct sockaddr_storage *addrs, int count)
+{
+	struct sockaddr_storage found[RESOLVE_MAX_ADDRS];
+	int rc, i;
+
+	if (!host || !addrs || count <= 0)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	if (ls_resolve_numeric(host, port, af, &addrs[0]))
+		return 1;
+
+	if (ls_resolve_init() == -1)
+		return -1;
+
+	// concurrent lookups of one host ask the system once
+	rc = ls_resolve_shared(host, af, found);
+	if (rc == -1)
+		return -1;
+
+	if (rc > count)
+		rc = count;
+
+	for (i = 0; i < rc; i++)
+	{
+		addrs[i] = found[i];
+		ls_set_port(&addrs[i], port);
+	}
+
+	return rc;
+}
+
+static void ls_job_release(struct ls_resolve_job *job)
+{
+	if (ls_atomic_add32(&job->refs, -1) != 1)
+		return;
+
+	ls_close(job->event);
+	ls_free(job->host);
+	ls_free(job);
+}
+
+static int ls_resolve_worker(void *up)
+{
+	struct ls_resolve_job *job;
+
+	(void)up;
+
+	for (;;)
+	{
+		lock_lock(&_queue_lock);
+		_nidle++;
+		lock_unlock(&_queue_lock);
+
+		(void)ls_wait(_queue_sema);
+
+		lock_lock(&_queue_lock);
+		_nidle--;
+
+		job = _queue_head;
+		if (job)
+		{
+			_queue_head = job->next;
+			if (!_queue_head)
+				_queue_tail = NULL;
+		}
+
+		lock_unlock(&_queue_lock);
+
+		if (!job)
+			continue;
+
+		// nobody is waiting for the result if the handle was closed
+		if (ls_atomic_load32(&job->refs) > 1)
+		{
+			job->result = ls_resolve(job->host, job->port, job->af, job->addrs, RESOLVE_MAX_ADDRS);
+			job->error = job->result == -1 ? _ls_errno : 0;
+		}
+
+		(void)ls_event_set(job->event);
+		ls_job_release(job);
+	}
+
+	return 0;
+}
+
+static void ls_resolve_dtor(struct ls_resolve *req)
+{
+	ls_job_release(req->job);
+}
+
+static int ls_resolve_wait(struct ls_resolve *req, unsigned long ms)
+{
+	return ls_timedwait(req->job->event, ms);
+}
+
+static intptr_t ls_resolve_pollfd(struct ls_resolve *req)
+{
+	return LS_HANDLE_CLASS(req->job->event)->pollfd(req->job->event);
+}
+
+static const struct ls_class ResolveClass = {
+	.type = LS_RESOLVE,
+	.cb = sizeof(struct ls_resolve),
+	.dtor = (ls_dtor_t)&ls_resolve_dtor,
+	.wait = (ls_wait_t)&ls_resolve_wait,
+	.pollfd = (ls_pollfd_t)&ls_resolve_pollfd
+};
+
+//! \brief Queue a job, starting a worker if none is idle.
+//!
+//! \return 0 on success, -1 if the job could not be queued.
+static int ls_resolve_enqueue(struct ls_resolve_job *job)
+{
+	ls_handle sema, thread;
+	int spawn;
+
+	if (ls_resolve_init() == -1)
+		return -1;
+
+	if (!ls_atomic_loadptr(&_queue_sema))
+	{
+		sema = ls_semaphore_create(0);
+		if (!sema)
+			return -1;
+
+		if (!ls_atomic_casptr(&_queue_sema, NULL, sema))
+			ls_close(sema);
+	}
+
+	lock_lock(&_queue_lock);
+
+	job->next = NULL;
+	if (_queue_tail)
+		_queue_tail->next = job;
+	else
+		_queue_head = job;
+	_queue_tail = job;
+
+	spawn = _nidle == 0 && _nworkers < NUM_WORKERS;
+	if (spawn)
+		_nworkers++;
+
+	lock_unlock(&_queue_lock);
+
+	if (spawn)
+	{
+		thread = ls_thread_create(&ls_resolve_worker, NULL);
+		if (thread)
+			ls_close(thread); // runs until the process exits
+		else
+		{
+			lock_lock(&_queue_lock);
+			_nworkers--;
+			lock_unlock(&_queue_lock);
+
+			// an existing worker takes the job later
+		}
+	}
+
+	(void)ls_semaphore_signal(_queue_sema);
+	return 0;
+}
+
+ls_handle ls_resolve_async(const char *host, unsigned short port, int af)
+{
+	struct ls_resolve *req;
+	struct ls_resolve_job *job;
+	int rc;
+
+	if (!host)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	job = ls_calloc(1, sizeof(struct ls_resolve_job));
+	if (!job)
+		return NULL;
+
+	job->refs = 1;
+	job->port = port;
+	job->af = af;
+	job->result = -1;
+	job->error = LS_NOT_READY;
+
+	job->host = ls_strdup(host);
+	if (!job->host)
+	{
+		ls_free(job);
+		return NULL;
+	}
+
+	job->event = ls_event_create();
+	if (!job->event)
+	{
+		ls_free(job->host);
+		ls_free(job);
+		return NULL;
+	}
+
+	req = ls_handle_create(&ResolveClass, 0);
+	if (!req)
+	{
+		ls_job_release(job);
+		return NULL;
+	}
+
+	req->job = job;
+
+	// complete immediately without a thread if possible
+	if (ls_resolve_numeric(host, port, af, &job->addrs[0]))
+		rc = 1;
+	else
+		rc = ls_cache_lookup(host, port, af, job->addrs, RESOLVE_MAX_ADDRS);
+
+	if (rc != 0)
+	{
+		job->result = rc;
+		job->error = rc == -1 ? _ls_errno : 0;
+		(void)ls_event_set(job->event);
+		return req;
+	}
+
+	ls_atomic_add32(&job->refs, 1);
+	if (ls_resolve_enqueue(job) == -1)
+	{
+		job->error = _ls_errno;
+		(void)ls_event_set(job->event);
+		ls_job_release(job);
+	}
+
+	return req;
+}
+
+int ls_resolve_result(ls_handle req, struct sockaddr_storage *addrs, int count)
+{
+	struct ls_resolve_job *job;
+	int rc;
+
+	if (ls_type_check(req, LS_RESOLVE))
+		return -1;
+
+	if (!addrs || count <= 0)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	job = ((struct ls_resolve *)req)->job;
+
+	if (ls_event_signaled(job->event) != 1)
+		return ls_set_errno(LS_NOT_READY);
+
+	if (job->result == -1)
+		return ls_set_errno(job->error);
+
+	rc = job->result < count ? job->result : count;
+	memcpy(addrs, job->addrs, rc * sizeof(struct sockaddr_storage));
+
+	return rc;
+}
+
+void ls_resolve_set_ttl(unsigned long ttl, unsigned long negative_ttl)
+{
+	ls_atomic_store32(&_ttl, ttl > INT32_MAX ? INT32_MAX : (int32_t)ttl);
+	ls_atomic_store32(&_negative_ttl, negative_ttl > INT32_MAX ? INT32_MAX : (int32_t)negative_ttl);
+
+	// results were cached with the old lifetime
+	ls_resolve_flush();
+}
+
+void ls_resolve_flush(void)
+{
+	if (ls_resolve_init() == -1)
+		return;
+
+	lock_lock(&_cache_lock);
+	ls_cache_prune(0, 1);
+	lock_unlock(&_cache_lock);
+}
@@ -0,0 +1,50 @@
+#ifndef _LS_RESOLVE_PRIV_H_
+#define _LS_RESOLVE_PRIV_H_
+
+#include "ls_native.h"
+
+#if LS_WINDOWS
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#endif // LS_WINDOWS
+
+#define RESOLVE_MAX_ADDRS 16 // addresses kept per host
+
+//! \brief Resolve a host name.
+//!
+//! Numeric addresses are converted directly, host names are looked
+//! up in the process-wide cache before asking the system resolver.
+//!
+//! \param host The host name or numeric address.
+//! \param port The port to set in each address.
+//! \param af The native address family, AF_UNSPEC for any.
+//! \param addrs Receives the addresses, in the order of preference.
+//! \param count The number of addresses addrs can hold.
+//!
+//! \return The number of addresses, at least 1, or -1 on failure.
+int ls_resolve(const char *host, unsigned short port, int af, struct sockaddr_storage *addrs, int count);
+
+//! \brief Start resolving a host name on a background thread.
+//!
+//! \return A waitable handle signaled once the result is available,
+//! or NULL on failure.
+ls_handle ls_resolve_async(const char *host, unsigned short port, int af);
+
+//! \brief Get the result of ls_resolve_async().
+//!
+//! \return The number of addresses, or -1 on failure. Fails with
+//! LS_NOT_READY if the host is still being resolved.
+int ls_resolve_result(ls_handle req, struct sockaddr_storage *addrs, int count);
+
+//! \brief Set how long results are cached, in milliseconds.
+void ls_resolve_set_ttl(unsigned long ttl, unsigned long negative_ttl);
+
+//! \brief Remove all cached results.
+void ls_resolve_flush(void);
+
+#endif // _LS_RESOLVE_PRIV_H_
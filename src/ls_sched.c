@@ -0,0 +1,1397 @@
+#include <lysys/ls_sched.h>
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+#include <lysys/ls_thread.h>
+#include <lysys/ls_sysinfo.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ls_native.h"
+#include "ls_handle.h"
+#include "ls_atomic.h"
+#include "ls_sync_util.h"
+#include "ls_sched_priv.h"
+#include "ls_reactor.h"
+#include "ls_waiter.h"
+
+#if LS_POSIX
+#include <poll.h>
+#endif // LS_POSIX
+
+#define RUNQ_SIZE 256
+#define TASK_STACK_SIZE (64 * 1024)
+#define RUNNEXT_MAX 16 // consecutive handoffs before checking the run queue
+
+// task states
+#define TASK_RUNNING 0
+#define TASK_PARKED 1
+#define TASK_NOTIFIED 2 // woken while running, next park returns immediately
+#define TASK_DEAD 3 // finished by a stopping scheduler, wakes are ignored
+
+// requests made by a task when switching back to its worker
+#define ACTION_YIELD 0
+#define ACTION_PARK 1
+#define ACTION_EXIT 2
+
+struct ls_fls_slot
+{
+	uint32_t gen; // generation of the key which set value
+	void *value;
+};
+
+struct ls_task
+{
+	struct ls_task *next; // inject queue link
+	struct ls_task *live_prev, *live_next; // tasks which have not completed
+	struct ls_sched *sched;
+
+	ls_thread_func_t func;
+	void *up;
+	int exit_code;
+	int err; // ls_errno of the task while it is switched out
+
+	volatile int32_t state;
+	volatile int32_t refs; // handle and scheduler references
+	int waiting; // in ls_waiter_wait, a waiter on the stack may be queued
+
+	ls_lock_t lock;
+	struct ls_waitq joiners; // waiting for the task to complete
+	int done;
+
+	struct ls_fls_slot *fls; // fiber-local storage, indexed by key
+	uint32_t nfls;
+
+#if LS_WINDOWS
+	LPVOID lpFiber;
+#else
+	void *stack;
+	ucontext_t ctx;
+#endif // LS_WINDOWS
+};
+
+//! \brief Bounded run queue, pushed to by its owner and popped by
+//! the owner and thieves.
+struct ls_runq
+{
+	volatile uint32_t head; // advanced by owner and thieves
+	volatile uint32_t tail; // advanced by owner only
+	struct ls_task *volatile buf[RUNQ_SIZE];
+};
+
+struct ls_worker
+{
+	struct ls_runq runq;
+	struct ls_task *volatile runnext; // handed off, runs before runq
+	int nnext; // consecutive tasks taken from runnext
+
+	struct ls_sched *sched;
+	ls_handle thread;
+	int id;
+	uint32_t seed; // for victim selection
+
+	struct ls_task *current; // task being run
+	int action; // what current requested when it switched out
+	ls_lock_t *unlock; // lock to release after parking current
+
+#if LS_WINDOWS
+	LPVOID lpFiber;
+#else
+	ucontext_t ctx;
+#endif // LS_WINDOWS
+
+	char pad[LS_CACHE_LINE]; // keep run queues of workers apart
+};
+
+struct ls_sched
+{
+	struct ls_worker *workers;
+	int nworkers;
+
+	ls_lock_t lock; // protects inject queue and idle workers
+	ls_cond_t idle_cond; // signaled when work becomes available
+	ls_cond_t done_cond; // signaled when ntasks reaches zero
+
+	struct ls_task *inject_head; // tasks readied outside of workers
+	struct ls_task *inject_tail;
+	volatile int32_t ninject;
+
+	volatile int32_t nidle; // workers waiting for work
+	volatile int32_t ntasks; // tasks which have not completed
+	volatile int32_t stop;
+
+	ls_lock_t tasks_lock; // protects tasks
+	struct ls_task *tasks; // tasks which have not completed
+
+	int async_io; // LS_SCHED_ASYNC_IO
+	struct ls_reactor *volatile reactor; // created on first use
+	int no_reactor; // reactor could not be created
+};
+
+struct ls_fls
+{
+	uint32_t index;
+	uint32_t gen;
+};
+
+struct ls_task_ref
+{
+	struct ls_task *task;
+};
+
+static LS_THREADLOCAL struct ls_worker *_worker = NULL;
+
+//! \brief Get the worker of the calling thread.
+//!
+//! Not inlined so the thread-local is reloaded each time, a task
+//! may be resumed on another thread after it switches out.
+static LS_NOINLINE struct ls_worker *ls_worker_current(void)
+{
+	return _worker;
+}
+
+// fiber-local storage keys, slots of deleted keys are reused with a
+// new generation so stale values are never returned
+static volatile int32_t _fls_spin = 0;
+static uint32_t *_fls_gens = NULL; // current generation of each slot
+static uint32_t *_fls_free = NULL; // stack of free slots
+static uint32_t _fls_nslots = 0;
+static uint32_t _fls_nfree = 0;
+
+static void ls_fls_lock(void)
+{
+	while (!ls_atomic_cas32(&_fls_spin, 0, 1))
+		ls_cpu_relax();
+}
+
+static void ls_fls_unlock(void)
+{
+	ls_atomic_store32(&_fls_spin, 0);
+}
+
+#if LS_POSIX
+
+static void *ls_create_pointer(int lo, int hi)
+{
+#if __SIZEOF_SIZE_T__ == 4
+	return (void *)lo;
+#else
+	return (void *)(((uint64_t)hi << 32) | (uint64_t)(uint32_t)lo);
+#endif // __SIZEOF_SIZE_T__
+}
+
+static void ls_split_pointer(void *ptr, int *lo, int *hi)
+{
+#if __SIZEOF_SIZE_T__ == 4
+	*lo = (int)ptr;
+	*hi = 0;
+#else
+	*lo = (int)((uint64_t)ptr & 0xffffffff);
+	*hi = (int)((uint64_t)ptr >> 32);
+#endif // __SIZEOF_SIZE_T__
+}
+
+#endif // LS_POSIX
+
+static int ls_runq_push(struct ls_runq *q, struct ls_task *t)
+{
+	uint32_t h, tl;
+
+	h = (uint32_t)ls_atomic_load32(&q->head);
+	tl = q->tail;
+
+	if (tl - h >= RUNQ_SIZE)
+		return -1; // full
+
+	ls_atomic_storeptr(&q->buf[tl % RUNQ_SIZE], t);
+	ls_atomic_store32(&q->tail, tl + 1);
+
+	return 0;
+}
+
+static struct ls_task *ls_runq_pop(struct ls_runq *q)
+{
+	uint32_t h, tl;
+	struct ls_task *t;
+
+	for (;;)
+	{
+		h = (uint32_t)ls_atomic_load32(&q->head);
+		tl = q->tail;
+
+		if (h == tl)
+			return NULL;
+
+		t = ls_atomic_loadptr(&q->buf[h % RUNQ_SIZE]);
+		if (ls_atomic_cas32(&q->head, h, h + 1))
+			return t;
+	}
+}
+
+//! \brief Steal half of the tasks in src.
+//!
+//! \param dst Run queue of the caller, must be empty.
+//! \param src Run queue to steal from.
+//!
+//! \return One of the stolen tasks, the rest are placed in dst.
+static struct ls_task *ls_runq_steal(struct ls_runq *dst, struct ls_runq *src)
+{
+	uint32_t h, tl, n, i, dt;
+	struct ls_task *t;
+
+	dt = dst->tail;
+
+	for (;;)
+	{
+		h = (uint32_t)ls_atomic_load32(&src->head);
+		tl = (uint32_t)ls_atomic_load32(&src->tail);
+
+		n = tl - h;
+		n -= n / 2;
+
+		if (n == 0)
+			return NULL;
+
+		if (n > RUNQ_SIZE / 2)
+			continue; // read an inconsistent head and tail
+
+		for (i = 0; i < n; i++)
+			ls_atomic_storeptr(&dst->buf[(dt + i) % RUNQ_SIZE], ls_atomic_loadptr(&src->buf[(h + i) % RUNQ_SIZE]));
+
+		if (ls_atomic_cas32(&src->head, h, h + n))
+			break;
+	}
+
+	n--;
+	t = dst->buf[(dt + n) % RUNQ_SIZE];
+	if (n != 0)
+		ls_atomic_store32(&dst->tail, dt + n);
+
+	return t;
+}
+
+static int ls_runq_empty(struct ls_runq *q)
+{
+	return ls_atomic_load32(&q->head) == ls_atomic_load32(&q->tail);
+}
+
+static void ls_task_release(struct ls_task *t)
+{
+	if (ls_atomic_add32(&t->refs, -1) != 1)
+		return;
+
+	ls_free(t->fls);
+	lock_destroy(&t->lock);
+	ls_free(t);
+}
+
+//! \brief Wake a worker if any are idle.
+//!
+//! Must be called after making a task available in a run queue.
+static void ls_sched_notify(struct ls_sched *s)
+{
+	// pairs with the increment of nidle in ls_sched_next
+	ls_atomic_fence();
+	if (ls_atomic_load32(&s->nidle) == 0)
+		return;
+
+	lock_lock(&s->lock);
+	cond_signal(&s->idle_cond);
+	lock_unlock(&s->lock);
+}
+
+static void ls_inject_push(struct ls_sched *s, struct ls_task *t)
+{
+	lock_lock(&s->lock);
+
+	t->next = NULL;
+	if (s->inject_tail)
+		s->inject_tail->next = t;
+	else
+		s->inject_head = t;
+	s->inject_tail = t;
+
+	ls_atomic_add32(&s->ninject, 1);
+
+	if (ls_atomic_load32(&s->nidle) != 0)
+		cond_signal(&s->idle_cond);
+
+	lock_unlock(&s->lock);
+}
+
+static struct ls_task *ls_inject_pop(struct ls_sched *s)
+{
+	struct ls_task *t;
+
+	if (ls_atomic_load32(&s->ninject) == 0)
+		return NULL;
+
+	lock_lock(&s->lock);
+
+	t = s->inject_head;
+	if (t)
+	{
+		s->inject_head = t->next;
+		if (!s->inject_head)
+			s->inject_tail = NULL;
+		ls_atomic_add32(&s->ninject, -1);
+	}
+
+	lock_unlock(&s->lock);
+
+	return t;
+}
+
+//! \brief Place a runnable task in a run queue.
+static void ls_sched_ready(struct ls_sched *s, struct ls_task *t)
+{
+	struct ls_worker *w;
+
+	w = ls_worker_current();
+	if (w && w->sched == s && ls_runq_push(&w->runq, t) == 0)
+	{
+		ls_sched_notify(s);
+		return;
+	}
+
+	ls_inject_push(s, t);
+}
+
+static struct ls_task *ls_sched_steal(struct ls_worker *w)
+{
+	struct ls_sched *s = w->sched;
+	struct ls_task *t;
+	int i, start;
+
+	if (s->nworkers == 1)
+		return NULL;
+
+	// xorshift32
+	w->seed ^= w->seed << 13;
+	w->seed ^= w->seed >> 17;
+	w->seed ^= w->seed << 5;
+
+	start = (int)(w->seed % (uint32_t)s->nworkers);
+	for (i = 0; i < s->nworkers; i++)
+	{
+		struct ls_worker *victim = &s->workers[(start + i) % s->nworkers];
+		if (victim == w)
+			continue;
+
+		t = ls_runq_steal(&w->runq, &victim->runq);
+		if (t)
+			return t;
+
+		t = ls_atomic_xchgptr(&victim->runnext, NULL);
+		if (t)
+			return t;
+	}
+
+	return NULL;
+}
+
+static int ls_sched_has_work(struct ls_sched *s)
+{
+	int i;
+
+	if (s->inject_head)
+		return 1;
+
+	for (i = 0; i < s->nworkers; i++)
+	{
+		if (!ls_runq_empty(&s->workers[i].runq))
+			return 1;
+
+		if (ls_atomic_loadptr(&s->workers[i].runnext))
+			return 1;
+	}
+
+	return 0;
+}
+
+//! \brief Find the next task to run, blocking if there is none.
+//!
+//! \return The task, or NULL if the scheduler is stopping.
+static struct ls_task *ls_sched_next(struct ls_worker *w)
+{
+	struct ls_sched *s = w->sched;
+	struct ls_task *t;
+
+	for (;;)
+	{
+		if (ls_atomic_load32(&s->stop))
+			return NULL;
+
+		// bound handoffs, so tasks passing a resource back and forth
+		// cannot starve the run queue
+		if (w->nnext < RUNNEXT_MAX || ls_runq_empty(&w->runq))
+		{
+			t = ls_atomic_xchgptr(&w->runnext, NULL);
+			if (t)
+			{
+				w->nnext++;
+				return t;
+			}
+		}
+
+		w->nnext = 0;
+
+		t = ls_runq_pop(&w->runq);
+		if (t)
+			return t;
+
+		t = ls_inject_pop(s);
+		if (t)
+			return t;
+
+		t = ls_sched_steal(w);
+		if (t)
+			return t;
+
+		lock_lock(&s->lock);
+
+		// advertise before checking for work, pairs with the fence
+		// in ls_sched_notify
+		ls_atomic_add32(&s->nidle, 1);
+
+		if (!ls_atomic_load32(&s->stop) && !ls_sched_has_work(s))
+			(void)cond_wait(&s->idle_cond, &s->lock, LS_INFINITE);
+
+		ls_atomic_add32(&s->nidle, -1);
+
+		lock_unlock(&s->lock);
+	}
+}
+
+//! \brief Switch from the calling task back to its worker.
+//!
+//! Returns when the task is resumed, possibly on another worker.
+static void ls_task_switch_out(int action, ls_lock_t *unlock)
+{
+	struct ls_worker *w;
+	struct ls_task *t;
+
+	w = ls_worker_current();
+	t = w->current;
+
+	w->action = action;
+	w->unlock = unlock;
+
+#if LS_WINDOWS
+	(void)t;
+	SwitchToFiber(w->lpFiber);
+#else
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+	swapcontext(&t->ctx, &w->ctx);
+#pragma clang diagnostic pop
+#endif // LS_WINDOWS
+}
+
+static void ls_task_link(struct ls_sched *s, struct ls_task *t)
+{
+	lock_lock(&s->tasks_lock);
+
+	t->live_prev = NULL;
+	t->live_next = s->tasks;
+	if (t->live_next)
+		t->live_next->live_prev = t;
+	s->tasks = t;
+
+	lock_unlock(&s->tasks_lock);
+}
+
+//! \brief Remove a task from the list of live tasks, does nothing if
+//! it was already removed. Must hold the tasks lock.
+static void ls_task_unlink(struct ls_sched *s, struct ls_task *t)
+{
+	if (t->live_prev)
+		t->live_prev->live_next = t->live_next;
+	else if (s->tasks == t)
+		s->tasks = t->live_next;
+	else
+		return;
+
+	if (t->live_next)
+		t->live_next->live_prev = t->live_prev;
+
+	t->live_prev = NULL;
+	t->live_next = NULL;
+}
+
+static void ls_task_finish(struct ls_task *t, int exit_code)
+{
+	struct ls_sched *s = t->sched;
+	int waiting = t->waiting;
+
+	lock_lock(&s->tasks_lock);
+	ls_task_unlink(s, t);
+	lock_unlock(&s->tasks_lock);
+
+	// a task abandoned by ls_sched_stop while blocked on an object is
+	// still referenced by the wait queue of that object, keep its
+	// stack and the task itself so a later wake finds them
+	if (!waiting)
+	{
+#if LS_WINDOWS
+		if (t->lpFiber)
+		{
+			DeleteFiber(t->lpFiber);
+			t->lpFiber = NULL;
+		}
+#else
+		ls_free(t->stack);
+		t->stack = NULL;
+#endif // LS_WINDOWS
+	}
+
+	lock_lock(&t->lock);
+	t->exit_code = exit_code;
+	t->done = 1;
+	ls_waitq_wake_all(&t->joiners);
+	lock_unlock(&t->lock);
+
+	if (!waiting)
+		ls_task_release(t);
+
+	if (ls_atomic_add32(&s->ntasks, -1) == 1)
+	{
+		lock_lock(&s->lock);
+		cond_broadcast(&s->done_cond);
+		lock_unlock(&s->lock);
+	}
+}
+
+#if LS_WINDOWS
+
+static void CALLBACK ls_task_entry(void *up)
+{
+	struct ls_task *t = up;
+	t->exit_code = t->func(t->up);
+	ls_task_switch_out(ACTION_EXIT, NULL);
+}
+
+#else
+
+static void ls_task_entry(int lo, int hi)
+{
+	struct ls_task *t = ls_create_pointer(lo, hi);
+	t->exit_code = t->func(t->up);
+	ls_task_switch_out(ACTION_EXIT, NULL);
+}
+
+#endif // LS_WINDOWS
+
+static int ls_worker_main(void *param)
+{
+	struct ls_worker *w = param;
+	struct ls_task *t;
+	ls_lock_t *unlock;
+
+	_worker = w;
+
+#if LS_WINDOWS
+	w->lpFiber = ConvertThreadToFiber(NULL);
+	if (!w->lpFiber)
+	{
+		_worker = NULL;
+		return -1;
+	}
+#endif // LS_WINDOWS
+
+	while ((t = ls_sched_next(w)))
+	{
+		w->current = t;
+		_ls_errno = t->err;
+
+#if LS_WINDOWS
+		SwitchToFiber(t->lpFiber);
+#else
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+		swapcontext(&w->ctx, &t->ctx);
+#pragma clang diagnostic pop
+#endif // LS_WINDOWS
+
+		t->err = _ls_errno;
+		w->current = NULL;
+
+		switch (w->action)
+		{
+		case ACTION_YIELD:
+			ls_sched_ready(w->sched, t);
+			break;
+		case ACTION_PARK:
+			// release the lock first, the task must not run again
+			// until the state below is published
+			unlock = w->unlock;
+			if (unlock)
+				lock_unlock(unlock);
+
+			if (!ls_atomic_cas32(&t->state, TASK_RUNNING, TASK_PARKED))
+			{
+				// woken before it was parked
+				ls_atomic_store32(&t->state, TASK_RUNNING);
+				ls_sched_ready(w->sched, t);
+			}
+			break;
+		case ACTION_EXIT:
+			ls_task_finish(t, t->exit_code);
+			break;
+		}
+	}
+
+#if LS_WINDOWS
+	(void)ConvertFiberToThread();
+#endif // LS_WINDOWS
+
+	_worker = NULL;
+
+	return 0;
+}
+
+static void ls_sched_stop(struct ls_sched *s)
+{
+	struct ls_worker *w;
+	struct ls_task *t;
+	int i;
+
+	lock_lock(&s->lock);
+	ls_atomic_store32(&s->stop, 1);
+	cond_broadcast(&s->idle_cond);
+	lock_unlock(&s->lock);
+
+	for (i = 0; i < s->nworkers; i++)
+	{
+		w = &s->workers[i];
+		if (w->thread)
+		{
+			(void)ls_wait(w->thread);
+			ls_close(w->thread);
+			w->thread = NULL;
+		}
+	}
+
+	// after the workers, tasks may still be waiting on the reactor
+	if (s->reactor)
+	{
+		ls_reactor_destroy(s->reactor);
+		s->reactor = NULL;
+	}
+
+	// forget runnable tasks, they are finished with the rest below
+	for (i = 0; i < s->nworkers; i++)
+	{
+		s->workers[i].runnext = NULL;
+		while (ls_runq_pop(&s->workers[i].runq))
+			;
+	}
+
+	while (ls_inject_pop(s))
+		;
+
+	// no worker runs the remaining tasks anymore, so wakes, including
+	// those made while finishing them below, must not reach the
+	// scheduler
+	lock_lock(&s->tasks_lock);
+	for (t = s->tasks; t; t = t->live_next)
+		ls_atomic_store32(&t->state, TASK_DEAD);
+	lock_unlock(&s->tasks_lock);
+
+	// finish every task which has not completed, whether runnable or
+	// parked, so their joiners return
+	for (;;)
+	{
+		lock_lock(&s->tasks_lock);
+		t = s->tasks;
+		if (t)
+			ls_task_unlink(s, t);
+		lock_unlock(&s->tasks_lock);
+
+		if (!t)
+			break;
+
+		ls_task_finish(t, -1);
+	}
+}
+
+static void ls_sched_dtor(struct ls_sched *s)
+{
+	ls_sched_stop(s);
+
+	ls_free(s->workers);
+
+	lock_destroy(&s->tasks_lock);
+	cond_destroy(&s->done_cond);
+	cond_destroy(&s->idle_cond);
+	lock_destroy(&s->lock);
+}
+
+static int ls_sched_wait(struct ls_sched *s, unsigned long ms)
+{
+	long long deadline, remain;
+	int rc;
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	lock_lock(&s->lock);
+
+	while (ls_atomic_load32(&s->ntasks) != 0)
+	{
+		if (ms == LS_INFINITE)
+		{
+			(void)cond_wait(&s->done_cond, &s->lock, LS_INFINITE);
+			continue;
+		}
+
+		remain = deadline - ls_nanotime();
+		if (remain <= 0)
+		{
+			lock_unlock(&s->lock);
+			return 1;
+		}
+
+		rc = cond_wait(&s->done_cond, &s->lock, (unsigned long)((remain + 999999) / 1000000));
+		if (rc == 1 && ls_atomic_load32(&s->ntasks) != 0)
+		{
+			lock_unlock(&s->lock);
+			return 1;
+		}
+	}
+
+	lock_unlock(&s->lock);
+
+	return 0;
+}
+
+static const struct ls_class SchedClass = {
+	.type = LS_SCHED,
+	.cb = sizeof(struct ls_sched),
+	.dtor = (ls_dtor_t)&ls_sched_dtor,
+	.wait = (ls_wait_t)&ls_sched_wait
+};
+
+static void ls_task_ref_dtor(struct ls_task_ref *ref)
+{
+	ls_task_release(ref->task);
+}
+
+static int ls_task_ref_wait(struct ls_task_ref *ref, unsigned long ms)
+{
+	struct ls_task *t = ref->task;
+	struct ls_waiter w;
+	int rc;
+
+	lock_lock(&t->lock);
+
+	if (t->done)
+	{
+		lock_unlock(&t->lock);
+		return 0;
+	}
+
+	if (ms == 0)
+	{
+		lock_unlock(&t->lock);
+		return 1;
+	}
+
+	if (ls_waiter_init(&w) == -1)
+	{
+		lock_unlock(&t->lock);
+		return -1;
+	}
+
+	ls_waitq_push(&t->joiners, &w);
+
+	rc = ls_waiter_wait(&w, &t->lock, ms);
+	if (rc == 1)
+		ls_waitq_remove(&t->joiners, &w);
+
+	lock_unlock(&t->lock);
+
+	ls_waiter_destroy(&w);
+
+	return rc;
+}
+
+static void ls_fls_dtor(struct ls_fls *fls)
+{
+	ls_fls_lock();
+
+	_fls_gens[fls->index]++;
+	_fls_free[_fls_nfree++] = fls->index;
+
+	ls_fls_unlock();
+}
+
+static const struct ls_class FlsClass = {
+	.type = LS_FLS,
+	.cb = sizeof(struct ls_fls),
+	.dtor = (ls_dtor_t)&ls_fls_dtor,
+	.wait = NULL
+};
+
+static const struct ls_class TaskClass = {
+	.type = LS_TASK,
+	.cb = sizeof(struct ls_task_ref),
+	.dtor = (ls_dtor_t)&ls_task_ref_dtor,
+	.wait = (ls_wait_t)&ls_task_ref_wait
+};
+
+ls_handle ls_sched_create(int nworkers, int flags)
+{
+	struct ls_sched *s;
+	struct ls_worker *w;
+	struct ls_cpuinfo ci;
+	int i;
+
+	if (nworkers < 0 || (flags & ~LS_SCHED_ASYNC_IO))
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	if (nworkers == 0)
+	{
+		ls_get_cpuinfo(&ci);
+		nworkers = ci.num_cores > 0 ? ci.num_cores : 1;
+	}
+
+	s = ls_handle_create(&SchedClass, 0);
+	if (!s)
+		return NULL;
+
+	if (lock_init(&s->lock) == -1)
+	{
+		ls_handle_dealloc(s);
+		return NULL;
+	}
+
+	if (cond_init(&s->idle_cond) == -1)
+	{
+		lock_destroy(&s->lock);
+		ls_handle_dealloc(s);
+		return NULL;
+	}
+
+	if (cond_init(&s->done_cond) == -1)
+	{
+		cond_destroy(&s->idle_cond);
+		lock_destroy(&s->lock);
+		ls_handle_dealloc(s);
+		return NULL;
+	}
+
+	if (lock_init(&s->tasks_lock) == -1)
+	{
+		cond_destroy(&s->done_cond);
+		cond_destroy(&s->idle_cond);
+		lock_destroy(&s->lock);
+		ls_handle_dealloc(s);
+		return NULL;
+	}
+
+	s->workers = ls_calloc(nworkers, sizeof(struct ls_worker));
+	if (!s->workers)
+	{
+		lock_destroy(&s->tasks_lock);
+		cond_destroy(&s->done_cond);
+		cond_destroy(&s->idle_cond);
+		lock_destroy(&s->lock);
+		ls_handle_dealloc(s);
+		return NULL;
+	}
+
+	s->nworkers = nworkers;
+
+	if (flags & LS_SCHED_ASYNC_IO)
+	{
+		s->async_io = 1;
+		s->reactor = ls_reactor_create();
+		if (!s->reactor)
+		{
+			ls_free(s->workers);
+			lock_destroy(&s->tasks_lock);
+			cond_destroy(&s->done_cond);
+			cond_destroy(&s->idle_cond);
+			lock_destroy(&s->lock);
+			ls_handle_dealloc(s);
+			return NULL;
+		}
+	}
+
+	for (i = 0; i < nworkers; i++)
+	{
+		w = &s->workers[i];
+		w->sched = s;
+		w->id = i;
+		w->seed = (uint32_t)(i + 1) * 2654435761u;
+	}
+
+	for (i = 0; i < nworkers; i++)
+	{
+		w = &s->workers[i];
+		w->thread = ls_thread_create(&ls_worker_main, w);
+		if (!w->thread)
+		{
+			ls_sched_dtor(s);
+			ls_handle_dealloc(s);
+			return NULL;
+		}
+	}
+
+	return s;
+}
+
+ls_handle ls_sched_spawn(ls_handle sched, ls_thread_func_t func, void *up)
+{
+	struct ls_sched *s = sched;
+	struct ls_task_ref *ref;
+	struct ls_task *t;
+#if LS_POSIX
+	int lo, hi;
+#endif // LS_POSIX
+
+	if (ls_type_check(sched, LS_SCHED))
+		return NULL;
+
+	if (!func)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return NULL;
+	}
+
+	ref = ls_handle_create(&TaskClass, 0);
+	if (!ref)
+		return NULL;
+
+	t = ls_calloc(1, sizeof(struct ls_task));
+	if (!t)
+	{
+		ls_handle_dealloc(ref);
+		return NULL;
+	}
+
+	if (lock_init(&t->lock) == -1)
+	{
+		ls_free(t);
+		ls_handle_dealloc(ref);
+		return NULL;
+	}
+
+	t->sched = s;
+	t->func = func;
+	t->up = up;
+	t->state = TASK_RUNNING;
+	t->refs = 2;
+
+#if LS_WINDOWS
+	t->lpFiber = CreateFiber(TASK_STACK_SIZE, &ls_task_entry, t);
+	if (!t->lpFiber)
+	{
+		ls_set_errno_win32(GetLastError());
+		lock_destroy(&t->lock);
+		ls_free(t);
+		ls_handle_dealloc(ref);
+		return NULL;
+	}
+#else
+	t->stack = ls_malloc(TASK_STACK_SIZE);
+	if (!t->stack)
+	{
+		lock_destroy(&t->lock);
+		ls_free(t);
+		ls_handle_dealloc(ref);
+		return NULL;
+	}
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+	if (getcontext(&t->ctx) == -1)
+#pragma clang diagnostic pop
+	{
+		ls_set_errno_errno(errno);
+		ls_free(t->stack);
+		lock_destroy(&t->lock);
+		ls_free(t);
+		ls_handle_dealloc(ref);
+		return NULL;
+	}
+
+	t->ctx.uc_stack.ss_sp = t->stack;
+	t->ctx.uc_stack.ss_size = TASK_STACK_SIZE;
+	t->ctx.uc_link = NULL;
+
+	// ucontext function takes int as arguments, so we need to split the pointer
+	ls_split_pointer(t, &lo, &hi);
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+	makecontext(&t->ctx, (void(*)(void))&ls_task_entry, 2, lo, hi);
+#pragma clang diagnostic pop
+#endif // LS_WINDOWS
+
+	ref->task = t;
+
+	ls_task_link(s, t);
+	ls_atomic_add32(&s->ntasks, 1);
+	ls_sched_ready(s, t);
+
+	return ref;
+}
+
+void ls_sched_yield(void)
+{
+	struct ls_worker *w;
+
+	w = ls_worker_current();
+	if (!w || !w->current)
+	{
+		ls_yield();
+		return;
+	}
+
+	ls_task_switch_out(ACTION_YIELD, NULL);
+}
+
+ls_handle ls_task_self(void)
+{
+	return ls_task_current() ? LS_SELF : NULL;
+}
+
+int ls_sched_worker(void)
+{
+	struct ls_worker *w;
+
+	w = ls_worker_current();
+	if (!w || !w->current)
+		return -1;
+	return w->id;
+}
+
+int ls_task_exit_code(ls_handle task, int *exit_code)
+{
+	struct ls_task_ref *ref = task;
+	struct ls_task *t;
+
+	if (ls_type_check(task, LS_TASK))
+		return -1;
+
+	if (!exit_code)
+		return ls_set_errno(LS_INVALID_ARGUMENT);
+
+	t = ref->task;
+
+	lock_lock(&t->lock);
+
+	if (!t->done)
+	{
+		lock_unlock(&t->lock);
+		return 1;
+	}
+
+	*exit_code = t->exit_code;
+
+	lock_unlock(&t->lock);
+
+	return 0;
+}
+
+struct ls_task *ls_task_current(void)
+{
+	struct ls_worker *w;
+
+	w = ls_worker_current();
+	return w ? w->current : NULL;
+}
+
+void ls_task_park(ls_lock_t *lock)
+{
+	struct ls_task *t;
+
+	t = ls_task_current();
+
+	// consume a wake which arrived before parking
+	if (ls_atomic_cas32(&t->state, TASK_NOTIFIED, TASK_RUNNING))
+	{
+		if (lock)
+			lock_unlock(lock);
+		return;
+	}
+
+	ls_task_switch_out(ACTION_PARK, lock);
+}
+
+//! \brief Transition a task out of the parked state.
+//!
+//! \return Nonzero if the task was parked and the caller must make
+//! it runnable.
+static int ls_task_unpark(struct ls_task *task)
+{
+	int32_t state;
+
+	for (;;)
+	{
+		state = ls_atomic_load32(&task->state);
+		switch (state)
+		{
+		case TASK_PARKED:
+			if (ls_atomic_cas32(&task->state, TASK_PARKED, TASK_RUNNING))
+				return 1;
+			break;
+		case TASK_RUNNING:
+			if (ls_atomic_cas32(&task->state, TASK_RUNNING, TASK_NOTIFIED))
+				return 0;
+			break;
+		default:
+			return 0; // already notified
+		}
+	}
+}
+
+void ls_task_wake(struct ls_task *task)
+{
+	if (ls_task_unpark(task))
+		ls_sched_ready(task->sched, task);
+}
+
+void ls_task_wake_next(struct ls_task *task)
+{
+	struct ls_sched *s = task->sched;
+	struct ls_worker *w;
+	struct ls_task *prev;
+
+	if (!ls_task_unpark(task))
+		return;
+
+	w = ls_worker_current();
+	if (!w || w->sched != s)
+	{
+		ls_sched_ready(s, task);
+		return;
+	}
+
+	// displace the previous handoff to the back of the run queue
+	prev = ls_atomic_xchgptr(&w->runnext, task);
+	if (prev)
+		ls_sched_ready(s, prev);
+	else
+		ls_sched_notify(s);
+}
+
+//! \brief Get the reactor of a scheduler, creating it if needed.
+//!
+//! \return The reactor, or NULL if it could not be created.
+static struct ls_reactor *ls_sched_reactor(struct ls_sched *s)
+{
+	struct ls_reactor *r;
+	int err;
+
+	r = ls_atomic_loadptr(&s->reactor);
+	if (r || s->no_reactor)
+		return r;
+
+	lock_lock(&s->lock);
+
+	if (!s->reactor && !s->no_reactor)
+	{
+		err = _ls_errno; // failure is not reported to the caller
+
+		r = ls_reactor_create();
+		if (r)
+			ls_atomic_storeptr(&s->reactor, r);
+		else
+			s->no_reactor = 1;
+
+		_ls_errno = err;
+	}
+
+	r = s->reactor;
+
+	lock_unlock(&s->lock);
+
+	return r;
+}
+
+void ls_task_timed_park(ls_lock_t *lock, unsigned long ms)
+{
+	struct ls_task *t;
+	struct ls_reactor *r;
+
+	t = ls_task_current();
+
+	r = ls_sched_reactor(t->sched);
+	if (r && ls_reactor_park(r, t, lock, ms) == 0)
+		return;
+
+	// no way to time the wait, poll instead
+	if (lock)
+		lock_unlock(lock);
+	ls_sched_yield();
+}
+
+void ls_task_set_waiting(struct ls_task *task, int waiting)
+{
+	task->waiting = waiting;
+}
+
+int ls_task_io_active(void)
+{
+	struct ls_task *t;
+
+	t = ls_task_current();
+	return t && t->sched->async_io;
+}
+
+int ls_task_wait_fd(int fd, int events, unsigned long ms)
+{
+#if LS_WINDOWS
+	return ls_set_errno(LS_NOT_SUPPORTED);
+#else
+	struct ls_task *t;
+	struct pollfd pfd;
+
+	t = ls_task_current();
+	if (!t || !t->sched->async_io)
+		return ls_set_errno(LS_NOT_SUPPORTED);
+
+	pfd.fd = fd;
+	pfd.events = 0;
+	if (events & LS_POLL_IN)
+		pfd.events |= POLLIN;
+	if (events & LS_POLL_OUT)
+		pfd.events |= POLLOUT;
+
+	// avoid suspending if already ready, errors are left to the
+	// following I/O call to report
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) != 0)
+		return 0;
+
+	if (ms == 0)
+		return 1;
+
+	return ls_reactor_wait(t->sched->reactor, t, fd, events, ms);
+#endif // LS_WINDOWS
+}
+
+int ls_task_sleep(unsigned long ms)
+{
+	struct ls_task *t;
+
+	t = ls_task_current();
+	if (!t || !t->sched->async_io)
+		return ls_set_errno(LS_NOT_SUPPORTED);
+
+	(void)ls_reactor_wait(t->sched->reactor, t, -1, 0, ms);
+	return 0;
+}
+
+ls_handle ls_fls_create(void)
+{
+	struct ls_fls *fls;
+	uint32_t *gens, *free_slots;
+	uint32_t n;
+
+	fls = ls_handle_create(&FlsClass, 0);
+	if (!fls)
+		return NULL;
+
+	ls_fls_lock();
+
+	if (_fls_nfree == 0)
+	{
+		n = _fls_nslots + 1;
+
+		gens = ls_realloc(_fls_gens, n * sizeof(uint32_t));
+		if (!gens)
+		{
+			ls_fls_unlock();
+			ls_handle_dealloc(fls);
+			return NULL;
+		}
+		_fls_gens = gens;
+
+		// reserve room to free every slot
+		free_slots = ls_realloc(_fls_free, n * sizeof(uint32_t));
+		if (!free_slots)
+		{
+			ls_fls_unlock();
+			ls_handle_dealloc(fls);
+			return NULL;
+		}
+		_fls_free = free_slots;
+
+		_fls_gens[_fls_nslots] = 1;
+		_fls_free[_fls_nfree++] = _fls_nslots;
+		_fls_nslots = n;
+	}
+
+	fls->index = _fls_free[--_fls_nfree];
+	fls->gen = _fls_gens[fls->index];
+
+	ls_fls_unlock();
+
+	return fls;
+}
+
+int ls_fls_set(ls_handle flsh, void *value)
+{
+	struct ls_fls *fls = flsh;
+	struct ls_fls_slot *slots;
+	struct ls_task *t;
+	uint32_t n;
+
+	if (ls_type_check(flsh, LS_FLS))
+		return -1;
+
+	t = ls_task_current();
+	if (!t)
+		return ls_set_errno(LS_INVALID_STATE);
+
+	if (fls->index >= t->nfls)
+	{
+		n = fls->index + 1;
+		if (n < t->nfls * 2)
+			n = t->nfls * 2;
+
+		slots = ls_realloc(t->fls, n * sizeof(struct ls_fls_slot));
+		if (!slots)
+			return -1;
+
+		memset(slots + t->nfls, 0, (n - t->nfls) * sizeof(struct ls_fls_slot));
+
+		t->fls = slots;
+		t->nfls = n;
+	}
+
+	t->fls[fls->index].gen = fls->gen;
+	t->fls[fls->index].value = value;
+
+	return 0;
+}
+
+void *ls_fls_get(ls_handle flsh)
+{
+	struct ls_fls *fls = flsh;
+	struct ls_fls_slot *slot;
+	struct ls_task *t;
+
+	if (ls_type_check(flsh, LS_FLS))
+		return NULL;
+
+	t = ls_task_current();
+	if (!t)
+	{
+		ls_set_errno(LS_INVALID_STATE);
+		return NULL;
+	}
+
+	if (fls->index >= t->nfls)
+		return NULL;
+
+	slot = &t->fls[fls->index];
+	return slot->gen == fls->gen ? slot->value : NULL;
+}
@@ -0,0 +1,96 @@
+#ifndef _LS_SCHED_PRIV_H_
+#define _LS_SCHED_PRIV_H_
+
+#include "ls_native.h"
+#include "ls_sync_util.h"
+
+#define LS_POLL_IN 0x1
+#define LS_POLL_OUT 0x2
+
+struct ls_task;
+
+//! \brief Get the task running on the calling thread.
+//!
+//! \return The task, or NULL if the caller is not running in a task.
+struct ls_task *ls_task_current(void);
+
+//! \brief Suspend the calling task.
+//!
+//! Switches out the calling task until ls_task_wake() is called on
+//! it. If lock is not NULL, it is released after the task has been
+//! switched out, so a waker which takes the same lock is guaranteed
+//! to find the task suspended. The lock is not held upon return.
+//!
+//! A wake which arrives before the task is suspended is not lost,
+//! but wakes may be spurious, so callers must recheck their
+//! condition upon return. Must only be called from a task.
+//!
+//! \param lock Lock to release once suspended, may be NULL.
+void ls_task_park(ls_lock_t *lock);
+
+//! \brief Make a suspended task runnable.
+//!
+//! May be called from any thread. If the task is not suspended, its
+//! next call to ls_task_park() returns immediately.
+//!
+//! \param task The task to wake.
+void ls_task_wake(struct ls_task *task);
+
+//! \brief Make a suspended task runnable, running it next.
+//!
+//! Like ls_task_wake(), but if called from a worker of the same
+//! scheduler, the task runs as soon as the caller switches out
+//! instead of at the back of the run queue. Used to hand off a
+//! resource directly to the task waiting for it.
+//!
+//! \param task The task to wake.
+void ls_task_wake_next(struct ls_task *task);
+
+//! \brief Suspend the calling task with a timeout.
+//!
+//! Like ls_task_park(), but also returns once ms milliseconds have
+//! passed. If the scheduler cannot time the wait, the task yields
+//! instead, so callers must check their deadline upon return.
+//!
+//! \param lock Lock to release once suspended, may be NULL.
+//! \param ms Maximum time to wait in milliseconds.
+void ls_task_timed_park(ls_lock_t *lock, unsigned long ms);
+
+//! \brief Mark a task as blocked on a synchronization object.
+//!
+//! While set, a waiter on the stack of the task may be linked into
+//! the wait queue of an object, so a stopping scheduler must not
+//! free the stack.
+//!
+//! \param task The calling task.
+//! \param waiting Nonzero while the task is blocked.
+void ls_task_set_waiting(struct ls_task *task, int waiting);
+
+//! \brief Check whether blocking calls should suspend the caller.
+//!
+//! \return Nonzero if the caller is a task running on a scheduler
+//! created with LS_SCHED_ASYNC_IO.
+int ls_task_io_active(void);
+
+//! \brief Wait for a descriptor to become ready.
+//!
+//! Suspends only the calling task, its worker continues to run other
+//! tasks in the meantime.
+//!
+//! \param fd The descriptor.
+//! \param events Combination of LS_POLL_IN and LS_POLL_OUT.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if the descriptor is ready, 1 if the timeout expired, -1
+//! if the caller cannot be suspended. In the last case the caller
+//! should fall back to a blocking call.
+int ls_task_wait_fd(int fd, int events, unsigned long ms);
+
+//! \brief Suspend the calling task for a period of time.
+//!
+//! \param ms The number of milliseconds to sleep.
+//!
+//! \return 0 on success, -1 if the caller cannot be suspended.
+int ls_task_sleep(unsigned long ms);
+
+#endif // _LS_SCHED_PRIV_H_
@@ -1,3 +1,7 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // sched_getcpu
+#endif
+
 #include "ls_native.h"
 
 #include <stdlib.h>
@@ -5,9 +9,17 @@
 
 #include <lysys/ls_sync.h>
 #include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+#include <lysys/ls_memory.h>
 
 #include "ls_handle.h"
 #include "ls_sync_util.h"
+#include "ls_atomic.h"
+#include "ls_futex.h"
+
+#if LS_LINUX
+#include <sched.h>
+#endif // LS_LINUX
 
 #if LS_DARWIN
 #include <mach/semaphore.h>
@@ -46,10 +58,77 @@ struct semaphore
 #elif LS_DARWIN
     semaphore_t sema;
 #else
-    int placeholder;
+    volatile int32_t count;
+    volatile int32_t nwaiters; // threads which may be blocked on count
 #endif // LS_WINDOWS
 };
 
+#define RWLOCK_SLOTS 16
+
+struct rwlock_slot
+{
+    // readers which entered through this slot, a reader which leaves
+    // on another CPU may drive a count negative
+    volatile int32_t readers;
+    char pad[LS_CACHE_LINE - sizeof(int32_t)];
+};
+
+struct rwlock
+{
+    volatile int32_t writer; // 0 none, 1 held or pending, 2 with waiters
+    volatile int32_t drain; // changed as readers leave while writer is set
+    char pad[LS_CACHE_LINE - 2 * sizeof(int32_t)];
+    struct rwlock_slot slots[RWLOCK_SLOTS];
+};
+
+static const struct ls_class RWLockClass = {
+    .type = LS_RWLOCK,
+    .cb = sizeof(struct rwlock),
+    .dtor = NULL,
+    .wait = NULL
+};
+
+#define BARRIER_FANIN 4 // arrivals combined per node
+#define SPIN_COUNT 1000 // polls before a barrier or latch waiter sleeps
+
+struct barrier_node
+{
+    // arrivals since creation, capacity per completed phase
+    volatile int32_t count;
+    int32_t capacity;
+    int32_t parent; // -1 for the root
+    char pad[LS_CACHE_LINE - 3 * sizeof(int32_t)];
+};
+
+struct barrier
+{
+    volatile int32_t phase; // incremented as each phase completes
+    volatile int32_t nwaiters; // threads which may be blocked on phase
+    char pad[LS_CACHE_LINE - 2 * sizeof(int32_t)];
+
+    // combining tree, leaves first and the root last
+    struct barrier_node *nodes;
+    int32_t nleaves;
+};
+
+struct latch
+{
+    volatile int32_t count;
+    volatile int32_t nwaiters; // threads which may be blocked on count
+};
+
+static void ls_barrier_dtor(struct barrier *barrier)
+{
+    ls_free(barrier->nodes);
+}
+
+static const struct ls_class BarrierClass = {
+    .type = LS_BARRIER,
+    .cb = sizeof(struct barrier),
+    .dtor = (ls_dtor_t)&ls_barrier_dtor,
+    .wait = NULL
+};
+
 static void ls_semaphore_dtor(struct semaphore *sema)
 {
 #if LS_WINDOWS
@@ -106,7 +185,63 @@ static int ls_semaphore_wait(struct semaphore *sema, unsigned long timeout)
     
     return ls_set_errno_kr(kr);
 #else
-    return ls_set_errno(LS_NOT_IMPLEMENTED);
+    int32_t count;
+    long long deadline, remain;
+
+    // uncontended path, never enters the kernel
+    while ((count = ls_atomic_load32(&sema->count)) > 0)
+    {
+        if (ls_atomic_cas32(&sema->count, count, count - 1))
+            return 0;
+    }
+
+    if (timeout == 0)
+        return 1;
+
+    deadline = ls_nanotime() + (long long)timeout * 1000000;
+
+    // advertise before rechecking count, pairs with the fence in
+    // ls_semaphore_signal
+    ls_atomic_add32(&sema->nwaiters, 1);
+    ls_atomic_fence();
+
+    for (;;)
+    {
+        count = ls_atomic_load32(&sema->count);
+        if (count > 0)
+        {
+            if (ls_atomic_cas32(&sema->count, count, count - 1))
+                break;
+            continue;
+        }
+
+        if (timeout == LS_INFINITE)
+        {
+            (void)ls_futex_wait(&sema->count, 0, LS_INFINITE);
+            continue;
+        }
+
+        remain = deadline - ls_nanotime();
+        if (remain <= 0)
+        {
+            ls_atomic_add32(&sema->nwaiters, -1);
+            return 1;
+        }
+
+        (void)ls_futex_wait(&sema->count, 0, (unsigned long)((remain + 999999) / 1000000));
+    }
+
+    ls_atomic_add32(&sema->nwaiters, -1);
+    return 0;
+#endif // LS_WINDOWS
+}
+
+static intptr_t ls_semaphore_pollfd(struct semaphore *sema)
+{
+#if LS_WINDOWS
+    return (intptr_t)sema->hSemaphore;
+#else
+    return -1;
 #endif // LS_WINDOWS
 }
 
@@ -114,10 +249,16 @@ static const struct ls_class SemaphoreClass = {
     .type = LS_SEMAPHORE,
     .cb = sizeof(struct semaphore),
     .dtor = (ls_dtor_t)&ls_semaphore_dtor,
-    .wait = (ls_wait_t)&ls_semaphore_wait
+    .wait = (ls_wait_t)&ls_semaphore_wait,
+    .pollfd = (ls_pollfd_t)&ls_semaphore_pollfd
 };
 
 ls_handle ls_lock_create(void)
+{
+    return ls_lock_create_ex(0);
+}
+
+ls_handle ls_lock_create_ex(int flags)
 {
     ls_lock_t *lock;
     int rc;
@@ -126,7 +267,11 @@ ls_handle ls_lock_create(void)
     if (!lock)
         return NULL;
     
-    rc = lock_init(lock);
+#if LS_LOCK_PROFILE
+    rc = lock_init_named(lock, (flags & LS_LOCK_RECURSIVE) ? LOCK_RECURSIVE : 0, "ls_lock");
+#else
+    rc = lock_init_ex(lock, (flags & LS_LOCK_RECURSIVE) ? LOCK_RECURSIVE : 0);
+#endif // LS_LOCK_PROFILE
     if (rc == -1)
     {
         ls_handle_dealloc(lock);
@@ -216,7 +361,7 @@ ls_handle ls_semaphore_create(int count)
     if (!sema)
         return NULL;
     
-    kr = semaphore_create(mach_task_self(), &sema->sema, SYNC_POLICY_FIFO, 0);
+    kr = semaphore_create(mach_task_self(), &sema->sema, SYNC_POLICY_FIFO, count);
     if (kr != KERN_SUCCESS)
     {
         ls_handle_dealloc(sema);
@@ -226,8 +371,22 @@ ls_handle ls_semaphore_create(int count)
     
     return sema;
 #else
-    ls_set_errno(LS_NOT_IMPLEMENTED);
-    return NULL;
+    struct semaphore *sema;
+
+    if (count < 0)
+    {
+        ls_set_errno(LS_INVALID_ARGUMENT);
+        return NULL;
+    }
+
+    sema = ls_handle_create(&SemaphoreClass, 0);
+    if (!sema)
+        return NULL;
+
+    sema->count = count;
+    sema->nwaiters = 0;
+
+    return sema;
 #endif // LS_WNIDOWS
 }
 
@@ -252,6 +411,461 @@ int ls_semaphore_signal(ls_handle sema)
         return -1;
     return ls_set_errno_kr(semaphore_signal(semaphore->sema));
 #else
-    return ls_set_errno(LS_NOT_IMPLEMENTED);
+    struct semaphore *semaphore = sema;
+
+    if (ls_type_check(sema, LS_SEMAPHORE) != 0)
+        return -1;
+
+    ls_atomic_add32(&semaphore->count, 1);
+
+    // pairs with the fence in ls_semaphore_wait
+    ls_atomic_fence();
+    if (ls_atomic_load32(&semaphore->nwaiters) != 0)
+        ls_futex_wake(&semaphore->count, 0);
+
+    return 0;
+#endif // LS_WINDOWS
+}
+
+#if !LS_WINDOWS && !LS_LINUX
+static LS_THREADLOCAL int32_t _cpu_hint = -1;
+static volatile int32_t _next_cpu_hint = 0;
+#endif // !LS_WINDOWS && !LS_LINUX
+
+//! \brief Get a hint for spreading threads over cache lines.
+//!
+//! \return The current CPU, or a value which is stable per thread if
+//! the CPU cannot be queried.
+static int ls_cpu_hint(void)
+{
+#if LS_WINDOWS
+    return (int)GetCurrentProcessorNumber();
+#elif LS_LINUX
+    int cpu;
+
+    cpu = sched_getcpu();
+    return cpu < 0 ? 0 : cpu;
+#else
+    if (_cpu_hint == -1)
+        _cpu_hint = ls_atomic_add32(&_next_cpu_hint, 1) & 0x7fffffff;
+    return _cpu_hint;
 #endif // LS_WINDOWS
 }
+
+static struct rwlock_slot *ls_rwlock_slot(struct rwlock *rw)
+{
+    return &rw->slots[ls_cpu_hint() % RWLOCK_SLOTS];
+}
+
+static unsigned long ls_sync_remain(long long deadline, unsigned long ms)
+{
+    long long remain;
+
+    if (ms == LS_INFINITE)
+        return LS_INFINITE;
+
+    remain = deadline - ls_nanotime();
+    if (remain <= 0)
+        return 0;
+    return (unsigned long)((remain + 999999) / 1000000);
+}
+
+static void ls_rwlock_leave(struct rwlock *rw, struct rwlock_slot *slot)
+{
+    ls_atomic_add32(&slot->readers, -1);
+
+    // a writer waiting for readers to drain rechecks on each change
+    if (ls_atomic_load32(&rw->writer) != 0)
+    {
+        ls_atomic_add32(&rw->drain, 1);
+        ls_futex_wake(&rw->drain, 0);
+    }
+}
+
+static int ls_rwlock_enter(struct rwlock *rw, unsigned long ms)
+{
+    struct rwlock_slot *slot;
+    long long deadline = 0;
+    unsigned long remain;
+    int32_t writer;
+
+    if (ms != 0 && ms != LS_INFINITE)
+        deadline = ls_nanotime() + (long long)ms * 1000000;
+
+    for (;;)
+    {
+        slot = ls_rwlock_slot(rw);
+
+        // pairs with the writer setting its flag before counting readers
+        ls_atomic_add32(&slot->readers, 1);
+        if (LS_LIKELY(ls_atomic_load32(&rw->writer) == 0))
+            return 0;
+
+        // writers take precedence, back off until the writer is done
+        ls_rwlock_leave(rw, slot);
+        if (ms == 0)
+            return 1;
+
+        while ((writer = ls_atomic_load32(&rw->writer)) != 0)
+        {
+            if (writer == 1 && !ls_atomic_cas32(&rw->writer, 1, 2))
+                continue;
+
+            remain = ls_sync_remain(deadline, ms);
+            if (remain == 0)
+                return 1;
+
+            (void)ls_futex_wait(&rw->writer, 2, remain);
+        }
+    }
+}
+
+static int32_t ls_rwlock_readers(struct rwlock *rw)
+{
+    int32_t readers = 0;
+    int i;
+
+    for (i = 0; i < RWLOCK_SLOTS; i++)
+        readers += ls_atomic_load32(&rw->slots[i].readers);
+    return readers;
+}
+
+static void ls_rwlock_release(struct rwlock *rw)
+{
+    if (ls_atomic_xchg32(&rw->writer, 0) == 2)
+        ls_futex_wake(&rw->writer, 1);
+}
+
+static int ls_rwlock_acquire(struct rwlock *rw, unsigned long ms)
+{
+    long long deadline = 0;
+    unsigned long remain;
+    int32_t drain;
+
+    if (ms != 0 && ms != LS_INFINITE)
+        deadline = ls_nanotime() + (long long)ms * 1000000;
+
+    if (!ls_atomic_cas32(&rw->writer, 0, 1))
+    {
+        if (ms == 0)
+            return 1;
+
+        while (ls_atomic_xchg32(&rw->writer, 2) != 0)
+        {
+            remain = ls_sync_remain(deadline, ms);
+            if (remain == 0)
+                return 1;
+
+            (void)ls_futex_wait(&rw->writer, 2, remain);
+        }
+    }
+
+    // new readers now back off, wait for the remaining ones to leave
+    for (;;)
+    {
+        drain = ls_atomic_load32(&rw->drain);
+        if (ls_rwlock_readers(rw) == 0)
+            return 0;
+
+        remain = ms == 0 ? 0 : ls_sync_remain(deadline, ms);
+        if (remain == 0)
+        {
+            ls_rwlock_release(rw);
+            return 1;
+        }
+
+        (void)ls_futex_wait(&rw->drain, drain, remain);
+    }
+}
+
+ls_handle ls_rwlock_create(void)
+{
+    return ls_handle_create(&RWLockClass, 0);
+}
+
+void ls_rwlock_lock_shared(ls_handle rwlock)
+{
+    (void)ls_rwlock_enter(rwlock, LS_INFINITE);
+}
+
+int ls_rwlock_trylock_shared(ls_handle rwlock)
+{
+    return ls_rwlock_enter(rwlock, 0);
+}
+
+int ls_rwlock_timedlock_shared(ls_handle rwlock, unsigned long ms)
+{
+    return ls_rwlock_enter(rwlock, ms);
+}
+
+void ls_rwlock_unlock_shared(ls_handle rwlock)
+{
+    struct rwlock *rw = rwlock;
+    ls_rwlock_leave(rw, ls_rwlock_slot(rw));
+}
+
+void ls_rwlock_lock(ls_handle rwlock)
+{
+    (void)ls_rwlock_acquire(rwlock, LS_INFINITE);
+}
+
+int ls_rwlock_trylock(ls_handle rwlock)
+{
+    return ls_rwlock_acquire(rwlock, 0);
+}
+
+int ls_rwlock_timedlock(ls_handle rwlock, unsigned long ms)
+{
+    return ls_rwlock_acquire(rwlock, ms);
+}
+
+void ls_rwlock_unlock(ls_handle rwlock)
+{
+    ls_rwlock_release(rwlock);
+}
+
+ls_handle ls_barrier_create(int count)
+{
+    struct barrier *barrier;
+    struct barrier_node *node;
+    int32_t nnodes, width, first, last, i;
+
+    if (count <= 0)
+    {
+        ls_set_errno(LS_INVALID_ARGUMENT);
+        return NULL;
+    }
+
+    // each level has a node per BARRIER_FANIN arrivals at the level
+    nnodes = 0;
+    width = count;
+    do
+    {
+        width = (width + BARRIER_FANIN - 1) / BARRIER_FANIN;
+        nnodes += width;
+    } while (width > 1);
+
+    barrier = ls_handle_create(&BarrierClass, 0);
+    if (!barrier)
+        return NULL;
+
+    barrier->nodes = ls_calloc(nnodes, sizeof(struct barrier_node));
+    if (!barrier->nodes)
+    {
+        ls_handle_dealloc(barrier);
+        return NULL;
+    }
+
+    barrier->nleaves = (count + BARRIER_FANIN - 1) / BARRIER_FANIN;
+
+    first = 0;
+    width = count; // arrivals at the current level
+    for (;;)
+    {
+        last = first + (width + BARRIER_FANIN - 1) / BARRIER_FANIN;
+
+        for (i = first; i < last; i++)
+        {
+            node = &barrier->nodes[i];
+
+            node->capacity = width - (i - first) * BARRIER_FANIN;
+            if (node->capacity > BARRIER_FANIN)
+                node->capacity = BARRIER_FANIN;
+
+            node->parent = last - first == 1 ? -1 : last + (i - first) / BARRIER_FANIN;
+        }
+
+        if (last - first == 1)
+            break;
+
+        width = last - first;
+        first = last;
+    }
+
+    return barrier;
+}
+
+//! \brief Arrive at a leaf of the combining tree.
+//!
+//! \return The leaf, or NULL if the thread did not complete it.
+static struct barrier_node *ls_barrier_arrive(struct barrier *barrier, int32_t phase)
+{
+    struct barrier_node *node;
+    int32_t i, start;
+    uint32_t base, count;
+
+    // spread threads over the leaves, moving on from full ones
+    start = ls_cpu_hint() % barrier->nleaves;
+    i = start;
+
+    for (;;)
+    {
+        node = &barrier->nodes[i];
+        base = (uint32_t)node->capacity * (uint32_t)phase;
+
+        count = (uint32_t)ls_atomic_load32(&node->count);
+        if (count - base < (uint32_t)node->capacity)
+        {
+            if (ls_atomic_cas32(&node->count, (int32_t)count, (int32_t)(count + 1)))
+                return count + 1 - base == (uint32_t)node->capacity ? node : NULL;
+            continue;
+        }
+
+        i = (i + 1) % barrier->nleaves;
+        if (i == start)
+            ls_cpu_relax(); // more arrivals than participants
+    }
+}
+
+int ls_barrier_wait(ls_handle barrier)
+{
+    struct barrier *b = barrier;
+    struct barrier_node *node;
+    int32_t phase;
+    uint32_t base, count;
+    int i;
+
+    if (ls_type_check(barrier, LS_BARRIER))
+        return -1;
+
+    // the phase cannot complete before this thread arrives
+    phase = ls_atomic_load32(&b->phase);
+
+    node = ls_barrier_arrive(b, phase);
+    while (node)
+    {
+        if (node->parent == -1)
+        {
+            // last to arrive, release the phase
+            ls_atomic_add32(&b->phase, 1);
+            if (ls_atomic_load32(&b->nwaiters) != 0)
+                ls_futex_wake(&b->phase, 1);
+            return LS_BARRIER_SERIAL;
+        }
+
+        // the last arrival at a node carries it to the parent
+        node = &b->nodes[node->parent];
+        base = (uint32_t)node->capacity * (uint32_t)phase;
+        count = (uint32_t)ls_atomic_add32(&node->count, 1) + 1;
+        if (count - base != (uint32_t)node->capacity)
+            node = NULL;
+    }
+
+    for (i = 0; i < SPIN_COUNT; i++)
+    {
+        if (ls_atomic_load32(&b->phase) != phase)
+            return 0;
+        ls_cpu_relax();
+    }
+
+    ls_atomic_add32(&b->nwaiters, 1);
+    while (ls_atomic_load32(&b->phase) == phase)
+        (void)ls_futex_wait(&b->phase, phase, LS_INFINITE);
+    ls_atomic_add32(&b->nwaiters, -1);
+
+    return 0;
+}
+
+static int ls_latch_wait(struct latch *latch, unsigned long ms)
+{
+    long long deadline = 0;
+    unsigned long remain;
+    int32_t count;
+    int i;
+
+    for (i = 0; i < SPIN_COUNT; i++)
+    {
+        if (ls_atomic_load32(&latch->count) == 0)
+            return 0;
+
+        if (ms == 0)
+            return 1;
+
+        ls_cpu_relax();
+    }
+
+    if (ms != LS_INFINITE)
+        deadline = ls_nanotime() + (long long)ms * 1000000;
+
+    ls_atomic_add32(&latch->nwaiters, 1);
+
+    while ((count = ls_atomic_load32(&latch->count)) != 0)
+    {
+        remain = ls_sync_remain(deadline, ms);
+        if (remain == 0)
+        {
+            ls_atomic_add32(&latch->nwaiters, -1);
+            return 1;
+        }
+
+        (void)ls_futex_wait(&latch->count, count, remain);
+    }
+
+    ls_atomic_add32(&latch->nwaiters, -1);
+
+    return 0;
+}
+
+static const struct ls_class LatchClass = {
+    .type = LS_LATCH,
+    .cb = sizeof(struct latch),
+    .dtor = NULL,
+    .wait = (ls_wait_t)&ls_latch_wait
+};
+
+ls_handle ls_latch_create(int count)
+{
+    struct latch *latch;
+
+    if (count < 0)
+    {
+        ls_set_errno(LS_INVALID_ARGUMENT);
+        return NULL;
+    }
+
+    latch = ls_handle_create(&LatchClass, 0);
+    if (!latch)
+        return NULL;
+
+    latch->count = count;
+
+    return latch;
+}
+
+int ls_latch_count_down(ls_handle latch, int n)
+{
+    struct latch *l = latch;
+    int32_t count;
+
+    if (ls_type_check(latch, LS_LATCH))
+        return -1;
+
+    if (n < 0)
+        return ls_set_errno(LS_INVALID_ARGUMENT);
+
+    do
+    {
+        count = ls_atomic_load32(&l->count);
+        if (n > count)
+            return ls_set_errno(LS_INVALID_STATE);
+    } while (!ls_atomic_cas32(&l->count, count, count - n));
+
+    if (count == n && n != 0 && ls_atomic_load32(&l->nwaiters) != 0)
+        ls_futex_wake(&l->count, 1);
+
+    return 0;
+}
+
+int ls_latch_arrive_and_wait(ls_handle latch)
+{
+    if (ls_latch_count_down(latch, 1) == -1)
+        return -1;
+    return ls_latch_wait(latch, LS_INFINITE);
+}
+
+int ls_latch_count(ls_handle latch)
+{
+    if (ls_type_check(latch, LS_LATCH))
+        return -1;
+    return ls_atomic_load32(&((struct latch *)latch)->count);
+}
@@ -1,41 +1,283 @@
 #include "ls_sync_util.h"
 
 #include <lysys/ls_core.h>
+#include <lysys/ls_sync.h>
 
-int lock_init(ls_lock_t *lock)
+#if LS_LOCK_PROFILE
+#include <stddef.h>
+#include <string.h>
+
+#include <lysys/ls_time.h>
+#endif // LS_LOCK_PROFILE
+
+#include "ls_atomic.h"
+
+#if LS_LOCK_PROFILE
+static volatile int32_t _prof_lock = 0; // guards the list of live locks
+static struct ls_lock_prof *_prof_head = NULL;
+
+static void prof_list_lock(void)
+{
+    while (!ls_atomic_cas32(&_prof_lock, 0, 1))
+        ls_cpu_relax();
+}
+
+static void prof_list_unlock(void)
+{
+    ls_atomic_store32(&_prof_lock, 0);
+}
+
+static void prof_register(struct ls_lock_prof *prof, const char *name)
 {
-#if LS_WINDOWS
-    InitializeCriticalSection(lock);
+    const char *base;
+
+    // report only the file name of internal locks
+    base = strrchr(name, '/');
+    if (!base)
+        base = strrchr(name, '\\');
+
+    memset(prof, 0, sizeof(*prof));
+    prof->name = base ? base + 1 : name;
+
+    prof_list_lock();
+
+    prof->next = _prof_head;
+    if (_prof_head)
+        _prof_head->prev = prof;
+    _prof_head = prof;
+
+    prof_list_unlock();
+}
+
+static void prof_unregister(struct ls_lock_prof *prof)
+{
+    prof_list_lock();
+
+    if (prof->prev)
+        prof->prev->next = prof->next;
+    else
+        _prof_head = prof->next;
+
+    if (prof->next)
+        prof->next->prev = prof->prev;
+
+    prof_list_unlock();
+}
+
+//! \brief Record an acquire, called with the lock held.
+//!
+//! \param prof Statistics of the lock
+//! \param start ls_nanotime when the thread started waiting, or -1
+//! if the lock was acquired without waiting
+static void prof_acquired(struct ls_lock_prof *prof, long long start)
+{
+    long long now, wait;
+
+    now = ls_nanotime();
+
+    prof->acquires++;
+
+    // a recursive lock is held until its outermost release
+    if (prof->depth++ == 0)
+        prof->acquired_at = now;
+
+    if (start >= 0)
+    {
+        wait = now - start;
+
+        prof->contended++;
+        prof->wait_total += wait;
+        if (wait > prof->wait_max)
+            prof->wait_max = wait;
+    }
+}
+
+//! \brief Record a release, called with the lock held.
+static void prof_released(struct ls_lock_prof *prof)
+{
+    long long hold;
+
+    if (--prof->depth != 0)
+        return;
+
+    hold = ls_nanotime() - prof->acquired_at;
+
+    prof->hold_total += hold;
+    if (hold > prof->hold_max)
+        prof->hold_max = hold;
+}
+#endif // LS_LOCK_PROFILE
+
+#if LS_FUTEX_LOCK
+#include "ls_futex.h"
+
+#define LOCK_SPIN_MAX 100
+
+// address identifies the calling thread for recursive locks
+static LS_THREADLOCAL char _lock_self;
+
+static void lock_acquire_slow(ls_lock_t *lock)
+{
+    int32_t max, n;
+
+    // spin for up to twice the recent average before sleeping
+    max = lock->spin * 2 + 10;
+    if (max > LOCK_SPIN_MAX)
+        max = LOCK_SPIN_MAX;
+
+    for (n = 0; n < max; n++)
+    {
+        if (ls_atomic_load32(&lock->state) == 0 &&
+            ls_atomic_cas32(&lock->state, 0, 1))
+        {
+            lock->spin += (n - lock->spin) / 8;
+            return;
+        }
+
+        ls_cpu_relax();
+    }
+
+    lock->spin += (n - lock->spin) / 8;
+
+    // mark the lock as contended so the holder wakes us on release
+    while (ls_atomic_xchg32(&lock->state, 2) != 0)
+        (void)ls_futex_wait(&lock->state, 2, LS_INFINITE);
+}
+
+static inline void lock_acquire(ls_lock_t *lock)
+{
+#if LS_LOCK_PROFILE
+    long long start;
+
+    if (LS_LIKELY(ls_atomic_cas32(&lock->state, 0, 1)))
+    {
+        prof_acquired(&lock->prof, -1);
+        return;
+    }
+
+    start = ls_nanotime();
+    lock_acquire_slow(lock);
+    prof_acquired(&lock->prof, start);
+#else
+    if (LS_LIKELY(ls_atomic_cas32(&lock->state, 0, 1)))
+        return;
+    lock_acquire_slow(lock);
+#endif // LS_LOCK_PROFILE
+}
+
+static inline void lock_release(ls_lock_t *lock)
+{
+#if LS_LOCK_PROFILE
+    prof_released(&lock->prof);
+#endif // LS_LOCK_PROFILE
+
+    if (ls_atomic_xchg32(&lock->state, 0) == 2)
+        ls_futex_wake(&lock->state, 0);
+}
+#elif LS_LOCK_PROFILE
+#define LOCK_MUTEX(lock) (&(lock)->mutex)
+#else
+#define LOCK_MUTEX(lock) (lock)
+#endif // LS_FUTEX_LOCK
+
+static int lock_setup(ls_lock_t *lock, int flags)
+{
+#if LS_FUTEX_LOCK
+    lock->state = 0;
+    lock->spin = 0;
+    lock->flags = flags;
+    lock->owner = NULL;
+    lock->depth = 0;
     return 0;
 #else
     pthread_mutexattr_t attr;
     int rc;
 
     pthread_mutexattr_init(&attr);
-    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutexattr_settype(&attr, (flags & LOCK_RECURSIVE) ?
+        PTHREAD_MUTEX_RECURSIVE : PTHREAD_MUTEX_NORMAL);
 
-    rc = pthread_mutex_init(lock, &attr);
+    rc = pthread_mutex_init(LOCK_MUTEX(lock), &attr);
 
     pthread_mutexattr_destroy(&attr);
 
     return ls_set_errno(ls_errno_to_error(rc));
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
+}
+
+#if LS_LOCK_PROFILE
+int lock_init_named(ls_lock_t *lock, int flags, const char *name)
+{
+    if (lock_setup(lock, flags) == -1)
+        return -1;
+
+    prof_register(&lock->prof, name);
+    return 0;
+}
+#else
+int lock_init(ls_lock_t *lock)
+{
+    return lock_setup(lock, 0);
 }
 
+int lock_init_ex(ls_lock_t *lock, int flags)
+{
+    return lock_setup(lock, flags);
+}
+#endif // LS_LOCK_PROFILE
+
 void lock_destroy(ls_lock_t *lock)
 {
-#if LS_WINDOWS
-    DeleteCriticalSection(lock);
+#if LS_LOCK_PROFILE
+    prof_unregister(&lock->prof);
+#endif // LS_LOCK_PROFILE
+
+#if LS_FUTEX_LOCK
+    (void)lock;
 #else
-    if (pthread_mutex_destroy(lock) != 0)
+    if (pthread_mutex_destroy(LOCK_MUTEX(lock)) != 0)
         abort();
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 void lock_lock(ls_lock_t *lock)
 {
-#if LS_WINDOWS
-    EnterCriticalSection(lock);
+#if LS_FUTEX_LOCK
+    if (LS_UNLIKELY(lock->flags & LOCK_RECURSIVE))
+    {
+        if (lock->owner == &_lock_self)
+        {
+            lock->depth++;
+            return;
+        }
+
+        lock_acquire(lock);
+        lock->owner = &_lock_self;
+        lock->depth = 1;
+        return;
+    }
+
+    lock_acquire(lock);
+#elif LS_LOCK_PROFILE
+    long long start = -1;
+    int rc;
+
+    rc = pthread_mutex_trylock(&lock->mutex);
+    if (rc == EBUSY)
+    {
+        start = ls_nanotime();
+        rc = pthread_mutex_lock(&lock->mutex);
+    }
+
+    if (LS_LIKELY(rc == 0))
+    {
+        prof_acquired(&lock->prof, start);
+        return;
+    }
+
+    errno = rc;
+    perror("pthread_mutex_lock");
+    abort();
 #else
     int rc;
     
@@ -46,17 +288,49 @@ void lock_lock(ls_lock_t *lock)
     errno = rc;
     perror("pthread_mutex_lock");
     abort();
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 int lock_trylock(ls_lock_t *lock)
 {
-#if LS_WINDOWS
-    return TryEnterCriticalSection(lock) ? 0 : 1;
+#if LS_FUTEX_LOCK
+    if (LS_UNLIKELY(lock->flags & LOCK_RECURSIVE))
+    {
+        if (lock->owner == &_lock_self)
+        {
+            lock->depth++;
+            return 0;
+        }
+
+        if (!ls_atomic_cas32(&lock->state, 0, 1))
+            return 1;
+
+#if LS_LOCK_PROFILE
+        prof_acquired(&lock->prof, -1);
+#endif // LS_LOCK_PROFILE
+
+        lock->owner = &_lock_self;
+        lock->depth = 1;
+        return 0;
+    }
+
+    if (!ls_atomic_cas32(&lock->state, 0, 1))
+        return 1;
+
+#if LS_LOCK_PROFILE
+    prof_acquired(&lock->prof, -1);
+#endif // LS_LOCK_PROFILE
+
+    return 0;
 #else
-    int rc = pthread_mutex_trylock(lock);
+    int rc = pthread_mutex_trylock(LOCK_MUTEX(lock));
     if (LS_LIKELY(rc == 0))
+    {
+#if LS_LOCK_PROFILE
+        prof_acquired(&lock->prof, -1);
+#endif // LS_LOCK_PROFILE
         return 0;
+    }
     
     if (rc == EBUSY)
         return 1;
@@ -64,39 +338,51 @@ int lock_trylock(ls_lock_t *lock)
     errno = rc;
     perror("pthread_mutex_trylock");
     abort();
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 void lock_unlock(ls_lock_t *lock)
 {
-#if LS_WINDOWS
-	LeaveCriticalSection(lock);
+#if LS_FUTEX_LOCK
+    if (LS_UNLIKELY(lock->flags & LOCK_RECURSIVE))
+    {
+        if (--lock->depth > 0)
+            return;
+        lock->owner = NULL;
+    }
+
+    lock_release(lock);
 #else
     int rc;
+
+#if LS_LOCK_PROFILE
+    prof_released(&lock->prof);
+#endif // LS_LOCK_PROFILE
     
-    rc = pthread_mutex_unlock(lock);
+    rc = pthread_mutex_unlock(LOCK_MUTEX(lock));
     if (LS_LIKELY(rc == 0))
         return;
     
     errno = rc;
     perror("pthread_mutex_unlock");
     abort();
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 int cond_init(ls_cond_t *cond)
 {
-#if LS_WINDOWS
-    InitializeConditionVariable(cond);
+#if LS_FUTEX_LOCK
+    cond->seq = 0;
     return 0;
 #else
     return ls_set_errno_errno(pthread_cond_init(cond, NULL));
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 void cond_destroy(ls_cond_t *cond)
 {
-#if LS_WINDOWS
+#if LS_FUTEX_LOCK
+    (void)cond;
 #else
     int rc;
     
@@ -107,28 +393,54 @@ void cond_destroy(ls_cond_t *cond)
     errno = rc;
     perror("pthread_cond_destroy");
     abort();
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 int cond_wait(ls_cond_t *LS_RESTRICT cond, ls_lock_t *LS_RESTRICT lock, unsigned long ms)
 {
-#if LS_WINDOWS
-    if (!SleepConditionVariableCS(cond, lock, ms))
+#if LS_FUTEX_LOCK
+    unsigned long depth;
+    int32_t seq;
+    int rc;
+
+    // read under the lock, any later signal changes the value
+    seq = ls_atomic_load32(&cond->seq);
+
+    // a recursive lock is released fully and restored after waking
+    depth = lock->depth;
+    if (lock->flags & LOCK_RECURSIVE)
+        lock->owner = NULL;
+
+    lock_release(lock);
+
+    rc = ls_futex_wait(&cond->seq, seq, ms);
+
+    lock_acquire(lock);
+
+    if (lock->flags & LOCK_RECURSIVE)
     {
-        if (GetLastError() == ERROR_TIMEOUT)
-			return 1;
-		
-		abort();
-	}
+        lock->owner = &_lock_self;
+        lock->depth = depth;
+    }
 
-    return 0;
+    return rc;
 #else
     int rc;
     struct timespec ts;
+
+#if LS_LOCK_PROFILE
+    // the wait for the condition is not counted as holding the lock
+    prof_released(&lock->prof);
+#endif // LS_LOCK_PROFILE
     
     if (ms == LS_INFINITE)
     {
-        rc = pthread_cond_wait(cond, lock);
+        rc = pthread_cond_wait(cond, LOCK_MUTEX(lock));
+
+#if LS_LOCK_PROFILE
+        prof_acquired(&lock->prof, -1);
+#endif // LS_LOCK_PROFILE
+
         if (rc == 0)
             return 0;
         
@@ -141,8 +453,18 @@ int cond_wait(ls_cond_t *LS_RESTRICT cond, ls_lock_t *LS_RESTRICT lock, unsigned
     
     ts.tv_sec += ms / 1000;
     ts.tv_nsec += (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
     
-    rc = pthread_cond_timedwait(cond, lock, &ts);
+    rc = pthread_cond_timedwait(cond, LOCK_MUTEX(lock), &ts);
+
+#if LS_LOCK_PROFILE
+    prof_acquired(&lock->prof, -1);
+#endif // LS_LOCK_PROFILE
+
     if (rc == 0)
         return 0;
     
@@ -152,23 +474,102 @@ int cond_wait(ls_cond_t *LS_RESTRICT cond, ls_lock_t *LS_RESTRICT lock, unsigned
     errno = rc;
     perror("pthread_cond_timedwait");
     abort();
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 void cond_signal(ls_cond_t *cond)
 {
-#if LS_WINDOWS
-    WakeConditionVariable(cond);
+#if LS_FUTEX_LOCK
+    ls_atomic_add32(&cond->seq, 1);
+    ls_futex_wake(&cond->seq, 0);
 #else
     (void)pthread_cond_signal(cond);
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 }
 
 void cond_broadcast(ls_cond_t *cond)
 {
-#if LS_WINDOWS
-    WakeAllConditionVariable(cond);
+#if LS_FUTEX_LOCK
+    ls_atomic_add32(&cond->seq, 1);
+    ls_futex_wake(&cond->seq, 1);
 #else
     (void)pthread_cond_broadcast(cond);
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
+}
+
+size_t ls_lock_profile(struct ls_lock_stat *stats, size_t count)
+{
+#if LS_LOCK_PROFILE
+    struct ls_lock_prof *prof;
+    struct ls_lock_stat stat;
+    size_t n = 0, i;
+
+    if (!stats && count)
+        return ls_set_errno(LS_INVALID_ARGUMENT);
+
+    prof_list_lock();
+
+    for (prof = _prof_head; prof; prof = prof->next)
+    {
+        if (prof->acquires == 0)
+            continue;
+
+        stat.name = prof->name;
+        stat.lock = (char *)prof - offsetof(ls_lock_t, prof);
+        stat.acquires = prof->acquires;
+        stat.contended = prof->contended;
+        stat.wait_total = prof->wait_total;
+        stat.wait_max = prof->wait_max;
+        stat.hold_total = prof->hold_total;
+        stat.hold_max = prof->hold_max;
+
+        // keep the count locks with the most waiting, in order
+        i = n;
+        if (i == count)
+        {
+            if (count == 0 || stat.wait_total <= stats[count - 1].wait_total)
+                continue;
+            i--;
+        }
+        else
+            n++;
+
+        for (; i > 0 && stats[i - 1].wait_total < stat.wait_total; i--)
+            stats[i] = stats[i - 1];
+        stats[i] = stat;
+    }
+
+    prof_list_unlock();
+
+    return n;
+#else
+    (void)stats;
+    (void)count;
+    return ls_set_errno(LS_NOT_SUPPORTED);
+#endif // LS_LOCK_PROFILE
+}
+
+int ls_lock_profile_reset(void)
+{
+#if LS_LOCK_PROFILE
+    struct ls_lock_prof *prof;
+
+    prof_list_lock();
+
+    for (prof = _prof_head; prof; prof = prof->next)
+    {
+        prof->acquires = 0;
+        prof->contended = 0;
+        prof->wait_total = 0;
+        prof->wait_max = 0;
+        prof->hold_total = 0;
+        prof->hold_max = 0;
+    }
+
+    prof_list_unlock();
+
+    return 0;
+#else
+    return ls_set_errno(LS_NOT_SUPPORTED);
+#endif // LS_LOCK_PROFILE
 }
@@ -6,13 +6,72 @@
 
 #include "ls_native.h"
 
-#ifdef LS_WINDOWS
-#define __LOCK_T CRITICAL_SECTION
-#define __COND_T CONDITION_VARIABLE
+// Windows and Linux locks are built on ls_futex_wait, other platforms
+// use pthreads
+#if LS_WINDOWS || LS_LINUX
+#define LS_FUTEX_LOCK 1
+#else
+#define LS_FUTEX_LOCK 0
+#endif // LS_WINDOWS || LS_LINUX
+
+#define LOCK_RECURSIVE 0x1 // lock may be reacquired by its owner
+
+// set by LYSYS_FEATURE_LOCK_PROFILE
+#ifndef LS_LOCK_PROFILE
+#define LS_LOCK_PROFILE 0
+#endif // LS_LOCK_PROFILE
+
+#if LS_LOCK_PROFILE
+//! \brief Contention statistics of a lock
+//!
+//! Counters are only updated by the thread holding the lock. Live
+//! locks are linked together so they can be reported.
+struct ls_lock_prof
+{
+    const char *name; // where the lock was initialized
+    unsigned long long acquires;
+    unsigned long long contended; // acquires which had to wait
+    long long wait_total, wait_max; // nanoseconds
+    long long hold_total, hold_max; // nanoseconds
+    long long acquired_at; // ls_nanotime of the current acquire
+    unsigned long depth; // acquires not yet released
+    struct ls_lock_prof *prev, *next;
+};
+#endif // LS_LOCK_PROFILE
+
+#if LS_FUTEX_LOCK
+struct ls_lock
+{
+    volatile int32_t state; // 0 unlocked, 1 locked, 2 locked with waiters
+    int32_t spin; // estimate of spins needed to acquire
+    int flags; // LOCK_* flags
+    void *volatile owner; // owning thread, if LOCK_RECURSIVE
+    unsigned long depth; // recursion depth, if LOCK_RECURSIVE
+#if LS_LOCK_PROFILE
+    struct ls_lock_prof prof;
+#endif // LS_LOCK_PROFILE
+};
+
+struct ls_cond
+{
+    volatile int32_t seq; // incremented on each signal
+};
+
+#define __LOCK_T struct ls_lock
+#define __COND_T struct ls_cond
+#elif LS_LOCK_PROFILE
+struct ls_lock
+{
+    pthread_mutex_t mutex;
+    struct ls_lock_prof prof;
+};
+
+#define __LOCK_T struct ls_lock
+#define __COND_T pthread_cond_t
 #else
 #define __LOCK_T pthread_mutex_t
 #define __COND_T pthread_cond_t
-#endif // LS_WINDOWS
+#endif // LS_FUTEX_LOCK
 
 //! \brief Lock providing mutal exclusion
 typedef __LOCK_T ls_lock_t;
@@ -22,13 +81,44 @@ typedef __COND_T ls_cond_t;
 
 //! \brief Create a lock
 //! 
-//! always succeeds on Windows
+//! The lock is not recursive, use lock_init_ex with LOCK_RECURSIVE
+//! if the owner must be able to acquire it again. Always succeeds on
+//! Windows and Linux.
 //!
 //! \param lock A lock
 //!
 //! \return 0 on success, -1 on failure
 int lock_init(ls_lock_t *lock);
 
+//! \brief Create a lock with flags
+//!
+//! Contended locks spin for a short, adaptively chosen time before
+//! the thread sleeps.
+//!
+//! \param lock A lock
+//! \param flags LOCK_* flags
+//!
+//! \return 0 on success, -1 on failure
+int lock_init_ex(ls_lock_t *lock, int flags);
+
+#if LS_LOCK_PROFILE
+#define __LOCK_STR(x) #x
+#define __LOCK_SITE(line) __FILE__ ":" __LOCK_STR(line)
+
+//! \brief Create a lock, naming it in the lock profile
+//!
+//! \param lock A lock
+//! \param flags LOCK_* flags
+//! \param name Name reported by ls_lock_profile, must stay valid
+//!
+//! \return 0 on success, -1 on failure
+int lock_init_named(ls_lock_t *lock, int flags, const char *name);
+
+// name internal locks after the place they are created
+#define lock_init(lock) lock_init_named((lock), 0, __LOCK_SITE(__LINE__))
+#define lock_init_ex(lock, flags) lock_init_named((lock), (flags), __LOCK_SITE(__LINE__))
+#endif // LS_LOCK_PROFILE
+
 //! \brief Destroy a lock
 //!
 //! \param lock A lock
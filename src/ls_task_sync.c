@@ -0,0 +1,316 @@
+#include <lysys/ls_task_sync.h>
+
+#include <lysys/ls_core.h>
+
+#include <stdlib.h>
+
+#include "ls_native.h"
+#include "ls_handle.h"
+#include "ls_sync_util.h"
+#include "ls_waiter.h"
+
+struct ls_task_lock
+{
+	ls_lock_t lock; // protects the fields below
+	int locked;
+	struct ls_waitq waiters;
+};
+
+struct ls_task_cond
+{
+	ls_lock_t lock;
+	struct ls_waitq waiters;
+};
+
+struct ls_task_event
+{
+	ls_lock_t lock;
+	int signaled;
+	struct ls_waitq waiters;
+};
+
+static void ls_task_lock_dtor(struct ls_task_lock *l)
+{
+	lock_destroy(&l->lock);
+}
+
+static const struct ls_class TaskLockClass = {
+	.type = LS_TASK_LOCK,
+	.cb = sizeof(struct ls_task_lock),
+	.dtor = (ls_dtor_t)&ls_task_lock_dtor,
+	.wait = NULL
+};
+
+static void ls_task_cond_dtor(struct ls_task_cond *c)
+{
+	lock_destroy(&c->lock);
+}
+
+static const struct ls_class TaskCondClass = {
+	.type = LS_TASK_COND,
+	.cb = sizeof(struct ls_task_cond),
+	.dtor = (ls_dtor_t)&ls_task_cond_dtor,
+	.wait = NULL
+};
+
+static void ls_task_event_dtor(struct ls_task_event *ev)
+{
+	lock_destroy(&ev->lock);
+}
+
+static int ls_task_event_wait(struct ls_task_event *ev, unsigned long ms)
+{
+	struct ls_waiter w;
+	int rc;
+
+	lock_lock(&ev->lock);
+
+	if (ev->signaled)
+	{
+		lock_unlock(&ev->lock);
+		return 0;
+	}
+
+	if (ms == 0)
+	{
+		lock_unlock(&ev->lock);
+		return 1;
+	}
+
+	if (ls_waiter_init(&w) == -1)
+	{
+		lock_unlock(&ev->lock);
+		return -1;
+	}
+
+	ls_waitq_push(&ev->waiters, &w);
+
+	rc = ls_waiter_wait(&w, &ev->lock, ms);
+	if (rc == 1)
+		ls_waitq_remove(&ev->waiters, &w);
+
+	lock_unlock(&ev->lock);
+
+	ls_waiter_destroy(&w);
+
+	return rc;
+}
+
+static const struct ls_class TaskEventClass = {
+	.type = LS_TASK_EVENT,
+	.cb = sizeof(struct ls_task_event),
+	.dtor = (ls_dtor_t)&ls_task_event_dtor,
+	.wait = (ls_wait_t)&ls_task_event_wait
+};
+
+ls_handle ls_task_lock_create(void)
+{
+	struct ls_task_lock *l;
+
+	l = ls_handle_create(&TaskLockClass, 0);
+	if (!l)
+		return NULL;
+
+	if (lock_init(&l->lock) == -1)
+	{
+		ls_handle_dealloc(l);
+		return NULL;
+	}
+
+	return l;
+}
+
+void ls_task_lock(ls_handle lock)
+{
+	struct ls_task_lock *l = lock;
+	struct ls_waiter w;
+
+	lock_lock(&l->lock);
+
+	if (!l->locked)
+	{
+		l->locked = 1;
+		lock_unlock(&l->lock);
+		return;
+	}
+
+	if (ls_waiter_init(&w) == -1)
+		abort();
+
+	ls_waitq_push(&l->waiters, &w);
+
+	// ownership is transferred by ls_task_unlock
+	(void)ls_waiter_wait(&w, &l->lock, LS_INFINITE);
+
+	lock_unlock(&l->lock);
+
+	ls_waiter_destroy(&w);
+}
+
+int ls_task_trylock(ls_handle lock)
+{
+	struct ls_task_lock *l = lock;
+	int rc;
+
+	lock_lock(&l->lock);
+
+	rc = l->locked;
+	l->locked = 1;
+
+	lock_unlock(&l->lock);
+
+	return rc;
+}
+
+void ls_task_unlock(ls_handle lock)
+{
+	struct ls_task_lock *l = lock;
+	struct ls_waiter *w;
+
+	lock_lock(&l->lock);
+
+	w = ls_waitq_pop(&l->waiters);
+	if (w)
+		ls_waiter_wake(w); // lock remains held, now by w
+	else
+		l->locked = 0;
+
+	lock_unlock(&l->lock);
+}
+
+ls_handle ls_task_cond_create(void)
+{
+	struct ls_task_cond *c;
+
+	c = ls_handle_create(&TaskCondClass, 0);
+	if (!c)
+		return NULL;
+
+	if (lock_init(&c->lock) == -1)
+	{
+		ls_handle_dealloc(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+void ls_task_cond_wait(ls_handle cond, ls_handle lock)
+{
+	(void)ls_task_cond_timedwait(cond, lock, LS_INFINITE);
+}
+
+int ls_task_cond_timedwait(ls_handle cond, ls_handle lock, unsigned long ms)
+{
+	struct ls_task_cond *c = cond;
+	struct ls_waiter w;
+	int rc;
+
+	if (ls_waiter_init(&w) == -1)
+		abort();
+
+	lock_lock(&c->lock);
+
+	// queued before lock is released, so no signal is missed
+	ls_waitq_push(&c->waiters, &w);
+
+	ls_task_unlock(lock);
+
+	rc = ls_waiter_wait(&w, &c->lock, ms);
+	if (rc == 1)
+		ls_waitq_remove(&c->waiters, &w);
+
+	lock_unlock(&c->lock);
+
+	ls_waiter_destroy(&w);
+
+	ls_task_lock(lock);
+
+	return rc;
+}
+
+void ls_task_cond_signal(ls_handle cond)
+{
+	struct ls_task_cond *c = cond;
+	struct ls_waiter *w;
+
+	lock_lock(&c->lock);
+
+	w = ls_waitq_pop(&c->waiters);
+	if (w)
+		ls_waiter_wake(w);
+
+	lock_unlock(&c->lock);
+}
+
+void ls_task_cond_broadcast(ls_handle cond)
+{
+	struct ls_task_cond *c = cond;
+
+	lock_lock(&c->lock);
+	ls_waitq_wake_all(&c->waiters);
+	lock_unlock(&c->lock);
+}
+
+ls_handle ls_task_event_create(void)
+{
+	struct ls_task_event *ev;
+
+	ev = ls_handle_create(&TaskEventClass, 0);
+	if (!ev)
+		return NULL;
+
+	if (lock_init(&ev->lock) == -1)
+	{
+		ls_handle_dealloc(ev);
+		return NULL;
+	}
+
+	return ev;
+}
+
+int ls_task_event_signaled(ls_handle evt)
+{
+	struct ls_task_event *ev = evt;
+	int rc;
+
+	if (ls_type_check(evt, LS_TASK_EVENT))
+		return -1;
+
+	lock_lock(&ev->lock);
+	rc = ev->signaled;
+	lock_unlock(&ev->lock);
+
+	return rc;
+}
+
+int ls_task_event_set(ls_handle evt)
+{
+	struct ls_task_event *ev = evt;
+
+	if (ls_type_check(evt, LS_TASK_EVENT))
+		return -1;
+
+	lock_lock(&ev->lock);
+
+	ev->signaled = 1;
+	ls_waitq_wake_all(&ev->waiters);
+
+	lock_unlock(&ev->lock);
+
+	return 0;
+}
+
+int ls_task_event_reset(ls_handle evt)
+{
+	struct ls_task_event *ev = evt;
+
+	if (ls_type_check(evt, LS_TASK_EVENT))
+		return -1;
+
+	lock_lock(&ev->lock);
+	ev->signaled = 0;
+	lock_unlock(&ev->lock);
+
+	return 0;
+}
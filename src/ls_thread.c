@@ -1,3 +1,7 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_tryjoin_np, pthread_timedjoin_np
+#endif
+
 #include "ls_native.h"
 
 #include <signal.h>
@@ -21,6 +25,7 @@ struct ls_thread
 	void *up;
 
 	unsigned long id;
+	int joined; // must not be detached anymore
 };
 
 struct ls_thread_self
@@ -34,7 +39,8 @@ static void ls_thread_dtor(struct ls_thread *th)
 #if LS_WINDOWS
 	CloseHandle(th->hThread);
 #else
-	pthread_detach(th->thread);
+	if (!th->joined)
+		pthread_detach(th->thread);
 #endif // LS_WINDOWS
 }
 
@@ -60,6 +66,9 @@ static int ls_thread_wait(struct ls_thread *th, unsigned long ms)
 #else
 	int rc;
     uint64_t id;
+#if LS_LINUX
+	struct timespec ts;
+#endif // LS_LINUX
     
 #if LS_DARWIN
     pthread_threadid_np(NULL, &id);
@@ -70,7 +79,34 @@ static int ls_thread_wait(struct ls_thread *th, unsigned long ms)
 	if (th->id == id)
 		return ls_set_errno(LS_NOT_WAITABLE); // Myself
 
+	if (th->joined)
+		return 0;
+
+#if LS_LINUX
+	if (ms == 0)
+		rc = pthread_tryjoin_np(th->thread, NULL);
+	else if (ms != LS_INFINITE)
+	{
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += ms / 1000;
+		ts.tv_nsec += (ms % 1000) * 1000000;
+		if (ts.tv_nsec >= 1000000000)
+		{
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+
+		rc = pthread_timedjoin_np(th->thread, NULL, &ts);
+	}
+	else
+		rc = pthread_join(th->thread, NULL);
+
+	if (rc == EBUSY || rc == ETIMEDOUT)
+		return 1;
+#else
 	rc = pthread_join(th->thread, NULL);
+#endif // LS_LINUX
+
 	if (rc != 0)
 	{
 		if (rc == ESRCH)
@@ -79,6 +115,7 @@ static int ls_thread_wait(struct ls_thread *th, unsigned long ms)
 		return ls_set_errno(LS_INVALID_STATE);
 	}
 
+	th->joined = 1;
 	return 0;
 #endif // LS_WINDOWS
 }
@@ -97,11 +134,21 @@ static ENTRY_PROC ls_thread_startup(struct ls_thread *th)
 	return EXIT_OK;
 }
 
+static intptr_t ls_thread_pollfd(struct ls_thread *th)
+{
+#if LS_WINDOWS
+	return (intptr_t)th->hThread;
+#else
+	return -1;
+#endif // LS_WINDOWS
+}
+
 static const struct ls_class ThreadClass = {
 	.type = LS_THREAD,
 	.cb = sizeof(struct ls_thread),
 	.dtor = (ls_dtor_t)&ls_thread_dtor,
 	.wait = (ls_wait_t)&ls_thread_wait,
+	.pollfd = (ls_pollfd_t)&ls_thread_pollfd
 };
 
 ls_handle ls_thread_create(ls_thread_func_t func, void *up)
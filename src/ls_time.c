@@ -7,6 +7,7 @@
 #include <lysys/ls_defs.h>
 
 #include "ls_native.h"
+#include "ls_sched_priv.h"
 
 #define NS_PER_SEC 1000000000LL
 #define NS_PER_MS 1000000LL
@@ -129,6 +130,12 @@ static void ls_sleep_ts(struct timespec *ts)
 
 void ls_sleep(unsigned long ms)
 {
+	if (ls_task_io_active())
+	{
+		(void)ls_task_sleep(ms);
+		return;
+	}
+
 #if LS_WINDOWS
 	Sleep(ms);
 #else
@@ -143,6 +150,12 @@ void ls_sleep(unsigned long ms)
 
 void ls_nanosleep(long long ns)
 {
+	if (ls_task_io_active())
+	{
+		(void)ls_task_sleep((unsigned long)((ns + NS_PER_MS - 1) / NS_PER_MS));
+		return;
+	}
+
 #if LS_WINDOWS
 	LARGE_INTEGER li_start, li_now;
 	__int64 i64_end, i64_sleep_time;
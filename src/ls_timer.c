@@ -0,0 +1,304 @@
+#include <lysys/ls_timer.h>
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+
+#include <string.h>
+
+#include "ls_native.h"
+#include "ls_handle.h"
+#include "ls_sync_util.h"
+#include "ls_sched_priv.h"
+
+#if LS_LINUX
+#include <poll.h>
+#include <sys/timerfd.h>
+#endif // LS_LINUX
+
+struct ls_timer
+{
+#if LS_WINDOWS
+	HANDLE hTimer;
+#elif LS_LINUX
+	int fd;
+#else
+	ls_lock_t lock;
+	ls_cond_t cond; // broadcast when the timer is set or cancelled
+	long long deadline; // ls_nanotime of the next expiry, 0 if disarmed
+	long long period; // nanoseconds, 0 if not periodic
+#endif // LS_WINDOWS
+};
+
+static void ls_timer_dtor(struct ls_timer *timer)
+{
+#if LS_WINDOWS
+	CloseHandle(timer->hTimer);
+#elif LS_LINUX
+	(void)close(timer->fd);
+#else
+	cond_destroy(&timer->cond);
+	lock_destroy(&timer->lock);
+#endif // LS_WINDOWS
+}
+
+#if LS_LINUX
+
+//! \brief Reset the timer if it expired.
+//!
+//! \return 0 if the timer expired, 1 if not, -1 on failure.
+static int ls_timer_consume(struct ls_timer *timer)
+{
+	uint64_t expirations;
+
+	if (read(timer->fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+		return 0;
+
+	if (errno == EAGAIN)
+		return 1;
+
+	return ls_set_errno_errno(errno);
+}
+
+#endif // LS_LINUX
+
+static int ls_timer_wait(struct ls_timer *timer, unsigned long ms)
+{
+#if LS_WINDOWS
+	DWORD dwResult;
+
+	dwResult = WaitForSingleObject(timer->hTimer, ms);
+	if (dwResult == WAIT_OBJECT_0)
+		return 0;
+
+	if (dwResult == WAIT_TIMEOUT)
+		return 1;
+
+	return ls_set_errno_win32(GetLastError());
+#elif LS_LINUX
+	struct pollfd pfd;
+	long long deadline, remain;
+	unsigned long wait;
+	int rc;
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	for (;;)
+	{
+		// another waiter may take the expiry between poll and read
+		rc = ls_timer_consume(timer);
+		if (rc != 1)
+			return rc;
+
+		if (ms == LS_INFINITE)
+			wait = LS_INFINITE;
+		else
+		{
+			remain = deadline - ls_nanotime();
+			if (remain <= 0)
+				return 1;
+			wait = (unsigned long)((remain + 999999) / 1000000);
+		}
+
+		if (ls_task_io_active() && ls_task_wait_fd(timer->fd, LS_POLL_IN, wait) != -1)
+			continue;
+
+		pfd.fd = timer->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		rc = poll(&pfd, 1, wait == LS_INFINITE ? -1 : wait > INT_MAX ? INT_MAX : (int)wait);
+		if (rc == -1 && errno != EINTR)
+			return ls_set_errno_errno(errno);
+	}
+#else
+	long long now, deadline, expiry;
+	unsigned long wait;
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	lock_lock(&timer->lock);
+
+	for (;;)
+	{
+		now = ls_nanotime();
+
+		expiry = timer->deadline;
+		if (expiry && now >= expiry)
+		{
+			if (timer->period)
+			{
+				// merge expiries which were missed
+				expiry += ((now - expiry) / timer->period + 1) * timer->period;
+				timer->deadline = expiry;
+			}
+			else
+				timer->deadline = 0;
+
+			lock_unlock(&timer->lock);
+			return 0;
+		}
+
+		if (ms != LS_INFINITE && now >= deadline)
+		{
+			lock_unlock(&timer->lock);
+			return 1;
+		}
+
+		if (expiry && (ms == LS_INFINITE || expiry < deadline))
+			wait = (unsigned long)((expiry - now + 999999) / 1000000);
+		else if (ms == LS_INFINITE)
+			wait = LS_INFINITE;
+		else
+			wait = (unsigned long)((deadline - now + 999999) / 1000000);
+
+		(void)cond_wait(&timer->cond, &timer->lock, wait);
+	}
+#endif // LS_WINDOWS
+}
+
+static intptr_t ls_timer_pollfd(struct ls_timer *timer)
+{
+#if LS_WINDOWS
+	return (intptr_t)timer->hTimer;
+#elif LS_LINUX
+	return timer->fd;
+#else
+	return -1;
+#endif // LS_WINDOWS
+}
+
+static const struct ls_class TimerClass = {
+	.type = LS_TIMER,
+	.cb = sizeof(struct ls_timer),
+	.dtor = (ls_dtor_t)&ls_timer_dtor,
+	.wait = (ls_wait_t)&ls_timer_wait,
+	.pollfd = (ls_pollfd_t)&ls_timer_pollfd
+};
+
+ls_handle ls_timer_create(void)
+{
+	struct ls_timer *timer;
+
+	timer = ls_handle_create(&TimerClass, 0);
+	if (!timer)
+		return NULL;
+
+#if LS_WINDOWS
+	// synchronization timer, a completed wait resets it
+	timer->hTimer = CreateWaitableTimerW(NULL, FALSE, NULL);
+	if (!timer->hTimer)
+	{
+		ls_set_errno_win32(GetLastError());
+		ls_handle_dealloc(timer);
+		return NULL;
+	}
+#elif LS_LINUX
+	timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer->fd == -1)
+	{
+		ls_set_errno_errno(errno);
+		ls_handle_dealloc(timer);
+		return NULL;
+	}
+#else
+	if (lock_init(&timer->lock) == -1)
+	{
+		ls_handle_dealloc(timer);
+		return NULL;
+	}
+
+	if (cond_init(&timer->cond) == -1)
+	{
+		lock_destroy(&timer->lock);
+		ls_handle_dealloc(timer);
+		return NULL;
+	}
+#endif // LS_WINDOWS
+
+	return timer;
+}
+
+int ls_timer_set(ls_handle timer, unsigned long ms, unsigned long period)
+{
+	struct ls_timer *t = timer;
+#if LS_WINDOWS
+	LARGE_INTEGER liDueTime;
+#elif LS_LINUX
+	struct itimerspec its;
+#endif // LS_WINDOWS
+
+	if (ls_type_check(timer, LS_TIMER))
+		return -1;
+
+#if LS_WINDOWS
+	// negative for a relative time, in 100 nanosecond intervals
+	liDueTime.QuadPart = -(LONGLONG)ms * 10000;
+
+	if (!SetWaitableTimer(t->hTimer, &liDueTime, (LONG)period, NULL, NULL, FALSE))
+		return ls_set_errno_win32(GetLastError());
+
+	return 0;
+#elif LS_LINUX
+	its.it_value.tv_sec = ms / 1000;
+	its.it_value.tv_nsec = (ms % 1000) * 1000000;
+	its.it_interval.tv_sec = period / 1000;
+	its.it_interval.tv_nsec = (period % 1000) * 1000000;
+
+	// a zero value would disarm the timer
+	if (ms == 0)
+		its.it_value.tv_nsec = 1;
+
+	// also discards an expiry of the previous setting
+	if (timerfd_settime(t->fd, 0, &its, NULL) == -1)
+		return ls_set_errno_errno(errno);
+
+	return 0;
+#else
+	lock_lock(&t->lock);
+
+	t->deadline = ls_nanotime() + (long long)ms * 1000000;
+	t->period = (long long)period * 1000000;
+
+	cond_broadcast(&t->cond);
+	lock_unlock(&t->lock);
+
+	return 0;
+#endif // LS_WINDOWS
+}
+
+int ls_timer_cancel(ls_handle timer)
+{
+	struct ls_timer *t = timer;
+#if LS_LINUX
+	struct itimerspec its;
+#endif // LS_LINUX
+
+	if (ls_type_check(timer, LS_TIMER))
+		return -1;
+
+#if LS_WINDOWS
+	if (!CancelWaitableTimer(t->hTimer))
+		return ls_set_errno_win32(GetLastError());
+
+	// an expired timer stays signaled when cancelled
+	(void)WaitForSingleObject(t->hTimer, 0);
+
+	return 0;
+#elif LS_LINUX
+	memset(&its, 0, sizeof(its));
+
+	if (timerfd_settime(t->fd, 0, &its, NULL) == -1)
+		return ls_set_errno_errno(errno);
+
+	return 0;
+#else
+	lock_lock(&t->lock);
+
+	t->deadline = 0;
+
+	cond_broadcast(&t->cond);
+	lock_unlock(&t->lock);
+
+	return 0;
+#endif // LS_WINDOWS
+}
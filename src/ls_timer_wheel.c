@@ -0,0 +1,262 @@
+#include "ls_timer_wheel.h"
+
+#if LS_WINDOWS
+#include <intrin.h>
+#endif // LS_WINDOWS
+
+#define SLOT_MASK (LS_WHEEL_SLOTS - 1)
+
+// number of ticks a level can hold
+#define LEVEL_SPAN(l) ((uint64_t)1 << (LS_WHEEL_BITS * ((l) + 1)))
+
+#define LEVEL_INDEX(t, l) ((size_t)((t) >> (LS_WHEEL_BITS * (l))) & SLOT_MASK)
+
+static int ls_ctz64(uint64_t x)
+{
+#if LS_WINDOWS
+	unsigned long index;
+	_BitScanForward64(&index, x);
+	return (int)index;
+#else
+	return __builtin_ctzll(x);
+#endif // LS_WINDOWS
+}
+
+static uint64_t ls_rotr64(uint64_t x, size_t n)
+{
+	return n ? (x >> n) | (x << (64 - n)) : x;
+}
+
+static int ls_list_empty(const struct ls_wheel_entry *head)
+{
+	return head->next == head;
+}
+
+static void ls_list_init(struct ls_wheel_entry *head)
+{
+	head->next = head->prev = head;
+}
+
+static void ls_list_push(struct ls_wheel_entry *head, struct ls_wheel_entry *e)
+{
+	e->prev = head->prev;
+	e->next = head;
+	head->prev->next = e;
+	head->prev = e;
+}
+
+static void ls_list_unlink(struct ls_wheel_entry *e)
+{
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+	e->next = e->prev = NULL;
+}
+
+//! \brief Move all entries of src to the empty list dst.
+static void ls_list_splice(struct ls_wheel_entry *src, struct ls_wheel_entry *dst)
+{
+	if (ls_list_empty(src))
+	{
+		ls_list_init(dst);
+		return;
+	}
+
+	dst->next = src->next;
+	dst->prev = src->prev;
+	dst->next->prev = dst;
+	dst->prev->next = dst;
+
+	ls_list_init(src);
+}
+
+//! \brief Link an entry into the slot matching its expiry.
+static void ls_wheel_place(struct ls_timer_wheel *w, struct ls_wheel_entry *e)
+{
+	uint64_t expires, delta;
+	size_t level, index;
+
+	expires = e->expires;
+	if (expires < w->now)
+		expires = w->now;
+
+	delta = expires - w->now;
+	for (level = 0; level < LS_WHEEL_LEVELS - 1; level++)
+	{
+		if (delta < LEVEL_SPAN(level))
+			break;
+	}
+
+	// too far out, moved down once the top level wraps around
+	if (delta >= LEVEL_SPAN(level))
+		expires = w->now + LEVEL_SPAN(level) - 1;
+
+	index = LEVEL_INDEX(expires, level);
+
+	ls_list_push(&w->slots[level][index], e);
+	w->occupied[level] |= (uint64_t)1 << index;
+}
+
+//! \brief Move the entries of a slot to lower levels.
+static void ls_wheel_cascade(struct ls_timer_wheel *w, size_t level, size_t index)
+{
+	struct ls_wheel_entry list, *e;
+
+	ls_list_splice(&w->slots[level][index], &list);
+	w->occupied[level] &= ~((uint64_t)1 << index);
+
+	while (!ls_list_empty(&list))
+	{
+		e = list.next;
+		ls_list_unlink(e);
+		ls_wheel_place(w, e);
+	}
+}
+
+void ls_wheel_init(struct ls_timer_wheel *w, uint64_t now)
+{
+	size_t level, index;
+
+	w->now = now;
+	w->count = 0;
+
+	for (level = 0; level < LS_WHEEL_LEVELS; level++)
+	{
+		w->occupied[level] = 0;
+		for (index = 0; index < LS_WHEEL_SLOTS; index++)
+			ls_list_init(&w->slots[level][index]);
+	}
+}
+
+void ls_wheel_add(struct ls_timer_wheel *w, struct ls_wheel_entry *e, uint64_t expires)
+{
+	if (ls_wheel_pending(e))
+		ls_list_unlink(e);
+	else
+		w->count++;
+
+	e->expires = expires;
+	ls_wheel_place(w, e);
+}
+
+void ls_wheel_cancel(struct ls_timer_wheel *w, struct ls_wheel_entry *e)
+{
+	if (!ls_wheel_pending(e))
+		return;
+
+	// the occupied bit is cleared once the slot is next visited
+	ls_list_unlink(e);
+	w->count--;
+}
+
+size_t ls_wheel_advance(struct ls_timer_wheel *w, uint64_t now, ls_wheel_func_t func, void *up)
+{
+	struct ls_wheel_entry list, *e;
+	uint64_t t, bits, boundary, next;
+	size_t index, level, expired = 0;
+
+	while (w->now <= now)
+	{
+		t = w->now;
+		index = LEVEL_INDEX(t, 0);
+
+		if (index == 0)
+		{
+			// the level below wrapped around, move the next slot of
+			// each level down, lowest level first
+			for (level = 1; level < LS_WHEEL_LEVELS; level++)
+			{
+				ls_wheel_cascade(w, level, LEVEL_INDEX(t, level));
+				if (LEVEL_INDEX(t, level) != 0)
+					break;
+			}
+		}
+
+		if (w->count == 0)
+		{
+			w->now = now + 1;
+			break;
+		}
+
+		bits = w->occupied[0] >> index;
+		if (bits == 0)
+		{
+			// nothing on the bottom level before it wraps around, if
+			// it is empty skip straight to the next slot to move down
+			boundary = (t | SLOT_MASK) + 1;
+			if (!w->occupied[0])
+			{
+				next = ls_wheel_next(w);
+				if (next > boundary)
+					boundary = next;
+			}
+			w->now = boundary <= now ? boundary : now + 1;
+			continue;
+		}
+
+		t += ls_ctz64(bits);
+		if (t > now)
+		{
+			w->now = now + 1;
+			break;
+		}
+
+		index = LEVEL_INDEX(t, 0);
+
+		// entries added by the callbacks expire at a later tick
+		w->now = t + 1;
+
+		ls_list_splice(&w->slots[0][index], &list);
+		w->occupied[0] &= ~((uint64_t)1 << index);
+
+		while (!ls_list_empty(&list))
+		{
+			e = list.next;
+			ls_list_unlink(e);
+			w->count--;
+			expired++;
+
+			func(e, up);
+		}
+	}
+
+	return expired;
+}
+
+uint64_t ls_wheel_next(const struct ls_timer_wheel *w)
+{
+	uint64_t next, t, chunk;
+	size_t level, index;
+
+	if (w->count == 0)
+		return LS_WHEEL_NEVER;
+
+	t = w->now;
+	next = LS_WHEEL_NEVER;
+
+	if (w->occupied[0])
+		next = t + ls_ctz64(ls_rotr64(w->occupied[0], LEVEL_INDEX(t, 0)));
+
+	for (level = 1; level < LS_WHEEL_LEVELS; level++)
+	{
+		if (!w->occupied[level])
+			continue;
+
+		// the current slot was already moved down, unless its chunk
+		// starts at the next tick to process
+		index = LEVEL_INDEX(t, level);
+		chunk = t >> (LS_WHEEL_BITS * level);
+		if (t & (LEVEL_SPAN(level - 1) - 1))
+		{
+			index = (index + 1) & SLOT_MASK;
+			chunk++;
+		}
+
+		chunk += ls_ctz64(ls_rotr64(w->occupied[level], index));
+		chunk <<= LS_WHEEL_BITS * level;
+
+		if (chunk < next)
+			next = chunk;
+	}
+
+	return next;
+}
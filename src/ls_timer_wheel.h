@@ -0,0 +1,110 @@
+#ifndef _LS_TIMER_WHEEL_H_
+#define _LS_TIMER_WHEEL_H_
+
+#include "ls_native.h"
+
+#include <stdint.h>
+
+#define LS_WHEEL_BITS 6
+#define LS_WHEEL_SLOTS (1 << LS_WHEEL_BITS)
+#define LS_WHEEL_LEVELS 5 // spans 2^30 ticks, later expiries are clamped
+
+#define LS_WHEEL_NEVER UINT64_MAX
+
+//! \brief Timer linked into a timer wheel.
+//!
+//! Entries are embedded in the structure they time and are owned by
+//! the caller. An entry must be initialized with ls_wheel_entry_init()
+//! before its first use.
+struct ls_wheel_entry
+{
+	struct ls_wheel_entry *next, *prev; // NULL if not pending
+	uint64_t expires; // tick at which the entry expires
+};
+
+//! \brief Hierarchical timing wheel.
+//!
+//! Each level has LS_WHEEL_SLOTS slots, a slot of level n spanning
+//! LS_WHEEL_SLOTS^n ticks. Entries are placed on the lowest level
+//! which can hold their expiry and moved down a level each time the
+//! level below wraps around, so adding and cancelling an entry is
+//! O(1) regardless of the number of pending entries.
+//!
+//! The unit of a tick is up to the caller. A wheel is not thread
+//! safe.
+struct ls_timer_wheel
+{
+	uint64_t now; // next tick to process
+	size_t count; // pending entries
+
+	// bit n is set if slot n of the level may be non-empty
+	uint64_t occupied[LS_WHEEL_LEVELS];
+	struct ls_wheel_entry slots[LS_WHEEL_LEVELS][LS_WHEEL_SLOTS];
+};
+
+//! \brief Expiry callback.
+//!
+//! The entry is no longer pending when the callback is called, and
+//! may be added again, to the same wheel or another. The callback may
+//! add and cancel other entries of the wheel.
+typedef void(*ls_wheel_func_t)(struct ls_wheel_entry *e, void *up);
+
+//! \brief Initialize a timer wheel.
+//!
+//! \param w The wheel.
+//! \param now The current tick.
+void ls_wheel_init(struct ls_timer_wheel *w, uint64_t now);
+
+static inline void ls_wheel_entry_init(struct ls_wheel_entry *e)
+{
+	e->next = e->prev = NULL;
+}
+
+static inline int ls_wheel_pending(const struct ls_wheel_entry *e)
+{
+	return e->next != NULL;
+}
+
+//! \brief Add an entry to a timer wheel.
+//!
+//! If the entry is already pending, it is rescheduled. An entry which
+//! expires at a tick which was already processed expires at the next
+//! call to ls_wheel_advance().
+//!
+//! \param w The wheel.
+//! \param e The entry.
+//! \param expires The tick at which the entry expires.
+void ls_wheel_add(struct ls_timer_wheel *w, struct ls_wheel_entry *e, uint64_t expires);
+
+//! \brief Cancel an entry.
+//!
+//! Does nothing if the entry is not pending.
+//!
+//! \param w The wheel the entry was added to.
+//! \param e The entry.
+void ls_wheel_cancel(struct ls_timer_wheel *w, struct ls_wheel_entry *e);
+
+//! \brief Process all ticks up to and including now.
+//!
+//! Calls func for every entry which expires at a processed tick.
+//! Empty stretches of the wheel are skipped.
+//!
+//! \param w The wheel.
+//! \param now The current tick.
+//! \param func Callback to call for each expired entry.
+//! \param up User data to pass to the callback.
+//!
+//! \return The number of expired entries.
+size_t ls_wheel_advance(struct ls_timer_wheel *w, uint64_t now, ls_wheel_func_t func, void *up);
+
+//! \brief Get the tick at which the wheel next needs to be advanced.
+//!
+//! The result may be earlier than the next expiry, because entries on
+//! higher levels must first be moved down, but never later.
+//!
+//! \param w The wheel.
+//!
+//! \return The tick, or LS_WHEEL_NEVER if no entry is pending.
+uint64_t ls_wheel_next(const struct ls_timer_wheel *w);
+
+#endif // _LS_TIMER_WHEEL_H_
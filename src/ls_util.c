@@ -159,6 +159,43 @@ entry_t *ls_map_insert(map_t *map, any_t key, any_t value)
 	return entry;
 }
 
+int ls_map_remove(map_t *map, any_t key)
+{
+	entry_t **link, *entry;
+	int equal;
+
+	if (!map)
+	{
+		ls_set_errno(LS_INVALID_ARGUMENT);
+		return -1;
+	}
+
+	for (link = &map->entries; (entry = *link); link = &entry->next)
+	{
+		if (map->cmp)
+			equal = !map->cmp(key, entry->key);
+		else
+			equal = key.ptr == entry->key.ptr;
+
+		if (!equal)
+			continue;
+
+		*link = entry->next;
+		map->size--;
+
+		if (map->key_free)
+			map->key_free(entry->key);
+		if (map->value_free)
+			map->value_free(entry->value);
+
+		ls_free(entry);
+		return 0;
+	}
+
+	ls_set_errno(LS_NOT_FOUND);
+	return -1;
+}
+
 size_t ls_scbprintf(char *str, size_t cb, const char *format, ...)
 {
 	int len;
@@ -110,6 +110,17 @@ entry_t *ls_map_find(map_t *map, any_t key);
 //! \return A pointer to the new or existing entry, or NULL on failure.
 entry_t *ls_map_insert(map_t *map, any_t key, any_t value);
 
+//! \brief Remove an entry from the map
+//!
+//! The key and value of the entry are freed.
+//!
+//! \param map Map
+//! \param key Key
+//!
+//! \return 0 on success, -1 if the key was not found, and ls_errno
+//! is set
+int ls_map_remove(map_t *map, any_t key);
+
 //! \brief Print formatted output to a buffer
 //!
 //! \param str Destination buffer
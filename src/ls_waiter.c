@@ -0,0 +1,135 @@
+#include "ls_waiter.h"
+
+#include <lysys/ls_core.h>
+#include <lysys/ls_time.h>
+
+#include "ls_sched_priv.h"
+
+int ls_waiter_init(struct ls_waiter *w)
+{
+	w->next = NULL;
+	w->prev = NULL;
+	w->signaled = 0;
+
+	w->task = ls_task_current();
+	if (w->task)
+		return 0;
+
+	return cond_init(&w->cond);
+}
+
+void ls_waiter_destroy(struct ls_waiter *w)
+{
+	if (!w->task)
+		cond_destroy(&w->cond);
+}
+
+int ls_waiter_wait(struct ls_waiter *w, ls_lock_t *lock, unsigned long ms)
+{
+	long long deadline, remain;
+	int rc = 0;
+
+	deadline = ls_nanotime() + (long long)ms * 1000000;
+
+	if (w->task)
+		ls_task_set_waiting(w->task, 1);
+
+	while (!w->signaled)
+	{
+		if (ms == LS_INFINITE)
+		{
+			if (w->task)
+			{
+				ls_task_park(lock);
+				lock_lock(lock);
+			}
+			else
+				(void)cond_wait(&w->cond, lock, LS_INFINITE);
+			continue;
+		}
+
+		remain = deadline - ls_nanotime();
+		if (remain <= 0)
+		{
+			rc = 1;
+			break;
+		}
+
+		if (w->task)
+		{
+			ls_task_timed_park(lock, (unsigned long)((remain + 999999) / 1000000));
+			lock_lock(lock);
+		}
+		else
+			(void)cond_wait(&w->cond, lock, (unsigned long)((remain + 999999) / 1000000));
+	}
+
+	if (w->task)
+		ls_task_set_waiting(w->task, 0);
+
+	return rc;
+}
+
+void ls_waiter_wake(struct ls_waiter *w)
+{
+	w->signaled = 1;
+
+	// the waiter cannot return before the lock is released, so w
+	// remains valid here
+	if (w->task)
+		ls_task_wake_next(w->task);
+	else
+		cond_signal(&w->cond);
+}
+
+void ls_waitq_push(struct ls_waitq *q, struct ls_waiter *w)
+{
+	w->next = NULL;
+	w->prev = q->tail;
+
+	if (q->tail)
+		q->tail->next = w;
+	else
+		q->head = w;
+	q->tail = w;
+}
+
+struct ls_waiter *ls_waitq_pop(struct ls_waitq *q)
+{
+	struct ls_waiter *w;
+
+	w = q->head;
+	if (w)
+		ls_waitq_remove(q, w);
+	return w;
+}
+
+void ls_waitq_remove(struct ls_waitq *q, struct ls_waiter *w)
+{
+	if (w->prev)
+		w->prev->next = w->next;
+	else
+		q->head = w->next;
+
+	if (w->next)
+		w->next->prev = w->prev;
+	else
+		q->tail = w->prev;
+
+	w->next = NULL;
+	w->prev = NULL;
+}
+
+void ls_waitq_wake_all(struct ls_waitq *q)
+{
+	struct ls_waiter *w;
+
+	while ((w = ls_waitq_pop(q)))
+	{
+		w->signaled = 1;
+		if (w->task)
+			ls_task_wake(w->task);
+		else
+			cond_signal(&w->cond);
+	}
+}
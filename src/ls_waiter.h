@@ -0,0 +1,77 @@
+#ifndef _LS_WAITER_H_
+#define _LS_WAITER_H_
+
+#include "ls_native.h"
+#include "ls_sync_util.h"
+
+struct ls_task;
+
+//! \brief A thread or task blocked on a synchronization object.
+//!
+//! Waiters live on the stack of the waiting thread or task and are
+//! linked into the queue of the object they are waiting on. The queue
+//! and the waiter are protected by a lock belonging to the object.
+struct ls_waiter
+{
+	struct ls_waiter *next, *prev;
+
+	struct ls_task *task; // NULL if a thread is waiting
+	ls_cond_t cond; // only used if task is NULL
+
+	int signaled;
+};
+
+//! \brief FIFO queue of waiters.
+struct ls_waitq
+{
+	struct ls_waiter *head, *tail;
+};
+
+//! \brief Initialize a waiter for the calling thread or task.
+//!
+//! \param w The waiter.
+//!
+//! \return 0 on success, -1 on failure.
+int ls_waiter_init(struct ls_waiter *w);
+
+//! \brief Release the resources of a waiter.
+//!
+//! \param w The waiter.
+void ls_waiter_destroy(struct ls_waiter *w);
+
+//! \brief Block until the waiter is signaled.
+//!
+//! Releases lock while blocked. A task only suspends itself, leaving
+//! its worker free to run other tasks.
+//!
+//! \param w The waiter, initialized by the caller.
+//! \param lock The lock protecting w, must be held by the caller. It
+//! is held again upon return.
+//! \param ms Maximum time to wait in milliseconds.
+//!
+//! \return 0 if the waiter was signaled, 1 if the timeout expired.
+//! On timeout the waiter is still queued and the caller must remove
+//! it.
+int ls_waiter_wait(struct ls_waiter *w, ls_lock_t *lock, unsigned long ms);
+
+//! \brief Signal a waiter.
+//!
+//! The lock protecting w must be held. The waiter must already be
+//! removed from its queue and must not be accessed after this call. A
+//! task is scheduled to run next on the calling worker.
+//!
+//! \param w The waiter.
+void ls_waiter_wake(struct ls_waiter *w);
+
+void ls_waitq_push(struct ls_waitq *q, struct ls_waiter *w);
+
+struct ls_waiter *ls_waitq_pop(struct ls_waitq *q);
+
+void ls_waitq_remove(struct ls_waitq *q, struct ls_waiter *w);
+
+//! \brief Signal all waiters of a queue.
+//!
+//! \param q The queue.
+void ls_waitq_wake_all(struct ls_waitq *q);
+
+#endif // _LS_WAITER_H_
@@ -26,6 +26,8 @@
 #define NAME_MAX 255
 #endif // NAME_MAX
 
+#include <sys/eventfd.h>
+
 #define NOTIF_BUFSIZE (sizeof(struct inotify_event) + NAME_MAX + 1)
 #define NOTIF_MINSIZE (sizeof(struct inotify_event))
 
@@ -90,6 +92,8 @@ struct ls_watch
 	ls_lock_t lock;
 	ls_cond_t cond;
 
+	int ready; // eventfd readable while the queue is not empty
+
 	char avail[NOTIF_BUFSIZE];
 	size_t avail_size;
 
@@ -564,6 +568,7 @@ static void *ls_watch_thread(void *arg)
 			{
 				w->front = e;
 				w->back = e;
+				(void)eventfd_write(w->ready, 1);
 			}
 			else
 			{
@@ -626,6 +631,8 @@ static void ls_watch_dtor(struct ls_watch *w)
 	close(w->notify);
 
 	pthread_join(w->thread, NULL);
+
+	close(w->ready);
 	
 	cond_destroy(&w->cond);
 	lock_destroy(&w->lock);
@@ -696,11 +703,21 @@ static int ls_watch_wait(struct ls_watch *w, unsigned long ms)
 #endif // LS_WINDOWS
 }
 
+static intptr_t ls_watch_pollfd(struct ls_watch *w)
+{
+#if LS_WINDOWS || LS_DARWIN
+	return -1;
+#else
+	return w->ready;
+#endif // LS_WINDOWS || LS_DARWIN
+}
+
 static const struct ls_class WatchClass = {
 	.type = LS_WATCH,
 	.cb = sizeof(struct ls_watch),
 	.dtor = (ls_dtor_t)&ls_watch_dtor,
-	.wait = (ls_wait_t)&ls_watch_wait
+	.wait = (ls_wait_t)&ls_watch_wait,
+	.pollfd = (ls_pollfd_t)&ls_watch_pollfd
 };
 
 ls_handle ls_watch_dir(const char *dir, int flags)
@@ -922,10 +939,24 @@ ls_handle ls_watch_dir(const char *dir, int flags)
 		return NULL;
 	}
 
+	w->ready = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (w->ready == -1)
+	{
+		rc = errno;
+		inotify_rm_watch(w->notify, w->watch);
+		close(w->notify);
+		cond_destroy(&w->cond);
+		lock_destroy(&w->lock);
+		ls_handle_dealloc(w);
+		ls_set_errno_errno(rc);
+		return NULL;
+	}
+
 	rc = pthread_create(&w->thread, NULL, &ls_watch_thread, w);
 	if (rc == -1)
 	{
 		rc = errno;
+		close(w->ready);
 		inotify_rm_watch(w->notify, w->watch);
 		close(w->notify);
 		cond_destroy(&w->cond);
@@ -945,6 +976,9 @@ size_t ls_watch_get_result(ls_handle watch, struct ls_watch_event *event, size_t
 	struct ls_watch *w;
 	struct ls_watch_event_imp *e;
 	size_t len;
+#if !LS_WINDOWS && !LS_DARWIN
+	eventfd_t value;
+#endif // !LS_WINDOWS && !LS_DARWIN
 
 	w = watch;
 
@@ -990,7 +1024,12 @@ size_t ls_watch_get_result(ls_handle watch, struct ls_watch_event *event, size_t
 
 	w->front = w->front->next;
 	if (!w->front)
+	{
 		w->back = NULL;
+#if !LS_WINDOWS && !LS_DARWIN
+		(void)eventfd_read(w->ready, &value);
+#endif // !LS_WINDOWS && !LS_DARWIN
+	}
 
 	lock_unlock(&w->lock);
 